@@ -0,0 +1,19 @@
+#version 450
+
+// Image traced by the compute traversal, the same size as the swapchain
+layout(set = 0, binding = 0) uniform sampler2D tracedImage;
+
+layout(push_constant) uniform PushConstants {
+    vec2 renderSize; // Part of the traced image that holds the frame, in pixels from the top left corner
+};
+
+layout(location = 0) out vec4 outColor;
+
+// Scales the traced part of the image up to the swapchain with bilinear filtering. At full resolution every pixel lands on the
+// center of its texel, so it is a copy. The swapchain is sRGB, so the linear colors are encoded when they are stored like in the fragment traversal
+void main() {
+    vec2 imageSize = vec2(textureSize(tracedImage, 0));
+    // Texels past the traced part are stale, the filter is kept from reaching them
+    vec2 texel = clamp(gl_FragCoord.xy * renderSize / imageSize, vec2(0.5), renderSize - 0.5);
+    outColor = texture(tracedImage, texel / imageSize);
+}
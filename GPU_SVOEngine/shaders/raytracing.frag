@@ -17,8 +17,27 @@ layout ( push_constant ) uniform PushConstants {
     float saturation;
     float contrast;
     float gamma;
+
+    uint leafFlags; // Octree::LeafFlags of the octree being rendered
+    uint beamPrepass; // Primary rays start at the distance of their block in the beam image
+
+    // Temporal mode of the compute traversal. Pass 0 traces every pixel without history, 1 traces the checkerboard of the frame
+    // (every pixel when frameIndex is 0) and 2 reprojects the other half from the previous frame
+    uint temporalPass;
+    uint frameIndex; // Frames since the history was reset, its parity is the layer of the history the frame writes
+    mat4 prevPVMatrix;
+    vec3 prevCamPos;
+    uvec2 renderSize; // Pixels the compute passes trace, the top left corner of the traced image when the resolution is scaled down
+
+    uint wavefrontPass; // Pass of the WAVEFRONT pipeline to run, one of the WAVEFRONT_ constants
+    uint sortShift; // First bit of the digit the sort passes of the WAVEFRONT pipeline work on
 };
 
+// Same values as Octree::LeafFlags
+const uint LEAF_BAKED_COLOR = 1u << 0;
+const uint LEAF_BAKED_SPECULAR = 1u << 1;
+const uint LEAF_OPAQUE = 1u << 2;
+
 struct Material {
     vec3 ambient;
     vec3 diffuse;
@@ -29,6 +48,7 @@ struct Material {
     uint specularMap;
 };
 
+// Pool of octree pages, each one takes OCTREE_PAGE_SIZE nodes (defined in the C++ code). The first slot always holds the root page
 layout(set = 0, binding = 0) buffer OctreeData {
   uint octree[];
 };
@@ -37,16 +57,113 @@ layout(set = 0, binding = 1) buffer MaterialData {
   Material materials[];
 };
 
-layout(set = 0, binding = 2) uniform sampler2D tex[SAMPLER_ARRAY_SIZE]; // SAMPLER_ARRAY_SIZE defined in the C++ code at runtime
+// Slot of every page in the pool, PAGE_NOT_RESIDENT while the page is not on the GPU
+layout(set = 0, binding = 3) buffer PageTable {
+  uint pageTable[];
+};
+
+const uint PAGE_NOT_RESIDENT = 0xFFFFFFFFu;
+
+// Octrees with baked colors don't load their textures, a white texel is bound instead and no material points to it
+layout(set = 0, binding = 2) uniform sampler2DArray tex[TEXTURE_ARRAY_COUNT]; // TEXTURE_ARRAY_COUNT defined in the C++ code, it doesn't depend on the octree
+
+// Material maps are packed as (array << 16 | layer), NO_TEXTURE when the material doesn't have one
+// Every texture fills its whole layer, so the UVs are used as they are
+const uint NO_TEXTURE = 0xFFFFFFFFu;
+
+vec4 sampleMap(uint map, vec2 uv, float lod)
+{
+    return textureLod(tex[map >> 16], vec3(uv, float(map & 0xFFFFu)), lod);
+}
+
+// Side of the blocks of the beam pre-pass, in pixels
+const int BEAM_BLOCK_SIZE = 8;
+
+// Start distance of the rays of each block, written by the beam pre-pass
+#ifdef BEAM_PREPASS
+layout(set = 0, binding = 5, r32f) uniform writeonly image2D beamImage;
+#else
+layout(set = 0, binding = 5, r32f) uniform readonly image2D beamImage;
+#endif
+
+#if defined(COMPUTE_TILES) || defined(BEAM_PREPASS)
+// Compiled as a compute shader. Each workgroup traces a tile of 8x8 pixels, or of 8x8 blocks for the beam pre-pass
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// Same size as the swapchain, the compute traversal writes the renderSize corner and the engine scales it up to the swapchain
+layout(set = 0, binding = 4, rgba16f) uniform writeonly image2D tracedImage;
+#endif
+
+#ifdef COMPUTE_TILES
+// What the temporal mode keeps of every pixel, one layer for the frame being traced and one for the previous frame
+// The color has the distance to the hit in alpha, negative for the sky
+layout(set = 0, binding = 6, rgba16f) uniform image2DArray historyColor;
+layout(set = 0, binding = 7, rgba8_snorm) uniform image2DArray historyNormal;
+
+// Written by main like the fragment output, then stored in the traced image
+vec4 outColor;
+
+#ifdef WAVEFRONT
+// Passes of the wavefront pipeline, the engine dispatches them in this order with a barrier between each
+const uint WAVEFRONT_TRAVERSAL = 1u;
+const uint WAVEFRONT_SORT_COUNT = 2u;
+const uint WAVEFRONT_SORT_SCAN = 3u;
+const uint WAVEFRONT_SORT_SCATTER = 4u;
+const uint WAVEFRONT_SHADOW = 5u;
+const uint WAVEFRONT_SHADING = 6u;
+
+const uint NO_HIT = 0xFFFFFFFFu;
+
+struct WavefrontHit
+{
+    vec3 voxelPos;
+    float voxelSize;
+    uint voxelIndex; // NO_HIT for the sky
+    uint shadowed;
+};
+
+// Primary hit of every pixel of the renderSize corner, row by row
+layout(set = 0, binding = 8) buffer HitBuffer {
+    WavefrontHit hits[];
+};
+
+// Shadow rays as the Morton code of their origin and their pixel. Each sort pass moves them from one half of the array to the other,
+// after the four passes they are back in the first half
+layout(set = 0, binding = 9) buffer ShadowQueue {
+    uint queueCount;
+    uvec2 queue[];
+};
+
+// Digit counts of every block of the sort, digit major so the scan leaves where each block writes the rays of every digit
+layout(set = 0, binding = 10) buffer SortCounts {
+    uint blockCounts[];
+};
 
+// Whether the shadow pass found the sun blocked, calculateLighting reads it instead of tracing the ray
+bool wavefrontShadowed;
+#endif
+#elif !defined(BEAM_PREPASS)
 layout(location = 0) in vec2 fragScreenCoord;
 
 layout(location = 0) out vec4 outColor;
+#endif
+
+// Angle covered by the pixel, set at the start of main while the control flow is still uniform
+// The textures are sampled after a loop that diverges, where implicit derivatives are undefined, so the mip is picked from this instead
+float pixelAngle;
+
+vec3 homogenize(vec4 p)
+{
+    return p.xyz / p.w;
+}
 
 //*********************
 //  OCTREE TRAVERSAL
 //*********************
 
+// Everything down to LIGHTING is also compiled as C++ by tests/cpu_tracer_tests.cpp and checked against CpuTracer,
+// it only uses what tests/glsl_shim.hpp declares
+
 struct BranchNode 
 {
     uint address;
@@ -60,6 +177,8 @@ struct LeafNode
     uint material;
     vec3 normal;
     vec2 uv;
+    vec3 color;
+    float specular;
 };
 
 struct Collision 
@@ -67,8 +186,9 @@ struct Collision
     bool hit;
     uint voxelIndex;
     vec3 voxelPos;
+    float voxelSize; // Leaves can be at any depth, flat surfaces and solid interiors stop subdividing early
 
-    #define NULL_COLLISION Collision(false, 0, vec3(0.0))
+    #define NULL_COLLISION Collision(false, 0, vec3(0.0), 0.0)
 };
 
 struct Ray
@@ -76,23 +196,26 @@ struct Ray
     vec3 origin;
     vec3 direction;
     vec3 invDirection;
+    float tStart; // The ray skips whatever is closer, 0 starts at the origin
 #ifdef INTERSECTION_TEST
     float testTint;
 #endif
 };
 
+// Level above the current one in the short stack of traceRay and traceShadowRay. The descriptor of the node is kept so a pop doesn't read it again
 struct StackElem
 {
     uint index;
-    vec3 pos;
-    uint childCount;
-    uint intersectionMask;
+    uint node;
+    uint mask; // Intersection mask of the node in traceRay, the branches left to visit in traceShadowRay
 };
 
-vec3 homogenize(vec4 p)
-{
-    return p.xyz / p.w;
-}
+// Levels above the current one the traversals keep, popping past them restarts from the root
+const int SHORT_STACK_SIZE = 4;
+
+// Distance from the center of a leaf where its shadow ray starts, in leaf sizes along the normal
+// Half the leaf diagonal (sqrt(3) / 2) plus a margin, so rays along diagonal normals leave the leaf too
+const float SHADOW_ORIGIN_OFFSET = 0.87;
 
 BranchNode parseBranch(uint node)
 {
@@ -104,6 +227,11 @@ BranchNode parseBranch(uint node)
 	return n;
 }
 
+vec3 srgbToLinear(vec3 color)
+{
+    return mix(color / 12.92, pow((color + 0.055) / 1.055, vec3(2.4)), greaterThan(color, vec3(0.04045)));
+}
+
 LeafNode parseLeaf(uint node1, uint node2)
 {
 	LeafNode n;
@@ -121,18 +249,34 @@ LeafNode parseLeaf(uint node1, uint node2)
     if (n.normal.x != 0.0 || n.normal.y != 0.0 || n.normal.z != 0.0)
         n.normal = normalize(n.normal);
 
+    n.color = vec3(1.0);
+    n.specular = 1.0;
+    // The flags are the same for every pixel, so these branches don't diverge
+    if ((leafFlags & LEAF_BAKED_COLOR) != 0u)
+    {
+        // The UV bits hold the sRGB color baked by the voxelizer
+        uint packedColor = node1 >> 8;
+        if ((leafFlags & LEAF_BAKED_SPECULAR) != 0u)
+        {
+            n.color = vec3((packedColor >> 19) & 0x1F, (packedColor >> 13) & 0x3F, (packedColor >> 8) & 0x1F) / vec3(31.0, 63.0, 31.0);
+            n.specular = float(packedColor & 0xFF) / 255.0;
+        }
+        else
+            n.color = vec3((packedColor >> 16) & 0xFF, (packedColor >> 8) & 0xFF, packedColor & 0xFF) / 255.0;
+        n.color = srgbToLinear(n.color);
+    }
+
 	return n;
 }
 
-uint getNextChild(inout StackElem stackElem, uint octant)
+uint getNextChild(BranchNode node, uint intersectionMask, inout uint childCount, uint octant)
 {
-    BranchNode node = parseBranch(octree[stackElem.index]);
     if (node.childMask == 0) return 8;
-    while (stackElem.childCount < 8)
+    while (childCount < 8)
     {
-        uint next = stackElem.childCount ^ octant;
-        if ((node.childMask & (1 << next)) != 0 && (stackElem.intersectionMask & (1 << next)) != 0) return next;
-        stackElem.childCount++;
+        uint next = childCount ^ octant;
+        if ((node.childMask & (1 << next)) != 0 && (intersectionMask & (1 << next)) != 0) return next;
+        childCount++;
     }
     return 8;
 }
@@ -146,9 +290,13 @@ uint createIntersectionMask(Ray ray, vec3 boxMin, vec3 boxMax)
 
     vec3 slabRadius = nodeRadius * abs(ray.invDirection);
     vec3 tMin = tMid - slabRadius;
-    float rayTMin = max(max(max(tMin.x, tMin.y), tMin.z), 0.0);
+    float rayTMin = max(max(max(tMin.x, tMin.y), tMin.z), ray.tStart);
     vec3 tMax = tMid + slabRadius;
     float rayTMax = min(min(tMax.x, tMax.y), tMax.z);
+    // Boxes the ray leaves before a start past the origin have no children to visit
+    // Rays that start at the origin keep the first child of boxes they only graze, as they always did
+    if (ray.tStart > 0.0 && rayTMax < ray.tStart)
+        return 0;
 
     uint intersectionMask = 0;
     uint firstChildHit;
@@ -175,56 +323,347 @@ uint createIntersectionMask(Ray ray, vec3 boxMin, vec3 boxMax)
     return intersectionMask;
 }
 
+// Same slabs as createIntersectionMask
+bool missesBox(Ray ray, vec3 boxMin, vec3 boxMax)
+{
+    float nodeRadius = (boxMax.x - boxMin.x) / 2.0;
+    vec3 tMid = (boxMin + nodeRadius - ray.origin) * ray.invDirection;
+    vec3 slabRadius = nodeRadius * abs(ray.invDirection);
+    vec3 tMin = tMid - slabRadius;
+    vec3 tMax = tMid + slabRadius;
+    return max(max(max(tMin.x, tMin.y), tMin.z), ray.tStart) > min(min(tMax.x, tMax.y), tMax.z);
+}
+
+// Index of a child of the branch at parentIndex, with far links resolved through the page table
+// Children in a page that is not resident give PAGE_NOT_RESIDENT, the leaf at linkAddress + 2 stands in for them
+uint getChildIndex(BranchNode parent, uint parentIndex, uint current, out uint linkAddress)
+{
+    uint bitMask = (1 << current) - 1;
+    uint childOffset = bitCount(parent.childMask & bitMask) + bitCount(parent.leafMask & bitMask & parent.childMask);
+    linkAddress = parentIndex + parent.address;
+    uint resolvedAddress = linkAddress;
+    // The far flag marks children in another page, the link holds [page, offset, leaf]
+    if (parent.farFlag != 0)
+    {
+        uint slot = pageTable[octree[linkAddress]];
+        if (slot == PAGE_NOT_RESIDENT)
+            return PAGE_NOT_RESIDENT;
+        resolvedAddress = slot * OCTREE_PAGE_SIZE + octree[linkAddress + 1];
+    }
+    return resolvedAddress + childOffset;
+}
+
+bool isOpaqueLeaf(uint index)
+{
+    // Transparent leaves were already removed when the octree was voxelized
+    if ((leafFlags & (LEAF_BAKED_COLOR | LEAF_OPAQUE)) != 0u)
+        return true;
+    // Leaves without a diffuse map have nothing to cut them out
+    LeafNode voxel = parseLeaf(octree[index], octree[index + 1]);
+    return materials[voxel.material].diffuseMap == NO_TEXTURE || sampleMap(materials[voxel.material].diffuseMap, voxel.uv, 0.0).a >= 0.1;
+}
+
+// Child a cell position is in below the level whose children are 1 << shift cells wide
+uint getChildOfCell(uvec3 cell, uint shift)
+{
+    uvec3 bits = (cell >> shift) & 1u;
+    return bits.x << 2 | bits.y << 1 | bits.z;
+}
+
+#ifdef COMPUTE_TILES
+// Stack of every invocation of the workgroup in shared memory instead of registers: the node index and
+// childCount | intersectionMask << 8 of each level. Positions are not kept, 8KB for the whole tile leaves room for more workgroups
+shared uint stackIndex[64][MAX_OCTREE_DEPTH];
+shared uint stackState[64][MAX_OCTREE_DEPTH];
+
+// Position of a stack level, rebuilt from the children taken by the levels above it with the same operations as the push
+vec3 getStackPos(uint lane, int level, uint octant)
+{
+    vec3 pos = vec3(-octreeScale / 2.0);
+    for (int i = 0; i < level; i++)
+    {
+        uint child = (stackState[lane][i] & 0xFFu) ^ octant;
+        float size = pow(2.0, -(i + 1)) * octreeScale;
+        pos = pos + size * vec3((child & 4) >> 2, (child & 2) >> 1, child & 1);
+    }
+    return pos;
+}
+
+// Same traversal as the fragment version, visiting the same children in the same order
 Collision traceRay(inout Ray ray, uint octant)
 {
+    uint lane = gl_LocalInvocationIndex;
     float halfScale = octreeScale / 2.0;
-    StackElem[OCTREE_DEPTH] stack;
-    stack[0] = StackElem(0, vec3(-halfScale), 0, createIntersectionMask(ray, vec3(-halfScale), vec3(halfScale)));
+    // Rays that don't go through the octree hit nothing, the intersection mask would still give them a first child
+    if (missesBox(ray, vec3(-halfScale), vec3(halfScale)))
+        return NULL_COLLISION;
+    vec3 stackPos = vec3(-halfScale);
+    stackIndex[lane][0] = 0;
+    stackState[lane][0] = createIntersectionMask(ray, vec3(-halfScale), vec3(halfScale)) << 8;
     int stackPtr = 0;
 
     while (true)
     {
-        uint current = getNextChild(stack[stackPtr], octant);
+        BranchNode parent = parseBranch(octree[stackIndex[lane][stackPtr]]);
+        uint intersectionMask = stackState[lane][stackPtr] >> 8;
+        uint childCount = stackState[lane][stackPtr] & 0xFFu;
+        uint current = 8;
+        while (parent.childMask != 0 && childCount < 8)
+        {
+            uint next = childCount ^ octant;
+            if ((parent.childMask & intersectionMask & (1 << next)) != 0)
+            {
+                current = next;
+                break;
+            }
+            childCount++;
+        }
+        stackState[lane][stackPtr] = intersectionMask << 8 | childCount;
         if (current > 7)
         {
             // POP
             stackPtr--;
             if (stackPtr < 0) break;
-            stack[stackPtr].childCount++;
+            stackState[lane][stackPtr]++;
+            stackPos = getStackPos(lane, stackPtr, octant);
             continue;
         }
 #ifdef INTERSECTION_TEST
         ray.testTint += 0.0025;
 #endif
-        BranchNode parent = parseBranch(octree[stack[stackPtr].index]);
-        uint nextChild;
-        {
-            uint bitMask = (1 << current) - 1;
-            uint childOffset = bitCount(parent.childMask & bitMask) + bitCount(parent.leafMask & bitMask & parent.childMask);
-            uint nextAbsAddress = stack[stackPtr].index + parent.address;
-            uint resolvedAddress = parent.farFlag == 0 ? nextAbsAddress : nextAbsAddress + octree[nextAbsAddress];
-            nextChild = resolvedAddress + childOffset;
-        }
         float size = pow(2.0, -(stackPtr + 1)) * octreeScale;
-        vec3 pos = stack[stackPtr].pos + size * vec3((current & 4) >> 2, (current & 2) >> 1, current & 1);
+        vec3 pos = stackPos + size * vec3((current & 4) >> 2, (current & 2) >> 1, current & 1);
+        uint linkAddress;
+        uint nextChild = getChildIndex(parent, stackIndex[lane][stackPtr], current, linkAddress);
+        if (nextChild == PAGE_NOT_RESIDENT)
+            return Collision(true, linkAddress + 2, pos + vec3(size) / 2.0, size);
         if ((parent.leafMask & (1 << current)) != 0)
         {
-            LeafNode voxel = parseLeaf(octree[nextChild], octree[nextChild + 1]);
-            if (materials[voxel.material].diffuseMap < SAMPLER_ARRAY_SIZE && texture(tex[materials[voxel.material].diffuseMap], voxel.uv).a >= 0.1)
-                return Collision(true, nextChild, pos + vec3(size) / 2.0);
-            stack[stackPtr].childCount++;
-            continue;
+            if (isOpaqueLeaf(nextChild))
+                return Collision(true, nextChild, pos + vec3(size) / 2.0, size);
+            stackState[lane][stackPtr]++;
         }
         else
         {
             // PUSH
             stackPtr++;
-            stack[stackPtr] = StackElem(nextChild, pos, 0, createIntersectionMask(ray, pos, pos + vec3(size)));
+            stackIndex[lane][stackPtr] = nextChild;
+            stackState[lane][stackPtr] = createIntersectionMask(ray, pos, pos + vec3(size)) << 8;
+            stackPos = pos;
+        }
+    }
+    return NULL_COLLISION;
+}
+#else
+// Only the current level is in registers, with the descriptor of its node, and the SHORT_STACK_SIZE levels above it in the stack
+// Positions are integers in cells of the deepest level: children add the bit of their level and the parent clears it, and that bit
+// is the child the level was at, so the stack keeps no position nor child count. A pop past the stored levels restarts from the root
+// and follows those bits back down. The mask is created again from the same box, so the children visited are the same as with a
+// stack of MAX_OCTREE_DEPTH elements
+Collision traceRay(inout Ray ray, uint octant)
+{
+    float halfScale = octreeScale / 2.0;
+    // Rays that don't go through the octree hit nothing, the intersection mask would still give them a first child
+    if (missesBox(ray, vec3(-halfScale), vec3(halfScale)))
+        return NULL_COLLISION;
+    float cellSize = octreeScale / float(1u << MAX_OCTREE_DEPTH);
+    StackElem stack[SHORT_STACK_SIZE];
+    // Lowest level in the stack, the levels from it to the one above the current one are stored
+    int stackBottom = 0;
+    int level = 0;
+    uvec3 cell = uvec3(0);
+    uint index = 0;
+    uint node = octree[0];
+    uint intersectionMask = createIntersectionMask(ray, vec3(-halfScale), vec3(halfScale));
+    uint childCount = 0;
+
+    while (true)
+    {
+        BranchNode parent = parseBranch(node);
+        uint current = getNextChild(parent, intersectionMask, childCount, octant);
+        if (current > 7)
+        {
+            // POP
+            if (level == 0) break;
+            uint child = getChildOfCell(cell, MAX_OCTREE_DEPTH - level);
+            level--;
+            cell &= ~((1u << (MAX_OCTREE_DEPTH - level)) - 1u);
+            if (level >= stackBottom)
+            {
+                StackElem elem = stack[level % SHORT_STACK_SIZE];
+                index = elem.index;
+                node = elem.node;
+                intersectionMask = elem.mask;
+            }
+            else
+            {
+                // RESTART, the pages of the path were resident on the way down and stay so until the frame ends
+                index = 0;
+                node = octree[0];
+                for (int i = 0; i < level; i++)
+                {
+                    uint linkAddress;
+                    index = getChildIndex(parseBranch(node), index, getChildOfCell(cell, MAX_OCTREE_DEPTH - i - 1), linkAddress);
+                    node = octree[index];
+                }
+                vec3 pos = vec3(cell) * cellSize - halfScale;
+                intersectionMask = createIntersectionMask(ray, pos, pos + vec3(pow(2.0, -level) * octreeScale));
+                stackBottom = level;
+            }
+            childCount = (child ^ octant) + 1;
             continue;
         }
+#ifdef INTERSECTION_TEST
+        ray.testTint += 0.0025;
+#endif
+        float size = pow(2.0, -(level + 1)) * octreeScale;
+        uvec3 childCell = cell + (uvec3((current & 4) >> 2, (current & 2) >> 1, current & 1) << (MAX_OCTREE_DEPTH - level - 1));
+        vec3 pos = vec3(childCell) * cellSize - halfScale;
+        uint linkAddress;
+        uint nextChild = getChildIndex(parent, index, current, linkAddress);
+        // If the page is not resident the traversal stops at this level and the leaf stands in for the child
+        if (nextChild == PAGE_NOT_RESIDENT)
+            return Collision(true, linkAddress + 2, pos + vec3(size) / 2.0, size);
+        if ((parent.leafMask & (1 << current)) != 0)
+        {
+            if (isOpaqueLeaf(nextChild))
+                return Collision(true, nextChild, pos + vec3(size) / 2.0, size);
+            childCount++;
+        }
+        else
+        {
+            // PUSH
+            stack[level % SHORT_STACK_SIZE] = StackElem(index, node, intersectionMask);
+            stackBottom = max(stackBottom, level - SHORT_STACK_SIZE + 1);
+            level++;
+            cell = childCell;
+            index = nextChild;
+            node = octree[nextChild];
+            intersectionMask = createIntersectionMask(ray, pos, pos + vec3(size));
+            childCount = 0;
+        }
     }
     return NULL_COLLISION;
 }
+#endif
+
+// Child mask with the bit of child i moved to i ^ octant, the order traceRay visits the children in
+uint toVisitOrder(uint mask, uint octant)
+{
+    if ((octant & 4u) != 0u) mask = (mask & 0x0Fu) << 4 | (mask & 0xF0u) >> 4;
+    if ((octant & 2u) != 0u) mask = (mask & 0x33u) << 2 | (mask & 0xCCu) >> 2;
+    if ((octant & 1u) != 0u) mask = (mask & 0x55u) << 1 | (mask & 0xAAu) >> 1;
+    return mask;
+}
+
+// Branch children of a node the ray goes through, in visit order
+uint getRemainingBranches(BranchNode node, uint intersectionMask, uint octant)
+{
+    return toVisitOrder(node.childMask & ~node.leafMask & intersectionMask, octant);
+}
+
+// Whether one of the leaf children of a node the ray goes through stops it, a child in a page that is not resident does
+bool hitsLeafChild(BranchNode node, uint index, uint intersectionMask)
+{
+    uint leaves = node.childMask & node.leafMask & intersectionMask;
+    if (leaves == 0u)
+        return false;
+    // Every leaf is opaque when the alpha test was done while voxelizing, neither the leaf nor its texture has to be read
+    if ((leafFlags & (LEAF_BAKED_COLOR | LEAF_OPAQUE)) != 0u)
+        return true;
+    while (leaves != 0u)
+    {
+        uint current = uint(findLSB(leaves));
+        leaves &= leaves - 1u;
+        uint linkAddress;
+        uint child = getChildIndex(node, index, current, linkAddress);
+        if (child == PAGE_NOT_RESIDENT || isOpaqueLeaf(child))
+            return true;
+    }
+    return false;
+}
+
+// Any hit traversal for shadow rays, which only need to know if something is in the way. It goes through the same children as
+// traceRay, so it gives the same answer, but the leaves of a node are tested as soon as it is entered, before any of its branches,
+// and the first opaque one ends the ray. Nothing is ordered by distance and no collision is built
+// The stack keeps the branches each level has left instead of its intersection mask, the next one is the lowest bit of the visit order
+// It uses the same short stack as the fragment traceRay, also from the compute tiles, whose shared stack only holds the primary rays
+bool traceShadowRay(Ray ray, uint octant)
+{
+    float halfScale = octreeScale / 2.0;
+    if (missesBox(ray, vec3(-halfScale), vec3(halfScale)))
+        return false;
+    float cellSize = octreeScale / float(1u << MAX_OCTREE_DEPTH);
+    StackElem stack[SHORT_STACK_SIZE];
+    int stackBottom = 0;
+    int level = 0;
+    uvec3 cell = uvec3(0);
+    uint index = 0;
+    uint node = octree[0];
+    uint intersectionMask = createIntersectionMask(ray, vec3(-halfScale), vec3(halfScale));
+    if (hitsLeafChild(parseBranch(node), index, intersectionMask))
+        return true;
+    uint remaining = getRemainingBranches(parseBranch(node), intersectionMask, octant);
+
+    while (true)
+    {
+        if (remaining == 0u)
+        {
+            // POP
+            if (level == 0) break;
+            uint child = getChildOfCell(cell, MAX_OCTREE_DEPTH - level);
+            level--;
+            cell &= ~((1u << (MAX_OCTREE_DEPTH - level)) - 1u);
+            if (level >= stackBottom)
+            {
+                StackElem elem = stack[level % SHORT_STACK_SIZE];
+                index = elem.index;
+                node = elem.node;
+                remaining = elem.mask;
+            }
+            else
+            {
+                // RESTART, the branches up to the one the ray comes from were already visited
+                index = 0;
+                node = octree[0];
+                for (int i = 0; i < level; i++)
+                {
+                    uint linkAddress;
+                    index = getChildIndex(parseBranch(node), index, getChildOfCell(cell, MAX_OCTREE_DEPTH - i - 1), linkAddress);
+                    node = octree[index];
+                }
+                vec3 pos = vec3(cell) * cellSize - halfScale;
+                intersectionMask = createIntersectionMask(ray, pos, pos + vec3(pow(2.0, -level) * octreeScale));
+                remaining = getRemainingBranches(parseBranch(node), intersectionMask, octant) & ~((2u << (child ^ octant)) - 1u);
+                stackBottom = level;
+            }
+            continue;
+        }
+
+        uint current = uint(findLSB(remaining)) ^ octant;
+        remaining &= remaining - 1u;
+        float size = pow(2.0, -(level + 1)) * octreeScale;
+        uvec3 childCell = cell + (uvec3((current & 4) >> 2, (current & 2) >> 1, current & 1) << (MAX_OCTREE_DEPTH - level - 1));
+        vec3 pos = vec3(childCell) * cellSize - halfScale;
+        uint linkAddress;
+        uint nextChild = getChildIndex(parseBranch(node), index, current, linkAddress);
+        if (nextChild == PAGE_NOT_RESIDENT)
+            return true;
+
+        // PUSH
+        stack[level % SHORT_STACK_SIZE] = StackElem(index, node, remaining);
+        stackBottom = max(stackBottom, level - SHORT_STACK_SIZE + 1);
+        level++;
+        cell = childCell;
+        index = nextChild;
+        node = octree[nextChild];
+        intersectionMask = createIntersectionMask(ray, pos, pos + vec3(size));
+        if (hitsLeafChild(parseBranch(node), index, intersectionMask))
+            return true;
+        remaining = getRemainingBranches(parseBranch(node), intersectionMask, octant);
+    }
+    return false;
+}
 
 uint getOctant(vec3 direction)
 {
@@ -259,21 +698,31 @@ vec3 calculateLighting(Collision coll)
 {
     LeafNode voxel = parseLeaf(octree[coll.voxelIndex], octree[coll.voxelIndex + 1]);
     Material mat = materials[voxel.material];
+    // The base level is taken as one texel per leaf, each mip after it covers twice the leaves the pixel spans
+    float lod = log2(max(distance(camPos, coll.voxelPos) * pixelAngle / coll.voxelSize, 1.0));
 
-    vec3 diffAmbTexel = vec3(1.0);
-    if (mat.diffuseMap < SAMPLER_ARRAY_SIZE) 
-        diffAmbTexel = texture(tex[mat.diffuseMap], voxel.uv).rgb;
+    // The color is white unless it was baked, materials of baked octrees never have maps
+    vec3 diffAmbTexel = voxel.color;
+    if (mat.diffuseMap != NO_TEXTURE) 
+        diffAmbTexel = sampleMap(mat.diffuseMap, voxel.uv, lod).rgb;
     vec3 ambientColor = mat.ambient * diffAmbTexel;
     
     float amb = 0.1;
     vec3 ambient = sunColor * amb * ambientColor;
 
-#ifndef NO_SHADOW
+#ifdef WAVEFRONT
+    if (wavefrontShadowed)
+    {
+        return ambient;
+    }
+#elif !defined(NO_SHADOW)
     Ray shadowRay;
     shadowRay.direction = normalize(sunDirection);
-    shadowRay.origin = coll.voxelPos + VOXEL_SIZE * octreeScale * voxel.normal;
+    // The offset scales with the leaf that was hit, coarse leaves need a bigger one to get out of themselves
+    shadowRay.origin = coll.voxelPos + SHADOW_ORIGIN_OFFSET * coll.voxelSize * voxel.normal;
     shadowRay.invDirection = 1.0 / shadowRay.direction;
-    if (traceRay(shadowRay, getOctant(shadowRay.direction)).hit)
+    shadowRay.tStart = 0.0;
+    if (traceShadowRay(shadowRay, getOctant(shadowRay.direction)))
     {
         return ambient;
     }
@@ -282,9 +731,9 @@ vec3 calculateLighting(Collision coll)
     vec3 norm_sunDirection = normalize(sunDirection);
     vec3 norm_camDir = normalize(camPos - coll.voxelPos);
     vec3 halfV = normalize(norm_sunDirection + norm_camDir);
-    float specularTexel = 1.0;
-    if (mat.specularMap < SAMPLER_ARRAY_SIZE) 
-        specularTexel = texture(tex[mat.specularMap], voxel.uv).r;
+    float specularTexel = voxel.specular;
+    if (mat.specularMap != NO_TEXTURE) 
+        specularTexel = sampleMap(mat.specularMap, voxel.uv, lod).r;
 
     vec3 diffuseColor = mat.diffuse * diffAmbTexel;
     vec3 specularColor = mat.specular * specularTexel;
@@ -303,11 +752,414 @@ vec3 calculateLighting(Collision coll)
 //        MAIN
 //*********************
 
+#if defined(COMPUTE_TILES) || defined(BEAM_PREPASS)
+// Direction through a point of the image of a camera, with the screen coordinates the vertex shader would pass on
+vec3 getCameraDirection(mat4 invPV, vec3 origin, vec2 pixel, vec2 size)
+{
+    vec2 screenCoord = vec2(pixel.x / size.x * 2.0 - 1.0, 1.0 - pixel.y / size.y * 2.0);
+    return normalize(homogenize(invPV * vec4(screenCoord, 1.0, 1.0)) - origin);
+}
+
+vec3 getPixelDirection(vec2 pixel, vec2 size)
+{
+    return getCameraDirection(invPVMatrix, camPos, pixel, size);
+}
+
+// There are no derivatives in compute shaders, the difference that fwidth takes is done with the next pixels
+float getPixelAngle(vec2 pixelCenter, vec2 size, vec3 direction)
+{
+    return length(abs(getPixelDirection(pixelCenter + vec2(1.0, 0.0), size) - direction) + abs(getPixelDirection(pixelCenter + vec2(0.0, 1.0), size) - direction));
+}
+#endif
+
+#ifdef COMPUTE_TILES
+//*********************
+// TEMPORAL REPROJECTION
+//*********************
+
+// Same functions as Tracer/reprojection.cpp, where the CPU tracer tests them. Half of the pixels are traced in a checkerboard that
+// flips every frame, the other half projects the surface its traced neighbours see into the previous frame and keeps the sample
+// found there if it is that surface. The history stores the distance along the ray of each pixel instead of the point it hit
+
+// Distance along the ray the history can be from the surface of the neighbour, relative to that distance
+const float REPROJECTION_DEPTH_TOLERANCE = 0.02;
+// Smallest cosine between the normal of the history and the normal of the neighbour
+const float REPROJECTION_NORMAL_TOLERANCE = 0.9;
+// Distance the history can be from the ray, in pixels at the distance of the history
+const float REPROJECTION_PIXEL_TOLERANCE = 1.0;
+
+struct HistorySample
+{
+    vec3 position;
+    vec3 normal;
+    vec3 color;
+    bool hit;
+};
+
+bool isTracedPixel(ivec2 pixel)
+{
+    return ((uint(pixel.x + pixel.y) + frameIndex) & 1u) == 0u;
+}
+
+// Points with w = 0 are directions, as far as the sky
+bool projectToPixel(mat4 pvMatrix, vec4 point, ivec2 size, out ivec2 pixel)
+{
+    vec4 clip = pvMatrix * point;
+    pixel = ivec2(-1);
+    if (clip.w <= 0.0) return false;
+    vec2 screen = vec2(clip.x / clip.w + 1.0, 1.0 - clip.y / clip.w) / 2.0 * vec2(size);
+    if (any(lessThan(screen, vec2(0.0))) || any(greaterThanEqual(screen, vec2(size)))) return false;
+    pixel = ivec2(screen);
+    return true;
+}
+
+// Distance along the ray to the entry point of the leaf it hit
+float getHitDistance(Ray ray, Collision coll)
+{
+    vec3 tMid = (coll.voxelPos - ray.origin) * ray.invDirection;
+    vec3 tMin = tMid - coll.voxelSize / 2.0 * abs(ray.invDirection);
+    return max(max(max(tMin.x, tMin.y), tMin.z), 0.0);
+}
+
+float getPlaneDistance(vec3 origin, vec3 direction, HistorySample neighbour)
+{
+    float facing = dot(direction, neighbour.normal);
+    // Grazing planes would put the point anywhere along the ray, the distance of the neighbour itself is closer to the truth
+    if (abs(facing) < 0.1)
+        return dot(neighbour.position - origin, direction);
+    return dot(neighbour.position - origin, neighbour.normal) / facing;
+}
+
+bool acceptHistory(HistorySample history, vec3 origin, vec3 direction, float distance, vec3 normal, float angle)
+{
+    vec3 toHistory = history.position - origin;
+    float along = dot(toHistory, direction);
+    if (abs(along - distance) > REPROJECTION_DEPTH_TOLERANCE * distance)
+        return false;
+    if (length(toHistory - along * direction) > REPROJECTION_PIXEL_TOLERANCE * angle * along)
+        return false;
+    return dot(history.normal, normal) >= REPROJECTION_NORMAL_TOLERANCE;
+}
+
+// The point is rebuilt from the ray the camera of the layer traced through the pixel
+HistorySample loadHistory(ivec2 pixel, int layer, mat4 invPV, vec3 origin, ivec2 size)
+{
+    vec4 color = imageLoad(historyColor, ivec3(pixel, layer));
+    HistorySample history;
+    history.hit = color.a >= 0.0;
+    history.position = origin + color.a * getCameraDirection(invPV, origin, vec2(pixel) + 0.5, vec2(size));
+    history.normal = imageLoad(historyNormal, ivec3(pixel, layer)).xyz;
+    history.color = color.rgb;
+    return history;
+}
+
+void storeHistory(ivec2 pixel, vec3 color, float distance, vec3 normal)
+{
+    int layer = int(frameIndex & 1u);
+    imageStore(historyColor, ivec3(pixel, layer), vec4(color, distance));
+    imageStore(historyNormal, ivec3(pixel, layer), vec4(normal, 0.0));
+}
+
+// Sample of the previous frame for a pixel the frame doesn't trace, tried with each of its four neighbours, which are traced
+bool reprojectPixel(ivec2 pixel, ivec2 size, vec3 direction, float angle, out HistorySample reprojected)
+{
+    const ivec2 NEIGHBOURS[4] = ivec2[](ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1));
+    int current = int(frameIndex & 1u);
+    mat4 prevInvPVMatrix = inverse(prevPVMatrix);
+    for (int i = 0; i < 4; i++)
+    {
+        ivec2 neighbourPixel = pixel + NEIGHBOURS[i];
+        if (any(lessThan(neighbourPixel, ivec2(0))) || any(greaterThanEqual(neighbourPixel, size)))
+            continue;
+        HistorySample neighbour = loadHistory(neighbourPixel, current, invPVMatrix, camPos, size);
+
+        ivec2 previous;
+        if (!neighbour.hit)
+        {
+            // The sky only depends on the direction, it is kept if the previous frame saw the sky that way too
+            if (projectToPixel(prevPVMatrix, vec4(direction, 0.0), size, previous))
+            {
+                reprojected = loadHistory(previous, 1 - current, prevInvPVMatrix, prevCamPos, size);
+                if (!reprojected.hit) return true;
+            }
+            continue;
+        }
+
+        float distance = getPlaneDistance(camPos, direction, neighbour);
+        if (distance <= 0.0 || !projectToPixel(prevPVMatrix, vec4(camPos + distance * direction, 1.0), size, previous))
+            continue;
+        reprojected = loadHistory(previous, 1 - current, prevInvPVMatrix, prevCamPos, size);
+        if (reprojected.hit && acceptHistory(reprojected, camPos, direction, distance, neighbour.normal, angle))
+            return true;
+    }
+    return false;
+}
+#endif
+
+#ifdef WAVEFRONT
+//*********************
+//  WAVEFRONT PASSES
+//*********************
+
+// Same stages as the wavefront mode of the CPU tracer (Tracer/wavefront.hpp), where they can be measured without a GPU
+// The traversal and shading passes take a pixel per invocation like the compute traversal. The passes over the queue number their
+// workgroups row by row, so a queue longer than the dispatch limit of one dimension still fits, and the engine sizes them for a full queue
+
+const uint MORTON_AXIS_BITS = 10u;
+const uint SORT_DIGIT_BITS = 8u;
+const uint SORT_DIGITS = 1u << SORT_DIGIT_BITS;
+// Rays each workgroup of the count and scatter passes goes through, SORT_BLOCK_SIZE of the engine
+const uint SORT_BLOCK_SIZE = 4096u;
+
+shared uint groupRays;
+shared uint groupQueueStart;
+shared uint digitOffsets[SORT_DIGITS];
+shared uint sortDigits[64];
+shared uint scanSums[64];
+
+uint getLinearWorkgroup()
+{
+    return gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+}
+
+// Puts two zero bits after each of the 10 lowest bits
+uint expandBits(uint v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// Interleaved bits of the cell of a point in a grid of 1024^3 over the octree, same code as getMortonCode of wavefront.cpp
+uint getMortonCode(vec3 position)
+{
+    float cells = float(1u << MORTON_AXIS_BITS);
+    uvec3 cell = uvec3(clamp((position / octreeScale + 0.5) * cells, vec3(0.0), vec3(cells - 1.0)));
+    return expandBits(cell.x) << 2 | expandBits(cell.y) << 1 | expandBits(cell.z);
+}
+
+// Same offset calculateLighting gives the shadow rays
+vec3 getShadowOrigin(WavefrontHit hit)
+{
+    vec3 normal = parseLeaf(octree[hit.voxelIndex], octree[hit.voxelIndex + 1]).normal;
+    return hit.voxelPos + SHADOW_ORIGIN_OFFSET * hit.voxelSize * normal;
+}
+
+uint getSortBlockCount()
+{
+    return (queueCount + SORT_BLOCK_SIZE - 1u) / SORT_BLOCK_SIZE;
+}
+
+// Half of the queue the sort pass of the digit reads from
+uint getSortSource()
+{
+    return (sortShift / SORT_DIGIT_BITS) % 2u * (uint(queue.length()) / 2u);
+}
+
+void traverseWavefront()
+{
+    ivec2 size = ivec2(renderSize);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    // Pixels outside still go through the barriers of the append
+    bool inside = pixel.x < size.x && pixel.y < size.y;
+    uint pixelIndex = uint(pixel.y) * renderSize.x + uint(pixel.x);
+    bool hasRay = false;
+    uint key = 0u;
+    if (inside)
+    {
+        Ray ray;
+        ray.origin = camPos;
+        ray.direction = getPixelDirection(vec2(pixel) + 0.5, vec2(size));
+        ray.invDirection = 1.0 / ray.direction;
+        ray.tStart = beamPrepass != 0u ? imageLoad(beamImage, pixel / BEAM_BLOCK_SIZE).r : 0.0;
+        Collision coll = traceRay(ray, getOctant(ray.direction));
+        WavefrontHit hit = WavefrontHit(coll.voxelPos, coll.voxelSize, coll.hit ? coll.voxelIndex : NO_HIT, 0u);
+        hits[pixelIndex] = hit;
+        hasRay = coll.hit;
+        if (hasRay)
+            key = getMortonCode(getShadowOrigin(hit));
+    }
+
+    // The rays of the workgroup take consecutive entries of the queue with a single atomic on it
+    if (gl_LocalInvocationIndex == 0u)
+        groupRays = 0u;
+    barrier();
+    uint groupSlot = hasRay ? atomicAdd(groupRays, 1u) : 0u;
+    barrier();
+    if (gl_LocalInvocationIndex == 0u && groupRays != 0u)
+        groupQueueStart = atomicAdd(queueCount, groupRays);
+    barrier();
+    if (hasRay)
+        queue[groupQueueStart + groupSlot] = uvec2(key, pixelIndex);
+}
+
+void countSortDigits()
+{
+    uint block = getLinearWorkgroup();
+    uint blockCount = getSortBlockCount();
+    // Whole workgroups past the queue leave before any barrier
+    if (block >= blockCount)
+        return;
+    uint lane = gl_LocalInvocationIndex;
+    for (uint digit = lane; digit < SORT_DIGITS; digit += 64u)
+        digitOffsets[digit] = 0u;
+    barrier();
+
+    uint source = getSortSource();
+    uint end = min((block + 1u) * SORT_BLOCK_SIZE, queueCount);
+    for (uint i = block * SORT_BLOCK_SIZE + lane; i < end; i += 64u)
+        atomicAdd(digitOffsets[(queue[source + i].x >> sortShift) & (SORT_DIGITS - 1u)], 1u);
+    barrier();
+
+    for (uint digit = lane; digit < SORT_DIGITS; digit += 64u)
+        blockCounts[digit * blockCount + block] = digitOffsets[digit];
+}
+
+// Exclusive scan of the counts in a single workgroup, each invocation sums a contiguous slice and adds the slices before it
+void scanSortCounts()
+{
+    uint lane = gl_LocalInvocationIndex;
+    uint total = SORT_DIGITS * getSortBlockCount();
+    uint slice = (total + 63u) / 64u;
+    uint begin = min(lane * slice, total);
+    uint end = min(begin + slice, total);
+    uint sum = 0u;
+    for (uint i = begin; i < end; i++)
+        sum += blockCounts[i];
+    scanSums[lane] = sum;
+    barrier();
+
+    uint offset = 0u;
+    for (uint i = 0u; i < lane; i++)
+        offset += scanSums[i];
+    for (uint i = begin; i < end; i++)
+    {
+        uint count = blockCounts[i];
+        blockCounts[i] = offset;
+        offset += count;
+    }
+}
+
+// The rays of the block go in chunks of 64 in queue order, each one after the rays of its digit in the chunks and lanes before it,
+// so the sort is stable like sortShadowRays
+void scatterSortBlock()
+{
+    uint block = getLinearWorkgroup();
+    uint blockCount = getSortBlockCount();
+    if (block >= blockCount)
+        return;
+    uint lane = gl_LocalInvocationIndex;
+    for (uint digit = lane; digit < SORT_DIGITS; digit += 64u)
+        digitOffsets[digit] = blockCounts[digit * blockCount + block];
+
+    uint source = getSortSource();
+    uint destination = uint(queue.length()) / 2u - source;
+    uint begin = block * SORT_BLOCK_SIZE;
+    uint end = min(begin + SORT_BLOCK_SIZE, queueCount);
+    for (uint chunk = begin; chunk < end; chunk += 64u)
+    {
+        uint i = chunk + lane;
+        uvec2 entry = i < end ? queue[source + i] : uvec2(0u);
+        uint digit = i < end ? (entry.x >> sortShift) & (SORT_DIGITS - 1u) : SORT_DIGITS;
+        sortDigits[lane] = digit;
+        barrier();
+
+        uint rank = 0u;
+        bool last = true;
+        for (uint j = 0u; j < 64u; j++)
+        {
+            if (sortDigits[j] == digit && j < lane) rank++;
+            if (sortDigits[j] == digit && j > lane) last = false;
+        }
+        if (i < end)
+            queue[destination + digitOffsets[digit] + rank] = entry;
+        barrier();
+
+        // The last ray of each digit moves the offset past the rays of the chunk
+        if (i < end && last)
+            digitOffsets[digit] += rank + 1u;
+        barrier();
+    }
+}
+
+void traceWavefrontShadow()
+{
+    uint i = getLinearWorkgroup() * 64u + gl_LocalInvocationIndex;
+    if (i >= queueCount)
+        return;
+    uint pixelIndex = queue[i].y;
+    Ray ray;
+    ray.direction = normalize(sunDirection);
+    ray.origin = getShadowOrigin(hits[pixelIndex]);
+    ray.invDirection = 1.0 / ray.direction;
+    ray.tStart = 0.0;
+    hits[pixelIndex].shadowed = traceShadowRay(ray, getOctant(ray.direction)) ? 1u : 0u;
+}
+
+void shadeWavefront()
+{
+    ivec2 size = ivec2(renderSize);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (pixel.x >= size.x || pixel.y >= size.y) return;
+    vec2 pixelCenter = vec2(pixel) + 0.5;
+    pixelAngle = getPixelAngle(pixelCenter, vec2(size), getPixelDirection(pixelCenter, vec2(size)));
+
+    WavefrontHit hit = hits[uint(pixel.y) * renderSize.x + uint(pixel.x)];
+    outColor = vec4(skyColor, 1.0);
+    if (hit.voxelIndex != NO_HIT)
+    {
+        wavefrontShadowed = hit.shadowed != 0u;
+        vec3 shaded = calculateLighting(Collision(true, hit.voxelIndex, hit.voxelPos, hit.voxelSize));
+        outColor = vec4(colorCorrection(shaded), 1.0);
+    }
+    imageStore(tracedImage, pixel, outColor);
+}
+
+void main() {
+    if (wavefrontPass == WAVEFRONT_TRAVERSAL)
+        traverseWavefront();
+    else if (wavefrontPass == WAVEFRONT_SORT_COUNT)
+        countSortDigits();
+    else if (wavefrontPass == WAVEFRONT_SORT_SCAN)
+        scanSortCounts();
+    else if (wavefrontPass == WAVEFRONT_SORT_SCATTER)
+        scatterSortBlock();
+    else if (wavefrontPass == WAVEFRONT_SHADOW)
+        traceWavefrontShadow();
+    else if (wavefrontPass == WAVEFRONT_SHADING)
+        shadeWavefront();
+}
+#elif !defined(BEAM_PREPASS)
 void main() {
+#ifdef COMPUTE_TILES
+    ivec2 size = ivec2(renderSize);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (pixel.x >= size.x || pixel.y >= size.y) return;
+    // Each temporal pass takes its half of the checkerboard
+    if (temporalPass != 0u && frameIndex != 0u && isTracedPixel(pixel) != (temporalPass == 1u)) return;
+    vec2 pixelCenter = vec2(pixel) + 0.5;
+#endif
     Ray ray;
     ray.origin = camPos.xyz;
+#ifdef COMPUTE_TILES
+    ray.direction = getPixelDirection(pixelCenter, vec2(size));
+    pixelAngle = getPixelAngle(pixelCenter, vec2(size), ray.direction);
+    HistorySample reprojected;
+    if (temporalPass == 2u && reprojectPixel(pixel, size, ray.direction, pixelAngle, reprojected))
+    {
+        imageStore(tracedImage, pixel, vec4(reprojected.color, 1.0));
+        storeHistory(pixel, reprojected.color, reprojected.hit ? dot(reprojected.position - camPos, ray.direction) : -1.0, reprojected.normal);
+        return;
+    }
+#else
     ray.direction = normalize(homogenize(invPVMatrix * vec4(fragScreenCoord, 1.0, 1.0)) - ray.origin);
+    pixelAngle = length(fwidth(ray.direction));
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+#endif
     ray.invDirection = 1.0 / ray.direction;
+    ray.tStart = beamPrepass != 0u ? imageLoad(beamImage, pixel / BEAM_BLOCK_SIZE).r : 0.0;
 #ifdef INTERSECTION_TEST
     ray.testTint = 0.0;
 #endif
@@ -339,4 +1191,118 @@ void main() {
         outColor = vec4(skyColor, 1.0);
 #endif
     }
-}
\ No newline at end of file
+#ifdef COMPUTE_TILES
+    imageStore(tracedImage, pixel, outColor);
+    if (temporalPass != 0u)
+    {
+        vec3 normal = coll.hit ? parseLeaf(octree[coll.voxelIndex], octree[coll.voxelIndex + 1]).normal : vec3(0.0);
+        storeHistory(pixel, outColor.rgb, coll.hit ? getHitDistance(ray, coll) : -1.0, normal);
+    }
+#endif
+}
+#else
+//*********************
+//   BEAM PRE-PASS
+//*********************
+
+// Start distance of the rays of a block whose beam doesn't touch the octree, they are done at the root
+const float BEAM_MISS = 1e30;
+// Part of the distance found by a beam the rays of its block skip
+const float BEAM_START_FACTOR = 0.999;
+
+struct BeamElem
+{
+    uint index;
+    vec3 pos;
+    uint childCount;
+};
+
+// Shortest distance from the camera to a box, 0 inside of it
+float getBoxDistance(vec3 boxMin, float size)
+{
+    return length(max(max(boxMin - camPos, camPos - (boxMin + size)), vec3(0.0)));
+}
+
+// Conservative test of the cone against the bounding sphere of a box
+bool coneIntersectsBox(vec3 axis, float coneAngle, vec3 boxMin, float size)
+{
+    vec3 toCenter = boxMin + size / 2.0 - camPos;
+    float dist = length(toCenter);
+    float radius = 0.8660254 * size;
+    if (dist <= radius)
+        return true;
+    return acos(clamp(dot(toCenter, axis) / dist, -1.0, 1.0)) <= coneAngle + asin(radius / dist);
+}
+
+// Shortest distance from the camera to a leaf in the cone, BEAM_MISS when it doesn't reach any
+// Nodes no bigger than the cone is wide at their distance are not opened, their own distance stands in for the leaves inside
+float traceBeam(vec3 axis, float coneAngle)
+{
+    float halfScale = octreeScale / 2.0;
+    if (!coneIntersectsBox(axis, coneAngle, vec3(-halfScale), octreeScale))
+        return BEAM_MISS;
+    float coneWidth = 2.0 * tan(coneAngle);
+    uint octant = getOctant(axis);
+    BeamElem[MAX_OCTREE_DEPTH] stack;
+    stack[0] = BeamElem(0, vec3(-halfScale), 0);
+    int stackPtr = 0;
+    float nearest = BEAM_MISS;
+
+    while (stackPtr >= 0)
+    {
+        if (stack[stackPtr].childCount > 7)
+        {
+            // POP
+            stackPtr--;
+            continue;
+        }
+        uint current = stack[stackPtr].childCount ^ octant;
+        stack[stackPtr].childCount++;
+        BranchNode parent = parseBranch(octree[stack[stackPtr].index]);
+        if ((parent.childMask & (1 << current)) == 0)
+            continue;
+
+        float size = pow(2.0, -(stackPtr + 1)) * octreeScale;
+        vec3 pos = stack[stackPtr].pos + size * vec3((current & 4) >> 2, (current & 2) >> 1, current & 1);
+        float dist = getBoxDistance(pos, size);
+        if (dist >= nearest || !coneIntersectsBox(axis, coneAngle, pos, size))
+            continue;
+        // Leaves count whether they are opaque or not, the alpha test is left to the rays
+        if ((parent.leafMask & (1 << current)) != 0 || size <= dist * coneWidth)
+        {
+            nearest = dist;
+            continue;
+        }
+        uint linkAddress;
+        uint nextChild = getChildIndex(parent, stack[stackPtr].index, current, linkAddress);
+        // The rays draw the leaf of the link in place of a missing page
+        if (nextChild == PAGE_NOT_RESIDENT)
+        {
+            nearest = dist;
+            continue;
+        }
+
+        // PUSH
+        stackPtr++;
+        stack[stackPtr] = BeamElem(nextChild, pos, 0);
+    }
+    return nearest;
+}
+
+// One invocation per block, the cone goes through the corners of its pixels so it holds every ray of the block
+void main() {
+    ivec2 size = ivec2(renderSize);
+    ivec2 block = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(block * BEAM_BLOCK_SIZE, size))) return;
+    vec2 corner = vec2(block * BEAM_BLOCK_SIZE);
+    vec3 axis = getPixelDirection(corner + float(BEAM_BLOCK_SIZE) / 2.0, vec2(size));
+    float coneAngle = 0.0;
+    for (uint i = 0; i < 4; i++)
+    {
+        vec3 cornerDirection = getPixelDirection(corner + float(BEAM_BLOCK_SIZE) * vec2(i & 1, i >> 1), vec2(size));
+        coneAngle = max(coneAngle, acos(clamp(dot(axis, cornerDirection), -1.0, 1.0)));
+    }
+    // Rays start a little before the distance, so rounding in their slab tests never skips the leaf the beam stopped at
+    imageStore(beamImage, block, vec4(BEAM_START_FACTOR * traceBeam(axis, coneAngle)));
+}
+#endif
\ No newline at end of file
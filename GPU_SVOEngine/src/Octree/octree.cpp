@@ -1,8 +1,10 @@
 #include "octree.hpp"
 
+#include <algorithm>
 #include <array>
 #include <bitset>
 #include <chrono>
+#include <cstring>
 #include <fstream>
 
 #define GLM_ENABLE_EXPERIMENTAL
@@ -38,11 +40,21 @@ uint32_t Octree::getRaw(const uint32_t index) const
     return m_data[index];
 }
 
+uint32_t Octree::getNode(const uint32_t index) const
+{
+    return m_reversed ? m_data[getSize() - 1 - index] : m_data[index];
+}
+
 Octree::Material& Octree::getMaterialProps(const uint32_t index)
 {
     return m_materials[index];
 }
 
+const std::vector<Octree::Material>& Octree::getMaterials() const
+{
+    return m_materials;
+}
+
 const std::vector<std::string>& Octree::getMaterialTextures() const
 {
     return m_materialTextures;
@@ -238,6 +250,29 @@ void Octree::generateParallel(const AABB rootShape, const ParallelProcessFunc fu
     Logger::popContext();
 }
 
+// Builds the octree from leaves generated outside of the octree (see Voxelizer::rasterize)
+// The leaves must be sorted by key and contain no duplicates. The result is reversed, like with generate
+void Octree::generateFromLeaves(const std::vector<MortonLeaf>& leaves)
+{
+    Logger::pushContext("Octree generation from leaves");
+    m_data.clear();
+    m_stats = Stats{};
+    m_loadedFromFile = false;
+    m_reversed = true;
+    const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    const NodeRef ref = populateSortedRec(leaves.data(), leaves.data() + leaves.size(), 0);
+    resolveRoot(ref);
+    const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+    m_stats.constructionTime = static_cast<float>(std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()) / 1000.f;
+
+    LOG_DEBUG("Octree stats:");
+    LOG_DEBUG("  Leaves: ", leaves.size());
+    LOG_DEBUG("  Nodes: ", getSize());
+    LOG_DEBUG("  Far pointers: ", m_stats.farPtrs);
+    LOG_DEBUG("  Merge time: ", m_stats.constructionTime, "s");
+    Logger::popContext();
+}
+
 void Octree::resolveRoot(const NodeRef& ref)
 {
     if (!ref.exists)
@@ -339,8 +374,6 @@ NodeRef Octree::populateRec(const AABB nodeShape, const uint8_t currentDepth, vo
     if (!ref.exists || ref.isLeaf)
         return ref;
 
-    BranchNode node{0};
-
     // Recurse into children
     std::array<NodeRef, 8> children;
     for (int8_t i = 7; i >= 0; i--)
@@ -351,15 +384,53 @@ NodeRef Octree::populateRec(const AABB nodeShape, const uint8_t currentDepth, vo
         children[i] = populateRec(childShape, currentDepth + 1, processData, parallel, parallelIndex);
         if (currentDepth == 0 && !parallel)
             LOG_INFO("Finished processing root child ", i);
+    }
+
+    return resolveBranch(children);
+}
 
+// Same traversal as populateRec, but the leaves are already known. Since they are sorted by morton key
+// the leaves of each child are a contiguous range, so we just need to split the range at every level
+NodeRef Octree::populateSortedRec(const MortonLeaf* begin, const MortonLeaf* end, const uint8_t currentDepth)
+{
+    NodeRef ref;
+    if (begin == end)
+        return ref;
+
+    if (currentDepth >= m_depth)
+    {
+        const auto [leaf1, leaf2] = LeafNode{begin->leaf}.split();
+        ref.exists = true;
+        ref.isLeaf = true;
+        ref.data1 = leaf1.toRaw();
+        ref.data2 = leaf2.toRaw();
+        return ref;
+    }
+
+    const uint8_t shift = 3 * (m_depth - currentDepth - 1);
+    std::array<NodeRef, 8> children;
+    for (int8_t i = 7; i >= 0; i--)
+    {
+        const MortonLeaf* childBegin = std::partition_point(begin, end, [&](const MortonLeaf& leaf) { return static_cast<int8_t>((leaf.key >> shift) & 0x7) < i; });
+        const MortonLeaf* childEnd = std::partition_point(childBegin, end, [&](const MortonLeaf& leaf) { return static_cast<int8_t>((leaf.key >> shift) & 0x7) <= i; });
+        children[i] = populateSortedRec(childBegin, childEnd, currentDepth + 1);
+    }
+
+    return resolveBranch(children);
+}
+
+// Pushes the children of a branch and returns the reference to it. The branch does not exist if none of the children do
+NodeRef Octree::resolveBranch(std::array<NodeRef, 8>& children)
+{
+    NodeRef ref;
+    BranchNode node{0};
+    for (uint8_t i = 0; i < 8; i++)
+    {
         node.childMask.setBit(i, children[i].exists);
         node.leafMask.setBit(i, children[i].isLeaf);
     }
     if (node.childMask.toRaw() == 0)
-    {
-        ref.exists = false;
         return ref;
-    }
 
     resolveFarPointersAndPush(children);
 
@@ -373,6 +444,7 @@ NodeRef Octree::populateRec(const AABB nodeShape, const uint8_t currentDepth, vo
             break;
         }
     }
+    ref.exists = true;
     ref.childPos = children[firstChild].pos;
     ref.data1 = node.toRaw();
 
@@ -453,6 +525,8 @@ void* Octree::getMaterialTexData()
 //  3. material textures
 //    1. size of the material texture array
 //    2. material textures
+// 3. optional data (older files end before this, it is read as 0)
+//  1. leaf flags
 void Octree::dump(const std::string_view filenameArg) const
 {
     Logger::pushContext("Octree dumping");
@@ -492,6 +566,7 @@ void Octree::dump(const std::string_view filenameArg) const
         file.write(reinterpret_cast<const char*>(&texSize), sizeof(texSize));
         file.write(texture.data(), texSize);
     }
+    file.write(reinterpret_cast<const char*>(&m_leafFlags), sizeof(m_leafFlags));
     file.close();
     const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
     m_stats.saveTime = static_cast<float>(std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()) / 1000.f;
@@ -538,6 +613,9 @@ void Octree::load(const std::string_view filename)
         m_materialTextures[i].resize(pathSize);
         file.read(m_materialTextures[i].data(), pathSize);
     }
+    m_leafFlags = 0;
+    if (file.peek() != std::ifstream::traits_type::eof())
+        file.read(reinterpret_cast<char*>(&m_leafFlags), sizeof(m_leafFlags));
     file.close();
     const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
     m_stats.saveTime = static_cast<float>(std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()) / 1000.f;
@@ -586,12 +664,145 @@ void Octree::addMaterial(Material material, const std::string_view diffuseMap, c
 
 void Octree::packAndFinish()
 {
+    if (!m_finished)
+        pruneMaterials();
     if (m_materials.empty())
         m_materials.push_back(Material{});
     m_finished = true;
     m_stats.materials = static_cast<uint16_t>(m_materials.size());
 }
 
+// MATERIAL PRUNING
+
+// The MTL file usually has many more materials than the ones that end up in a voxel, and every texture they point to
+// would be decoded and uploaded for nothing. This drops the materials no leaf uses and the textures no remaining material uses
+// The leaves are found by walking the octree in the same order the shader does, the subtrees are walked in parallel
+void Octree::pruneMaterials()
+{
+    if (m_data.empty() || m_materials.empty())
+        return;
+    Logger::pushContext("Material pruning");
+
+    // The first two levels are walked here to get up to 64 subtrees, enough to keep every thread busy
+    // The root is never a leaf here, the traversal in the shader can't handle that either
+    std::vector<uint32_t> subtrees;
+    std::vector<uint32_t> topLeaves;
+    collectLeaves(0, 2, topLeaves, &subtrees);
+
+    std::vector<std::vector<uint32_t>> leaves(subtrees.size() + 1);
+    leaves.back() = std::move(topLeaves);
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < static_cast<int>(subtrees.size()); i++)
+        collectLeaves(subtrees[i], UINT8_MAX, leaves[i], nullptr);
+
+    // Leaf material IDs are split between the two words of the leaf, the combined node puts them back together
+    std::vector<uint32_t> leafCount(m_materials.size(), 0);
+    for (const std::vector<uint32_t>& group : leaves)
+    {
+        for (const uint32_t leaf : group)
+        {
+            const uint32_t material = LeafNode::combine(LeafNode1{ getNode(leaf) }, LeafNode2{ getNode(leaf + 1) }).material;
+            if (material >= m_materials.size())
+            {
+                LOG_WARN("Leaf uses material ", material, " but there are only ", m_materials.size(), ", materials will not be pruned");
+                Logger::popContext();
+                return;
+            }
+            leafCount[material]++;
+        }
+    }
+
+    std::vector<uint32_t> materialRemap(m_materials.size(), UINT32_MAX);
+    std::vector<Material> materials;
+    for (uint32_t i = 0; i < m_materials.size(); i++)
+    {
+        if (leafCount[i] == 0)
+            continue;
+        materialRemap[i] = static_cast<uint32_t>(materials.size());
+        materials.push_back(m_materials[i]);
+    }
+
+    // Textures are only read by the shader if the colors were not baked into the leaves
+    std::vector<uint32_t> textureRemap(m_materialTextures.size(), UINT32_MAX);
+    std::vector<std::string> textures;
+    const bool bakedColor = (m_leafFlags & LEAF_BAKED_COLOR) != 0;
+    for (Material& material : materials)
+    {
+        for (uint32_t* map : { &material.diffuseMap, &material.normalMap, &material.specularMap })
+        {
+            if (*map >= m_materialTextures.size())
+                continue;
+            if (bakedColor)
+            {
+                *map = 500;
+                continue;
+            }
+            if (textureRemap[*map] == UINT32_MAX)
+            {
+                textureRemap[*map] = static_cast<uint32_t>(textures.size());
+                textures.push_back(std::move(m_materialTextures[*map]));
+            }
+            *map = textureRemap[*map];
+        }
+    }
+
+    const size_t removedMaterials = m_materials.size() - materials.size();
+    const size_t removedTextures = m_materialTextures.size() - textures.size();
+    m_materials = std::move(materials);
+    m_materialTextures = std::move(textures);
+    m_stats.materials = static_cast<uint16_t>(m_materials.size());
+
+    // Only the leaves whose material moved have to be rewritten
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < static_cast<int>(leaves.size()); i++)
+    {
+        for (const uint32_t leaf : leaves[i])
+        {
+            LeafNode node = LeafNode::combine(LeafNode1{ getNode(leaf) }, LeafNode2{ getNode(leaf + 1) });
+            const uint32_t material = materialRemap[node.material];
+            if (material == node.material)
+                continue;
+            node.setMaterial(static_cast<uint16_t>(material));
+            const auto [node1, node2] = node.split();
+            getNodeRef(leaf) = node1.toRaw();
+            getNodeRef(leaf + 1) = node2.toRaw();
+        }
+    }
+
+    LOG_INFO("Pruned ", removedMaterials, " unused materials (", m_materials.size(), " left) and ", removedTextures, " unused textures (", m_materialTextures.size(), " left)");
+    Logger::popContext();
+}
+
+// Same address resolution as the shader, the result is the index of the first child in forward order
+uint32_t Octree::getChildAddress(const uint32_t index, const BranchNode node) const
+{
+    const uint32_t address = index + node.ptr.getPtr();
+    return node.ptr.isFar() ? address + getNode(address) : address;
+}
+
+// Stores the index of the first word of every leaf below the branch at the index
+// If subtrees is given, the branches that many levels below are stored there instead of being walked
+void Octree::collectLeaves(const uint32_t index, const uint8_t levels, std::vector<uint32_t>& leaves, std::vector<uint32_t>* subtrees) const
+{
+    const BranchNode node{ getNode(index) };
+    const uint32_t childAddress = getChildAddress(index, node);
+    uint32_t offset = 0;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        if (!node.childMask.getBit(i))
+            continue;
+        if (node.leafMask.getBit(i))
+        {
+            leaves.push_back(childAddress + offset);
+            offset += 2;
+        }
+        else if (subtrees && levels == 1)
+            subtrees->push_back(childAddress + offset++);
+        else
+            collectLeaves(childAddress + offset++, levels - 1, leaves, subtrees);
+    }
+}
+
 void Octree::clear()
 {
     m_data.clear();
@@ -603,6 +814,16 @@ bool Octree::isFinished() const
     return m_finished;
 }
 
+uint32_t Octree::getLeafFlags() const
+{
+    return m_leafFlags;
+}
+
+void Octree::setLeafFlags(const uint32_t flags)
+{
+    m_leafFlags = flags;
+}
+
 void Octree::populate(const AABB nodeShape, void* processData, const bool parallel, const uint8_t parallelIndex)
 {
     const NodeRef ref = populateRec(nodeShape, 0, processData, parallel, parallelIndex);
@@ -613,3 +834,8 @@ uint32_t& Octree::get(const uint32_t index)
 {
     return m_data[index];
 }
+
+uint32_t& Octree::getNodeRef(const uint32_t index)
+{
+    return m_reversed ? m_data[getSize() - 1 - index] : m_data[index];
+}
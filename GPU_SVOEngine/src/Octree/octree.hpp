@@ -1,4 +1,5 @@
 #pragma once
+#include <array>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -25,6 +26,13 @@ struct AABB
     float halfSize;
 };
 
+// Leaf produced outside of the octree traversal (for example by the rasterizer), keyed by the morton code of its position
+struct MortonLeaf
+{
+    uint64_t key = 0;
+    uint64_t leaf = 0;
+};
+
 struct FarNodeRef
 {
     uint32_t sourcePos;
@@ -51,6 +59,15 @@ public:
         alignas(4) uint32_t specularMap = 500;
     };
 
+    // Flags stored with the octree that change how the leaves have to be read
+    enum LeafFlags : uint32_t
+    {
+        LEAF_BAKED_COLOR = 1 << 0,
+        LEAF_BAKED_SPECULAR = 1 << 1,
+        // The voxelizer ran the alpha test of the diffuse maps and removed the leaves that fail it, every leaf left is opaque
+        LEAF_OPAQUE = 1 << 2
+    };
+
     struct Stats
     {
         uint64_t voxels = 0;
@@ -64,7 +81,12 @@ public:
     Octree (uint8_t maxDepth, std::string_view outputFile);
 
     [[nodiscard]] uint32_t getRaw(uint32_t index) const;
+    // Nodes in the order the engine uploads them (root first), whether the octree is reversed or not
+    [[nodiscard]] uint32_t getNode(uint32_t index) const;
+    // Forward index of the first child of the branch, the same address resolution as the shader
+    [[nodiscard]] uint32_t getChildAddress(uint32_t index, BranchNode node) const;
     [[nodiscard]] Material& getMaterialProps(uint32_t index);
+    [[nodiscard]] const std::vector<Material>& getMaterials() const;
     [[nodiscard]] const std::vector<std::string>& getMaterialTextures() const;
 
     [[nodiscard]] uint32_t getSize() const;
@@ -76,10 +98,12 @@ public:
     [[nodiscard]] Stats getStats() const;
     [[nodiscard]] bool isOctreeLoadedFromFile() const;
     [[nodiscard]] bool isFinished() const;
+    [[nodiscard]] uint32_t getLeafFlags() const;
 
     void preallocate(size_t size);
     void generate(AABB root, ProcessFunc func, void* processData);
     void generateParallel(AABB rootShape, ParallelProcessFunc func, void* processData);
+    void generateFromLeaves(const std::vector<MortonLeaf>& leaves);
     void addNode(BranchNode child);
     void addNode(LeafNode child);
     void addNode(LeafNode1 child);
@@ -98,6 +122,8 @@ public:
 
     void setMaterialPath(std::string_view path);
     void addMaterial(Material material, std::string_view diffuseMap, std::string_view normalMap, std::string_view specularMap);
+    void pruneMaterials();
+    void setLeafFlags(uint32_t flags);
     void packAndFinish();
 
     void clear();
@@ -105,16 +131,23 @@ public:
 private:
     void populate(AABB nodeShape, void* processData, bool parallel, uint8_t parallelIndex = 0);
     NodeRef populateRec(AABB nodeShape, uint8_t currentDepth, void* processData, bool parallel, uint8_t parallelIndex);
+    NodeRef populateSortedRec(const MortonLeaf* begin, const MortonLeaf* end, uint8_t currentDepth);
+
+    NodeRef resolveBranch(std::array<NodeRef, 8>& children);
 
     void resolveFarPointersAndPush(std::array<NodeRef, 8>& children);
     void resolveRoot(const NodeRef& ref);
 
+    void collectLeaves(uint32_t index, uint8_t levels, std::vector<uint32_t>& leaves, std::vector<uint32_t>* subtrees) const;
+
     std::vector<uint32_t> m_data;
     uint32_t& get(uint32_t index);
+    uint32_t& getNodeRef(uint32_t index);
 
     std::vector<Material> m_materials;
     std::vector<std::string> m_materialTextures;
     std::string m_textureRootDir;
+    uint32_t m_leafFlags = 0;
 
     size_t m_sizePtr = 0;
     uint8_t m_depth = 0;
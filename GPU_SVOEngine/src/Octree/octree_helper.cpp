@@ -64,4 +64,37 @@ uint8_t BitField::toRaw() const
 bool BitField::operator==(const BitField& other) const
 {
     return field == other.field;
+}
+
+// Spreads the lower 21 bits of the value so there are two zero bits between each of them
+static uint64_t spreadBits(const uint32_t value)
+{
+    uint64_t x = value & 0x1FFFFF;
+    x = (x | x << 32) & 0x001F00000000FFFF;
+    x = (x | x << 16) & 0x001F0000FF0000FF;
+    x = (x | x << 8)  & 0x100F00F00F00F00F;
+    x = (x | x << 4)  & 0x10C30C30C30C30C3;
+    x = (x | x << 2)  & 0x1249249249249249;
+    return x;
+}
+
+static uint32_t compactBits(uint64_t x)
+{
+    x &= 0x1249249249249249;
+    x = (x ^ x >> 2)  & 0x10C30C30C30C30C3;
+    x = (x ^ x >> 4)  & 0x100F00F00F00F00F;
+    x = (x ^ x >> 8)  & 0x001F0000FF0000FF;
+    x = (x ^ x >> 16) & 0x001F00000000FFFF;
+    x = (x ^ x >> 32) & 0x00000000001FFFFF;
+    return static_cast<uint32_t>(x);
+}
+
+uint64_t mortonEncode(const glm::uvec3 coords)
+{
+    return spreadBits(coords.x) << 2 | spreadBits(coords.y) << 1 | spreadBits(coords.z);
+}
+
+glm::uvec3 mortonDecode(const uint64_t key)
+{
+    return { compactBits(key >> 2), compactBits(key >> 1), compactBits(key) };
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdint>
+#include <glm/glm.hpp>
 
 // Simple class to work with a uint16_t as 15 bit address with far flag
 class NearPtr
@@ -35,4 +36,9 @@ public:
 
 private:
     uint8_t field;
-};
\ No newline at end of file
+};
+
+// Morton (Z-order) keys for voxel coordinates. Each level takes 3 bits laid out like the octree child index (x << 2 | y << 1 | z),
+// so sorting leaves by key groups them by subtree and visits the children of every node in index order
+[[nodiscard]] uint64_t mortonEncode(glm::uvec3 coords);
+[[nodiscard]] glm::uvec3 mortonDecode(uint64_t key);
\ No newline at end of file
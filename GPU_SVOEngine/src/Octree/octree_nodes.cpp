@@ -55,6 +55,13 @@ void LeafNode::setMaterial(const uint16_t mat)
     material = mat & 0x3FF;
 }
 
+// The 24 bits of the color take the place of the UV, so the shader reads them as (node1 >> 8)
+void LeafNode::setColor(const uint32_t packedColor)
+{
+    uvx = (packedColor & 0xFFF000) >> 12;
+    uvy =  packedColor & 0x000FFF;
+}
+
 glm::vec2 LeafNode::getUV() const
 {
     return { static_cast<float>(uvx) / 0xFFF, static_cast<float>(uvy) / 0xFFF };
@@ -70,6 +77,11 @@ uint16_t LeafNode::getMaterial(const LeafNode1 other) const
     return static_cast<uint16_t>((material & 0x003) << 8 | (other.material & 0xFF));
 }
 
+uint32_t LeafNode::getColor() const
+{
+    return static_cast<uint32_t>(uvx) << 12 | static_cast<uint32_t>(uvy);
+}
+
 uint64_t LeafNode::toRaw() const
 {
     uint64_t raw = 0;
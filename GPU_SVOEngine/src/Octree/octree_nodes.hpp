@@ -20,6 +20,7 @@
 // - Contains 24 bits for the UV coordinates (12 bits for each axis)
 // - Contains 10 bits for the material index
 // - Contains 30 bits for the normal vector (10 bits for each axis)
+// When colors are baked at voxelization time the UV bits hold the packed color instead (RGB888, or RGB565 plus 8 bits of specular)
 // Since the LeafNode is 64 bits it on serialization it is split into two 32 bit nodes (LeafNode1 and LeafNode2)
 
 // FarNode:
@@ -53,10 +54,12 @@ struct LeafNode
     void setUV(glm::vec2 uv);
     void setNormal(const glm::vec3& normal);
     void setMaterial(uint16_t material);
+    void setColor(uint32_t packedColor);
 
     [[nodiscard]] glm::vec2 getUV() const;
     [[nodiscard]] glm::vec3 getNormal() const;
     [[nodiscard]] uint16_t getMaterial(LeafNode1 other) const;
+    [[nodiscard]] uint32_t getColor() const;
 
     [[nodiscard]] uint64_t toRaw() const;
     [[nodiscard]] std::pair<LeafNode1, LeafNode2> split() const;
@@ -0,0 +1,453 @@
+#include "octree_pager.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <queue>
+#include <stdexcept>
+#include <string>
+
+// Pages are wanted while the branch that links them covers at least this many pixels. Below that the leaf in the link looks the same
+static constexpr float MIN_PAGE_PIXELS = 4.0f;
+// Words taken by a link at the end of a page
+static constexpr uint32_t LINK_SIZE = 4;
+
+// PAGED OCTREE
+
+namespace
+{
+    struct BlockEntry
+    {
+        uint32_t source;
+        bool leaf;
+        glm::vec3 min;
+        float size;
+        uint8_t depth;
+        // Block with the children of the entry in the page, or PAGE_NOT_RESIDENT if they are in another page
+        uint32_t childBlock = PAGE_NOT_RESIDENT;
+    };
+
+    // Subtrees that start a page, with the page that links them
+    struct PageRoot
+    {
+        std::vector<BlockEntry> entries;
+        uint32_t parent;
+        // Words taken by the children of the entries, where the next entry starts
+        uint32_t size = 0;
+    };
+
+    std::vector<BlockEntry> getChildBlock(const Octree& octree, const BlockEntry& parent)
+    {
+        std::vector<BlockEntry> block;
+        const BranchNode node{ octree.getNode(parent.source) };
+        const uint32_t childAddress = octree.getChildAddress(parent.source, node);
+        const float childSize = parent.size / 2;
+        uint32_t offset = 0;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            if (!node.childMask.getBit(i))
+                continue;
+            const bool leaf = node.leafMask.getBit(i);
+            const glm::vec3 min = parent.min + childSize * glm::vec3((i & 4) >> 2, (i & 2) >> 1, i & 1);
+            block.push_back({ childAddress + offset, leaf, min, childSize, static_cast<uint8_t>(parent.depth + 1) });
+            offset += leaf ? 2 : 1;
+        }
+        return block;
+    }
+
+    uint32_t getBlockSize(const std::vector<BlockEntry>& block)
+    {
+        uint32_t size = 0;
+        for (const BlockEntry& entry : block)
+            size += entry.leaf ? 2 : 1;
+        return size;
+    }
+
+    uint32_t getBlockBranches(const std::vector<BlockEntry>& block)
+    {
+        return static_cast<uint32_t>(std::ranges::count_if(block, [](const BlockEntry& entry) { return !entry.leaf; }));
+    }
+
+    // Words below every branch, so small subtrees can be packed together in a single page
+    uint32_t computeSubtreeSizes(const Octree& octree, const uint32_t index, std::vector<uint32_t>& sizes)
+    {
+        const BranchNode node{ octree.getNode(index) };
+        const uint32_t childAddress = octree.getChildAddress(index, node);
+        uint32_t size = 0;
+        uint32_t offset = 0;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            if (!node.childMask.getBit(i))
+                continue;
+            if (node.leafMask.getBit(i))
+            {
+                size += 2;
+                offset += 2;
+            }
+            else
+                size += 1 + computeSubtreeSizes(octree, childAddress + offset++, sizes);
+        }
+        sizes[index] = size;
+        return size;
+    }
+
+    // First leaf found going down the first child of every branch. It is what the subtree looks like while its page is missing
+    std::pair<uint32_t, uint32_t> getRepresentativeLeaf(const Octree& octree, uint32_t index)
+    {
+        while (true)
+        {
+            const BranchNode node{ octree.getNode(index) };
+            uint8_t child = 0;
+            while (child < 8 && !node.childMask.getBit(child))
+                child++;
+            if (child == 8)
+                return { 0, 0 };
+            const uint32_t address = octree.getChildAddress(index, node);
+            if (node.leafMask.getBit(child))
+                return { octree.getNode(address), octree.getNode(address + 1) };
+            index = address;
+        }
+    }
+}
+
+std::vector<OctreePage> paginateOctree(const Octree& octree, const uint32_t pageSize)
+{
+    if (pageSize > NEAR_PTR_MAX + 1 || pageSize < 8 * 2 + 8 * LINK_SIZE)
+        throw std::runtime_error("Octree page size must be between 48 and 32768 nodes");
+
+    std::vector<OctreePage> pages;
+    if (octree.getSize() == 0)
+    {
+        pages.emplace_back().nodes.push_back(0);
+        return pages;
+    }
+
+    std::vector<uint32_t> subtreeSizes(octree.getSize(), 0);
+    computeSubtreeSizes(octree, 0, subtreeSizes);
+
+    std::vector<PageRoot> roots(1);
+    roots[0].entries.push_back({ 0, false, glm::vec3(0.0f), 1.0f, 0 });
+    roots[0].parent = PAGE_NOT_RESIDENT;
+    for (uint32_t pageID = 0; pageID < roots.size(); pageID++)
+    {
+        // The first page starts at the root itself, the rest with the children of the branches that link them, one block after the other
+        std::vector<std::vector<BlockEntry>> blocks;
+        if (pageID == 0)
+            blocks.push_back(roots[0].entries);
+        else
+        {
+            for (const BlockEntry& entry : roots[pageID].entries)
+                blocks.push_back(getChildBlock(octree, entry));
+        }
+
+        // Branches are visited breadth first. Every branch whose children are not in the page needs a link, so adding
+        // a block frees the link of its parent and reserves one for each of its own branches
+        uint32_t used = 0;
+        for (const std::vector<BlockEntry>& block : blocks)
+            used += getBlockSize(block) + LINK_SIZE * getBlockBranches(block);
+        for (uint32_t b = 0; b < blocks.size(); b++)
+        {
+            for (uint32_t e = 0; e < blocks[b].size(); e++)
+            {
+                if (blocks[b][e].leaf)
+                    continue;
+                std::vector<BlockEntry> children = getChildBlock(octree, blocks[b][e]);
+                const uint32_t newUsed = used + getBlockSize(children) + LINK_SIZE * getBlockBranches(children) - LINK_SIZE;
+                if (newUsed > pageSize)
+                    continue;
+                used = newUsed;
+                blocks[b][e].childBlock = static_cast<uint32_t>(blocks.size());
+                blocks.push_back(std::move(children));
+            }
+        }
+
+        std::vector<uint32_t> blockPositions(blocks.size());
+        uint32_t position = 0;
+        for (uint32_t b = 0; b < blocks.size(); b++)
+        {
+            blockPositions[b] = position;
+            position += getBlockSize(blocks[b]);
+        }
+
+        OctreePage page;
+        page.parent = roots[pageID].parent;
+        page.boundsMin = glm::vec3(1.0f);
+        page.boundsMax = glm::vec3(0.0f);
+        page.depth = UINT8_MAX;
+        for (const BlockEntry& entry : roots[pageID].entries)
+        {
+            page.boundsMin = glm::min(page.boundsMin, entry.min);
+            page.boundsMax = glm::max(page.boundsMax, entry.min + entry.size);
+            page.depth = std::min(page.depth, entry.depth);
+        }
+        page.nodes.resize(position);
+
+        // Links are written once the pages they point to are known
+        std::vector<std::pair<BlockEntry, uint32_t>> links;
+        for (uint32_t b = 0; b < blocks.size(); b++)
+        {
+            uint32_t nodePos = blockPositions[b];
+            for (const BlockEntry& entry : blocks[b])
+            {
+                if (entry.leaf)
+                {
+                    page.nodes[nodePos] = octree.getNode(entry.source);
+                    page.nodes[nodePos + 1] = octree.getNode(entry.source + 1);
+                    nodePos += 2;
+                    continue;
+                }
+                // Children always come after their parent, so the offsets are positive and below the page size
+                BranchNode node{ octree.getNode(entry.source) };
+                if (entry.childBlock != PAGE_NOT_RESIDENT)
+                {
+                    node.ptr = NearPtr(static_cast<uint16_t>(blockPositions[entry.childBlock] - nodePos), false);
+                }
+                else if (node.childMask.toRaw() == 0)
+                {
+                    node.ptr = NearPtr(0, false);
+                }
+                else
+                {
+                    const uint32_t linkPos = static_cast<uint32_t>(page.nodes.size() + links.size() * LINK_SIZE);
+                    node.ptr = NearPtr(static_cast<uint16_t>(linkPos - nodePos), true);
+                    links.emplace_back(entry, 0);
+                }
+                page.nodes[nodePos++] = node.toRaw();
+            }
+        }
+
+        // Subtrees that fit whole share pages, in breadth first order so the ones in the same page are close to each other
+        // A bigger subtree gets a page of its own and keeps splitting from there
+        uint32_t groupPage = PAGE_NOT_RESIDENT;
+        uint32_t groupSize = 0;
+        for (std::pair<BlockEntry, uint32_t>& link : links)
+        {
+            const uint32_t size = subtreeSizes[link.first.source];
+            if (size > pageSize || groupPage == PAGE_NOT_RESIDENT || groupSize + size > pageSize)
+            {
+                link.second = static_cast<uint32_t>(roots.size());
+                roots.push_back({ {}, pageID });
+                page.children.push_back(link.second);
+                if (size <= pageSize)
+                {
+                    groupPage = link.second;
+                    groupSize = 0;
+                }
+            }
+            else
+                link.second = groupPage;
+
+            PageRoot& root = roots[link.second];
+            const uint32_t offset = root.size;
+            root.entries.push_back(link.first);
+            root.size += getBlockSize(getChildBlock(octree, link.first));
+            if (link.second == groupPage)
+                groupSize += size;
+
+            const std::pair<uint32_t, uint32_t> leaf = getRepresentativeLeaf(octree, link.first.source);
+            page.nodes.insert(page.nodes.end(), { link.second, offset, leaf.first, leaf.second });
+        }
+        pages.push_back(std::move(page));
+    }
+    return pages;
+}
+
+// OCTREE PAGER
+
+OctreePager::OctreePager(std::vector<OctreePage> pages, const uint32_t slotCount, const uint8_t pinnedDepth)
+    : m_pages(std::move(pages)), m_pageTable(m_pages.size(), PAGE_NOT_RESIDENT), m_slotPages(slotCount, PAGE_NOT_RESIDENT),
+      m_lastUsed(m_pages.size(), 0), m_residentChildren(m_pages.size(), 0), m_pinned(m_pages.size(), false)
+{
+    if (m_pages.empty() || slotCount == 0)
+        throw std::runtime_error("Octree pager needs at least one page and one slot");
+
+    // If everything fits there is no reason to leave pages out
+    m_minPixels = slotCount >= m_pages.size() ? 0.0f : MIN_PAGE_PIXELS;
+
+    // Parents come before their children, so a single pass pins whole subtrees from the root down
+    for (uint32_t page = 0; page < m_pages.size(); page++)
+    {
+        if (page != 0 && (m_pages[page].depth >= pinnedDepth || !m_pinned[m_pages[page].parent]))
+            continue;
+        if (m_pinnedCount == slotCount)
+            throw std::runtime_error("Octree page pool is too small for the pinned pages, " + std::to_string(slotCount) + " slots available");
+        m_pinned[page] = true;
+        load(page, m_pinnedCount++, m_pendingLoads);
+    }
+    for (uint32_t slot = slotCount; slot > m_pinnedCount; slot--)
+        m_freeSlots.push_back(slot - 1);
+}
+
+std::vector<OctreePager::Load> OctreePager::update(const glm::vec3& cameraPos, const float pixelAngle, const uint32_t maxLoads)
+{
+    m_frame++;
+    std::vector<Load> loads = std::move(m_pendingLoads);
+    m_pendingLoads.clear();
+
+    // Ties are broken by page number so the result doesn't depend on the order of the slots
+    using Candidate = std::pair<float, uint32_t>;
+    std::priority_queue<Candidate> candidates;
+    const auto pushChildren = [&](const uint32_t page)
+    {
+        for (const uint32_t child : m_pages[page].children)
+        {
+            if (m_pageTable[child] != PAGE_NOT_RESIDENT)
+                continue;
+            const float pixels = getPixelSize(child, cameraPos, pixelAngle);
+            if (pixels >= m_minPixels)
+                candidates.emplace(pixels, PAGE_NOT_RESIDENT - child);
+        }
+    };
+
+    // Resident pages the camera still needs are marked as used, their missing children are the ones to load
+    std::vector<std::pair<float, uint32_t>> victims;
+    for (const uint32_t page : m_slotPages)
+    {
+        if (page == PAGE_NOT_RESIDENT)
+            continue;
+        const float pixels = getPixelSize(page, cameraPos, pixelAngle);
+        if (pixels >= m_minPixels)
+            m_lastUsed[page] = m_frame;
+        pushChildren(page);
+        if (!m_pinned[page] && m_residentChildren[page] == 0)
+            victims.emplace_back(pixels, page);
+    }
+    // Least recently used first, and the smallest on screen among the ones used at the same time
+    std::ranges::sort(victims, [&](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b)
+    {
+        if (m_lastUsed[a.second] != m_lastUsed[b.second])
+            return m_lastUsed[a.second] < m_lastUsed[b.second];
+        return a.first != b.first ? a.first < b.first : a.second < b.second;
+    });
+
+    uint32_t loaded = 0;
+    size_t nextVictim = 0;
+    while (!candidates.empty() && loaded < maxLoads)
+    {
+        const auto [pixels, key] = candidates.top();
+        candidates.pop();
+        const uint32_t page = PAGE_NOT_RESIDENT - key;
+        // The parent may have been evicted to make room for an earlier candidate
+        if (m_pageTable[m_pages[page].parent] == PAGE_NOT_RESIDENT)
+            continue;
+
+        if (m_freeSlots.empty())
+        {
+            if (m_waitingSlotCount >= maxLoads)
+                break;
+            while (nextVictim < victims.size() && (m_residentChildren[victims[nextVictim].second] != 0 || victims[nextVictim].second == m_pages[page].parent))
+                nextVictim++;
+            if (nextVictim == victims.size())
+                break;
+            // A page that is still wanted only makes room for a bigger one, everything after it is wanted too
+            const auto [victimPixels, victim] = victims[nextVictim];
+            if (m_lastUsed[victim] == m_frame && victimPixels >= pixels)
+                break;
+            nextVictim++;
+            evict(victim);
+            // The slot comes back once the frames that may read the victim are done, the page is loaded by the update after that
+            continue;
+        }
+
+        const uint32_t slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        load(page, slot, loads);
+        m_lastUsed[page] = m_frame;
+        loaded++;
+        pushChildren(page);
+    }
+    return loads;
+}
+
+std::vector<uint32_t> OctreePager::takeEvictedSlots()
+{
+    std::vector<uint32_t> slots = std::move(m_evictedSlots);
+    m_evictedSlots.clear();
+    return slots;
+}
+
+void OctreePager::releaseSlots(const std::span<const uint32_t> slots)
+{
+    for (const uint32_t slot : slots)
+    {
+        if (slot >= m_slotPages.size() || m_slotPages[slot] != PAGE_NOT_RESIDENT || m_waitingSlotCount == 0)
+            throw std::runtime_error("Octree page slot " + std::to_string(slot) + " was released without being evicted");
+        m_freeSlots.push_back(slot);
+        m_waitingSlotCount--;
+    }
+}
+
+const OctreePage& OctreePager::getPage(const uint32_t page) const
+{
+    return m_pages[page];
+}
+
+uint32_t OctreePager::getPageCount() const
+{
+    return static_cast<uint32_t>(m_pages.size());
+}
+
+const std::vector<uint32_t>& OctreePager::getPageTable() const
+{
+    return m_pageTable;
+}
+
+uint32_t OctreePager::getSlotCount() const
+{
+    return static_cast<uint32_t>(m_slotPages.size());
+}
+
+uint32_t OctreePager::getResidentCount() const
+{
+    return m_residentCount;
+}
+
+uint32_t OctreePager::getPinnedCount() const
+{
+    return m_pinnedCount;
+}
+
+uint32_t OctreePager::getWaitingSlotCount() const
+{
+    return m_waitingSlotCount;
+}
+
+OctreePager::Stats OctreePager::getStats() const
+{
+    return m_stats;
+}
+
+// Size on screen of the branches that link the page. Infinite if the camera is inside it
+float OctreePager::getPixelSize(const uint32_t page, const glm::vec3& cameraPos, const float pixelAngle) const
+{
+    const OctreePage& data = m_pages[page];
+    const glm::vec3 closest = glm::clamp(cameraPos, data.boundsMin, data.boundsMax);
+    const float distance = glm::length(cameraPos - closest);
+    if (distance <= 0.0f)
+        return FLT_MAX;
+    const glm::vec3 extent = data.boundsMax - data.boundsMin;
+    return glm::max(extent.x, glm::max(extent.y, extent.z)) / (distance * pixelAngle);
+}
+
+void OctreePager::load(const uint32_t page, const uint32_t slot, std::vector<Load>& loads)
+{
+    m_pageTable[page] = slot;
+    m_slotPages[slot] = page;
+    if (m_pages[page].parent != PAGE_NOT_RESIDENT)
+        m_residentChildren[m_pages[page].parent]++;
+    m_residentCount++;
+    m_stats.loads++;
+    loads.push_back({ page, slot });
+}
+
+void OctreePager::evict(const uint32_t page)
+{
+    const uint32_t slot = m_pageTable[page];
+    m_pageTable[page] = PAGE_NOT_RESIDENT;
+    m_slotPages[slot] = PAGE_NOT_RESIDENT;
+    m_evictedSlots.push_back(slot);
+    m_waitingSlotCount++;
+    if (m_pages[page].parent != PAGE_NOT_RESIDENT)
+        m_residentChildren[m_pages[page].parent]--;
+    m_residentCount--;
+    m_stats.evictions++;
+}
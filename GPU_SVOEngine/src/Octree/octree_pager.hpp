@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "octree.hpp"
+
+// Nodes per page. Every offset inside a page fits in a near pointer, so the far flag of a branch is free to mark links to other pages
+enum { OCTREE_PAGE_SIZE = 16384 };
+// Page table value of a page that is not in the GPU pool
+enum : uint32_t { PAGE_NOT_RESIDENT = 0xFFFFFFFF };
+
+// PAGED OCTREE
+
+// A piece of the octree that is copied to the GPU as a whole. It starts with the children of the branches that link it (or the root for the first page)
+// Branches whose children did not fit have the far flag set and point to a link at the end of the page: [page, offset, leaf word 1, leaf word 2]
+// The leaf is taken from the subtree, it is drawn in its place while the page is not resident
+struct OctreePage
+{
+    std::vector<uint32_t> nodes;
+    std::vector<uint32_t> children;
+    uint32_t parent = PAGE_NOT_RESIDENT;
+    // Box around the branches that link the page, in octree space ([0, 1] on every axis)
+    glm::vec3 boundsMin{ 0.0f };
+    glm::vec3 boundsMax{ 1.0f };
+    uint8_t depth = 0;
+};
+
+// Splits the octree at child block boundaries. Pages are filled breadth first, so each one holds the top levels of its subtrees
+// Parents always come before their children and the first page holds the root
+[[nodiscard]] std::vector<OctreePage> paginateOctree(const Octree& octree, uint32_t pageSize = OCTREE_PAGE_SIZE);
+
+// OCTREE PAGER
+
+// Decides which pages are kept in a pool of fixed size slots on the GPU. It only keeps the policy, the engine does the copies
+// Pages are wanted while the branch that links them covers enough pixels, the ones closest to the camera are loaded first
+// When the pool is full the least recently wanted pages are evicted, but never a page with resident children or a pinned page
+// Frames in flight may still read the slot of an evicted page, so it is only reused once the engine gives it back with releaseSlots()
+class OctreePager
+{
+public:
+    struct Load
+    {
+        uint32_t page;
+        uint32_t slot;
+    };
+
+    struct Stats
+    {
+        uint64_t loads = 0;
+        uint64_t evictions = 0;
+    };
+
+    // Pages linked above the pinned depth never leave the pool. The root page is always pinned and always in slot 0
+    OctreePager(std::vector<OctreePage> pages, uint32_t slotCount, uint8_t pinnedDepth = 0);
+
+    // Camera position in octree space and angle covered by one pixel. Returns the pages to copy to their slots before the next frame
+    // The page table already points to them, so it has to be uploaded together with the pages
+    // Pages that need a slot while none is free evict one for a later update, at most maxLoads slots wait to be released at a time
+    [[nodiscard]] std::vector<Load> update(const glm::vec3& cameraPos, float pixelAngle, uint32_t maxLoads);
+    // Slots of the pages evicted since the last call. The page table no longer points to them
+    [[nodiscard]] std::vector<uint32_t> takeEvictedSlots();
+    // Slots taken from takeEvictedSlots() that nothing reads anymore, later updates load pages into them
+    void releaseSlots(std::span<const uint32_t> slots);
+
+    [[nodiscard]] const OctreePage& getPage(uint32_t page) const;
+    [[nodiscard]] uint32_t getPageCount() const;
+    [[nodiscard]] const std::vector<uint32_t>& getPageTable() const;
+    [[nodiscard]] uint32_t getSlotCount() const;
+    [[nodiscard]] uint32_t getResidentCount() const;
+    [[nodiscard]] uint32_t getPinnedCount() const;
+    // Evicted and not released yet
+    [[nodiscard]] uint32_t getWaitingSlotCount() const;
+    [[nodiscard]] Stats getStats() const;
+
+private:
+    [[nodiscard]] float getPixelSize(uint32_t page, const glm::vec3& cameraPos, float pixelAngle) const;
+    void load(uint32_t page, uint32_t slot, std::vector<Load>& loads);
+    void evict(uint32_t page);
+
+    std::vector<OctreePage> m_pages;
+    std::vector<uint32_t> m_pageTable;
+    std::vector<uint32_t> m_slotPages;
+    std::vector<uint32_t> m_freeSlots;
+    std::vector<uint32_t> m_evictedSlots;
+    std::vector<uint64_t> m_lastUsed;
+    std::vector<uint32_t> m_residentChildren;
+    std::vector<bool> m_pinned;
+    std::vector<Load> m_pendingLoads;
+
+    float m_minPixels;
+    uint32_t m_pinnedCount = 0;
+    uint32_t m_residentCount = 0;
+    uint32_t m_waitingSlotCount = 0;
+    uint64_t m_frame = 0;
+    Stats m_stats{};
+};
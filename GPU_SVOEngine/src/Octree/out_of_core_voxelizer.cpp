@@ -0,0 +1,487 @@
+#include "out_of_core_voxelizer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+#include "utils/logger.hpp"
+
+#include "tiny_obj_loader.h"
+
+// Memory a triangle takes once its bucket is loaded into a Voxelizer: its vertices and indices in the model, its root index,
+// its plane for the leaf test and its index in every triangle tree
+static constexpr size_t BUCKET_TRIANGLE_BYTES = 3 * sizeof(Vertex) + 3 * sizeof(uint32_t) + sizeof(TriangleRootIndex) + 4 * sizeof(glm::vec3) + 8 * sizeof(uint32_t);
+// Octree::generateParallel works on the 8 children of the root at the same time, so there can be 8 buckets loaded at once
+static constexpr size_t PARALLEL_BUCKETS = 8;
+// Deepest split considered, 8^6 buckets is already more files than anyone wants in a directory
+static constexpr uint8_t MAX_SPLIT_DEPTH = 6;
+// Triangles read or written at once when going through the intermediate files
+static constexpr size_t FILE_BLOCK_SIZE = 4096;
+
+static Material convertMaterial(const tinyobj::material_t& material)
+{
+    Material mat{};
+    mat.name = material.name;
+    mat.diffuse = { material.diffuse[0], material.diffuse[1], material.diffuse[2] };
+    mat.ambient = { material.ambient[0], material.ambient[1], material.ambient[2] };
+    mat.specular = { material.specular[0], material.specular[1], material.specular[2] };
+    mat.specularComp = material.shininess;
+    mat.diffuseMap = material.diffuse_texname;
+    mat.normalMap = material.normal_texname;
+    mat.specularMap = material.specular_texname;
+    return mat;
+}
+
+template<typename T>
+static size_t readBlock(std::ifstream& file, std::vector<T>& block)
+{
+    file.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size() * sizeof(T)));
+    return static_cast<size_t>(file.gcount()) / sizeof(T);
+}
+
+template<typename T>
+static void writeBlock(std::ofstream& file, const std::vector<T>& block, const size_t count)
+{
+    file.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(count * sizeof(T)));
+}
+
+OutOfCoreVoxelizer::OutOfCoreVoxelizer(const std::string& filename, const uint8_t maxDepth, const size_t memoryLimit, const std::filesystem::path& workDir)
+    : m_baseDir(filename.substr(0, filename.find_last_of('/'))), m_maxDepth(maxDepth), m_memoryLimit(memoryLimit)
+{
+    Logger::pushContext("Out of core voxelization");
+    const std::filesystem::path baseDir = workDir.empty() ? std::filesystem::temp_directory_path() : workDir;
+    m_workDir = baseDir / ("svo_ooc_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+    std::filesystem::create_directories(m_workDir);
+
+    m_materials.emplace_back();
+    streamModel(filename);
+    resolveVertices();
+    chooseSplitDepth();
+    writeBuckets();
+    Logger::popContext();
+}
+
+OutOfCoreVoxelizer::~OutOfCoreVoxelizer()
+{
+    for (std::unique_ptr<Voxelizer>& bucket : m_buckets)
+        bucket.reset();
+    std::error_code error;
+    std::filesystem::remove_all(m_workDir, error);
+}
+
+// Same bounds the Voxelizer uses, so both voxelize the model with the same grid
+AABB OutOfCoreVoxelizer::getModelAABB() const
+{
+    const float distX = std::abs(m_max.x - m_min.x);
+    const float distY = std::abs(m_max.y - m_min.y);
+    const float distZ = std::abs(m_max.z - m_min.z);
+    const float size = std::max(distX, std::max(distY, distZ)) / 1.9f;
+    return { (m_min + m_max) / 2.0f, size };
+}
+
+const std::vector<Material>& OutOfCoreVoxelizer::getMaterials() const
+{
+    return m_materials;
+}
+
+std::string OutOfCoreVoxelizer::getMaterialFilePath() const
+{
+    return m_baseDir;
+}
+
+uint8_t OutOfCoreVoxelizer::getSplitDepth() const
+{
+    return m_splitDepth;
+}
+
+void OutOfCoreVoxelizer::setAreaFiltering(const bool enabled)
+{
+    m_areaFiltering = enabled;
+}
+
+void OutOfCoreVoxelizer::setAdaptiveDepth(const float tolerance)
+{
+    m_adaptiveTolerance = tolerance;
+}
+
+// STREAMING
+
+// The file is read once with the callback interface of tinyobj, which doesn't keep anything in memory
+// Vertex attributes go to one file each and the faces are triangulated as a fan and written as indices
+// Negative indices are only resolved for positions, tinyobj reports missing texture coordinates and normals with negative indices too
+void OutOfCoreVoxelizer::streamModel(const std::string& filename)
+{
+    std::ifstream file(filename);
+    if (!file.is_open())
+        throw std::runtime_error("failed to open model file " + filename);
+
+    struct StreamState
+    {
+        OutOfCoreVoxelizer& voxelizer;
+        std::ofstream positions;
+        std::ofstream texCoords;
+        std::ofstream normals;
+        std::ofstream faces;
+        uint32_t material = 0;
+    };
+    StreamState state{
+        *this,
+        std::ofstream(getFilePath("positions.bin"), std::ios::binary),
+        std::ofstream(getFilePath("texcoords.bin"), std::ios::binary),
+        std::ofstream(getFilePath("normals.bin"), std::ios::binary),
+        std::ofstream(getFilePath("faces.bin"), std::ios::binary)
+    };
+    if (!state.positions.is_open() || !state.texCoords.is_open() || !state.normals.is_open() || !state.faces.is_open())
+        throw std::runtime_error("failed to create temporary files in " + m_workDir.string());
+
+    tinyobj::callback_t callbacks{};
+    callbacks.vertex_cb = [](void* data, const tinyobj::real_t x, const tinyobj::real_t y, const tinyobj::real_t z, tinyobj::real_t)
+    {
+        StreamState& stream = *static_cast<StreamState*>(data);
+        const glm::vec3 position{ x, y, z };
+        stream.positions.write(reinterpret_cast<const char*>(&position), sizeof(position));
+        stream.voxelizer.m_min = glm::min(stream.voxelizer.m_min, position);
+        stream.voxelizer.m_max = glm::max(stream.voxelizer.m_max, position);
+        stream.voxelizer.m_attributeCounts[0]++;
+    };
+    callbacks.texcoord_cb = [](void* data, const tinyobj::real_t x, const tinyobj::real_t y, tinyobj::real_t)
+    {
+        StreamState& stream = *static_cast<StreamState*>(data);
+        const glm::vec2 texCoord{ x, y };
+        stream.texCoords.write(reinterpret_cast<const char*>(&texCoord), sizeof(texCoord));
+        stream.voxelizer.m_attributeCounts[1]++;
+    };
+    callbacks.normal_cb = [](void* data, const tinyobj::real_t x, const tinyobj::real_t y, const tinyobj::real_t z)
+    {
+        StreamState& stream = *static_cast<StreamState*>(data);
+        const glm::vec3 normal{ x, y, z };
+        stream.normals.write(reinterpret_cast<const char*>(&normal), sizeof(normal));
+        stream.voxelizer.m_attributeCounts[2]++;
+    };
+    callbacks.index_cb = [](void* data, tinyobj::index_t* indices, const int count)
+    {
+        StreamState& stream = *static_cast<StreamState*>(data);
+        const std::array<uint64_t, 3>& counts = stream.voxelizer.m_attributeCounts;
+        const auto getCorner = [&](const tinyobj::index_t& index)
+        {
+            const int64_t position = index.vertex_index >= 0 ? index.vertex_index : static_cast<int64_t>(counts[0]) + index.vertex_index;
+            return glm::ivec3{
+                position >= 0 && position < static_cast<int64_t>(counts[0]) ? static_cast<int32_t>(position) : -1,
+                index.texcoord_index >= 0 && static_cast<uint64_t>(index.texcoord_index) < counts[1] ? index.texcoord_index : -1,
+                index.normal_index >= 0 && static_cast<uint64_t>(index.normal_index) < counts[2] ? index.normal_index : -1
+            };
+        };
+
+        for (int i = 1; i + 1 < count; i++)
+        {
+            const FaceIndices face{ { getCorner(indices[0]), getCorner(indices[i]), getCorner(indices[i + 1]) }, stream.material };
+            if (face.corners[0].x < 0 || face.corners[1].x < 0 || face.corners[2].x < 0)
+                continue;
+            stream.faces.write(reinterpret_cast<const char*>(&face), sizeof(face));
+            stream.voxelizer.m_triangleCount++;
+        }
+    };
+    callbacks.usemtl_cb = [](void* data, const char*, const int materialId)
+    {
+        static_cast<StreamState*>(data)->material = materialId >= 0 ? static_cast<uint32_t>(materialId) + 1 : 0;
+    };
+    // tinyobj passes all the materials read so far every time it finds a material library
+    callbacks.mtllib_cb = [](void* data, const tinyobj::material_t* materials, const int count)
+    {
+        std::vector<Material>& modelMaterials = static_cast<StreamState*>(data)->voxelizer.m_materials;
+        modelMaterials.resize(1);
+        for (int i = 0; i < count; i++)
+            modelMaterials.push_back(convertMaterial(materials[i]));
+    };
+
+    tinyobj::MaterialFileReader materialReader(m_baseDir + "/");
+    std::string warn, err;
+    if (!tinyobj::LoadObjWithCallback(file, callbacks, &state, &materialReader, &warn, &err))
+        throw std::runtime_error(warn + err);
+
+    LOG_INFO("Streamed ", m_attributeCounts[0], " vertices and ", m_triangleCount, " triangles from ", filename);
+}
+
+// Faces only reference their vertices, so their data is filled one attribute at a time. Each pass loads as many values of an
+// attribute as fit in memory and goes through all faces, filling the corners that reference them. The soup file is rewritten every pass
+void OutOfCoreVoxelizer::resolveVertices()
+{
+    const std::filesystem::path facesPath = getFilePath("faces.bin");
+    const std::filesystem::path soupPath = getFilePath("soup.bin");
+    const std::filesystem::path nextSoupPath = getFilePath("soup_next.bin");
+    const std::array<std::filesystem::path, 3> attributePaths{ getFilePath("positions.bin"), getFilePath("texcoords.bin"), getFilePath("normals.bin") };
+    constexpr std::array<uint32_t, 3> components{ 3, 2, 3 };
+
+    std::vector<FaceIndices> faceBlock(FILE_BLOCK_SIZE);
+    std::vector<SoupTriangle> soupBlock(FILE_BLOCK_SIZE);
+
+    // The first pass only writes the materials, vertices start zeroed
+    {
+        std::ifstream faces(facesPath, std::ios::binary);
+        std::ofstream soup(soupPath, std::ios::binary);
+        size_t count;
+        while ((count = readBlock(faces, faceBlock)) != 0)
+        {
+            for (size_t i = 0; i < count; i++)
+                soupBlock[i] = SoupTriangle{ {}, faceBlock[i].material };
+            writeBlock(soup, soupBlock, count);
+        }
+    }
+
+    const uint64_t chunkBytes = std::max<uint64_t>(m_memoryLimit / 2, 1 << 20);
+    uint32_t passes = 1;
+    for (uint8_t attribute = 0; attribute < 3; attribute++)
+    {
+        const uint64_t chunkSize = chunkBytes / (components[attribute] * sizeof(float));
+        std::ifstream values(attributePaths[attribute], std::ios::binary);
+        for (uint64_t first = 0; first < m_attributeCounts[attribute]; first += chunkSize)
+        {
+            const uint64_t last = std::min(first + chunkSize, m_attributeCounts[attribute]);
+            std::vector<float> chunk((last - first) * components[attribute]);
+            values.read(reinterpret_cast<char*>(chunk.data()), static_cast<std::streamsize>(chunk.size() * sizeof(float)));
+
+            {
+                std::ifstream faces(facesPath, std::ios::binary);
+                std::ifstream soupIn(soupPath, std::ios::binary);
+                std::ofstream soupOut(nextSoupPath, std::ios::binary);
+                size_t count;
+                while ((count = readBlock(faces, faceBlock)) != 0)
+                {
+                    readBlock(soupIn, soupBlock);
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        for (uint8_t corner = 0; corner < 3; corner++)
+                        {
+                            const int32_t index = faceBlock[i].corners[corner][attribute];
+                            if (index < 0 || static_cast<uint64_t>(index) < first || static_cast<uint64_t>(index) >= last)
+                                continue;
+                            const float* value = chunk.data() + (index - first) * components[attribute];
+                            Vertex& vertex = soupBlock[i].vertices[corner];
+                            if (attribute == 0)
+                                vertex.pos = { value[0], value[1], value[2] };
+                            else if (attribute == 1)
+                                vertex.texCoord = { value[0], 1.0f - value[1] };
+                            else
+                                vertex.normal = { value[0], value[1], value[2] };
+                        }
+                    }
+                    writeBlock(soupOut, soupBlock, count);
+                }
+            }
+            std::filesystem::rename(nextSoupPath, soupPath);
+            passes++;
+        }
+    }
+
+    for (const std::filesystem::path& path : attributePaths)
+        std::filesystem::remove(path);
+    std::filesystem::remove(facesPath);
+    LOG_INFO("Resolved vertices in ", passes, " passes");
+}
+
+// BUCKETS
+
+// Depths are tried from the top, the first one where the biggest bucket of every thread fits in memory is used
+// Triangles are counted in every cell their bounding box overlaps, which is a bit more than what the buckets will really get
+void OutOfCoreVoxelizer::chooseSplitDepth()
+{
+    const uint8_t maxSplit = std::min<uint8_t>(MAX_SPLIT_DEPTH, m_maxDepth > 1 ? m_maxDepth - 1 : 0);
+    std::vector<std::vector<uint32_t>> counts(maxSplit + 1);
+    for (uint8_t depth = 0; depth <= maxSplit; depth++)
+        counts[depth].resize(1ull << (3 * depth), 0);
+
+    std::ifstream soup(getFilePath("soup.bin"), std::ios::binary);
+    std::vector<SoupTriangle> block(FILE_BLOCK_SIZE);
+    size_t count;
+    while ((count = readBlock(soup, block)) != 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            const std::array<Vertex, 3>& vertices = block[i].vertices;
+            const glm::vec3 min = glm::min(vertices[0].pos, glm::min(vertices[1].pos, vertices[2].pos));
+            const glm::vec3 max = glm::max(vertices[0].pos, glm::max(vertices[1].pos, vertices[2].pos));
+            for (uint8_t depth = 0; depth <= maxSplit; depth++)
+            {
+                const glm::uvec3 minCell = getCellCoords(min, depth);
+                const glm::uvec3 maxCell = getCellCoords(max, depth);
+                for (uint32_t x = minCell.x; x <= maxCell.x; x++)
+                    for (uint32_t y = minCell.y; y <= maxCell.y; y++)
+                        for (uint32_t z = minCell.z; z <= maxCell.z; z++)
+                            counts[depth][mortonEncode({ x, y, z })]++;
+            }
+        }
+    }
+
+    // The root is never handed to the process function by Octree::generateParallel, so we split at least once when we can
+    m_splitDepth = maxSplit;
+    const size_t bucketBudget = m_memoryLimit / 2 / PARALLEL_BUCKETS;
+    for (uint8_t depth = std::min<uint8_t>(1, maxSplit); depth <= maxSplit; depth++)
+    {
+        const uint64_t biggestBucket = *std::max_element(counts[depth].begin(), counts[depth].end());
+        if (biggestBucket * BUCKET_TRIANGLE_BYTES <= bucketBudget)
+        {
+            m_splitDepth = depth;
+            break;
+        }
+    }
+    const uint64_t biggestBucket = *std::max_element(counts[m_splitDepth].begin(), counts[m_splitDepth].end());
+    if (biggestBucket * BUCKET_TRIANGLE_BYTES > bucketBudget)
+        LOG_WARN("The biggest bucket (", biggestBucket, " triangles) does not fit in the memory limit even at the deepest split");
+    LOG_INFO("Split depth ", static_cast<uint32_t>(m_splitDepth), ", biggest bucket has up to ", biggestBucket, " triangles");
+}
+
+// Every triangle goes to every bucket its node intersects. Each bucket keeps a small buffer in memory and appends it to its file when full
+void OutOfCoreVoxelizer::writeBuckets()
+{
+    const uint64_t bucketCount = 1ull << (3 * m_splitDepth);
+    const size_t bufferCapacity = std::clamp<size_t>(m_memoryLimit / 2 / (bucketCount * sizeof(SoupTriangle)), 1, FILE_BLOCK_SIZE);
+    std::vector<std::vector<SoupTriangle>> buffers(bucketCount);
+    std::vector<uint64_t> counts(bucketCount, 0);
+    const auto flush = [&](const uint64_t key)
+    {
+        std::ofstream bucket(getBucketPath(key), std::ios::binary | std::ios::app);
+        if (!bucket.is_open())
+            throw std::runtime_error("failed to write bucket file " + getBucketPath(key).string());
+        writeBlock(bucket, buffers[key], buffers[key].size());
+        buffers[key].clear();
+    };
+
+    const AABB root = getModelAABB();
+    const glm::vec3 rootMin = root.center - root.halfSize;
+    const float cellSize = root.halfSize * 2.0f / static_cast<float>(1u << m_splitDepth);
+
+    const std::filesystem::path soupPath = getFilePath("soup.bin");
+    {
+        std::ifstream soup(soupPath, std::ios::binary);
+        std::vector<SoupTriangle> block(FILE_BLOCK_SIZE);
+        size_t count;
+        while ((count = readBlock(soup, block)) != 0)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                const std::array<Vertex, 3>& vertices = block[i].vertices;
+                const glm::uvec3 minCell = getCellCoords(glm::min(vertices[0].pos, glm::min(vertices[1].pos, vertices[2].pos)), m_splitDepth);
+                const glm::uvec3 maxCell = getCellCoords(glm::max(vertices[0].pos, glm::max(vertices[1].pos, vertices[2].pos)), m_splitDepth);
+                for (uint32_t x = minCell.x; x <= maxCell.x; x++)
+                    for (uint32_t y = minCell.y; y <= maxCell.y; y++)
+                        for (uint32_t z = minCell.z; z <= maxCell.z; z++)
+                        {
+                            // The traversal computes the node bounds differently, so they are grown a little to never miss a triangle
+                            const AABB cell{ rootMin + (glm::vec3(x, y, z) + 0.5f) * cellSize, cellSize * 0.5f * 1.001f };
+                            if (!Voxelizer::intersectAABBTriangleSAT(vertices[0].pos, vertices[1].pos, vertices[2].pos, cell))
+                                continue;
+                            const uint64_t key = mortonEncode({ x, y, z });
+                            buffers[key].push_back(block[i]);
+                            counts[key]++;
+                            if (buffers[key].size() >= bufferCapacity)
+                                flush(key);
+                        }
+            }
+        }
+    }
+    std::filesystem::remove(soupPath);
+
+    uint64_t usedBuckets = 0;
+    m_bucketOffsets.assign(bucketCount + 1, 0);
+    for (uint64_t key = 0; key < bucketCount; key++)
+    {
+        if (!buffers[key].empty())
+            flush(key);
+        usedBuckets += counts[key] != 0;
+        m_bucketOffsets[key + 1] = m_bucketOffsets[key] + counts[key];
+    }
+    LOG_INFO("Binned ", m_triangleCount, " triangles into ", usedBuckets, " buckets (", m_bucketOffsets.back(), " references)");
+}
+
+std::unique_ptr<Voxelizer> OutOfCoreVoxelizer::loadBucket(const uint64_t key) const
+{
+    Model model{};
+    model.materials = m_materials;
+    model.meshes.resize(m_materials.size());
+
+    std::ifstream file(getBucketPath(key), std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("failed to read bucket file " + getBucketPath(key).string());
+    std::vector<SoupTriangle> block(FILE_BLOCK_SIZE);
+    size_t count;
+    while ((count = readBlock(file, block)) != 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            std::array<Vertex, 3>& vertices = block[i].vertices;
+            // Faces without normals take the one of the triangle
+            const glm::vec3 faceNormal = glm::cross(vertices[1].pos - vertices[0].pos, vertices[2].pos - vertices[0].pos);
+            const float faceNormalLength = glm::length(faceNormal);
+            Mesh& mesh = model.meshes[block[i].material < model.meshes.size() ? block[i].material : 0];
+            for (Vertex& vertex : vertices)
+            {
+                if (vertex.normal == glm::vec3(0.0f) && faceNormalLength > 0.0f)
+                    vertex.normal = faceNormal / faceNormalLength;
+                model.min = glm::min(model.min, vertex.pos);
+                model.max = glm::max(model.max, vertex.pos);
+                mesh.indices.push_back(static_cast<uint32_t>(mesh.vertices.size()));
+                mesh.vertices.push_back(vertex);
+            }
+        }
+    }
+
+    std::unique_ptr<Voxelizer> voxelizer = std::make_unique<Voxelizer>(std::move(model), m_baseDir, m_maxDepth);
+    voxelizer->setAreaFiltering(m_areaFiltering);
+    voxelizer->setAdaptiveDepth(m_adaptiveTolerance);
+    return voxelizer;
+}
+
+uint64_t OutOfCoreVoxelizer::getNodeKey(const AABB& shape, const uint8_t depth) const
+{
+    return mortonEncode(getCellCoords(shape.center, depth));
+}
+
+glm::uvec3 OutOfCoreVoxelizer::getCellCoords(const glm::vec3 point, const uint8_t depth) const
+{
+    const AABB root = getModelAABB();
+    const float cells = static_cast<float>(1u << depth);
+    const glm::vec3 coords = glm::floor((point - (root.center - root.halfSize)) / (root.halfSize * 2.0f) * cells);
+    return glm::uvec3(glm::clamp(coords, glm::vec3(0.0f), glm::vec3(cells - 1.0f)));
+}
+
+std::filesystem::path OutOfCoreVoxelizer::getBucketPath(const uint64_t key) const
+{
+    return m_workDir / ("bucket_" + std::to_string(key) + ".bin");
+}
+
+std::filesystem::path OutOfCoreVoxelizer::getFilePath(const char* name) const
+{
+    return m_workDir / name;
+}
+
+// VOXELIZATION GLOBAL FUNCTION
+
+NodeRef OutOfCoreVoxelizer::voxelize(const AABB& nodeShape, const uint8_t depth, const uint8_t maxDepth, void* data)
+{
+    return OutOfCoreVoxelizer::parallelVoxelize(nodeShape, depth, maxDepth, data, 0);
+}
+
+// Above the split depth a node exists if any bucket below it has triangles. At the split depth the bucket of the node replaces
+// the one this thread had loaded, and from there on the bucket voxelizes its subtree like the Voxelizer does with the whole model
+NodeRef OutOfCoreVoxelizer::parallelVoxelize(const AABB& nodeShape, const uint8_t depth, const uint8_t maxDepth, void* data, const uint8_t parallelIndex)
+{
+    OutOfCoreVoxelizer& voxelizer = *static_cast<OutOfCoreVoxelizer*>(data);
+    // Children of the root processed by Octree::generateParallel start at depth 0, so the real depth of the node comes from its size
+    const uint8_t nodeDepth = static_cast<uint8_t>(std::lround(std::log2(voxelizer.getModelAABB().halfSize / nodeShape.halfSize)));
+    std::unique_ptr<Voxelizer>& bucket = voxelizer.m_buckets[parallelIndex];
+    if (nodeDepth <= voxelizer.m_splitDepth)
+    {
+        const uint8_t shift = 3 * (voxelizer.m_splitDepth - nodeDepth);
+        const uint64_t key = voxelizer.getNodeKey(nodeShape, nodeDepth);
+        NodeRef nodeRef{};
+        nodeRef.exists = voxelizer.m_bucketOffsets[(key + 1) << shift] != voxelizer.m_bucketOffsets[key << shift];
+        if (!nodeRef.exists || nodeDepth < voxelizer.m_splitDepth)
+            return nodeRef;
+
+        bucket.reset();
+        bucket = voxelizer.loadBucket(key);
+    }
+    return Voxelizer::parallelVoxelize(nodeShape, depth, maxDepth, bucket.get(), parallelIndex);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <array>
+#include <cfloat>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "voxelizer.hpp"
+
+// OUT OF CORE VOXELIZATION
+
+// Voxelizes models that don't fit in memory. The OBJ file is streamed once and its triangles are binned into files on disk,
+// one bucket per node at the split depth. During the traversal a bucket is loaded into a regular Voxelizer when its node is reached
+// and dropped when the next one is, so each thread only keeps one bucket in memory at a time
+// The memory limit covers the model data (buckets, vertex chunks and file buffers), not the octree being generated
+class OutOfCoreVoxelizer
+{
+public:
+    // Temporary files are written to a new directory inside workDir, the system temporary directory if empty
+    OutOfCoreVoxelizer(const std::string& filename, uint8_t maxDepth, size_t memoryLimit, const std::filesystem::path& workDir = {});
+    ~OutOfCoreVoxelizer();
+
+    OutOfCoreVoxelizer(const OutOfCoreVoxelizer&) = delete;
+    OutOfCoreVoxelizer& operator=(const OutOfCoreVoxelizer&) = delete;
+
+    [[nodiscard]] AABB getModelAABB() const;
+    [[nodiscard]] const std::vector<Material>& getMaterials() const;
+    [[nodiscard]] std::string getMaterialFilePath() const;
+    [[nodiscard]] uint8_t getSplitDepth() const;
+
+    void setAreaFiltering(bool enabled);
+    void setAdaptiveDepth(float tolerance);
+
+    static NodeRef voxelize(const AABB& nodeShape, uint8_t depth, uint8_t maxDepth, void* data);
+    static NodeRef parallelVoxelize(const AABB& nodeShape, uint8_t depth, uint8_t maxDepth, void* data, uint8_t parallelIndex);
+
+private:
+    // Triangle with all of its vertex data, the format of the intermediate files and the buckets
+    struct SoupTriangle
+    {
+        std::array<Vertex, 3> vertices{};
+        uint32_t material = 0;
+    };
+
+    // Face as read from the file, each corner has the index of its position, texture coordinate and normal (-1 if missing)
+    struct FaceIndices
+    {
+        std::array<glm::ivec3, 3> corners{};
+        uint32_t material = 0;
+    };
+
+    void streamModel(const std::string& filename);
+    void resolveVertices();
+    void chooseSplitDepth();
+    void writeBuckets();
+
+    [[nodiscard]] std::unique_ptr<Voxelizer> loadBucket(uint64_t key) const;
+    [[nodiscard]] uint64_t getNodeKey(const AABB& shape, uint8_t depth) const;
+    [[nodiscard]] glm::uvec3 getCellCoords(glm::vec3 point, uint8_t depth) const;
+    [[nodiscard]] std::filesystem::path getBucketPath(uint64_t key) const;
+    [[nodiscard]] std::filesystem::path getFilePath(const char* name) const;
+
+    std::filesystem::path m_workDir;
+    std::string m_baseDir;
+    std::vector<Material> m_materials;
+    glm::vec3 m_min{ FLT_MAX };
+    glm::vec3 m_max{ -FLT_MAX };
+
+    uint8_t m_maxDepth;
+    uint8_t m_splitDepth = 0;
+    size_t m_memoryLimit;
+    bool m_areaFiltering = false;
+    float m_adaptiveTolerance = 0.0f;
+
+    // Positions, texture coordinates and normals read from the file, and the amount of triangles after triangulating the faces
+    std::array<uint64_t, 3> m_attributeCounts{};
+    uint64_t m_triangleCount = 0;
+
+    // Prefix sum of the triangles in each bucket, in morton order. All buckets below a node are a contiguous range of it
+    std::vector<uint64_t> m_bucketOffsets;
+    std::array<std::unique_ptr<Voxelizer>, 8> m_buckets;
+};
@@ -0,0 +1,680 @@
+#include "procedural.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include <stb_image.h>
+
+#include "utils/logger.hpp"
+
+static AABB createCube(const glm::vec3 min, const glm::vec3 max)
+{
+    const glm::vec3 extent = max - min;
+    return { (min + max) * 0.5f, std::max({ extent.x, extent.y, extent.z }) * 0.5f };
+}
+
+// PROCEDURAL SOURCE
+
+float ProceduralSource::getLipschitz() const
+{
+    return 1.0f;
+}
+
+glm::vec3 ProceduralSource::getNormal(const glm::vec3 point) const
+{
+    const float epsilon = getBounds().halfSize * 1e-4f;
+    const glm::vec3 gradient{
+        distance(point + glm::vec3(epsilon, 0, 0)) - distance(point - glm::vec3(epsilon, 0, 0)),
+        distance(point + glm::vec3(0, epsilon, 0)) - distance(point - glm::vec3(0, epsilon, 0)),
+        distance(point + glm::vec3(0, 0, epsilon)) - distance(point - glm::vec3(0, 0, epsilon))
+    };
+    const float length = glm::length(gradient);
+    return length > 0.0f ? gradient / length : glm::vec3(0, 1, 0);
+}
+
+uint16_t ProceduralSource::getMaterial(glm::vec3) const
+{
+    return 0;
+}
+
+Coverage ProceduralSource::classify(const AABB& shape) const
+{
+    // The farthest point of the node is at halfSize * sqrt(3) from the center
+    // If the distance can't change sign in that radius, the surface doesn't cross the node
+    const float bound = shape.halfSize * 1.7320508f * getLipschitz();
+    const float centerDistance = distance(shape.center);
+    if (centerDistance > bound)
+        return Coverage::EMPTY;
+    if (centerDistance < -bound)
+        return Coverage::FULL;
+    return Coverage::MIXED;
+}
+
+bool ProceduralSource::crossesSurface(const AABB& shape) const
+{
+    bool inside = false;
+    bool outside = false;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        const glm::vec3 corner = shape.center + glm::vec3(i & 4 ? 1 : -1, i & 2 ? 1 : -1, i & 1 ? 1 : -1) * shape.halfSize;
+        const float cornerDistance = distance(corner);
+        inside |= cornerDistance <= 0.0f;
+        outside |= cornerDistance >= 0.0f;
+    }
+    return inside && outside;
+}
+
+void ProceduralSource::setSolid(const bool solid)
+{
+    m_solid = solid;
+}
+
+NodeRef ProceduralSource::process(const AABB& nodeShape, const uint8_t depth, const uint8_t maxDepth, void* data)
+{
+    return ProceduralSource::parallelProcess(nodeShape, depth, maxDepth, data, 0);
+}
+
+// Sources are never modified during the generation, so there is nothing per thread
+NodeRef ProceduralSource::parallelProcess(const AABB& nodeShape, const uint8_t depth, const uint8_t maxDepth, void* data, uint8_t)
+{
+    const ProceduralSource& source = *static_cast<const ProceduralSource*>(data);
+    NodeRef nodeRef{};
+    nodeRef.isLeaf = depth >= maxDepth;
+    const Coverage coverage = source.classify(nodeShape);
+    // Full nodes only matter if the source is solid, and then the whole subtree collapses into a single leaf
+    if (coverage == Coverage::FULL && source.m_solid)
+    {
+        nodeRef.exists = true;
+        nodeRef.isLeaf = true;
+    }
+    else
+        nodeRef.exists = coverage == Coverage::MIXED;
+
+    // The bound is conservative, loose sources (like the noise) would generate a very thick shell with it
+    // so leaves are only kept if the sign changes between their corners
+    if (nodeRef.exists && nodeRef.isLeaf && coverage == Coverage::MIXED)
+        nodeRef.exists = source.crossesSurface(nodeShape);
+
+    if (nodeRef.exists && nodeRef.isLeaf)
+    {
+        LeafNode leafNode{ 0 };
+        leafNode.setNormal(source.getNormal(nodeShape.center));
+        leafNode.setMaterial(source.getMaterial(nodeShape.center));
+        auto [leaf1, leaf2] = leafNode.split();
+        nodeRef.data1 = leaf1.toRaw();
+        nodeRef.data2 = leaf2.toRaw();
+    }
+    return nodeRef;
+}
+
+// SIGNED DISTANCE FUNCTIONS
+
+SdfSphere::SdfSphere(const glm::vec3 center, const float radius, const uint16_t material)
+    : m_center(center), m_radius(radius), m_material(material)
+{
+
+}
+
+float SdfSphere::distance(const glm::vec3 point) const
+{
+    return glm::length(point - m_center) - m_radius;
+}
+
+AABB SdfSphere::getBounds() const
+{
+    return { m_center, m_radius };
+}
+
+glm::vec3 SdfSphere::getNormal(const glm::vec3 point) const
+{
+    const glm::vec3 offset = point - m_center;
+    const float length = glm::length(offset);
+    return length > 0.0f ? offset / length : glm::vec3(0, 1, 0);
+}
+
+uint16_t SdfSphere::getMaterial(glm::vec3) const
+{
+    return m_material;
+}
+
+SdfBox::SdfBox(const glm::vec3 center, const glm::vec3 halfExtents, const uint16_t material)
+    : m_center(center), m_halfExtents(halfExtents), m_material(material)
+{
+
+}
+
+float SdfBox::distance(const glm::vec3 point) const
+{
+    const glm::vec3 q = glm::abs(point - m_center) - m_halfExtents;
+    return glm::length(glm::max(q, glm::vec3(0.0f))) + std::min(std::max({ q.x, q.y, q.z }), 0.0f);
+}
+
+AABB SdfBox::getBounds() const
+{
+    return createCube(m_center - m_halfExtents, m_center + m_halfExtents);
+}
+
+glm::vec3 SdfBox::getNormal(const glm::vec3 point) const
+{
+    const glm::vec3 offset = point - m_center;
+    const glm::vec3 q = glm::abs(offset) - m_halfExtents;
+    const glm::vec3 side{ offset.x < 0 ? -1.0f : 1.0f, offset.y < 0 ? -1.0f : 1.0f, offset.z < 0 ? -1.0f : 1.0f };
+    // Outside, the closest point is in the direction of the axes we are out of. Inside, it is the closest face
+    const glm::vec3 outside = glm::max(q, glm::vec3(0.0f));
+    const float length = glm::length(outside);
+    if (length > 0.0f)
+        return outside / length * side;
+    if (q.x >= q.y && q.x >= q.z)
+        return { side.x, 0, 0 };
+    if (q.y >= q.z)
+        return { 0, side.y, 0 };
+    return { 0, 0, side.z };
+}
+
+uint16_t SdfBox::getMaterial(glm::vec3) const
+{
+    return m_material;
+}
+
+SdfOperation::SdfOperation(const Type type, std::shared_ptr<ProceduralSource> first, std::shared_ptr<ProceduralSource> second)
+    : m_type(type), m_first(std::move(first)), m_second(std::move(second))
+{
+
+}
+
+float SdfOperation::distance(const glm::vec3 point) const
+{
+    const float first = m_first->distance(point);
+    const float second = m_second->distance(point);
+    switch (m_type)
+    {
+    case Type::UNION:
+        return std::min(first, second);
+    case Type::INTERSECTION:
+        return std::max(first, second);
+    case Type::SUBTRACTION:
+        return std::max(first, -second);
+    }
+    return first;
+}
+
+AABB SdfOperation::getBounds() const
+{
+    const AABB first = m_first->getBounds();
+    const AABB second = m_second->getBounds();
+    const glm::vec3 firstMin = first.center - first.halfSize;
+    const glm::vec3 firstMax = first.center + first.halfSize;
+    const glm::vec3 secondMin = second.center - second.halfSize;
+    const glm::vec3 secondMax = second.center + second.halfSize;
+    switch (m_type)
+    {
+    case Type::UNION:
+        return createCube(glm::min(firstMin, secondMin), glm::max(firstMax, secondMax));
+    case Type::INTERSECTION:
+    {
+        const glm::vec3 min = glm::max(firstMin, secondMin);
+        const glm::vec3 max = glm::min(firstMax, secondMax);
+        if (min.x < max.x && min.y < max.y && min.z < max.z)
+            return createCube(min, max);
+        return first;
+    }
+    case Type::SUBTRACTION:
+        return first;
+    }
+    return first;
+}
+
+float SdfOperation::getLipschitz() const
+{
+    return std::max(m_first->getLipschitz(), m_second->getLipschitz());
+}
+
+glm::vec3 SdfOperation::getNormal(const glm::vec3 point) const
+{
+    if (!isSecondActive(point))
+        return m_first->getNormal(point);
+    return m_type == Type::SUBTRACTION ? -m_second->getNormal(point) : m_second->getNormal(point);
+}
+
+// The carved surface of a subtraction takes the material of the operand that carves it
+uint16_t SdfOperation::getMaterial(const glm::vec3 point) const
+{
+    return isSecondActive(point) ? m_second->getMaterial(point) : m_first->getMaterial(point);
+}
+
+Coverage SdfOperation::classify(const AABB& shape) const
+{
+    const Coverage first = m_first->classify(shape);
+    if (m_type == Type::INTERSECTION && first == Coverage::EMPTY)
+        return Coverage::EMPTY;
+    if (m_type == Type::SUBTRACTION && first == Coverage::EMPTY)
+        return Coverage::EMPTY;
+    if (m_type == Type::UNION && first == Coverage::FULL)
+        return Coverage::FULL;
+
+    const Coverage second = m_second->classify(shape);
+    switch (m_type)
+    {
+    case Type::UNION:
+        if (second == Coverage::FULL)
+            return Coverage::FULL;
+        return first == Coverage::EMPTY && second == Coverage::EMPTY ? Coverage::EMPTY : Coverage::MIXED;
+    case Type::INTERSECTION:
+        if (second == Coverage::EMPTY)
+            return Coverage::EMPTY;
+        return first == Coverage::FULL && second == Coverage::FULL ? Coverage::FULL : Coverage::MIXED;
+    case Type::SUBTRACTION:
+        if (second == Coverage::FULL)
+            return Coverage::EMPTY;
+        return first == Coverage::FULL && second == Coverage::EMPTY ? Coverage::FULL : Coverage::MIXED;
+    }
+    return Coverage::MIXED;
+}
+
+bool SdfOperation::isSecondActive(const glm::vec3 point) const
+{
+    const float first = m_first->distance(point);
+    const float second = m_second->distance(point);
+    switch (m_type)
+    {
+    case Type::UNION:
+        return second < first;
+    case Type::INTERSECTION:
+        return second > first;
+    case Type::SUBTRACTION:
+        return -second > first;
+    }
+    return false;
+}
+
+// HEIGHTMAP TERRAIN
+
+HeightmapSource::HeightmapSource(std::vector<float> heights, const uint32_t width, const uint32_t depth, const float size, const uint16_t material)
+    : m_heights(std::move(heights)), m_width(width), m_depth(depth), m_material(material)
+{
+    if (m_width < 2 || m_depth < 2 || m_heights.size() != static_cast<size_t>(m_width) * m_depth)
+        throw std::runtime_error("heightmap needs at least 2x2 samples and one height per sample");
+
+    m_cellSize = size / static_cast<float>(std::max(m_width, m_depth) - 1);
+    m_origin = -glm::vec2(static_cast<float>(m_width - 1), static_cast<float>(m_depth - 1)) * m_cellSize * 0.5f;
+
+    // The bilinear surface of a cell never leaves the range of its four samples, so those are the first level of the pyramid
+    PyramidLevel base{ m_width - 1, m_depth - 1, {} };
+    base.minMax.resize(static_cast<size_t>(base.width) * base.depth);
+    for (uint32_t z = 0; z < base.depth; z++)
+    {
+        for (uint32_t x = 0; x < base.width; x++)
+        {
+            const float h00 = getSample(x, z);
+            const float h10 = getSample(x + 1, z);
+            const float h01 = getSample(x, z + 1);
+            const float h11 = getSample(x + 1, z + 1);
+            base.minMax[z * base.width + x] = { std::min({ h00, h10, h01, h11 }), std::max({ h00, h10, h01, h11 }) };
+            const float slopeX = std::max(std::abs(h10 - h00), std::abs(h11 - h01)) / m_cellSize;
+            const float slopeZ = std::max(std::abs(h01 - h00), std::abs(h11 - h10)) / m_cellSize;
+            m_maxSlope = std::max(m_maxSlope, std::sqrt(slopeX * slopeX + slopeZ * slopeZ));
+        }
+    }
+    m_pyramid.push_back(std::move(base));
+
+    while (m_pyramid.back().width > 1 || m_pyramid.back().depth > 1)
+    {
+        const PyramidLevel& previous = m_pyramid.back();
+        PyramidLevel level{ (previous.width + 1) / 2, (previous.depth + 1) / 2, {} };
+        level.minMax.assign(static_cast<size_t>(level.width) * level.depth, { FLT_MAX, -FLT_MAX });
+        for (uint32_t z = 0; z < previous.depth; z++)
+        {
+            for (uint32_t x = 0; x < previous.width; x++)
+            {
+                const glm::vec2 child = previous.minMax[z * previous.width + x];
+                glm::vec2& parent = level.minMax[(z / 2) * level.width + x / 2];
+                parent = { std::min(parent.x, child.x), std::max(parent.y, child.y) };
+            }
+        }
+        m_pyramid.push_back(std::move(level));
+    }
+}
+
+std::shared_ptr<HeightmapSource> HeightmapSource::fromImage(const std::string_view path, const float size, const float heightScale, const uint16_t material)
+{
+    int width, depth, channels;
+    stbi_uc* pixels = stbi_load(std::string(path).c_str(), &width, &depth, &channels, STBI_grey);
+    if (!pixels)
+        throw std::runtime_error("failed to load heightmap image " + std::string(path));
+
+    std::vector<float> heights(static_cast<size_t>(width) * depth);
+    for (size_t i = 0; i < heights.size(); i++)
+        heights[i] = static_cast<float>(pixels[i]) / 255.0f * heightScale;
+    stbi_image_free(pixels);
+    return std::make_shared<HeightmapSource>(std::move(heights), width, depth, size, material);
+}
+
+float HeightmapSource::distance(const glm::vec3 point) const
+{
+    return point.y - getHeight(point.x, point.z);
+}
+
+// The terrain sits at the bottom of the cube, nothing below the lowest sample is part of the octree
+AABB HeightmapSource::getBounds() const
+{
+    const glm::vec2 range = m_pyramid.back().minMax[0];
+    const glm::vec2 extent = glm::vec2(static_cast<float>(m_width - 1), static_cast<float>(m_depth - 1)) * m_cellSize;
+    const float halfSize = std::max({ extent.x, extent.y, range.y - range.x }) * 0.5f;
+    return { { m_origin.x + extent.x * 0.5f, range.x + halfSize, m_origin.y + extent.y * 0.5f }, halfSize };
+}
+
+// distance() is measured vertically, its gradient is (-dh/dx, 1, -dh/dz)
+float HeightmapSource::getLipschitz() const
+{
+    return std::sqrt(1.0f + m_maxSlope * m_maxSlope);
+}
+
+glm::vec3 HeightmapSource::getNormal(const glm::vec3 point) const
+{
+    const float fx = std::clamp((point.x - m_origin.x) / m_cellSize, 0.0f, static_cast<float>(m_width - 1));
+    const float fz = std::clamp((point.z - m_origin.y) / m_cellSize, 0.0f, static_cast<float>(m_depth - 1));
+    const uint32_t x = std::min(static_cast<uint32_t>(fx), m_width - 2);
+    const uint32_t z = std::min(static_cast<uint32_t>(fz), m_depth - 2);
+    const float tx = fx - static_cast<float>(x);
+    const float tz = fz - static_cast<float>(z);
+    const float h00 = getSample(x, z);
+    const float h10 = getSample(x + 1, z);
+    const float h01 = getSample(x, z + 1);
+    const float h11 = getSample(x + 1, z + 1);
+    const float dhdx = ((h10 - h00) * (1.0f - tz) + (h11 - h01) * tz) / m_cellSize;
+    const float dhdz = ((h01 - h00) * (1.0f - tx) + (h11 - h10) * tx) / m_cellSize;
+    return glm::normalize(glm::vec3(-dhdx, 1.0f, -dhdz));
+}
+
+uint16_t HeightmapSource::getMaterial(glm::vec3) const
+{
+    return m_material;
+}
+
+Coverage HeightmapSource::classify(const AABB& shape) const
+{
+    const PyramidLevel& base = m_pyramid.front();
+    const float x0 = (shape.center.x - shape.halfSize - m_origin.x) / m_cellSize;
+    const float x1 = (shape.center.x + shape.halfSize - m_origin.x) / m_cellSize;
+    const float z0 = (shape.center.z - shape.halfSize - m_origin.y) / m_cellSize;
+    const float z1 = (shape.center.z + shape.halfSize - m_origin.y) / m_cellSize;
+    if (x1 < 0.0f || z1 < 0.0f || x0 > static_cast<float>(base.width) || z0 > static_cast<float>(base.depth))
+        return Coverage::EMPTY;
+
+    uint32_t minX = static_cast<uint32_t>(std::clamp(x0, 0.0f, static_cast<float>(base.width - 1)));
+    uint32_t maxX = static_cast<uint32_t>(std::clamp(x1, 0.0f, static_cast<float>(base.width - 1)));
+    uint32_t minZ = static_cast<uint32_t>(std::clamp(z0, 0.0f, static_cast<float>(base.depth - 1)));
+    uint32_t maxZ = static_cast<uint32_t>(std::clamp(z1, 0.0f, static_cast<float>(base.depth - 1)));
+
+    // Go up the pyramid until the node covers at most 2x2 cells of the level
+    size_t level = 0;
+    while (level + 1 < m_pyramid.size() && (maxX - minX > 1 || maxZ - minZ > 1))
+    {
+        minX /= 2;
+        maxX /= 2;
+        minZ /= 2;
+        maxZ /= 2;
+        level++;
+    }
+
+    const PyramidLevel& pyramidLevel = m_pyramid[level];
+    glm::vec2 range{ FLT_MAX, -FLT_MAX };
+    for (uint32_t z = minZ; z <= maxZ; z++)
+    {
+        for (uint32_t x = minX; x <= maxX; x++)
+        {
+            const glm::vec2 cell = pyramidLevel.minMax[z * pyramidLevel.width + x];
+            range = { std::min(range.x, cell.x), std::max(range.y, cell.y) };
+        }
+    }
+
+    if (shape.center.y - shape.halfSize > range.y)
+        return Coverage::EMPTY;
+    if (shape.center.y + shape.halfSize < range.x)
+        return Coverage::FULL;
+    return Coverage::MIXED;
+}
+
+float HeightmapSource::getHeight(const float x, const float z) const
+{
+    const float fx = std::clamp((x - m_origin.x) / m_cellSize, 0.0f, static_cast<float>(m_width - 1));
+    const float fz = std::clamp((z - m_origin.y) / m_cellSize, 0.0f, static_cast<float>(m_depth - 1));
+    const uint32_t cellX = std::min(static_cast<uint32_t>(fx), m_width - 2);
+    const uint32_t cellZ = std::min(static_cast<uint32_t>(fz), m_depth - 2);
+    const float tx = fx - static_cast<float>(cellX);
+    const float tz = fz - static_cast<float>(cellZ);
+    const float front = getSample(cellX, cellZ) * (1.0f - tx) + getSample(cellX + 1, cellZ) * tx;
+    const float back = getSample(cellX, cellZ + 1) * (1.0f - tx) + getSample(cellX + 1, cellZ + 1) * tx;
+    return front * (1.0f - tz) + back * tz;
+}
+
+float HeightmapSource::getSample(const uint32_t x, const uint32_t z) const
+{
+    return m_heights[static_cast<size_t>(z) * m_width + x];
+}
+
+// NOISE
+
+static float getLatticeValue(const int32_t x, const int32_t y, const int32_t z, const uint32_t seed)
+{
+    uint32_t hash = seed;
+    hash ^= static_cast<uint32_t>(x) * 0x8DA6B343u;
+    hash ^= static_cast<uint32_t>(y) * 0xD8163841u;
+    hash ^= static_cast<uint32_t>(z) * 0xCB1AB31Fu;
+    hash ^= hash >> 13;
+    hash *= 0x5BD1E995u;
+    hash ^= hash >> 15;
+    return static_cast<float>(hash & 0xFFFFFF) / static_cast<float>(0xFFFFFF) * 2.0f - 1.0f;
+}
+
+// Trilinear interpolation of random values in [-1, 1] with a smoothstep fade
+// The fade derivative is at most 1.5 and two lattice values differ at most by 2, so every partial derivative is at most 3
+static glm::vec4 getValueNoise(const glm::vec3 point, const uint32_t seed)
+{
+    const glm::vec3 cell = glm::floor(point);
+    const glm::vec3 f = point - cell;
+    const glm::vec3 u = f * f * (3.0f - 2.0f * f);
+    const glm::vec3 du = 6.0f * f * (1.0f - f);
+    const int32_t x = static_cast<int32_t>(cell.x);
+    const int32_t y = static_cast<int32_t>(cell.y);
+    const int32_t z = static_cast<int32_t>(cell.z);
+
+    const float v000 = getLatticeValue(x, y, z, seed);
+    const float v100 = getLatticeValue(x + 1, y, z, seed);
+    const float v010 = getLatticeValue(x, y + 1, z, seed);
+    const float v110 = getLatticeValue(x + 1, y + 1, z, seed);
+    const float v001 = getLatticeValue(x, y, z + 1, seed);
+    const float v101 = getLatticeValue(x + 1, y, z + 1, seed);
+    const float v011 = getLatticeValue(x, y + 1, z + 1, seed);
+    const float v111 = getLatticeValue(x + 1, y + 1, z + 1, seed);
+
+    const float k1 = v100 - v000;
+    const float k2 = v010 - v000;
+    const float k3 = v001 - v000;
+    const float k4 = v000 - v100 - v010 + v110;
+    const float k5 = v000 - v010 - v001 + v011;
+    const float k6 = v000 - v100 - v001 + v101;
+    const float k7 = -v000 + v100 + v010 - v110 + v001 - v101 - v011 + v111;
+
+    const float value = v000 + k1 * u.x + k2 * u.y + k3 * u.z + k4 * u.x * u.y + k5 * u.y * u.z + k6 * u.z * u.x + k7 * u.x * u.y * u.z;
+    const glm::vec3 gradient = du * glm::vec3(
+        k1 + k4 * u.y + k6 * u.z + k7 * u.y * u.z,
+        k2 + k5 * u.z + k4 * u.x + k7 * u.z * u.x,
+        k3 + k6 * u.x + k5 * u.y + k7 * u.x * u.y);
+    return { value, gradient.x, gradient.y, gradient.z };
+}
+
+// Range of the noise inside a cube of the given radius in lattice units
+// The interpolation never leaves the range of the lattice values it blends, and the derivatives bound how far the value can move from the center
+static glm::vec2 getValueNoiseRange(const glm::vec3 point, const float radius, const uint32_t seed)
+{
+    const float center = getValueNoise(point, seed).x;
+    glm::vec2 range{ std::max(center - 9.0f * radius, -1.0f), std::min(center + 9.0f * radius, 1.0f) };
+    const glm::ivec3 minCell = glm::ivec3(glm::floor(point - radius));
+    const glm::ivec3 maxCell = glm::ivec3(glm::floor(point + radius)) + 1;
+    const glm::ivec3 span = maxCell - minCell;
+    if (span.x > 2 || span.y > 2 || span.z > 2)
+        return range;
+
+    glm::vec2 latticeRange{ FLT_MAX, -FLT_MAX };
+    for (int32_t z = minCell.z; z <= maxCell.z; z++)
+        for (int32_t y = minCell.y; y <= maxCell.y; y++)
+            for (int32_t x = minCell.x; x <= maxCell.x; x++)
+            {
+                const float value = getLatticeValue(x, y, z, seed);
+                latticeRange = { std::min(latticeRange.x, value), std::max(latticeRange.y, value) };
+            }
+    return { std::max(range.x, latticeRange.x), std::min(range.y, latticeRange.y) };
+}
+
+NoiseSource::NoiseSource(const AABB bounds, const uint32_t seed, const float frequency, const uint8_t octaves, const float threshold, const uint16_t material)
+    : m_bounds(bounds), m_seed(seed), m_frequency(frequency), m_octaves(std::max<uint8_t>(octaves, 1)), m_threshold(threshold), m_material(material)
+{
+
+}
+
+float NoiseSource::distance(const glm::vec3 point) const
+{
+    return m_threshold - fractalNoise(point * m_frequency, m_seed, m_octaves).x;
+}
+
+AABB NoiseSource::getBounds() const
+{
+    return m_bounds;
+}
+
+// Each octave has half the amplitude and twice the frequency, so all of them add the same slope before normalizing
+float NoiseSource::getLipschitz() const
+{
+    float amplitude = 1.0f;
+    float amplitudeSum = 0.0f;
+    for (uint8_t i = 0; i < m_octaves; i++)
+    {
+        amplitudeSum += amplitude;
+        amplitude *= 0.5f;
+    }
+    return 3.0f * 1.7320508f * m_frequency * static_cast<float>(m_octaves) / amplitudeSum;
+}
+
+// Interval arithmetic over the octaves, each one adds its own range scaled by its amplitude
+Coverage NoiseSource::classify(const AABB& shape) const
+{
+    glm::vec2 range{ 0.0f };
+    float amplitude = 1.0f;
+    float frequency = m_frequency;
+    float amplitudeSum = 0.0f;
+    for (uint8_t i = 0; i < m_octaves; i++)
+    {
+        range += getValueNoiseRange(shape.center * frequency, shape.halfSize * frequency, m_seed + i * 0x9E3779B9u) * amplitude;
+        amplitudeSum += amplitude;
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+    range /= amplitudeSum;
+    if (range.y < m_threshold)
+        return Coverage::EMPTY;
+    if (range.x > m_threshold)
+        return Coverage::FULL;
+    return Coverage::MIXED;
+}
+
+glm::vec3 NoiseSource::getNormal(const glm::vec3 point) const
+{
+    const glm::vec4 noise = fractalNoise(point * m_frequency, m_seed, m_octaves);
+    const glm::vec3 gradient = -glm::vec3(noise.y, noise.z, noise.w);
+    const float length = glm::length(gradient);
+    return length > 0.0f ? gradient / length : glm::vec3(0, 1, 0);
+}
+
+uint16_t NoiseSource::getMaterial(glm::vec3) const
+{
+    return m_material;
+}
+
+glm::vec4 NoiseSource::fractalNoise(const glm::vec3 point, const uint32_t seed, const uint8_t octaves)
+{
+    glm::vec4 result{ 0.0f };
+    float amplitude = 1.0f;
+    float frequency = 1.0f;
+    float amplitudeSum = 0.0f;
+    for (uint8_t i = 0; i < octaves; i++)
+    {
+        const glm::vec4 noise = getValueNoise(point * frequency, seed + i * 0x9E3779B9u);
+        result.x += noise.x * amplitude;
+        result.y += noise.y * amplitude * frequency;
+        result.z += noise.z * amplitude * frequency;
+        result.w += noise.w * amplitude * frequency;
+        amplitudeSum += amplitude;
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+    return result / amplitudeSum;
+}
+
+// SCENES
+
+static Octree::Material createMaterial(const glm::vec3 color)
+{
+    Octree::Material material{};
+    material.ambient = color;
+    material.diffuse = color;
+    material.specular = glm::vec3(0.5f);
+    material.specularComp = 32.0f;
+    return material;
+}
+
+ProceduralScene createProceduralScene(const std::string_view name)
+{
+    ProceduralScene scene{};
+    if (name == "sphere")
+    {
+        scene.source = std::make_shared<SdfSphere>(glm::vec3(0.0f), 1.0f);
+        scene.materials.push_back(createMaterial({ 0.8f, 0.8f, 0.8f }));
+    }
+    else if (name == "csg")
+    {
+        // Rounded cube with a square hole through every axis
+        const std::shared_ptr<ProceduralSource> body = std::make_shared<SdfOperation>(SdfOperation::Type::INTERSECTION,
+            std::make_shared<SdfBox>(glm::vec3(0.0f), glm::vec3(0.75f), 0),
+            std::make_shared<SdfSphere>(glm::vec3(0.0f), 1.0f, 1));
+        const std::shared_ptr<ProceduralSource> holes = std::make_shared<SdfOperation>(SdfOperation::Type::UNION,
+            std::make_shared<SdfBox>(glm::vec3(0.0f), glm::vec3(1.0f, 0.35f, 0.35f), 2),
+            std::make_shared<SdfOperation>(SdfOperation::Type::UNION,
+                std::make_shared<SdfBox>(glm::vec3(0.0f), glm::vec3(0.35f, 1.0f, 0.35f), 2),
+                std::make_shared<SdfBox>(glm::vec3(0.0f), glm::vec3(0.35f, 0.35f, 1.0f), 2)));
+        scene.source = std::make_shared<SdfOperation>(SdfOperation::Type::SUBTRACTION, body, holes);
+        scene.materials.push_back(createMaterial({ 0.9f, 0.5f, 0.2f }));
+        scene.materials.push_back(createMaterial({ 0.2f, 0.4f, 0.9f }));
+        scene.materials.push_back(createMaterial({ 0.9f, 0.9f, 0.9f }));
+    }
+    else if (name == "terrain")
+    {
+        constexpr uint32_t resolution = 1024;
+        std::vector<float> heights(static_cast<size_t>(resolution) * resolution);
+        for (uint32_t z = 0; z < resolution; z++)
+            for (uint32_t x = 0; x < resolution; x++)
+            {
+                const glm::vec3 point{ static_cast<float>(x) / 128.0f, 0.5f, static_cast<float>(z) / 128.0f };
+                heights[z * resolution + x] = (NoiseSource::fractalNoise(point, 7, 8).x * 0.5f + 0.5f) * 0.5f;
+            }
+        scene.source = std::make_shared<HeightmapSource>(std::move(heights), resolution, resolution, 2.0f);
+        scene.materials.push_back(createMaterial({ 0.4f, 0.6f, 0.3f }));
+    }
+    else if (name == "noise")
+    {
+        scene.source = std::make_shared<SdfOperation>(SdfOperation::Type::INTERSECTION,
+            std::make_shared<NoiseSource>(AABB{ glm::vec3(0.0f), 1.0f }, 1337, 1.0f, 4, 0.1f),
+            std::make_shared<SdfSphere>(glm::vec3(0.0f), 1.0f));
+        scene.materials.push_back(createMaterial({ 0.7f, 0.6f, 0.5f }));
+    }
+    else
+    {
+        LOG_INFO("Unknown procedural scene, loading ", name, " as a heightmap");
+        scene.source = HeightmapSource::fromImage(name, 2.0f, 0.5f);
+        scene.materials.push_back(createMaterial({ 0.4f, 0.6f, 0.3f }));
+    }
+    return scene;
+}
@@ -0,0 +1,195 @@
+#pragma once
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "octree.hpp"
+
+// PROCEDURAL SOURCES
+
+// Procedural sources describe a shape without a model behind it, they can be plugged into the octree directly as its process function
+// Each node is classified as a whole without sampling its interior. EMPTY and FULL nodes stop there, only MIXED nodes are subdivided
+enum class Coverage : uint8_t
+{
+    EMPTY,
+    FULL,
+    MIXED
+};
+
+class ProceduralSource
+{
+public:
+    virtual ~ProceduralSource() = default;
+
+    // Signed distance to the surface, negative inside. It only has to be bounded by getLipschitz(), not exact
+    [[nodiscard]] virtual float distance(glm::vec3 point) const = 0;
+    [[nodiscard]] virtual AABB getBounds() const = 0;
+
+    // |distance(a) - distance(b)| <= L * |a - b|, exact distance functions have an L of 1
+    [[nodiscard]] virtual float getLipschitz() const;
+    // By default the gradient of distance() with central differences, the sources that can do it analytically override it
+    [[nodiscard]] virtual glm::vec3 getNormal(glm::vec3 point) const;
+    [[nodiscard]] virtual uint16_t getMaterial(glm::vec3 point) const;
+    // By default the distance at the center and the Lipschitz constant bound the distance anywhere inside the node
+    // Sources that know more about themselves (like the heightmap) override it with tighter intervals
+    [[nodiscard]] virtual Coverage classify(const AABB& shape) const;
+
+    // Full nodes collapse into a single leaf when solid, otherwise only the surface is kept
+    void setSolid(bool solid);
+
+    static NodeRef process(const AABB& nodeShape, uint8_t depth, uint8_t maxDepth, void* data);
+    static NodeRef parallelProcess(const AABB& nodeShape, uint8_t depth, uint8_t maxDepth, void* data, uint8_t parallelIndex);
+
+private:
+    [[nodiscard]] bool crossesSurface(const AABB& shape) const;
+
+    bool m_solid = false;
+};
+
+// SIGNED DISTANCE FUNCTIONS
+
+class SdfSphere final : public ProceduralSource
+{
+public:
+    SdfSphere(glm::vec3 center, float radius, uint16_t material = 0);
+
+    [[nodiscard]] float distance(glm::vec3 point) const override;
+    [[nodiscard]] AABB getBounds() const override;
+    [[nodiscard]] glm::vec3 getNormal(glm::vec3 point) const override;
+    [[nodiscard]] uint16_t getMaterial(glm::vec3 point) const override;
+
+private:
+    glm::vec3 m_center;
+    float m_radius;
+    uint16_t m_material;
+};
+
+class SdfBox final : public ProceduralSource
+{
+public:
+    SdfBox(glm::vec3 center, glm::vec3 halfExtents, uint16_t material = 0);
+
+    [[nodiscard]] float distance(glm::vec3 point) const override;
+    [[nodiscard]] AABB getBounds() const override;
+    [[nodiscard]] glm::vec3 getNormal(glm::vec3 point) const override;
+    [[nodiscard]] uint16_t getMaterial(glm::vec3 point) const override;
+
+private:
+    glm::vec3 m_center;
+    glm::vec3 m_halfExtents;
+    uint16_t m_material;
+};
+
+// CSG operations take the min/max of their operands, which keeps the largest Lipschitz constant of the two
+// Classification combines the coverage of both operands, so a tight operand (like a heightmap) stays tight inside the tree
+class SdfOperation final : public ProceduralSource
+{
+public:
+    enum class Type : uint8_t
+    {
+        UNION,
+        INTERSECTION,
+        SUBTRACTION
+    };
+
+    SdfOperation(Type type, std::shared_ptr<ProceduralSource> first, std::shared_ptr<ProceduralSource> second);
+
+    [[nodiscard]] float distance(glm::vec3 point) const override;
+    [[nodiscard]] AABB getBounds() const override;
+    [[nodiscard]] float getLipschitz() const override;
+    [[nodiscard]] glm::vec3 getNormal(glm::vec3 point) const override;
+    [[nodiscard]] uint16_t getMaterial(glm::vec3 point) const override;
+    [[nodiscard]] Coverage classify(const AABB& shape) const override;
+
+private:
+    // The operand whose distance is the result at that point, second is flipped inside out for the subtraction
+    [[nodiscard]] bool isSecondActive(glm::vec3 point) const;
+
+    Type m_type;
+    std::shared_ptr<ProceduralSource> m_first;
+    std::shared_ptr<ProceduralSource> m_second;
+};
+
+// HEIGHTMAP TERRAIN
+
+// Terrain over the XZ plane, solid below the heights. Each cell is bilinear between its four samples
+// A min/max pyramid over the cells gives the height interval of any node with at most four lookups
+class HeightmapSource final : public ProceduralSource
+{
+public:
+    // Heights are in world units, the longest side of the grid spans size units centered at the origin
+    HeightmapSource(std::vector<float> heights, uint32_t width, uint32_t depth, float size, uint16_t material = 0);
+    // Grayscale image, black is height 0 and white is heightScale
+    [[nodiscard]] static std::shared_ptr<HeightmapSource> fromImage(std::string_view path, float size, float heightScale, uint16_t material = 0);
+
+    [[nodiscard]] float distance(glm::vec3 point) const override;
+    [[nodiscard]] AABB getBounds() const override;
+    [[nodiscard]] float getLipschitz() const override;
+    [[nodiscard]] glm::vec3 getNormal(glm::vec3 point) const override;
+    [[nodiscard]] uint16_t getMaterial(glm::vec3 point) const override;
+    [[nodiscard]] Coverage classify(const AABB& shape) const override;
+
+    [[nodiscard]] float getHeight(float x, float z) const;
+
+private:
+    [[nodiscard]] float getSample(uint32_t x, uint32_t z) const;
+
+    struct PyramidLevel
+    {
+        uint32_t width = 0;
+        uint32_t depth = 0;
+        std::vector<glm::vec2> minMax;
+    };
+
+    std::vector<float> m_heights;
+    uint32_t m_width;
+    uint32_t m_depth;
+    glm::vec2 m_origin;
+    float m_cellSize;
+    float m_maxSlope = 0;
+    uint16_t m_material;
+    std::vector<PyramidLevel> m_pyramid;
+};
+
+// NOISE
+
+// Fractal value noise, solid where the noise is above the threshold
+// The noise derivatives are bounded, which gives the Lipschitz constant, and computed analytically for the normals
+// Classification uses the range of the lattice values each octave blends inside the node, which is a lot tighter than the Lipschitz bound
+class NoiseSource final : public ProceduralSource
+{
+public:
+    NoiseSource(AABB bounds, uint32_t seed, float frequency, uint8_t octaves, float threshold, uint16_t material = 0);
+
+    [[nodiscard]] float distance(glm::vec3 point) const override;
+    [[nodiscard]] AABB getBounds() const override;
+    [[nodiscard]] float getLipschitz() const override;
+    [[nodiscard]] glm::vec3 getNormal(glm::vec3 point) const override;
+    [[nodiscard]] uint16_t getMaterial(glm::vec3 point) const override;
+    [[nodiscard]] Coverage classify(const AABB& shape) const override;
+
+    // Noise value in [-1, 1] in x and its gradient in yzw
+    [[nodiscard]] static glm::vec4 fractalNoise(glm::vec3 point, uint32_t seed, uint8_t octaves);
+
+private:
+    AABB m_bounds;
+    uint32_t m_seed;
+    float m_frequency;
+    uint8_t m_octaves;
+    float m_threshold;
+    uint16_t m_material;
+};
+
+// SCENES
+
+// Ready to use scenes for tests and benchmarks: "sphere", "csg", "terrain" and "noise"
+// Any other name is loaded as a heightmap image
+struct ProceduralScene
+{
+    std::shared_ptr<ProceduralSource> source;
+    std::vector<Octree::Material> materials;
+};
+
+[[nodiscard]] ProceduralScene createProceduralScene(std::string_view name);
@@ -2,10 +2,12 @@
 
 #include <stdexcept>
 
+#include <algorithm>
 #include <array>
+#include <limits>
+#include <numeric>
 #include <unordered_set>
 #include <glm/gtx/string_cast.hpp>
-#include <glm/gtx/intersect.hpp>
 #include <glm/gtx/norm.hpp>
 
 #include "utils/logger.hpp"
@@ -24,6 +26,57 @@ glm::vec3 Triangle::getWeightedNormal(const glm::vec3 weights) const
     return v0.normal * weights.x + v1.normal * weights.y + v2.normal * weights.z;
 }
 
+// Closest point of the triangle to the given point and its weights (Real-Time Collision Detection, section 5.1.5)
+Triangle::WeightData Triangle::getTriangleClosestWeight(const glm::vec3 point) const
+{
+    const glm::vec3 ab = v1.pos - v0.pos;
+    const glm::vec3 ac = v2.pos - v0.pos;
+
+    const glm::vec3 ap = point - v0.pos;
+    const float d1 = glm::dot(ab, ap);
+    const float d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return {{1, 0, 0}, v0.pos};
+
+    const glm::vec3 bp = point - v1.pos;
+    const float d3 = glm::dot(ab, bp);
+    const float d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return {{0, 1, 0}, v1.pos};
+
+    const float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+    {
+        const float v = d1 / (d1 - d3);
+        return {{1.0f - v, v, 0}, v0.pos + ab * v};
+    }
+
+    const glm::vec3 cp = point - v2.pos;
+    const float d5 = glm::dot(ab, cp);
+    const float d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return {{0, 0, 1}, v2.pos};
+
+    const float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+    {
+        const float w = d2 / (d2 - d6);
+        return {{1.0f - w, 0, w}, v0.pos + ac * w};
+    }
+
+    const float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+    {
+        const float w = (d4 - d3) / (d4 - d3 + (d5 - d6));
+        return {{0, 1.0f - w, w}, v1.pos + (v2.pos - v1.pos) * w};
+    }
+
+    const float denom = 1.0f / (va + vb + vc);
+    const float v = vb * denom;
+    const float w = vc * denom;
+    return {{1.0f - v - w, v, w}, v0.pos + ab * v + ac * w};
+}
+
 // The constructor loads the model data and materials from the file
 Voxelizer::Voxelizer(std::string filename, uint8_t maxDepth)
 {
@@ -108,20 +161,28 @@ Voxelizer::Voxelizer(std::string filename, uint8_t maxDepth)
         }
     }
 
-    for (TriangleTree& tree : m_triangleTrees)
-    {
-        tree.branchTriangles.resize(maxDepth - 1);
-    }
+    prepareTriangles(maxDepth);
+}
+
+// Model already in memory, the meshes are indexed by material like the ones loaded from file
+Voxelizer::Voxelizer(Model model, std::string baseDir, const uint8_t maxDepth)
+    : m_model(std::move(model)), m_baseDir(std::move(baseDir))
+{
+    prepareTriangles(maxDepth);
+}
 
+void Voxelizer::prepareTriangles(const uint8_t maxDepth)
+{
     for (uint32_t i = 0; i < m_model.meshes.size(); i++)
     {
         for (uint32_t j = 0; j < m_model.meshes[i].indices.size(); j += 3)
         {
             m_triangles.emplace_back(i, j);
-            m_rootTriangles.emplace_back(m_triangles.size() - 1);
         }
     }
     m_triangles.shrink_to_fit();
+    prepareLeafTest();
+    resetOctreeData(maxDepth);
 }
 
 Octree::Material Material::toOctreeMaterial() const
@@ -137,9 +198,12 @@ Octree::Material Material::toOctreeMaterial() const
 // This function is used to obtain material, normal and UV data for the provided Node
 // The data is samples using the closest triangle intersect by the 6-connect test.
 // It samples taking the baricentric coordinates of the intersection point.
-void Voxelizer::sampleVoxel(NodeRef& node, uint8_t parallelIndex) const
+void Voxelizer::sampleVoxel(NodeRef& node, const AABB& shape, const uint8_t depth, const uint8_t parallelIndex) const
 {
-    LeafNode leafNode{ 0 };
+    if (m_areaFiltering && sampleVoxelByArea(node, shape, depth, parallelIndex))
+        return;
+
+    const float voxelSize = shape.halfSize * 2.0f;
     TriangleLeafIndex closestLeaf{};
     closestLeaf.d = FLT_MAX;
     for (const TriangleLeafIndex& triangle : m_triangleTrees[parallelIndex].leafTriangles)
@@ -151,15 +215,252 @@ void Voxelizer::sampleVoxel(NodeRef& node, uint8_t parallelIndex) const
     }
     // Baricentric at x = 1 - y - z
     glm::vec3 weights{1.0f - closestLeaf.baricentric.x - closestLeaf.baricentric.y, closestLeaf.baricentric.x, closestLeaf.baricentric.y};
-    Triangle closestT = getTriangle(m_triangles[closestLeaf.index]);
-    leafNode.setMaterial(getMaterialID(closestLeaf.index));
-    leafNode.setUV(closestT.getWeightedUV(weights));
-    leafNode.setNormal(closestT.getWeightedNormal(weights));
-    auto [leaf1, leaf2] = leafNode.split();
+    const std::optional<LeafNode> leafNode = createLeaf(closestLeaf.index, weights, voxelSize);
+    // Baked leaves that fail the alpha test are removed, the shader would skip them anyway
+    if (!leafNode)
+    {
+        node.exists = false;
+        return;
+    }
+    auto [leaf1, leaf2] = leafNode->split();
     node.data1 = leaf1.toRaw();
     node.data2 = leaf2.toRaw();
 }
 
+// Sutherland-Hodgman clipping of a triangle against the box. Returns the amount of vertices of the part inside, 0 if it is outside
+// Every plane can add at most one vertex to the polygon, so it never has more than 9
+static uint32_t clipTriangleToAABB(const std::array<glm::vec3, 3>& triangle, const AABB& box, std::array<glm::vec3, 9>& polygon)
+{
+    polygon = { triangle[0], triangle[1], triangle[2] };
+    std::array<glm::vec3, 9> clipped{};
+    uint32_t count = 3;
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+        for (const float side : { -1.0f, 1.0f })
+        {
+            uint32_t clippedCount = 0;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                const glm::vec3& current = polygon[i];
+                const glm::vec3& next = polygon[(i + 1) % count];
+                const float currentDist = side * (current[axis] - box.center[axis]) - box.halfSize;
+                const float nextDist = side * (next[axis] - box.center[axis]) - box.halfSize;
+                if (currentDist <= 0.0f)
+                    clipped[clippedCount++] = current;
+                if ((currentDist <= 0.0f) != (nextDist <= 0.0f))
+                    clipped[clippedCount++] = current + (next - current) * (currentDist / (currentDist - nextDist));
+            }
+            std::swap(polygon, clipped);
+            count = clippedCount;
+            if (count < 3)
+                return 0;
+        }
+    }
+    return count;
+}
+
+// Area of the part of the triangle inside the box and its centroid
+static float clipTriangleToAABB(const std::array<glm::vec3, 3>& triangle, const AABB& box, glm::vec3& centroid)
+{
+    std::array<glm::vec3, 9> polygon;
+    const uint32_t count = clipTriangleToAABB(triangle, box, polygon);
+
+    float area = 0.0f;
+    centroid = glm::vec3{ 0.0f };
+    for (uint32_t i = 1; i + 1 < count; i++)
+    {
+        const float fanArea = 0.5f * glm::length(glm::cross(polygon[i] - polygon[0], polygon[i + 1] - polygon[0]));
+        area += fanArea;
+        centroid += fanArea * (polygon[0] + polygon[i] + polygon[i + 1]) / 3.0f;
+    }
+    if (area > 0.0f)
+        centroid /= area;
+    return area;
+}
+
+// Alternative to sampleVoxel that uses every triangle crossing the leaf instead of the closest one
+// Each triangle is clipped to the leaf and weighted by the area left inside. The normal is the area weighted average and the
+// material is the one that covers the most area. UV (or baked color) comes from the biggest triangle of that material
+// Triangles are first rejected by their bounds in batches laid out as structure of arrays, so that part vectorizes, and only
+// the ones that survive are clipped. Returns false if no triangle covers any area, the closest triangle is used then
+bool Voxelizer::sampleVoxelByArea(NodeRef& node, const AABB& shape, const uint8_t depth, const uint8_t parallelIndex) const
+{
+    const std::span<const uint32_t> triangles = getParentTriangles(depth, parallelIndex);
+
+    // Leaves rarely see more than a few materials, the table only moves to the heap when it runs out of inline slots
+    constexpr uint32_t inlineMaterials = 16;
+    std::array<std::pair<uint16_t, float>, inlineMaterials> inlineMaterialAreas{};
+    std::vector<std::pair<uint16_t, float>> heapMaterialAreas;
+    std::span<std::pair<uint16_t, float>> materialAreas = inlineMaterialAreas;
+    uint32_t materialCount = 0;
+    glm::vec3 normal{ 0.0f };
+    uint32_t bestTriangle = UINT32_MAX;
+    uint16_t bestMaterial = 0;
+    float bestArea = 0.0f;
+    glm::vec3 bestCentroid{};
+
+    constexpr uint32_t batchSize = 8;
+    const glm::vec3 boxMin = shape.center - shape.halfSize;
+    const glm::vec3 boxMax = shape.center + shape.halfSize;
+    for (uint32_t first = 0; first < triangles.size(); first += batchSize)
+    {
+        const uint32_t count = std::min(batchSize, static_cast<uint32_t>(triangles.size()) - first);
+        float minBounds[3][batchSize];
+        float maxBounds[3][batchSize];
+        for (uint32_t lane = 0; lane < batchSize; lane++)
+        {
+            const LeafTestTriangle data = lane < count ? m_leafTestTriangles[triangles[first + lane]] : LeafTestTriangle{ glm::vec3{ FLT_MAX } };
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                minBounds[c][lane] = data.origin[c] + std::min(0.0f, std::min(data.edge1[c], data.edge2[c]));
+                maxBounds[c][lane] = data.origin[c] + std::max(0.0f, std::max(data.edge1[c], data.edge2[c]));
+            }
+        }
+        uint32_t overlapMask = 0;
+        for (uint32_t lane = 0; lane < batchSize; lane++)
+        {
+            const bool overlaps = minBounds[0][lane] <= boxMax.x && maxBounds[0][lane] >= boxMin.x
+                && minBounds[1][lane] <= boxMax.y && maxBounds[1][lane] >= boxMin.y
+                && minBounds[2][lane] <= boxMax.z && maxBounds[2][lane] >= boxMin.z;
+            overlapMask |= static_cast<uint32_t>(overlaps) << lane;
+        }
+
+        for (uint32_t lane = 0; lane < count; lane++)
+        {
+            if ((overlapMask & (1 << lane)) == 0)
+                continue;
+            const uint32_t triangle = triangles[first + lane];
+            glm::vec3 centroid;
+            const float area = clipTriangleToAABB(getTrianglePos(triangle), shape, centroid);
+            if (area <= 0.0f)
+                continue;
+
+            // The normal is linear over the triangle, so its value at the centroid is the average over the clipped area
+            const Triangle data = getTriangle(triangle);
+            normal += area * data.getWeightedNormal(data.getTriangleClosestWeight(centroid).weights);
+
+            const uint16_t material = getMaterialID(triangle);
+            uint32_t slot = 0;
+            while (slot < materialCount && materialAreas[slot].first != material)
+                slot++;
+            if (slot == materialCount)
+            {
+                // Every candidate triangle adds at most one material, so the heap table never runs out
+                if (materialCount == materialAreas.size())
+                {
+                    heapMaterialAreas.resize(triangles.size());
+                    std::copy(inlineMaterialAreas.begin(), inlineMaterialAreas.end(), heapMaterialAreas.begin());
+                    materialAreas = heapMaterialAreas;
+                }
+                materialAreas[materialCount++] = { material, 0.0f };
+            }
+            materialAreas[slot].second += area;
+
+            if (area > bestArea)
+            {
+                bestArea = area;
+                bestTriangle = triangle;
+                bestCentroid = centroid;
+            }
+        }
+    }
+    if (bestTriangle == UINT32_MAX || glm::length2(normal) == 0.0f)
+        return false;
+
+    // The UV is taken from the biggest triangle of the dominant material, UVs of different triangles can't be averaged
+    float dominantArea = 0.0f;
+    for (uint32_t i = 0; i < materialCount; i++)
+    {
+        if (materialAreas[i].second > dominantArea)
+        {
+            dominantArea = materialAreas[i].second;
+            bestMaterial = materialAreas[i].first;
+        }
+    }
+    if (getMaterialID(bestTriangle) != bestMaterial)
+    {
+        bestArea = 0.0f;
+        for (const uint32_t triangle : triangles)
+        {
+            if (getMaterialID(triangle) != bestMaterial)
+                continue;
+            glm::vec3 centroid;
+            const float area = clipTriangleToAABB(getTrianglePos(triangle), shape, centroid);
+            if (area > bestArea)
+            {
+                bestArea = area;
+                bestTriangle = triangle;
+                bestCentroid = centroid;
+            }
+        }
+    }
+
+    std::optional<LeafNode> leafNode = createLeaf(bestTriangle, getTriangle(bestTriangle).getTriangleClosestWeight(bestCentroid).weights, shape.halfSize * 2.0f);
+    if (!leafNode)
+    {
+        node.exists = false;
+        return true;
+    }
+    leafNode->setNormal(glm::normalize(normal));
+    auto [leaf1, leaf2] = leafNode->split();
+    node.data1 = leaf1.toRaw();
+    node.data2 = leaf2.toRaw();
+    return true;
+}
+
+// Leaf data of the given triangle sampled at the given baricentric weights, nothing is returned if the texel is transparent
+// When colors are baked, the textures are filtered over the area the leaf covers
+std::optional<LeafNode> Voxelizer::createLeaf(const uint32_t triangle, const glm::vec3 weights, const float voxelSize) const
+{
+    LeafNode leafNode{ 0 };
+    const Triangle data = getTriangle(triangle);
+    const uint16_t material = getMaterialID(triangle);
+    leafNode.setMaterial(material);
+    leafNode.setNormal(data.getWeightedNormal(weights));
+    if (m_colorBaking == ColorBaking::NONE)
+    {
+        leafNode.setUV(data.getWeightedUV(weights));
+        // The shader samples the base level at the stored UV, so the test uses the quantized one to give the same answer
+        const uint32_t diffuseMap = m_alphaTested ? m_bakeMaterialTextures[material].first : UINT32_MAX;
+        if (diffuseMap != UINT32_MAX && m_bakeTextures[diffuseMap].sample(leafNode.getUV(), 0.0f).w < 0.1f)
+            return std::nullopt;
+        return leafNode;
+    }
+
+    // Size of the leaf in UV space, taken from how much the triangle is stretched in UV space compared to world space
+    const float worldArea = glm::length(glm::cross(data.v1.pos - data.v0.pos, data.v2.pos - data.v0.pos));
+    const glm::vec2 uvEdge1 = data.v1.texCoord - data.v0.texCoord;
+    const glm::vec2 uvEdge2 = data.v2.texCoord - data.v0.texCoord;
+    const float uvArea = std::abs(uvEdge1.x * uvEdge2.y - uvEdge1.y * uvEdge2.x);
+    const float footprint = worldArea > 0.0f ? voxelSize * std::sqrt(uvArea / worldArea) : 0.0f;
+    const glm::vec2 uv = data.getWeightedUV(weights);
+
+    const auto [diffuseMap, specularMap] = m_bakeMaterialTextures[material];
+    glm::vec4 diffuse{ 1.0f };
+    if (diffuseMap != UINT32_MAX)
+        diffuse = m_bakeTextures[diffuseMap].sample(uv, footprint);
+    // Same alpha test the shader does with the diffuse texture
+    if (diffuse.w < 0.1f)
+        return std::nullopt;
+
+    const glm::uvec3 color{ linearToSrgb(diffuse.x), linearToSrgb(diffuse.y), linearToSrgb(diffuse.z) };
+    if (m_colorBaking == ColorBaking::DIFFUSE)
+    {
+        leafNode.setColor(color.x << 16 | color.y << 8 | color.z);
+        return leafNode;
+    }
+
+    float specular = 1.0f;
+    if (specularMap != UINT32_MAX)
+        specular = m_bakeTextures[specularMap].sample(uv, footprint).x;
+    const uint32_t red = (color.x * 31 + 127) / 255;
+    const uint32_t green = (color.y * 63 + 127) / 255;
+    const uint32_t blue = (color.z * 31 + 127) / 255;
+    const uint32_t spec = static_cast<uint32_t>(glm::clamp(specular, 0.0f, 1.0f) * 255.0f + 0.5f);
+    leafNode.setColor(red << 19 | green << 13 | blue << 8 | spec);
+    return leafNode;
+}
+
 // We want to get the smallest AABB that can contain the model
 AABB Voxelizer::getModelAABB() const
 {
@@ -233,31 +534,90 @@ Material Voxelizer::getMaterial(const TriangleRootIndex rootIndex) const
 
 // TESTS
 
-glm::vec3 axisGroup[] = {
-    {1, 0, 0},
-    {0, 1, 0},
-    {0, 0, 1}
-};
+// Planes of the triangles precomputed for the 6-connect test, so the leaves don't need to rebuild them for every triangle
+void Voxelizer::prepareLeafTest()
+{
+    m_leafTestTriangles.resize(m_triangles.size());
+    for (uint32_t i = 0; i < m_triangles.size(); i++)
+    {
+        const std::array<glm::vec3, 3> pos = getTrianglePos(i);
+        LeafTestTriangle& data = m_leafTestTriangles[i];
+        data.origin = pos[0];
+        data.edge1 = pos[1] - pos[0];
+        data.edge2 = pos[2] - pos[0];
+        data.normal = glm::cross(data.edge1, data.edge2);
+    }
+}
 
 // The 6-connect test is a test that will generate the smallest model without leaving holes
-// It simply tests three rays along each axis against the triangles. Then checks that the intersected point (if any) is inside the AABB
+// It shoots three rays along each axis from the center of the AABB against the triangles. The hit (if any) must be inside the AABB
 // It is used for the leaves of the octree
-// It stores the closest positive triangle for sampling
-TriangleLeafIndex Voxelizer::AABBTriangle6Connect(const uint32_t index, const AABB shape) const
+// It stores the closest positive triangles for sampling
+//
+// Each axis ray is solved against the precomputed plane of the triangle. With w = center - v0 the projection of the triangle
+// along axis k turns into 2D edge functions: u = (w x e2)_k / n_k and v = (e1 x w)_k / n_k
+// The distance is taken from the hit point itself, t = u * e1_k + v * e2_k - w_k, which stays stable for sliver triangles
+// Triangles are processed in small batches laid out as structure of arrays so the compiler can vectorize the test across them
+void Voxelizer::AABBTriangle6Connect(const std::span<const uint32_t> triangles, const AABB shape, std::vector<TriangleLeafIndex>& hits) const
 {
-    TriangleLeafIndex current{shape.halfSize, {}, false};
-    for (auto& axis : axisGroup)
+    constexpr uint32_t batchSize = 8;
+    struct Batch
+    {
+        float w[3][batchSize];
+        float e1[3][batchSize];
+        float e2[3][batchSize];
+        float n[3][batchSize];
+        float d[batchSize];
+        float u[batchSize];
+        float v[batchSize];
+    } batch;
+
+    for (uint32_t first = 0; first < triangles.size(); first += batchSize)
     {
-        float t;
-        glm::vec2 bari;
-        std::array<glm::vec3, 3> positions = getTrianglePos(index);
-        if (glm::intersectRayTriangle(shape.center, axis, positions[0], positions[1], positions[2], bari, t))
+        const uint32_t count = std::min(batchSize, static_cast<uint32_t>(triangles.size()) - first);
+        // Gather and transpose. Unused lanes get a degenerate triangle that can never hit
+        for (uint32_t lane = 0; lane < batchSize; lane++)
+        {
+            const LeafTestTriangle data = lane < count ? m_leafTestTriangles[triangles[first + lane]] : LeafTestTriangle{};
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                batch.w[c][lane] = shape.center[c] - data.origin[c];
+                batch.e1[c][lane] = data.edge1[c];
+                batch.e2[c][lane] = data.edge2[c];
+                batch.n[c][lane] = data.normal[c];
+            }
+            batch.d[lane] = shape.halfSize;
+            batch.u[lane] = 0.0f;
+            batch.v[lane] = 0.0f;
+        }
+
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            // The two other axes of the cross products, in cyclic order
+            const uint32_t a = (k + 1) % 3;
+            const uint32_t b = (k + 2) % 3;
+            for (uint32_t lane = 0; lane < batchSize; lane++)
+            {
+                // Triangles (almost) parallel to the ray are skipped. The threshold is relative to the normal so small triangles still hit
+                const float nk = batch.n[k][lane];
+                const bool facing = std::abs(nk) > std::numeric_limits<float>::epsilon() * (std::abs(batch.n[0][lane]) + std::abs(batch.n[1][lane]) + std::abs(batch.n[2][lane]));
+                const float invNk = 1.0f / (facing ? nk : 1.0f);
+                const float u = (batch.w[a][lane] * batch.e2[b][lane] - batch.w[b][lane] * batch.e2[a][lane]) * invNk;
+                const float v = (batch.e1[a][lane] * batch.w[b][lane] - batch.e1[b][lane] * batch.w[a][lane]) * invNk;
+                const float t = std::abs(u * batch.e1[k][lane] + v * batch.e2[k][lane] - batch.w[k][lane]);
+                const bool hit = facing && u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t < batch.d[lane];
+                batch.d[lane] = hit ? t : batch.d[lane];
+                batch.u[lane] = hit ? u : batch.u[lane];
+                batch.v[lane] = hit ? v : batch.v[lane];
+            }
+        }
+
+        for (uint32_t lane = 0; lane < count; lane++)
         {
-            if (std::abs(t) < current.d) 
-                current = {std::abs(t), bari, true, index};
+            if (batch.d[lane] < shape.halfSize)
+                hits.push_back({ batch.d[lane], { batch.u[lane], batch.v[lane] }, true, triangles[first + lane] });
         }
     }
-    return current;
 }
 
 static bool AABBTriangleSAT(const glm::vec3 v0, const glm::vec3 v1, const glm::vec3 v2, const float size, const glm::vec3 axis)
@@ -332,32 +692,35 @@ bool Voxelizer::doesAABBInteresect(const AABB& shape, const bool isLeaf, const u
 {
     if (depth == 0) return true;
 
-    const std::vector<uint32_t>& parentRef = depth - 1 == 0 ? m_rootTriangles : m_triangleTrees[parallelIndex].branchTriangles[depth - 2];
-    if (!isLeaf) m_triangleTrees[parallelIndex].branchTriangles[depth - 1].clear();
-    else m_triangleTrees[parallelIndex].leafTriangles.clear();
-
-    for (const uint32_t triangle : parentRef)
+    TriangleTree& tree = m_triangleTrees[parallelIndex];
+    if (isLeaf)
     {
-        std::array<glm::vec3, 3> tri = getTrianglePos(triangle);
-        if (isLeaf)
-        {
-            // 6-connect test for leaves
-            const TriangleLeafIndex result = AABBTriangle6Connect(triangle, shape);
-            if (!result.hit) continue;
-            // We store the positives into a vector for sampling
-            m_triangleTrees[parallelIndex].leafTriangles.push_back(result);
-        }
-        else
-        {
-            // SAT test for branches
-            if (!intersectAABBTriangleSAT(tri[0], tri[1], tri[2], shape)) continue;
-            // We store the positives into a vector for the children to test. That way we avoid testing all triangles at all levels
-            m_triangleTrees[parallelIndex].branchTriangles[depth - 1].push_back(triangle);
-        }
+        // 6-connect test for leaves
+        // We store the positives into a vector for sampling
+        tree.leafTriangles.clear();
+        AABBTriangle6Connect(getParentTriangles(depth, parallelIndex), shape, tree.leafTriangles);
+        return !tree.leafTriangles.empty();
     }
-    if (isLeaf)
-        return !m_triangleTrees[parallelIndex].leafTriangles.empty();
-    return !m_triangleTrees[parallelIndex].branchTriangles[depth - 1].empty();
+
+    // SAT test for branches
+    // The triangles of the parent are partitioned in place so the ones that intersect this node come first. That prefix is all the children
+    // need to test, so we avoid testing all triangles at all levels without copying them. The traversal is depth first, so by the time
+    // a sibling reorders the span of the parent this node's subtree is already finished
+    const auto parentEnd = tree.triangles.begin() + tree.spanSizes[depth - 1];
+    const auto nodeEnd = std::partition(tree.triangles.begin(), parentEnd, [&](const uint32_t triangle)
+    {
+        const std::array<glm::vec3, 3> tri = getTrianglePos(triangle);
+        return intersectAABBTriangleSAT(tri[0], tri[1], tri[2], shape);
+    });
+    tree.spanSizes[depth] = static_cast<uint32_t>(nodeEnd - tree.triangles.begin());
+    return tree.spanSizes[depth] != 0;
+}
+
+// Triangles that intersect the parent of a node at the given depth
+std::span<const uint32_t> Voxelizer::getParentTriangles(const uint8_t depth, const uint8_t parallelIndex) const
+{
+    const TriangleTree& tree = m_triangleTrees[parallelIndex];
+    return { tree.triangles.data(), tree.spanSizes[depth - 1] };
 }
 
 // VOXELIZATION GLOBAL FUNCTION
@@ -375,7 +738,22 @@ NodeRef Voxelizer::parallelVoxelize(const AABB& nodeShape, const uint8_t depth,
     nodeRef.isLeaf = depth >= maxDepth;
     nodeRef.exists = voxelizer.doesAABBInteresect(nodeShape, nodeRef.isLeaf, depth, parallelIndex);
     if (nodeRef.exists && nodeRef.isLeaf)
-        voxelizer.sampleVoxel(nodeRef, parallelIndex);
+        voxelizer.sampleVoxel(nodeRef, nodeShape, depth, parallelIndex);
+    // Flat surfaces end in a coarser leaf. It covers many triangles, so it is always sampled by area
+    // If no triangle leaves any area inside (it only touches the node) we keep subdividing
+    else if (nodeRef.exists && depth != 0 && voxelizer.m_adaptiveTolerance > 0.0f && voxelizer.isFlat(nodeShape, depth, maxDepth, parallelIndex))
+    {
+        // depth + 1 makes it read the triangles of this node instead of the ones of its parent
+        nodeRef.isLeaf = voxelizer.sampleVoxelByArea(nodeRef, nodeShape, depth + 1, parallelIndex);
+    }
+    // If no triangle crosses the node it is either completely inside or completely outside the model
+    // so one parity test is enough to know, and the whole subtree collapses into a single leaf if it is inside
+    else if (!nodeRef.exists && voxelizer.m_solid && voxelizer.isInside(nodeShape.center))
+    {
+        nodeRef.exists = true;
+        nodeRef.isLeaf = true;
+        voxelizer.sampleInterior(nodeRef, nodeShape, depth, parallelIndex);
+    }
     return nodeRef;
 }
 
@@ -383,8 +761,439 @@ void Voxelizer::resetOctreeData(const uint8_t newDepth)
 {
     for (TriangleTree& tree : m_triangleTrees)
     {
-        tree.branchTriangles.clear();
-        tree.branchTriangles.resize(newDepth - 1);
+        tree.triangles.resize(m_triangles.size());
+        std::iota(tree.triangles.begin(), tree.triangles.end(), 0);
+        // Every node writes its own span before its children read it, so only the depths above the first node matter here
+        // Filling all of them lets the traversal start below the root, like the buckets of the out of core voxelizer do
+        tree.spanSizes.assign(newDepth, static_cast<uint32_t>(m_triangles.size()));
         tree.leafTriangles.clear();
     }
 }
+
+
+// SOLID VOXELIZATION
+
+// Enabling solid voxelization bins all triangles in a grid over the YZ plane of the model
+// The parity test shoots rays along +X, so each test only needs to look at the triangles of one cell
+void Voxelizer::setSolid(const bool solid)
+{
+    m_solid = solid;
+    m_parityCells.clear();
+    m_parityTriangles.clear();
+    if (!solid)
+        return;
+
+    const AABB root = getModelAABB();
+    m_parityResolution = std::clamp(static_cast<uint32_t>(std::sqrt(static_cast<float>(m_triangles.size()))), 1U, 1024U);
+    m_parityMin = glm::vec2{ root.center.y, root.center.z } - root.halfSize;
+    m_parityCellSize = root.halfSize * 2.0f / static_cast<float>(m_parityResolution);
+
+    const auto getCellRange = [&](const uint32_t triangle)
+    {
+        const std::array<glm::vec3, 3> pos = getTrianglePos(triangle);
+        const glm::vec2 min = glm::min(glm::vec2{ pos[0].y, pos[0].z }, glm::min(glm::vec2{ pos[1].y, pos[1].z }, glm::vec2{ pos[2].y, pos[2].z }));
+        const glm::vec2 max = glm::max(glm::vec2{ pos[0].y, pos[0].z }, glm::max(glm::vec2{ pos[1].y, pos[1].z }, glm::vec2{ pos[2].y, pos[2].z }));
+        const glm::ivec2 last{ static_cast<int>(m_parityResolution) - 1 };
+        return std::pair{
+            glm::clamp(glm::ivec2(glm::floor((min - m_parityMin) / m_parityCellSize)), glm::ivec2{ 0 }, last),
+            glm::clamp(glm::ivec2(glm::floor((max - m_parityMin) / m_parityCellSize)), glm::ivec2{ 0 }, last)
+        };
+    };
+
+    // Counting pass first so the cells can be stored in one flat array
+    m_parityCells.resize(static_cast<size_t>(m_parityResolution) * m_parityResolution + 1, 0);
+    for (uint32_t triangle = 0; triangle < m_triangles.size(); triangle++)
+    {
+        const auto [first, last] = getCellRange(triangle);
+        for (int y = first.x; y <= last.x; y++)
+            for (int z = first.y; z <= last.y; z++)
+                m_parityCells[y * m_parityResolution + z + 1]++;
+    }
+    for (size_t i = 1; i < m_parityCells.size(); i++)
+        m_parityCells[i] += m_parityCells[i - 1];
+
+    std::vector<uint32_t> cellFill(m_parityCells.begin(), m_parityCells.end() - 1);
+    m_parityTriangles.resize(m_parityCells.back());
+    for (uint32_t triangle = 0; triangle < m_triangles.size(); triangle++)
+    {
+        const auto [first, last] = getCellRange(triangle);
+        for (int y = first.x; y <= last.x; y++)
+            for (int z = first.y; z <= last.y; z++)
+                m_parityTriangles[cellFill[y * m_parityResolution + z]++] = triangle;
+    }
+    LOG_INFO("Solid voxelization enabled, ", m_parityTriangles.size(), " triangle references in a ", m_parityResolution, "x", m_parityResolution, " parity grid");
+}
+
+// Half open point in triangle test for one edge of a counter clockwise triangle
+// Points exactly on an edge shared by two triangles are only counted by one of them
+static bool isLeftOfEdge(const glm::vec2 start, const glm::vec2 end, const glm::vec2 point)
+{
+    const glm::vec2 edge = end - start;
+    const float side = edge.x * (point.y - start.y) - edge.y * (point.x - start.x);
+    return side > 0.0f || (side == 0.0f && (edge.y > 0.0f || (edge.y == 0.0f && edge.x < 0.0f)));
+}
+
+// Counts how many triangles a ray along +X crosses. An odd count means the point is inside of the model
+// This only works for watertight meshes, holes in the mesh will leak into the interior
+bool Voxelizer::isInside(const glm::vec3 point) const
+{
+    if (!m_solid)
+        return false;
+
+    // The ray is nudged slightly so it doesn't go exactly through vertices and edges that are aligned with the model
+    const glm::vec2 origin = glm::vec2{ point.y, point.z } + m_parityCellSize * glm::vec2{ 1.3e-4f, 0.7e-4f };
+    const glm::ivec2 cell = glm::clamp(glm::ivec2(glm::floor((origin - m_parityMin) / m_parityCellSize)), glm::ivec2{ 0 }, glm::ivec2{ static_cast<int>(m_parityResolution) - 1 });
+    const uint32_t cellIndex = cell.x * m_parityResolution + cell.y;
+
+    uint32_t crossings = 0;
+    for (uint32_t i = m_parityCells[cellIndex]; i < m_parityCells[cellIndex + 1]; i++)
+    {
+        const std::array<glm::vec3, 3> pos = getTrianglePos(m_parityTriangles[i]);
+        const glm::vec3 normal = glm::cross(pos[1] - pos[0], pos[2] - pos[0]);
+        // Triangles parallel to the ray can't be crossed
+        if (normal.x == 0.0f)
+            continue;
+
+        glm::vec2 a{ pos[0].y, pos[0].z };
+        glm::vec2 b{ pos[1].y, pos[1].z };
+        glm::vec2 c{ pos[2].y, pos[2].z };
+        if (normal.x < 0.0f)
+            std::swap(b, c);
+        if (!isLeftOfEdge(a, b, origin) || !isLeftOfEdge(b, c, origin) || !isLeftOfEdge(c, a, origin))
+            continue;
+
+        const float crossX = pos[0].x - (normal.y * (origin.x - pos[0].y) + normal.z * (origin.y - pos[0].z)) / normal.x;
+        if (crossX > point.x)
+            crossings++;
+    }
+    return crossings % 2 == 1;
+}
+
+// Interior nodes take the attributes of the closest triangle crossing their parent
+// Thin surfaces can leave gaps that let rays reach the leaves right below them, so those must still look like the surface
+void Voxelizer::sampleInterior(NodeRef& node, const AABB& shape, const uint8_t depth, const uint8_t parallelIndex) const
+{
+    uint32_t closestTriangle = 0;
+    Triangle::WeightData closest{};
+    float closestDistance = FLT_MAX;
+    for (const uint32_t triangle : getParentTriangles(depth, parallelIndex))
+    {
+        const Triangle::WeightData data = getTriangle(triangle).getTriangleClosestWeight(shape.center);
+        const float distance = glm::distance2(data.position, shape.center);
+        if (distance < closestDistance)
+        {
+            closestDistance = distance;
+            closestTriangle = triangle;
+            closest = data;
+        }
+    }
+    auto [leaf1, leaf2] = createLeaf(closestTriangle, closest.weights, shape.halfSize * 2.0f).value_or(LeafNode{ 0 }).split();
+    node.data1 = leaf1.toRaw();
+    node.data2 = leaf2.toRaw();
+}
+
+// AREA FILTERING
+
+void Voxelizer::setAreaFiltering(const bool enabled)
+{
+    m_areaFiltering = enabled;
+}
+
+// ADAPTIVE DEPTH
+
+// Minimum cosine between the normal of any triangle and the plane of the node, around 10 degrees
+static constexpr float ADAPTIVE_NORMAL_CONE = 0.985f;
+
+// A coarse leaf draws the surface as a cube, so we measure how far that cube can end up from the real surface and stop subdividing
+// when it is within the tolerance, given in leaves of the maximum depth. Tolerance 0 disables it
+void Voxelizer::setAdaptiveDepth(const float tolerance)
+{
+    m_adaptiveTolerance = std::max(tolerance, 0.0f);
+}
+
+// The surface inside the node is flat if all its triangles face the same way (normal cone) and all the clipped parts lie close
+// to the area weighted plane through them (planar fit). The error of the leaf is then the distance from that plane to the farthest
+// corner of the node plus how far the triangles are from the plane. Nodes with more than one material are never merged
+bool Voxelizer::isFlat(const AABB& shape, const uint8_t depth, const uint8_t maxDepth, const uint8_t parallelIndex) const
+{
+    // The error is never smaller than half the node, so nodes too big for the tolerance are rejected before looking at the triangles
+    const float leafSize = shape.halfSize * 2.0f / static_cast<float>(1 << (maxDepth - depth));
+    const float maxError = m_adaptiveTolerance * leafSize;
+    if (shape.halfSize > maxError)
+        return false;
+
+    const TriangleTree& tree = m_triangleTrees[parallelIndex];
+    const std::span<const uint32_t> triangles{ tree.triangles.data(), tree.spanSizes[depth] };
+    const uint16_t material = getMaterialID(triangles.front());
+
+    glm::vec3 weightedNormal{ 0.0f };
+    glm::vec3 weightedCentroid{ 0.0f };
+    float totalArea = 0.0f;
+    for (const uint32_t triangle : triangles)
+    {
+        if (getMaterialID(triangle) != material)
+            return false;
+        glm::vec3 centroid;
+        const float area = clipTriangleToAABB(getTrianglePos(triangle), shape, centroid);
+        if (area <= 0.0f)
+            continue;
+        weightedNormal += area * glm::normalize(m_leafTestTriangles[triangle].normal);
+        weightedCentroid += area * centroid;
+        totalArea += area;
+    }
+    if (totalArea <= 0.0f || glm::length2(weightedNormal) == 0.0f)
+        return false;
+    const glm::vec3 planeNormal = glm::normalize(weightedNormal);
+    const glm::vec3 planePoint = weightedCentroid / totalArea;
+
+    float deviation = 0.0f;
+    for (const uint32_t triangle : triangles)
+    {
+        // The clipped part is planar, so its farthest point from the plane is one of its vertices
+        std::array<glm::vec3, 9> polygon;
+        const uint32_t count = clipTriangleToAABB(getTrianglePos(triangle), shape, polygon);
+        const glm::vec3 normal = m_leafTestTriangles[triangle].normal;
+        if (count == 0 || glm::length2(normal) == 0.0f)
+            continue;
+        if (glm::dot(glm::normalize(normal), planeNormal) < ADAPTIVE_NORMAL_CONE)
+            return false;
+        for (uint32_t i = 0; i < count; i++)
+            deviation = std::max(deviation, std::abs(glm::dot(polygon[i] - planePoint, planeNormal)));
+    }
+
+    const glm::vec3 absNormal = glm::abs(planeNormal);
+    const float cubeError = std::abs(glm::dot(shape.center - planePoint, planeNormal)) + shape.halfSize * (absNormal.x + absNormal.y + absNormal.z);
+    return cubeError + deviation <= maxError;
+}
+
+// COLOR BAKING
+
+// Loads every texture the materials use so they can be sampled while voxelizing. Textures shared by several materials are loaded once
+// Without baking only the diffuse textures are loaded, for the alpha test, and the ones without transparent texels are dropped again
+// since every leaf passes the test with them
+void Voxelizer::setColorBaking(const ColorBaking baking)
+{
+    m_colorBaking = baking;
+    m_bakeTextures.clear();
+    m_bakeMaterialTextures.clear();
+
+    Logger::pushContext(baking == ColorBaking::NONE ? "Alpha test" : "Color baking");
+    std::unordered_map<std::string, uint32_t> loadedTextures;
+    const auto loadTexture = [&](const std::string& name) -> uint32_t
+    {
+        if (name.empty())
+            return UINT32_MAX;
+        const std::string path = m_baseDir + '/' + name;
+        if (const auto it = loadedTextures.find(path); it != loadedTextures.end())
+            return it->second;
+        m_bakeTextures.emplace_back(path);
+        loadedTextures[path] = static_cast<uint32_t>(m_bakeTextures.size() - 1);
+        return static_cast<uint32_t>(m_bakeTextures.size() - 1);
+    };
+
+    for (const Material& material : m_model.materials)
+    {
+        const uint32_t diffuse = loadTexture(material.diffuseMap);
+        const uint32_t specular = baking == ColorBaking::DIFFUSE_SPECULAR ? loadTexture(material.specularMap) : UINT32_MAX;
+        m_bakeMaterialTextures.emplace_back(diffuse, specular);
+    }
+    if (baking == ColorBaking::NONE)
+    {
+        std::vector<TextureData> cutoutTextures;
+        std::vector<uint32_t> remap(m_bakeTextures.size(), UINT32_MAX);
+        for (uint32_t i = 0; i < m_bakeTextures.size(); i++)
+        {
+            if (!m_bakeTextures[i].hasAlphaBelow(0.1f))
+                continue;
+            remap[i] = static_cast<uint32_t>(cutoutTextures.size());
+            cutoutTextures.push_back(std::move(m_bakeTextures[i]));
+        }
+        for (auto& [diffuse, specular] : m_bakeMaterialTextures)
+            diffuse = diffuse != UINT32_MAX ? remap[diffuse] : UINT32_MAX;
+        LOG_INFO(cutoutTextures.size(), " of ", m_bakeTextures.size(), " diffuse textures have transparent texels");
+        m_bakeTextures = std::move(cutoutTextures);
+    }
+    else
+        LOG_INFO("Loaded ", m_bakeTextures.size(), " textures for color baking");
+    m_alphaTested = true;
+    Logger::popContext();
+}
+
+uint32_t Voxelizer::getLeafFlags() const
+{
+    const uint32_t opaque = m_alphaTested ? static_cast<uint32_t>(Octree::LEAF_OPAQUE) : 0u;
+    switch (m_colorBaking)
+    {
+    case ColorBaking::DIFFUSE: return opaque | Octree::LEAF_BAKED_COLOR;
+    case ColorBaking::DIFFUSE_SPECULAR: return opaque | Octree::LEAF_BAKED_COLOR | Octree::LEAF_BAKED_SPECULAR;
+    default: return opaque;
+    }
+}
+
+// RASTERIZATION
+
+// Edge function of a triangle edge projected on an axis plane. It is positive inside the triangle
+struct EdgeFunction
+{
+    glm::vec2 normal;
+    float offset;
+};
+
+static glm::vec2 projectOnAxis(const glm::vec3 point, const uint8_t axis)
+{
+    // Coordinates are taken in cyclic order (yz, zx, xy) so the winding of the projection matches the sign of the normal on that axis
+    return { point[(axis + 1) % 3], point[(axis + 2) % 3] };
+}
+
+static std::array<EdgeFunction, 3> getProjectedEdges(const std::array<glm::vec3, 3>& vertices, const glm::vec3 normal, const uint8_t axis, const bool conservative)
+{
+    const float orientation = normal[axis] >= 0.0f ? 1.0f : -1.0f;
+    std::array<EdgeFunction, 3> edges{};
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        const glm::vec2 start = projectOnAxis(vertices[i], axis);
+        const glm::vec2 end = projectOnAxis(vertices[(i + 1) % 3], axis);
+        const glm::vec2 edgeNormal = glm::vec2{ start.y - end.y, end.x - start.x } * orientation;
+        // The edges are pushed outwards so the test is done against the voxel and not only its center
+        // The conservative test pushes them by the whole voxel, the thin one only by the diamond inscribed in it
+        const glm::vec2 absNormal = glm::abs(edgeNormal);
+        const float expansion = conservative ? 0.5f * (absNormal.x + absNormal.y) : 0.5f * std::max(absNormal.x, absNormal.y);
+        edges[i] = { edgeNormal, expansion - glm::dot(edgeNormal, start) };
+    }
+    return edges;
+}
+
+static bool testEdges(const std::array<EdgeFunction, 3>& edges, const glm::vec2 point)
+{
+    return glm::dot(edges[0].normal, point) + edges[0].offset >= 0.0f
+        && glm::dot(edges[1].normal, point) + edges[1].offset >= 0.0f
+        && glm::dot(edges[2].normal, point) + edges[2].offset >= 0.0f;
+}
+
+// Sorts the samples by key and keeps only the closest sample of every voxel
+static void keepClosestSamples(std::vector<RasterSample>& samples)
+{
+    std::sort(samples.begin(), samples.end(), [](const RasterSample& a, const RasterSample& b)
+    {
+        return a.key < b.key || (a.key == b.key && a.distance < b.distance);
+    });
+    const auto last = std::unique(samples.begin(), samples.end(), [](const RasterSample& a, const RasterSample& b) { return a.key == b.key; });
+    samples.erase(last, samples.end());
+}
+
+// Scan converts the triangle into the voxel grid of the given depth (Schwarz and Seidel, Fast Parallel Surface and Solid Voxelization on GPUs)
+// The triangle is walked in columns along the dominant axis of its normal. The plane bounds each column and the three projections discard the rest
+void Voxelizer::rasterizeTriangle(const uint32_t triangle, const AABB& root, const uint8_t depth, const Separability separability, std::vector<RasterSample>& samples) const
+{
+    const int resolution = 1 << depth;
+    const float voxelSize = root.halfSize * 2.0f / static_cast<float>(resolution);
+    const glm::vec3 rootMin = root.center - root.halfSize;
+
+    // All the tests are done in voxel units
+    std::array<glm::vec3, 3> vertices = getTrianglePos(triangle);
+    for (glm::vec3& vertex : vertices)
+        vertex = (vertex - rootMin) / voxelSize;
+
+    const glm::vec3 normal = glm::cross(vertices[1] - vertices[0], vertices[2] - vertices[0]);
+    const glm::vec3 absNormal = glm::abs(normal);
+    if (absNormal.x == 0.0f && absNormal.y == 0.0f && absNormal.z == 0.0f)
+        return;
+
+    uint8_t dominant = absNormal.x >= absNormal.y ? 0 : 1;
+    if (absNormal.z > absNormal[dominant])
+        dominant = 2;
+    const uint8_t axisA = (dominant + 1) % 3;
+    const uint8_t axisB = (dominant + 2) % 3;
+
+    const bool conservative = separability == Separability::SEPARATING_26;
+    const float planeRadius = conservative ? 0.5f * (absNormal.x + absNormal.y + absNormal.z) : 0.5f * absNormal[dominant];
+    const float planeOffset = glm::dot(normal, vertices[0]);
+
+    std::array<std::array<EdgeFunction, 3>, 3> projections;
+    for (uint8_t axis = 0; axis < 3; axis++)
+        projections[axis] = getProjectedEdges(vertices, normal, axis, conservative);
+
+    const glm::ivec3 maxIndex{ resolution - 1 };
+    const glm::ivec3 minVoxel = glm::clamp(glm::ivec3(glm::floor(glm::min(vertices[0], glm::min(vertices[1], vertices[2])))), glm::ivec3{ 0 }, maxIndex);
+    const glm::ivec3 maxVoxel = glm::clamp(glm::ivec3(glm::floor(glm::max(vertices[0], glm::max(vertices[1], vertices[2])))), glm::ivec3{ 0 }, maxIndex);
+
+    const Triangle data = getTriangle(triangle);
+    glm::vec3 center;
+    for (int a = minVoxel[axisA]; a <= maxVoxel[axisA]; a++)
+    {
+        center[axisA] = static_cast<float>(a) + 0.5f;
+        for (int b = minVoxel[axisB]; b <= maxVoxel[axisB]; b++)
+        {
+            center[axisB] = static_cast<float>(b) + 0.5f;
+            if (!testEdges(projections[dominant], projectOnAxis(center, dominant)))
+                continue;
+
+            // Range of the column whose voxels are close enough to the plane
+            const float columnOffset = planeOffset - normal[axisA] * center[axisA] - normal[axisB] * center[axisB];
+            float low = (columnOffset - planeRadius) / normal[dominant];
+            float high = (columnOffset + planeRadius) / normal[dominant];
+            if (low > high)
+                std::swap(low, high);
+            const int first = std::max(static_cast<int>(std::ceil(low - 0.5f)), minVoxel[dominant]);
+            const int last = std::min(static_cast<int>(std::floor(high - 0.5f)), maxVoxel[dominant]);
+
+            for (int c = first; c <= last; c++)
+            {
+                center[dominant] = static_cast<float>(c) + 0.5f;
+                if (!testEdges(projections[axisA], projectOnAxis(center, axisA)) || !testEdges(projections[axisB], projectOnAxis(center, axisB)))
+                    continue;
+
+                const glm::vec3 worldCenter = rootMin + center * voxelSize;
+                const Triangle::WeightData closest = data.getTriangleClosestWeight(worldCenter);
+                const std::optional<LeafNode> leaf = createLeaf(triangle, closest.weights, voxelSize);
+                if (leaf)
+                    samples.push_back({ mortonEncode(glm::uvec3(center)), glm::distance(closest.position, worldCenter), leaf->toRaw() });
+            }
+        }
+    }
+}
+
+// Alternative to the octree traversal. Instead of asking every node which triangles it intersects, every triangle is scan converted
+// into the leaves it covers, so the work is proportional to the surface and not to the number of nodes tested
+// Triangles are processed in parallel batches and every voxel keeps the closest triangle, like sampleVoxel does
+// The result is sorted by morton key and ready to be given to Octree::generateFromLeaves
+std::vector<MortonLeaf> Voxelizer::rasterize(const uint8_t depth, const Separability separability) const
+{
+    Logger::pushContext("Rasterization");
+    const AABB root = getModelAABB();
+
+    constexpr uint32_t batchSize = 4096;
+    const int batchCount = static_cast<int>((m_triangles.size() + batchSize - 1) / batchSize);
+    std::vector<std::vector<RasterSample>> batches(batchCount);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int batch = 0; batch < batchCount; batch++)
+    {
+        const uint32_t begin = static_cast<uint32_t>(batch) * batchSize;
+        const uint32_t end = std::min(begin + batchSize, static_cast<uint32_t>(m_triangles.size()));
+        for (uint32_t triangle = begin; triangle < end; triangle++)
+            rasterizeTriangle(triangle, root, depth, separability, batches[batch]);
+        keepClosestSamples(batches[batch]);
+    }
+
+    size_t sampleCount = 0;
+    for (const std::vector<RasterSample>& batch : batches)
+        sampleCount += batch.size();
+
+    std::vector<RasterSample> samples;
+    samples.reserve(sampleCount);
+    for (std::vector<RasterSample>& batch : batches)
+    {
+        samples.insert(samples.end(), batch.begin(), batch.end());
+        std::vector<RasterSample>().swap(batch);
+    }
+    keepClosestSamples(samples);
+
+    std::vector<MortonLeaf> leaves(samples.size());
+    for (size_t i = 0; i < samples.size(); i++)
+        leaves[i] = { samples[i].key, samples[i].leaf };
+
+    LOG_INFO("Rasterized ", m_triangles.size(), " triangles into ", leaves.size(), " leaves");
+    Logger::popContext();
+    return leaves;
+}
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <array>
+#include <optional>
+#include <span>
 #include <string>
 #include <glm/glm.hpp>
 
@@ -8,6 +10,7 @@
 #include <glm/gtx/hash.hpp>
 
 #include "octree.hpp"
+#include "../Texture/texture_data.hpp"
 
 // MODEL DATA
 
@@ -95,6 +98,14 @@ struct TriangleLeafIndex
     uint32_t index = 0;
 };
 
+// A voxel covered by a triangle during rasterization. Several triangles can cover the same voxel, the closest one is kept
+struct RasterSample
+{
+    uint64_t key;
+    float distance;
+    uint64_t leaf;
+};
+
 // VOXELIZER
 
 struct OctreeAccStructure
@@ -106,14 +117,32 @@ struct OctreeAccStructure
 class Voxelizer
 {
 public:
+    // Thickness of the rasterized surface. SEPARATING_6 is the thin shell the 6-connect test generates (no 6-connected path crosses it)
+    // SEPARATING_26 is the conservative shell, every voxel the triangle touches (no 26-connected path crosses it)
+    enum class Separability : uint8_t
+    {
+        SEPARATING_6,
+        SEPARATING_26
+    };
+
+    // Textures can be sampled once per leaf while voxelizing and the color stored in the leaf instead of the UV
+    // DIFFUSE stores an RGB888 diffuse color, DIFFUSE_SPECULAR stores an RGB565 diffuse color and 8 bits of specular
+    enum class ColorBaking : uint8_t
+    {
+        NONE,
+        DIFFUSE,
+        DIFFUSE_SPECULAR
+    };
+
     explicit Voxelizer(std::string filename, uint8_t maxDepth);
-    [[nodiscard]] TriangleLeafIndex AABBTriangle6Connect(uint32_t index, AABB shape) const;
+    Voxelizer(Model model, std::string baseDir, uint8_t maxDepth);
+    void AABBTriangle6Connect(std::span<const uint32_t> triangles, AABB shape, std::vector<TriangleLeafIndex>& hits) const;
 
     static bool intersectAABBTriangleSAT(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, AABB shape);
     static bool intersectAABBPoint(glm::vec3 point, AABB shape);
 
     bool doesAABBInteresect(const AABB& shape, bool isLeaf, uint8_t depth, uint8_t parallelIndex);
-    void sampleVoxel(NodeRef& node, uint8_t parallelIndex) const;
+    void sampleVoxel(NodeRef& node, const AABB& shape, uint8_t depth, uint8_t parallelIndex) const;
     [[nodiscard]] AABB getModelAABB() const;
     [[nodiscard]] const std::vector<Material>& getMaterials() const;
 
@@ -124,6 +153,17 @@ public:
 
     void resetOctreeData(uint8_t newDepth);
 
+    [[nodiscard]] std::vector<MortonLeaf> rasterize(uint8_t depth, Separability separability) const;
+
+    void setSolid(bool solid);
+    [[nodiscard]] bool isInside(glm::vec3 point) const;
+
+    void setAreaFiltering(bool enabled);
+    void setAdaptiveDepth(float tolerance);
+    // Also runs the alpha test of the diffuse textures while voxelizing, leaves that fail it are not created
+    void setColorBaking(ColorBaking baking);
+    [[nodiscard]] uint32_t getLeafFlags() const;
+
 private:
     [[nodiscard]] std::array<glm::vec3, 3> getTrianglePos(uint32_t triangle) const;
     [[nodiscard]] Triangle getTriangle(uint32_t triangle) const;
@@ -132,17 +172,58 @@ private:
     [[nodiscard]] std::array<glm::vec3, 3> getTrianglePos(TriangleRootIndex rootIndex) const;
     [[nodiscard]] Triangle getTriangle(TriangleRootIndex rootIndex) const;
     [[nodiscard]] Material getMaterial(TriangleRootIndex rootIndex) const;
+    [[nodiscard]] std::span<const uint32_t> getParentTriangles(uint8_t depth, uint8_t parallelIndex) const;
+
+    [[nodiscard]] std::optional<LeafNode> createLeaf(uint32_t triangle, glm::vec3 weights, float voxelSize) const;
+    void rasterizeTriangle(uint32_t triangle, const AABB& root, uint8_t depth, Separability separability, std::vector<RasterSample>& samples) const;
+    void sampleInterior(NodeRef& node, const AABB& shape, uint8_t depth, uint8_t parallelIndex) const;
+    [[nodiscard]] bool sampleVoxelByArea(NodeRef& node, const AABB& shape, uint8_t depth, uint8_t parallelIndex) const;
+    [[nodiscard]] bool isFlat(const AABB& shape, uint8_t depth, uint8_t maxDepth, uint8_t parallelIndex) const;
+    void prepareTriangles(uint8_t maxDepth);
+    void prepareLeafTest();
 
     Model m_model;
 
     std::vector<TriangleRootIndex> m_triangles;
+    // The triangles of a node at depth d are always the first spanSizes[d] indices of the array
+    // Each node reorders the span of its parent in place, so no index is copied during the traversal
     struct TriangleTree
     {
-        std::vector<std::vector<uint32_t>> branchTriangles{};
+        std::vector<uint32_t> triangles{};
+        std::vector<uint32_t> spanSizes{};
         std::vector<TriangleLeafIndex> leafTriangles{};
     };
     std::array<TriangleTree, 8> m_triangleTrees;
-    std::vector<uint32_t> m_rootTriangles;
+
+    struct LeafTestTriangle
+    {
+        glm::vec3 origin{};
+        glm::vec3 edge1{};
+        glm::vec3 edge2{};
+        glm::vec3 normal{};
+    };
+    std::vector<LeafTestTriangle> m_leafTestTriangles;
+
+    // Triangles binned over the YZ plane of the model for the parity test of the solid voxelization
+    bool m_solid = false;
+    uint32_t m_parityResolution = 0;
+    glm::vec2 m_parityMin{};
+    float m_parityCellSize = 0;
+    std::vector<uint32_t> m_parityCells;
+    std::vector<uint32_t> m_parityTriangles;
+
+    // Leaves average the attributes of every triangle inside of them, weighted by the area they cover
+    bool m_areaFiltering = false;
+
+    // Branches whose surface is flat within this error (in leaves of the maximum depth) become a single leaf, 0 disables it
+    float m_adaptiveTolerance = 0.0f;
+
+    // Textures sampled on the CPU when colors are baked into the leaves, or only the diffuse textures with transparent texels for the alpha test
+    // Each material points to its diffuse and specular texture in m_bakeTextures, UINT32_MAX if it doesn't have one
+    ColorBaking m_colorBaking = ColorBaking::NONE;
+    bool m_alphaTested = false;
+    std::vector<TextureData> m_bakeTextures;
+    std::vector<std::pair<uint32_t, uint32_t>> m_bakeMaterialTextures;
 
 
     std::string m_baseDir;
@@ -0,0 +1,112 @@
+#include "texture_data.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+// The images of every loader are decoded with the same stb_image, its implementation lives here
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "texture_processing.hpp"
+
+
+// Decoding happens once per texel fetch, so it is worth keeping a table for it
+static const std::array<float, 256> srgbTable = []
+{
+    std::array<float, 256> table{};
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        const float value = static_cast<float>(i) / 255.0f;
+        table[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+    return table;
+}();
+
+float srgbToLinear(const uint8_t value)
+{
+    return srgbTable[value];
+}
+
+uint8_t linearToSrgb(float value)
+{
+    value = glm::clamp(value, 0.0f, 1.0f);
+    value = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    return static_cast<uint8_t>(value * 255.0f + 0.5f);
+}
+
+// The constructor loads the image and builds the mip chain with a box filter, the same way the engine builds the mips of the GPU copy
+TextureData::TextureData(const std::string& path)
+{
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels)
+        throw std::runtime_error("failed to load texture image " + path);
+
+    m_mips.push_back({ static_cast<uint32_t>(width), static_cast<uint32_t>(height), {} });
+    MipLevel& base = m_mips.back();
+    base.texels.resize(static_cast<size_t>(width) * height);
+    memcpy(base.texels.data(), pixels, base.texels.size() * sizeof(glm::u8vec4));
+    stbi_image_free(pixels);
+
+    while (m_mips.back().width > 1 || m_mips.back().height > 1)
+    {
+        const MipLevel& prev = m_mips.back();
+        MipLevel next{ std::max(prev.width / 2, 1U), std::max(prev.height / 2, 1U), halveTexels(prev.texels, prev.width, prev.height) };
+        m_mips.push_back(std::move(next));
+    }
+}
+
+// Trilinear sample of the texture. The footprint is the size of the sampled area in UV units, it selects the mip level
+// UVs wrap around like the repeat sampler used in the GPU
+glm::vec4 TextureData::sample(const glm::vec2 uv, const float footprint) const
+{
+    const float texels = footprint * static_cast<float>(std::max(getWidth(), getHeight()));
+    const float lod = glm::clamp(std::log2(std::max(texels, 1.0f)), 0.0f, static_cast<float>(m_mips.size() - 1));
+    const uint32_t lowLevel = static_cast<uint32_t>(lod);
+    const uint32_t highLevel = std::min(lowLevel + 1, static_cast<uint32_t>(m_mips.size() - 1));
+    return glm::mix(sampleBilinear(m_mips[lowLevel], uv), sampleBilinear(m_mips[highLevel], uv), lod - static_cast<float>(lowLevel));
+}
+
+bool TextureData::hasAlphaBelow(const float alpha) const
+{
+    for (const glm::u8vec4& texel : m_mips[0].texels)
+    {
+        if (static_cast<float>(texel.w) / 255.0f < alpha)
+            return true;
+    }
+    return false;
+}
+
+uint32_t TextureData::getWidth() const
+{
+    return m_mips.front().width;
+}
+
+uint32_t TextureData::getHeight() const
+{
+    return m_mips.front().height;
+}
+
+glm::vec4 TextureData::fetch(const MipLevel& level, int32_t x, int32_t y) const
+{
+    x %= static_cast<int32_t>(level.width);
+    y %= static_cast<int32_t>(level.height);
+    if (x < 0) x += static_cast<int32_t>(level.width);
+    if (y < 0) y += static_cast<int32_t>(level.height);
+    const glm::u8vec4 texel = level.texels[y * level.width + x];
+    return { srgbToLinear(texel.x), srgbToLinear(texel.y), srgbToLinear(texel.z), static_cast<float>(texel.w) / 255.0f };
+}
+
+glm::vec4 TextureData::sampleBilinear(const MipLevel& level, const glm::vec2 uv) const
+{
+    const glm::vec2 pos = uv * glm::vec2{ static_cast<float>(level.width), static_cast<float>(level.height) } - 0.5f;
+    const glm::vec2 base = glm::floor(pos);
+    const glm::vec2 frac = pos - base;
+    const int32_t x = static_cast<int32_t>(base.x);
+    const int32_t y = static_cast<int32_t>(base.y);
+    const glm::vec4 top = glm::mix(fetch(level, x, y), fetch(level, x + 1, y), frac.x);
+    const glm::vec4 bottom = glm::mix(fetch(level, x, y + 1), fetch(level, x + 1, y + 1), frac.x);
+    return glm::mix(top, bottom, frac.y);
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// CPU copy of a texture with its full mip chain, used to sample textures while voxelizing
+// Texels are stored as 8 bit sRGB like the images in the GPU, but filtering is done in linear space
+class TextureData
+{
+public:
+    explicit TextureData(const std::string& path);
+
+    [[nodiscard]] glm::vec4 sample(glm::vec2 uv, float footprint) const;
+    // Whether a texel of the base level has less alpha than the given value. Filtering never goes below the lowest texel,
+    // so a texture without them passes any alpha test with that value
+    [[nodiscard]] bool hasAlphaBelow(float alpha) const;
+
+    [[nodiscard]] uint32_t getWidth() const;
+    [[nodiscard]] uint32_t getHeight() const;
+
+private:
+    struct MipLevel
+    {
+        uint32_t width;
+        uint32_t height;
+        std::vector<glm::u8vec4> texels;
+    };
+
+    [[nodiscard]] glm::vec4 fetch(const MipLevel& level, int32_t x, int32_t y) const;
+    [[nodiscard]] glm::vec4 sampleBilinear(const MipLevel& level, glm::vec2 uv) const;
+
+    std::vector<MipLevel> m_mips;
+};
+
+[[nodiscard]] float srgbToLinear(uint8_t value);
+[[nodiscard]] uint8_t linearToSrgb(float value);
@@ -0,0 +1,342 @@
+#include "texture_loader.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include <stb_image.h>
+
+// Cache files start with this magic, the format, the size and mip count of the image and the size of the source image (64 bits)
+// The mips follow it, in the layout getMipLayout() gives
+static constexpr uint32_t CACHE_MAGIC = 0x33545653; // "SVT3"
+static constexpr uint32_t CACHE_HEADER_SIZE = 7;
+
+TextureLoader::TextureLoader(std::filesystem::path cacheDir, const size_t memoryBudget, const TextureCompression compression, const uint32_t threadCount)
+    : m_cacheDir(std::move(cacheDir)), m_memoryBudget(memoryBudget), m_compression(compression), m_threadCount(threadCount)
+{
+    if (m_threadCount == 0)
+        m_threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+    if (!m_cacheDir.empty())
+    {
+        std::error_code error;
+        std::filesystem::create_directories(m_cacheDir, error);
+        if (error)
+            m_cacheDir.clear();
+    }
+}
+
+// The calling thread is the only one that touches the sink, so it can be the thread that owns the GPU resources
+// It only sleeps while no image is ready, so uploads overlap with the decoding of the next images
+std::vector<uint32_t> TextureLoader::load(const std::span<const std::string> paths, TextureUploadSink& sink)
+{
+    m_results.clear();
+    m_memoryInFlight = 0;
+    m_peakMemory = 0;
+    m_failed = false;
+    m_error.clear();
+    m_cacheHits = 0;
+    m_duplicates = 0;
+    m_files.assign(paths.size(), {});
+    m_imagePaths.clear();
+    m_imageDescs.clear();
+
+    std::vector<uint32_t> images(paths.size(), UINT32_MAX);
+    if (paths.empty())
+        return images;
+
+    // First pass, the images are numbered here so the numbering doesn't depend on which thread finished first
+    std::vector<std::thread> workers;
+    m_nextItem = 0;
+    for (uint32_t i = 0; i < std::min(m_threadCount, static_cast<uint32_t>(paths.size())); i++)
+        workers.emplace_back(&TextureLoader::describeWorker, this, paths);
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+    if (m_failed)
+        throw std::runtime_error(m_error);
+
+    std::unordered_map<uint64_t, uint32_t> hashes;
+    for (uint32_t path = 0; path < paths.size(); path++)
+    {
+        const FileInfo& file = m_files[path];
+        const auto [it, inserted] = hashes.try_emplace(file.hash, static_cast<uint32_t>(m_imagePaths.size()));
+        images[path] = it->second;
+        if (!inserted)
+        {
+            m_duplicates++;
+            continue;
+        }
+        m_imagePaths.push_back(path);
+        m_imageDescs.push_back(describeTexture(file.width, file.height, file.alpha, m_compression));
+    }
+    sink.prepare(m_imageDescs);
+
+    // Second pass. If the sink throws, the workers are stopped and joined before the exception leaves, std::thread can't be destroyed while joinable
+    m_nextItem = 0;
+    for (uint32_t i = 0; i < std::min(m_threadCount, static_cast<uint32_t>(m_imagePaths.size())); i++)
+        workers.emplace_back(&TextureLoader::decodeWorker, this, paths);
+    const auto stopWorkers = [&]
+    {
+        for (std::thread& worker : workers)
+            worker.join();
+    };
+
+    for (size_t received = 0; received < m_imagePaths.size(); received++)
+    {
+        DecodeResult result;
+        {
+            std::unique_lock lock{ m_mutex };
+            m_resultReady.wait(lock, [&] { return !m_results.empty() || m_failed; });
+            if (m_failed)
+                break;
+            result = std::move(m_results.front());
+            m_results.pop_front();
+        }
+
+        try
+        {
+            sink.upload(result.image, std::move(result.texture));
+        }
+        catch (...)
+        {
+            fail("texture upload failed");
+            stopWorkers();
+            throw;
+        }
+
+        {
+            std::lock_guard lock{ m_mutex };
+            m_memoryInFlight -= result.reserved;
+        }
+        m_memoryFreed.notify_all();
+    }
+
+    stopWorkers();
+    if (m_failed)
+        throw std::runtime_error(m_error);
+    return images;
+}
+
+uint32_t TextureLoader::getCacheHits() const
+{
+    return m_cacheHits;
+}
+
+uint32_t TextureLoader::getDuplicates() const
+{
+    return m_duplicates;
+}
+
+size_t TextureLoader::getPeakMemory() const
+{
+    return m_peakMemory;
+}
+
+// FNV-1a, it only has to tell files apart, not resist collisions made on purpose
+uint64_t TextureLoader::hashBytes(const std::span<const uint8_t> bytes)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (const uint8_t byte : bytes)
+    {
+        hash ^= byte;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// DECODING
+
+bool TextureLoader::readFile(const std::string& path, std::vector<uint8_t>& bytes)
+{
+    std::ifstream file{ path, std::ios::binary | std::ios::ate };
+    if (!file.is_open())
+    {
+        fail("failed to load texture image " + path);
+        return false;
+    }
+    bytes.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    return true;
+}
+
+// Each worker takes the next path until there are none left. Only the header of the image is parsed here,
+// which is enough to know what the image will be turned into
+void TextureLoader::describeWorker(const std::span<const std::string> paths)
+{
+    std::vector<uint8_t> bytes;
+    for (uint32_t path = m_nextItem++; path < paths.size(); path = m_nextItem++)
+    {
+        if (!readFile(paths[path], bytes))
+            return;
+        FileInfo& file = m_files[path];
+        file.hash = hashBytes(bytes);
+        int width, height, channels;
+        if (!stbi_info_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &channels))
+        {
+            fail("failed to load texture image " + paths[path]);
+            return;
+        }
+        file.width = static_cast<uint32_t>(width);
+        file.height = static_cast<uint32_t>(height);
+        // Grey and alpha or RGBA
+        file.alpha = channels == 2 || channels == 4;
+    }
+}
+
+// Each worker takes the next image until there are none left. The file is read again, the operating system usually still has it cached
+// The memory is reserved before decoding instead of after, the sizes are known from the first pass
+void TextureLoader::decodeWorker(const std::span<const std::string> paths)
+{
+    for (uint32_t image = m_nextItem++; image < m_imagePaths.size(); image = m_nextItem++)
+    {
+        const uint32_t path = m_imagePaths[image];
+        const TextureDesc& desc = m_imageDescs[image];
+        DecodeResult result;
+        result.image = image;
+        DecodedTexture& texture = result.texture;
+        texture.hash = m_files[path].hash;
+
+        result.reserved = getTextureSize(desc);
+        if (!reserveMemory(result.reserved))
+            return;
+        if (readCache(texture.hash, desc, texture))
+        {
+            m_cacheHits++;
+            pushResult(std::move(result));
+            continue;
+        }
+        {
+            std::lock_guard lock{ m_mutex };
+            m_memoryInFlight -= result.reserved;
+        }
+
+        // The decoded image, the resized RGBA8 level and the processed copy are alive at the same time while processing
+        texture.sourceSize = static_cast<uint64_t>(m_files[path].width) * m_files[path].height * 4;
+        result.reserved = static_cast<size_t>(texture.sourceSize) + static_cast<size_t>(desc.width) * desc.height * 4 + getTextureSize(desc);
+        if (!reserveMemory(result.reserved))
+            return;
+
+        std::vector<uint8_t> bytes;
+        if (!readFile(paths[path], bytes))
+            return;
+        int width, height, channels;
+        stbi_uc* pixels = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &width, &height, &channels, STBI_rgb_alpha);
+        if (!pixels)
+        {
+            fail("failed to load texture image " + paths[path]);
+            return;
+        }
+        bytes = {};
+        texture.width = static_cast<uint32_t>(width);
+        texture.height = static_cast<uint32_t>(height);
+        texture.pixels.resize(static_cast<size_t>(texture.sourceSize));
+        memcpy(texture.pixels.data(), pixels, texture.pixels.size());
+        stbi_image_free(pixels);
+        processTexture(texture, desc);
+        writeCache(texture);
+        pushResult(std::move(result));
+    }
+}
+
+// Blocks until the image fits in the budget. A single image bigger than the budget is let through once nothing else is in flight
+// Returns false if another thread failed while waiting
+bool TextureLoader::reserveMemory(const size_t bytes)
+{
+    std::unique_lock lock{ m_mutex };
+    m_memoryFreed.wait(lock, [&] { return m_failed || m_memoryInFlight == 0 || m_memoryInFlight + bytes <= m_memoryBudget; });
+    if (m_failed)
+        return false;
+    m_memoryInFlight += bytes;
+    m_peakMemory = std::max(m_peakMemory, m_memoryInFlight);
+    return true;
+}
+
+void TextureLoader::pushResult(DecodeResult&& result)
+{
+    {
+        std::lock_guard lock{ m_mutex };
+        m_results.push_back(std::move(result));
+    }
+    m_resultReady.notify_one();
+}
+
+// The first error stops every thread, the uploading thread throws it once all of them are joined
+void TextureLoader::fail(const std::string& error)
+{
+    {
+        std::lock_guard lock{ m_mutex };
+        if (!m_failed)
+            m_error = error;
+        m_failed = true;
+    }
+    m_resultReady.notify_all();
+    m_memoryFreed.notify_all();
+}
+
+// DISK CACHE
+
+// Entries are named after the hash of the file they were decoded from and what it was turned into, so an edited image simply gets a new entry
+std::filesystem::path TextureLoader::getCachePath(const uint64_t hash, const TextureDesc& desc) const
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx_%u_%ux%u.tex", static_cast<unsigned long long>(hash), static_cast<uint32_t>(desc.format), desc.width, desc.height);
+    return m_cacheDir / name;
+}
+
+bool TextureLoader::readCache(const uint64_t hash, const TextureDesc& desc, DecodedTexture& texture) const
+{
+    if (m_cacheDir.empty())
+        return false;
+    std::ifstream file{ getCachePath(hash, desc), std::ios::binary };
+    uint32_t header[CACHE_HEADER_SIZE]{};
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != CACHE_MAGIC)
+        return false;
+    if (header[1] != static_cast<uint32_t>(desc.format) || header[2] != desc.width || header[3] != desc.height || header[4] != desc.mipCount)
+        return false;
+    texture.format = desc.format;
+    texture.width = desc.width;
+    texture.height = desc.height;
+    texture.mipCount = desc.mipCount;
+    texture.sourceSize = static_cast<uint64_t>(header[6]) << 32 | header[5];
+    texture.pixels.resize(getTextureSize(desc));
+    if (!file.read(reinterpret_cast<char*>(texture.pixels.data()), static_cast<std::streamsize>(texture.pixels.size())))
+    {
+        texture.pixels = {};
+        return false;
+    }
+    return true;
+}
+
+// The entry is written to a temporary file and renamed, so a run that is killed halfway never leaves a truncated entry behind
+// Failing to write it is not an error, the image is just processed again next time
+void TextureLoader::writeCache(const DecodedTexture& texture) const
+{
+    if (m_cacheDir.empty())
+        return;
+    const std::filesystem::path path = getCachePath(texture.hash, { texture.format, texture.width, texture.height, texture.mipCount });
+    std::filesystem::path tempPath = path;
+    tempPath += ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        std::ofstream file{ tempPath, std::ios::binary };
+        const uint32_t header[CACHE_HEADER_SIZE]{ CACHE_MAGIC, static_cast<uint32_t>(texture.format), texture.width, texture.height, texture.mipCount,
+            static_cast<uint32_t>(texture.sourceSize), static_cast<uint32_t>(texture.sourceSize >> 32) };
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(texture.pixels.data()), static_cast<std::streamsize>(texture.pixels.size()));
+        if (!file)
+        {
+            file.close();
+            std::error_code error;
+            std::filesystem::remove(tempPath, error);
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    if (error)
+        std::filesystem::remove(tempPath, error);
+}
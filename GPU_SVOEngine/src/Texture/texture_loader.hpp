@@ -0,0 +1,106 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "texture_processing.hpp"
+
+// Receives the decoded images in the thread that called TextureLoader::load, in the order they finish decoding
+// The engine uploads them to the GPU. Anything else can be plugged in without Vulkan, like the sink of GPU_SVOEngine/tests/texture_loader_tests.cpp that records them
+class TextureUploadSink
+{
+public:
+    virtual ~TextureUploadSink() = default;
+
+    // Called once before anything is decoded, with what each image will be turned into. The sink can change the descriptions
+    // (to fit the images in fewer GPU textures, for example), the images are processed to match them
+    virtual void prepare(std::span<TextureDesc> images) = 0;
+    // Images are numbered in the order their first path appears, starting at 0. The texture is moved in and freed as soon as this returns,
+    // unless the sink moves it somewhere else to keep it
+    virtual void upload(uint32_t image, DecodedTexture texture) = 0;
+};
+
+// TEXTURE LOADER
+
+// Loads a list of images on a pool of threads in two passes. The first one reads and hashes every file and looks at its header,
+// paths with the same content become a single image and the sink gets the description of every image
+// The second one decodes the images while the calling thread hands them to the sink as they complete
+// Each thread also resizes its image, builds the mip chain and compresses it, so the processing of different textures runs in parallel
+// Processed images are stored in the cache directory by hash and description, later runs read them back instead of processing them again
+// Decoding waits while the images that haven't been uploaded yet go over the memory budget, except if there are none
+class TextureLoader
+{
+public:
+    // An empty cache directory disables the disk cache, a thread count of 0 uses all hardware threads
+    TextureLoader(std::filesystem::path cacheDir, size_t memoryBudget, TextureCompression compression = TextureCompression::NONE, uint32_t threadCount = 0);
+
+    // Returns the image each path ended up in, paths with the same content share it
+    [[nodiscard]] std::vector<uint32_t> load(std::span<const std::string> paths, TextureUploadSink& sink);
+
+    [[nodiscard]] uint32_t getCacheHits() const;
+    [[nodiscard]] uint32_t getDuplicates() const;
+    // Most memory reserved at once by the images of the last load, it stays under the budget unless a single image is bigger
+    [[nodiscard]] size_t getPeakMemory() const;
+
+    [[nodiscard]] static uint64_t hashBytes(std::span<const uint8_t> bytes);
+
+private:
+    // What the first pass finds out about each path
+    struct FileInfo
+    {
+        uint64_t hash = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        bool alpha = false;
+    };
+
+    struct DecodeResult
+    {
+        uint32_t image = 0;
+        // Memory reserved for the image, released once it is uploaded
+        size_t reserved = 0;
+        DecodedTexture texture;
+    };
+
+    void describeWorker(std::span<const std::string> paths);
+    void decodeWorker(std::span<const std::string> paths);
+    [[nodiscard]] bool readFile(const std::string& path, std::vector<uint8_t>& bytes);
+    [[nodiscard]] bool reserveMemory(size_t bytes);
+    void pushResult(DecodeResult&& result);
+    void fail(const std::string& error);
+
+    [[nodiscard]] std::filesystem::path getCachePath(uint64_t hash, const TextureDesc& desc) const;
+    [[nodiscard]] bool readCache(uint64_t hash, const TextureDesc& desc, DecodedTexture& texture) const;
+    void writeCache(const DecodedTexture& texture) const;
+
+    std::filesystem::path m_cacheDir;
+    size_t m_memoryBudget;
+    TextureCompression m_compression;
+    uint32_t m_threadCount;
+
+    // Shared between the decoding threads and the uploading thread, everything below is guarded by the mutex except the counters
+    std::mutex m_mutex;
+    std::condition_variable m_resultReady;
+    std::condition_variable m_memoryFreed;
+    std::deque<DecodeResult> m_results;
+    size_t m_memoryInFlight = 0;
+    size_t m_peakMemory = 0;
+    bool m_failed = false;
+    std::string m_error;
+
+    // Filled by the first pass, each thread only writes the entries of the paths it takes
+    std::vector<FileInfo> m_files;
+    // First path and description of each image, read by the second pass
+    std::vector<uint32_t> m_imagePaths;
+    std::vector<TextureDesc> m_imageDescs;
+
+    std::atomic<uint32_t> m_nextItem = 0;
+    std::atomic<uint32_t> m_cacheHits = 0;
+    std::atomic<uint32_t> m_duplicates = 0;
+};
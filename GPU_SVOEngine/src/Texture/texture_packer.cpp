@@ -0,0 +1,94 @@
+#include "texture_packer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <map>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+// Classes are sorted by format and then by size, which is also the order the arrays are created in
+using SizeClass = std::tuple<TextureFormat, uint32_t, uint32_t>;
+
+static SizeClass getSizeClass(const TextureDesc& desc)
+{
+    return { desc.format, desc.width, desc.height };
+}
+
+static uint32_t getArrayCount(const std::map<SizeClass, std::vector<uint32_t>>& classes, const uint32_t maxLayers)
+{
+    uint32_t count = 0;
+    for (const std::vector<uint32_t>& images : classes | std::views::values)
+        count += (static_cast<uint32_t>(images.size()) + maxLayers - 1) / maxLayers;
+    return count;
+}
+
+// Lower is better: changing the format is the last resort, then how much detail changes (each image counts the halvings or doublings
+// its axes go through) and, if that is the same, growing the images instead of shrinking them
+// Sizes are powers of two, so the amount of halvings is the difference of their trailing zeros
+static std::tuple<bool, uint64_t, bool> getMergeCost(const SizeClass& from, const size_t images, const SizeClass& to)
+{
+    const auto [fromFormat, fromWidth, fromHeight] = from;
+    const auto [toFormat, toWidth, toHeight] = to;
+    const uint64_t steps = std::abs(std::countr_zero(toWidth) - std::countr_zero(fromWidth)) + std::abs(std::countr_zero(toHeight) - std::countr_zero(fromHeight));
+    return { fromFormat != toFormat, steps * images, static_cast<uint64_t>(toWidth) * toHeight > static_cast<uint64_t>(fromWidth) * fromHeight };
+}
+
+static bool canMerge(const TextureFormat from, const TextureFormat to)
+{
+    return from == to || (from == TextureFormat::BC1 && to == TextureFormat::BC3);
+}
+
+TexturePacking packTextures(const std::span<TextureDesc> images, const uint32_t maxArrays, const uint32_t maxLayers)
+{
+    std::map<SizeClass, std::vector<uint32_t>> classes;
+    for (uint32_t i = 0; i < images.size(); i++)
+        classes[getSizeClass(images[i])].push_back(i);
+
+    while (getArrayCount(classes, maxLayers) > maxArrays)
+    {
+        // Every pair of classes is tried, the cheapest merge wins. Ties go to the first pair in class order
+        auto source = classes.end();
+        auto target = classes.end();
+        for (auto from = classes.begin(); from != classes.end(); ++from)
+        {
+            for (auto to = classes.begin(); to != classes.end(); ++to)
+            {
+                if (to == from || !canMerge(std::get<0>(from->first), std::get<0>(to->first)))
+                    continue;
+                if (source == classes.end() || getMergeCost(from->first, from->second.size(), to->first) < getMergeCost(source->first, source->second.size(), target->first))
+                {
+                    source = from;
+                    target = to;
+                }
+            }
+        }
+        if (source == classes.end())
+            throw std::runtime_error("textures need more than " + std::to_string(maxArrays) + " texture arrays");
+
+        const auto [format, width, height] = target->first;
+        for (const uint32_t image : source->second)
+        {
+            images[image] = { format, width, height, getMipCount(width, height) };
+            target->second.push_back(image);
+        }
+        classes.erase(source);
+    }
+
+    // Layers follow the order of the images, so the same scene always packs the same way
+    TexturePacking packing;
+    packing.placements.resize(images.size());
+    for (std::vector<uint32_t>& classImages : classes | std::views::values)
+    {
+        std::ranges::sort(classImages);
+        for (uint32_t i = 0; i < classImages.size(); i++)
+        {
+            if (i % maxLayers == 0)
+                packing.arrays.push_back({ images[classImages[i]], 0 });
+            packing.placements[classImages[i]] = { static_cast<uint32_t>(packing.arrays.size() - 1), packing.arrays.back().layers++ };
+        }
+    }
+    return packing;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "texture_processing.hpp"
+
+// One GPU texture array, every layer has the same format, size and mip count
+struct TextureArrayDesc
+{
+    TextureDesc layer;
+    uint32_t layers = 0;
+};
+
+struct TexturePlacement
+{
+    uint32_t array = 0;
+    uint32_t layer = 0;
+};
+
+struct TexturePacking
+{
+    std::vector<TextureArrayDesc> arrays;
+    // Where each image ended up, in the same order as the images given to packTextures()
+    std::vector<TexturePlacement> placements;
+};
+
+// TEXTURE PACKING
+
+// Groups the images into texture arrays by size class (format and size), so the shader only needs a fixed amount of samplers
+// If there are more classes than arrays, classes are merged into others until they fit, always picking the merge that
+// changes the resolution of the fewest images by the fewest steps. Formats only change as a last resort, BC1 images can go into BC3 classes
+// Merged images have their description changed in place, they have to be processed to match it before uploading
+// The result only depends on the descriptions, never on the order the images finish loading in
+[[nodiscard]] TexturePacking packTextures(std::span<TextureDesc> images, uint32_t maxArrays, uint32_t maxLayers);
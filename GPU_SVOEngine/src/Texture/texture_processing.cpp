@@ -0,0 +1,455 @@
+#include "texture_processing.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#include "texture_data.hpp"
+
+uint32_t getMipCount(uint32_t width, uint32_t height)
+{
+    uint32_t count = 1;
+    while (width > 1 || height > 1)
+    {
+        width = std::max(width / 2, 1U);
+        height = std::max(height / 2, 1U);
+        count++;
+    }
+    return count;
+}
+
+std::vector<TextureMip> getMipLayout(const TextureFormat format, uint32_t width, uint32_t height, const uint32_t mipCount)
+{
+    std::vector<TextureMip> mips;
+    size_t offset = 0;
+    for (uint32_t i = 0; i < mipCount; i++)
+    {
+        const size_t blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+        size_t size = 0;
+        switch (format)
+        {
+        case TextureFormat::RGBA8: size = static_cast<size_t>(width) * height * 4; break;
+        case TextureFormat::BC1: size = blocks * 8; break;
+        case TextureFormat::BC3:
+        case TextureFormat::BC7: size = blocks * 16; break;
+        }
+        mips.push_back({ width, height, offset, size });
+        offset += size;
+        width = std::max(width / 2, 1U);
+        height = std::max(height / 2, 1U);
+    }
+    return mips;
+}
+
+size_t getTextureSize(const TextureDesc& desc)
+{
+    const std::vector<TextureMip> mips = getMipLayout(desc.format, desc.width, desc.height, desc.mipCount);
+    return mips.back().offset + mips.back().size;
+}
+
+// The closest power of two is measured linearly, so 1536 and above round up to 2048
+static uint32_t roundToPowerOfTwo(const uint32_t size)
+{
+    const uint32_t lower = std::bit_floor(std::max(size, 1U));
+    return size * 2 >= lower * 3 ? lower * 2 : lower;
+}
+
+TextureDesc describeTexture(const uint32_t width, const uint32_t height, const bool alpha, const TextureCompression compression)
+{
+    TextureDesc desc;
+    desc.width = std::min(roundToPowerOfTwo(width), MAX_TEXTURE_SIZE);
+    desc.height = std::min(roundToPowerOfTwo(height), MAX_TEXTURE_SIZE);
+    desc.mipCount = getMipCount(desc.width, desc.height);
+    if (compression == TextureCompression::BC7)
+        desc.format = TextureFormat::BC7;
+    else if (compression == TextureCompression::BC)
+        desc.format = alpha ? TextureFormat::BC3 : TextureFormat::BC1;
+    return desc;
+}
+
+std::vector<glm::u8vec4> halveTexels(const std::vector<glm::u8vec4>& texels, const uint32_t width, const uint32_t height)
+{
+    const uint32_t nextWidth = std::max(width / 2, 1U);
+    const uint32_t nextHeight = std::max(height / 2, 1U);
+    std::vector<glm::u8vec4> next(static_cast<size_t>(nextWidth) * nextHeight);
+    for (uint32_t y = 0; y < nextHeight; y++)
+    {
+        for (uint32_t x = 0; x < nextWidth; x++)
+        {
+            glm::vec4 sum{ 0.0f };
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                const uint32_t srcX = std::min(x * 2 + (i & 1), width - 1);
+                const uint32_t srcY = std::min(y * 2 + (i >> 1), height - 1);
+                const glm::u8vec4 texel = texels[srcY * width + srcX];
+                sum += glm::vec4{ srgbToLinear(texel.x), srgbToLinear(texel.y), srgbToLinear(texel.z), static_cast<float>(texel.w) / 255.0f };
+            }
+            sum *= 0.25f;
+            next[y * nextWidth + x] = { linearToSrgb(sum.x), linearToSrgb(sum.y), linearToSrgb(sum.z), static_cast<uint8_t>(sum.w * 255.0f + 0.5f) };
+        }
+    }
+    return next;
+}
+
+// Weights of the source texels that cover each texel of the resized axis. The tent is widened when shrinking, so every source texel contributes
+// Sources out of the image clamp to the edge
+static std::vector<std::vector<std::pair<uint32_t, float>>> getResampleWeights(const uint32_t size, const uint32_t newSize)
+{
+    const float scale = static_cast<float>(size) / static_cast<float>(newSize);
+    const float radius = std::max(scale, 1.0f);
+    std::vector<std::vector<std::pair<uint32_t, float>>> weights(newSize);
+    for (uint32_t i = 0; i < newSize; i++)
+    {
+        const float center = (static_cast<float>(i) + 0.5f) * scale - 0.5f;
+        const int32_t first = static_cast<int32_t>(std::floor(center - radius)) + 1;
+        const int32_t last = static_cast<int32_t>(std::floor(center + radius));
+        float total = 0.0f;
+        for (int32_t source = first; source <= last; source++)
+        {
+            const float weight = std::max(1.0f - std::abs(static_cast<float>(source) - center) / radius, 0.0f);
+            weights[i].emplace_back(static_cast<uint32_t>(std::clamp(source, 0, static_cast<int32_t>(size) - 1)), weight);
+            total += weight;
+        }
+        for (std::pair<uint32_t, float>& weight : weights[i])
+            weight.second /= total;
+    }
+    return weights;
+}
+
+std::vector<glm::u8vec4> resampleTexels(const std::vector<glm::u8vec4>& texels, const uint32_t width, const uint32_t height, const uint32_t newWidth, const uint32_t newHeight)
+{
+    std::array<float, 256> linear;
+    for (uint32_t i = 0; i < 256; i++)
+        linear[i] = srgbToLinear(static_cast<uint8_t>(i));
+
+    const std::vector<std::vector<std::pair<uint32_t, float>>> weightsX = getResampleWeights(width, newWidth);
+    const std::vector<std::vector<std::pair<uint32_t, float>>> weightsY = getResampleWeights(height, newHeight);
+    std::vector<glm::u8vec4> resized(static_cast<size_t>(newWidth) * newHeight);
+    for (uint32_t y = 0; y < newHeight; y++)
+    {
+        for (uint32_t x = 0; x < newWidth; x++)
+        {
+            glm::vec4 sum{ 0.0f };
+            for (const auto& [srcY, weightY] : weightsY[y])
+            {
+                for (const auto& [srcX, weightX] : weightsX[x])
+                {
+                    const glm::u8vec4 texel = texels[static_cast<size_t>(srcY) * width + srcX];
+                    sum += weightY * weightX * glm::vec4{ linear[texel.x], linear[texel.y], linear[texel.z], static_cast<float>(texel.w) / 255.0f };
+                }
+            }
+            resized[static_cast<size_t>(y) * newWidth + x] = { linearToSrgb(sum.x), linearToSrgb(sum.y), linearToSrgb(sum.z), static_cast<uint8_t>(std::clamp(sum.w, 0.0f, 1.0f) * 255.0f + 0.5f) };
+        }
+    }
+    return resized;
+}
+
+void processTexture(DecodedTexture& texture, const TextureDesc& desc)
+{
+    std::vector<glm::u8vec4> level(static_cast<size_t>(texture.width) * texture.height);
+    memcpy(level.data(), texture.pixels.data(), level.size() * sizeof(glm::u8vec4));
+    texture.pixels = {};
+
+    // The image is halved while it is at least twice the size it needs on both axes, the rest is left to the resampling
+    uint32_t width = texture.width;
+    uint32_t height = texture.height;
+    while (width >= desc.width * 2 && height >= desc.height * 2)
+    {
+        level = halveTexels(level, width, height);
+        width /= 2;
+        height /= 2;
+    }
+    if (width != desc.width || height != desc.height)
+        level = resampleTexels(level, width, height, desc.width, desc.height);
+    texture.width = desc.width;
+    texture.height = desc.height;
+    texture.mipCount = desc.mipCount;
+    texture.format = desc.format;
+    width = desc.width;
+    height = desc.height;
+
+    const std::vector<TextureMip> mips = getMipLayout(texture.format, width, height, texture.mipCount);
+    texture.pixels.resize(mips.back().offset + mips.back().size);
+    for (uint32_t i = 0; i < texture.mipCount; i++)
+    {
+        const TextureMip& mip = mips[i];
+        uint8_t* output = texture.pixels.data() + mip.offset;
+        if (texture.format == TextureFormat::RGBA8)
+            memcpy(output, level.data(), mip.size);
+        else
+        {
+            // Blocks that go past the edge of the level repeat its last row and column
+            const size_t blockSize = texture.format == TextureFormat::BC1 ? 8 : 16;
+            std::array<glm::u8vec4, 16> block;
+            for (uint32_t blockY = 0; blockY < mip.height; blockY += 4)
+            {
+                for (uint32_t blockX = 0; blockX < mip.width; blockX += 4)
+                {
+                    for (uint32_t j = 0; j < 16; j++)
+                        block[j] = level[std::min(blockY + j / 4, mip.height - 1) * mip.width + std::min(blockX + j % 4, mip.width - 1)];
+                    switch (texture.format)
+                    {
+                    case TextureFormat::BC1: encodeBC1(block.data(), output); break;
+                    case TextureFormat::BC3: encodeBC3(block.data(), output); break;
+                    default: encodeBC7(block.data(), output); break;
+                    }
+                    output += blockSize;
+                }
+            }
+        }
+        if (i + 1 < texture.mipCount)
+            level = halveTexels(level, mip.width, mip.height);
+    }
+}
+
+// BLOCK ENCODERS
+
+// Direction along which the texels of the block vary the most, found with a few power iterations over their covariance
+// The endpoints of all encoders are picked along this line, which is what makes the interpolated palette fit the block
+template<typename Vec>
+static Vec getPrincipalAxis(const std::array<Vec, 16>& texels, Vec& mean)
+{
+    constexpr uint32_t channels = sizeof(Vec) / sizeof(float);
+    mean = Vec{ 0.0f };
+    for (const Vec& texel : texels)
+        mean += texel;
+    mean /= 16.0f;
+
+    std::array<Vec, channels> covariance{};
+    Vec minTexel{ 255.0f };
+    Vec maxTexel{ 0.0f };
+    for (const Vec& texel : texels)
+    {
+        const Vec diff = texel - mean;
+        for (uint32_t i = 0; i < channels; i++)
+            covariance[i] += diff * diff[i];
+        minTexel = glm::min(minTexel, texel);
+        maxTexel = glm::max(maxTexel, texel);
+    }
+
+    Vec axis = maxTexel - minTexel;
+    if (glm::dot(axis, axis) == 0.0f)
+        return Vec{ 0.0f };
+    for (uint32_t iteration = 0; iteration < 8; iteration++)
+    {
+        Vec next{ 0.0f };
+        for (uint32_t i = 0; i < channels; i++)
+            next[i] = glm::dot(covariance[i], axis);
+        const float length = glm::length(next);
+        if (length == 0.0f)
+            break;
+        axis = next / length;
+    }
+    return glm::normalize(axis);
+}
+
+// Endpoints at both ends of the projection of the texels on the axis, moved inwards by the given fraction of the range
+template<typename Vec>
+static std::pair<Vec, Vec> getEndpoints(const std::array<Vec, 16>& texels, const float inset)
+{
+    Vec mean;
+    const Vec axis = getPrincipalAxis(texels, mean);
+    float minT = 0.0f;
+    float maxT = 0.0f;
+    for (const Vec& texel : texels)
+    {
+        const float t = glm::dot(texel - mean, axis);
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    const float border = (maxT - minT) * inset;
+    return { glm::clamp(mean + axis * (maxT - border), 0.0f, 255.0f), glm::clamp(mean + axis * (minT + border), 0.0f, 255.0f) };
+}
+
+static uint16_t packRGB565(const glm::vec3 color)
+{
+    const glm::uvec3 quantized = glm::uvec3(glm::round(color * glm::vec3{ 31.0f, 63.0f, 31.0f } / 255.0f));
+    return static_cast<uint16_t>(quantized.x << 11 | quantized.y << 5 | quantized.z);
+}
+
+static glm::vec3 unpackRGB565(const uint16_t color)
+{
+    const uint32_t r = color >> 11 & 0x1F;
+    const uint32_t g = color >> 5 & 0x3F;
+    const uint32_t b = color & 0x1F;
+    return { static_cast<float>(r << 3 | r >> 2), static_cast<float>(g << 2 | g >> 4), static_cast<float>(b << 3 | b >> 2) };
+}
+
+// Always uses the 4 color mode, the only one BC3 supports, so the alpha in BC1 blocks is ignored
+void encodeBC1(const glm::u8vec4* block, uint8_t* output)
+{
+    std::array<glm::vec3, 16> colors;
+    for (uint32_t i = 0; i < 16; i++)
+        colors[i] = glm::vec3(glm::vec4(block[i]));
+    const auto [first, second] = getEndpoints(colors, 1.0f / 16.0f);
+
+    uint16_t color0 = packRGB565(first);
+    uint16_t color1 = packRGB565(second);
+    // The 4 color mode is chosen by color0 > color1. If both are the same every texel takes index 0 and the mode doesn't matter
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1)
+    {
+        const glm::vec3 end0 = unpackRGB565(color0);
+        const glm::vec3 end1 = unpackRGB565(color1);
+        const std::array<glm::vec3, 4> palette{ end0, end1, (2.0f * end0 + end1) / 3.0f, (end0 + 2.0f * end1) / 3.0f };
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            uint32_t best = 0;
+            float bestError = FLT_MAX;
+            for (uint32_t j = 0; j < 4; j++)
+            {
+                const glm::vec3 diff = colors[i] - palette[j];
+                const float error = glm::dot(diff, diff);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = j;
+                }
+            }
+            indices |= best << (i * 2);
+        }
+    }
+    memcpy(output, &color0, 2);
+    memcpy(output + 2, &color1, 2);
+    memcpy(output + 4, &indices, 4);
+}
+
+// An 8 value alpha block from the lowest to the highest alpha, followed by a BC1 color block
+void encodeBC3(const glm::u8vec4* block, uint8_t* output)
+{
+    uint8_t alpha0 = 0;
+    uint8_t alpha1 = 255;
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        alpha0 = std::max(alpha0, block[i].w);
+        alpha1 = std::min(alpha1, block[i].w);
+    }
+
+    uint64_t indices = 0;
+    if (alpha0 != alpha1)
+    {
+        std::array<float, 8> palette{ static_cast<float>(alpha0), static_cast<float>(alpha1) };
+        for (uint32_t j = 2; j < 8; j++)
+            palette[j] = (static_cast<float>(8 - j) * alpha0 + static_cast<float>(j - 1) * alpha1) / 7.0f;
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            uint64_t best = 0;
+            float bestError = FLT_MAX;
+            for (uint32_t j = 0; j < 8; j++)
+            {
+                const float error = std::abs(static_cast<float>(block[i].w) - palette[j]);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = j;
+                }
+            }
+            indices |= best << (i * 3);
+        }
+    }
+    output[0] = alpha0;
+    output[1] = alpha1;
+    memcpy(output + 2, &indices, 6);
+    encodeBC1(block, output + 8);
+}
+
+// Writes values into a 128 bit block from the lowest bit up
+class BlockWriter
+{
+public:
+    explicit BlockWriter(uint8_t* output) : m_output(output) { memset(output, 0, 16); }
+
+    void write(const uint32_t value, const uint32_t bits)
+    {
+        for (uint32_t i = 0; i < bits; i++)
+        {
+            if ((value >> i & 1) != 0)
+                m_output[m_position / 8] |= static_cast<uint8_t>(1 << (m_position % 8));
+            m_position++;
+        }
+    }
+
+private:
+    uint8_t* m_output;
+    uint32_t m_position = 0;
+};
+
+void encodeBC7(const glm::u8vec4* block, uint8_t* output)
+{
+    static constexpr std::array<uint32_t, 16> weights{ 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    std::array<glm::vec4, 16> texels;
+    for (uint32_t i = 0; i < 16; i++)
+        texels[i] = glm::vec4(block[i]);
+    const auto [first, second] = getEndpoints(texels, 0.0f);
+
+    // Endpoints have 7 bits per channel plus a bit shared by the 4 channels that becomes the lowest bit of all of them
+    std::array<glm::uvec4, 2> quantized;
+    std::array<uint32_t, 2> pBits;
+    std::array<glm::uvec4, 2> endpoints;
+    for (uint32_t e = 0; e < 2; e++)
+    {
+        const glm::vec4 endpoint = e == 0 ? first : second;
+        float bestError = FLT_MAX;
+        for (uint32_t p = 0; p < 2; p++)
+        {
+            const glm::uvec4 value = glm::uvec4(glm::clamp(glm::round((endpoint - static_cast<float>(p)) / 2.0f), 0.0f, 127.0f));
+            const glm::vec4 diff = endpoint - glm::vec4(value * 2U + p);
+            const float error = glm::dot(diff, diff);
+            if (error < bestError)
+            {
+                bestError = error;
+                quantized[e] = value;
+                pBits[e] = p;
+            }
+        }
+        endpoints[e] = quantized[e] * 2U + pBits[e];
+    }
+
+    std::array<glm::vec4, 16> palette;
+    for (uint32_t j = 0; j < 16; j++)
+        palette[j] = glm::vec4((endpoints[0] * (64 - weights[j]) + endpoints[1] * weights[j] + 32U) / 64U);
+    std::array<uint32_t, 16> indices;
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        float bestError = FLT_MAX;
+        for (uint32_t j = 0; j < 16; j++)
+        {
+            const glm::vec4 diff = texels[i] - palette[j];
+            const float error = glm::dot(diff, diff);
+            if (error < bestError)
+            {
+                bestError = error;
+                indices[i] = j;
+            }
+        }
+    }
+
+    // The first index is stored with 3 bits, so its highest bit must be 0. Swapping the endpoints flips every index
+    if (indices[0] >= 8)
+    {
+        std::swap(quantized[0], quantized[1]);
+        std::swap(pBits[0], pBits[1]);
+        for (uint32_t& index : indices)
+            index = 15 - index;
+    }
+
+    BlockWriter writer{ output };
+    writer.write(1 << 6, 7);
+    for (uint32_t channel = 0; channel < 4; channel++)
+    {
+        writer.write(quantized[0][channel], 7);
+        writer.write(quantized[1][channel], 7);
+    }
+    writer.write(pBits[0], 1);
+    writer.write(pBits[1], 1);
+    writer.write(indices[0], 3);
+    for (uint32_t i = 1; i < 16; i++)
+        writer.write(indices[i], 4);
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Leaf UVs have 12 bits per axis, so no texture needs more texels than they can address
+static constexpr uint32_t MAX_TEXTURE_SIZE = 1 << 12;
+
+// Format of the texels in the GPU. All of them are sRGB, the block formats encode 4x4 texel blocks
+enum class TextureFormat : uint8_t
+{
+    RGBA8,
+    BC1,
+    BC3,
+    BC7
+};
+
+// Compression requested for the textures. BC uses BC1 for images without an alpha channel and BC3 for the ones with it
+// BC7 has better quality for both at the size of BC3
+enum class TextureCompression : uint8_t
+{
+    NONE,
+    BC,
+    BC7
+};
+
+// What an image is turned into before uploading it. Sizes are always powers of two, so textures of similar size share a size class
+struct TextureDesc
+{
+    TextureFormat format = TextureFormat::RGBA8;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t mipCount = 1;
+};
+
+struct TextureMip
+{
+    uint32_t width;
+    uint32_t height;
+    size_t offset;
+    size_t size;
+};
+
+// Image decoded to RGBA8 and then turned into its final format with the full mip chain, ready to be copied into a staging buffer
+// The mips are packed one after the other in pixels, getMipLayout() tells where each one is
+struct DecodedTexture
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint64_t hash = 0;
+    TextureFormat format = TextureFormat::RGBA8;
+    uint32_t mipCount = 1;
+    // Memory the image would take as it was decoded (RGBA8, no mips, no downscale), for the stats
+    uint64_t sourceSize = 0;
+    std::vector<uint8_t> pixels;
+};
+
+[[nodiscard]] uint32_t getMipCount(uint32_t width, uint32_t height);
+[[nodiscard]] std::vector<TextureMip> getMipLayout(TextureFormat format, uint32_t width, uint32_t height, uint32_t mipCount);
+[[nodiscard]] size_t getTextureSize(const TextureDesc& desc);
+
+// Only needs the header of the image. Each axis is rounded to the closest power of two, up to MAX_TEXTURE_SIZE
+[[nodiscard]] TextureDesc describeTexture(uint32_t width, uint32_t height, bool alpha, TextureCompression compression);
+
+// Halves the image with a box filter in linear space, odd sizes clamp the last row and column
+[[nodiscard]] std::vector<glm::u8vec4> halveTexels(const std::vector<glm::u8vec4>& texels, uint32_t width, uint32_t height);
+// Resizes the image with a tent filter in linear space. Any factor works, but halveTexels() is much cheaper for halving
+[[nodiscard]] std::vector<glm::u8vec4> resampleTexels(const std::vector<glm::u8vec4>& texels, uint32_t width, uint32_t height, uint32_t newWidth, uint32_t newHeight);
+
+// Takes a single RGBA8 level, resizes it to the size of the description and builds the mip chain, then encodes every level
+void processTexture(DecodedTexture& texture, const TextureDesc& desc);
+
+// BLOCK ENCODERS
+
+// Each one encodes a 4x4 block of texels given in rows. They work on the sRGB values directly, like the GPU decodes them
+void encodeBC1(const glm::u8vec4* block, uint8_t* output);
+void encodeBC3(const glm::u8vec4* block, uint8_t* output);
+// Only mode 6 (one subset, RGBA endpoints with 4 bit indices). It is the best single mode for most textures and fast to search
+void encodeBC7(const glm::u8vec4* block, uint8_t* output);
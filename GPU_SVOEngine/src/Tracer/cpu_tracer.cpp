@@ -0,0 +1,1374 @@
+#include "cpu_tracer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <span>
+#include <stdexcept>
+#include <thread>
+
+#include <omp.h>
+
+#include "simd.hpp"
+#include "Texture/texture_data.hpp"
+#include "Texture/texture_loader.hpp"
+
+// Same limit as the shader stack, the engine refuses deeper octrees too
+static constexpr uint32_t MAX_TRACER_DEPTH = 16;
+// Levels above the current one the short stack keeps, SHORT_STACK_SIZE of the shader
+static constexpr uint32_t SHORT_STACK_SIZE = 4;
+// Side of the square tiles threads take at a time, in pixels
+static constexpr uint32_t TILE_SIZE = 16;
+// Workgroup size of the compute traversal, the tiles of the computeTiles mode
+static constexpr uint32_t COMPUTE_TILE_SIZE = 8;
+// Side of the blocks of the beam pre-pass, in pixels. One beam covers the rays of a block
+static constexpr uint32_t BEAM_BLOCK_SIZE = 8;
+// Start distance of the rays of a block whose beam doesn't touch the octree, they are done at the root
+static constexpr float BEAM_MISS = 1e30f;
+// Part of the distance found by a beam the rays of its block skip
+static constexpr float BEAM_START_FACTOR = 0.999f;
+// Distance from the center of a leaf where its shadow ray starts, in leaf sizes. SHADOW_ORIGIN_OFFSET of the shader
+static constexpr float SHADOW_ORIGIN_OFFSET = 0.87f;
+// Images are decoded with a budget, they are kept decoded anyway once the sink has them
+static constexpr size_t TRACER_DECODE_BUDGET = 256ull * 1024 * 1024;
+
+struct CpuTracer::Packet
+{
+    alignas(32) float origin[3][SIMD_WIDTH];
+    alignas(32) float direction[3][SIMD_WIDTH];
+    alignas(32) float invDirection[3][SIMD_WIDTH];
+    alignas(32) float tStart[SIMD_WIDTH];
+    Hit hits[SIMD_WIDTH];
+
+    void setRay(const uint32_t lane, const glm::vec3 o, const glm::vec3 d, const float start = 0.0f)
+    {
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            origin[axis][lane] = o[axis];
+            direction[axis][lane] = d[axis];
+            invDirection[axis][lane] = 1.0f / d[axis];
+        }
+        tStart[lane] = start;
+        hits[lane] = Hit{};
+    }
+};
+
+struct CpuTracer::TileContext
+{
+    const Settings* settings;
+    glm::vec3 camPos;
+    glm::mat4 invPVMatrix;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tileSize;
+    uint32_t tilesX;
+    float pixelAngle;
+    // Start distance of the rays of every block, null without the beam pre-pass
+    const float* beams;
+    uint32_t beamsX;
+    // Samples of the temporal mode, null without it. Pass 1 traces the checkerboard of the frame and pass 2 reprojects the rest,
+    // pass 0 traces every pixel
+    FrameHistory* history;
+    uint32_t temporalPass;
+    uint8_t* pixels;
+    // Hit and shadow ray of every pixel of the wavefront mode, the tiles store them instead of shading. Null in the other modes
+    Hit* hits;
+    ShadowRay* shadowCandidates;
+    // Rays traced by the thread that owns the context
+    uint64_t rays;
+};
+
+// The octant of a direction has the bits of the negative axes, the traversal visits the children in that order
+static uint32_t getOctant(const glm::vec3 direction)
+{
+    uint32_t octant = 0;
+    if (direction.x < 0) octant |= 4;
+    if (direction.y < 0) octant |= 2;
+    if (direction.z < 0) octant |= 1;
+    return octant;
+}
+
+static glm::vec3 homogenize(const glm::vec4 p)
+{
+    return glm::vec3(p) / p.w;
+}
+
+// Direction through the center of the pixel, the screen coordinates go the same way as the ones the vertex shader passes on
+static glm::vec3 getPixelDirection(const glm::mat4& invPVMatrix, const glm::vec3 camPos, const float x, const float y, const uint32_t width, const uint32_t height)
+{
+    const glm::vec2 screen{ x / static_cast<float>(width) * 2.0f - 1.0f, 1.0f - y / static_cast<float>(height) * 2.0f };
+    return glm::normalize(homogenize(invPVMatrix * glm::vec4(screen.x, screen.y, 1.0f, 1.0f)) - camPos);
+}
+
+// What length(fwidth(direction)) gives in the fragment shader, with the next pixel to the right and below
+static float getPixelAngle(const glm::mat4& invPVMatrix, const glm::vec3 camPos, const float x, const float y, const uint32_t width, const uint32_t height)
+{
+    const glm::vec3 center = getPixelDirection(invPVMatrix, camPos, x, y, width, height);
+    const glm::vec3 right = getPixelDirection(invPVMatrix, camPos, x + 1.0f, y, width, height);
+    const glm::vec3 down = getPixelDirection(invPVMatrix, camPos, x, y + 1.0f, width, height);
+    return glm::length(glm::abs(right - center) + glm::abs(down - center));
+}
+
+// getStackPos of the compute shader. The position of a stack level is not stored, it is rebuilt from the children taken
+// by the levels above it, with the same operations the push used so the boxes are exactly the same
+static glm::vec3 getStackPos(const uint32_t* stackState, const int32_t level, const uint32_t octant, const float scale)
+{
+    glm::vec3 pos{ -scale / 2.0f };
+    for (int32_t i = 0; i < level; i++)
+    {
+        const uint32_t child = (stackState[i] & 0xFF) ^ octant;
+        pos = pos + std::ldexp(scale, -(i + 1)) * glm::vec3((child & 4) >> 2, (child & 2) >> 1, child & 1);
+    }
+    return pos;
+}
+
+// createIntersectionMask of the shader for every lane at once. Each bit of the result is a child of the box the ray goes through
+// after tStart, boxes the ray leaves before a start past the camera have none
+static SimdInt createIntersectionMask(const SimdFloat origin[3], const SimdFloat direction[3], const SimdFloat invDirection[3], const SimdFloat tStart, const glm::vec3 boxMin, const float size)
+{
+    static constexpr int32_t CHILD_BITS[3] = { 4, 2, 1 };
+    // Children on the positive and on the negative side of the plane through the center of each axis
+    static constexpr int32_t HIGH_CHILDREN[3] = { 0xF0, 0xCC, 0xAA };
+    static constexpr int32_t LOW_CHILDREN[3] = { 0x0F, 0x33, 0x55 };
+
+    const float nodeRadius = size / 2.0f;
+    const SimdFloat radius = SimdFloat::set(nodeRadius);
+    SimdFloat center[3], tMid[3], tMin[3], tMax[3];
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+        center[axis] = SimdFloat::set(boxMin[axis] + nodeRadius);
+        tMid[axis] = (center[axis] - origin[axis]) * invDirection[axis];
+        const SimdFloat slabRadius = radius * simdAbs(invDirection[axis]);
+        tMin[axis] = tMid[axis] - slabRadius;
+        tMax[axis] = tMid[axis] + slabRadius;
+    }
+    const SimdFloat rayTMin = simdMax(simdMax(simdMax(tMin[0], tMin[1]), tMin[2]), tStart);
+    const SimdFloat rayTMax = simdMin(simdMin(tMax[0], tMax[1]), tMax[2]);
+
+    const SimdInt none = SimdInt::set(0);
+    const SimdInt all = SimdInt::set(0xFF);
+
+    SimdInt firstChildHit = none;
+    const SimdFloat tHalf = SimdFloat::set(0.5f) * (rayTMin + rayTMax);
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+        const SimdFloat pointOnRay = origin[axis] + tHalf * direction[axis];
+        firstChildHit = firstChildHit + simdSelect(pointOnRay >= center[axis], SimdInt::set(CHILD_BITS[axis]), none);
+    }
+    SimdInt intersectionMask = simdShiftOne(firstChildHit);
+
+    const SimdFloat epsilon = SimdFloat::set(0.0001f);
+    for (uint32_t plane = 0; plane < 3; plane++)
+    {
+        SimdInt children = all;
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            if (axis == plane)
+                continue;
+            const SimdFloat pointOnRaySegment = origin[axis] + tMid[plane] * direction[axis];
+            const SimdInt side = simdSelect(pointOnRaySegment >= center[axis], SimdInt::set(HIGH_CHILDREN[axis]), SimdInt::set(LOW_CHILDREN[axis]));
+            children = children & simdSelect(simdAbs(center[axis] - pointOnRaySegment) < epsilon, all, side);
+        }
+        const SimdMask outside = (tMid[plane] < rayTMin) | (tMid[plane] > rayTMax);
+        intersectionMask = intersectionMask | simdSelect(outside, none, children);
+    }
+    // Rays that start at the camera keep the first child of boxes they only graze, as the shader always did
+    const SimdFloat zero = SimdFloat::set(0.0f);
+    return simdSelect((rayTMax < tStart) & (tStart > zero), none, intersectionMask);
+}
+
+// Lanes whose ray never goes through the box after tStart, with the same slabs as createIntersectionMask
+static uint32_t getMissedLanes(const SimdFloat origin[3], const SimdFloat invDirection[3], const SimdFloat tStart, const glm::vec3 boxMin, const float size)
+{
+    const float nodeRadius = size / 2.0f;
+    const SimdFloat radius = SimdFloat::set(nodeRadius);
+    SimdFloat tMin[3], tMax[3];
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+        const SimdFloat tMid = (SimdFloat::set(boxMin[axis] + nodeRadius) - origin[axis]) * invDirection[axis];
+        const SimdFloat slabRadius = radius * simdAbs(invDirection[axis]);
+        tMin[axis] = tMid - slabRadius;
+        tMax[axis] = tMid + slabRadius;
+    }
+    const SimdFloat rayTMin = simdMax(simdMax(simdMax(tMin[0], tMin[1]), tMin[2]), tStart);
+    const SimdFloat rayTMax = simdMin(simdMin(tMax[0], tMax[1]), tMax[2]);
+    return (rayTMin > rayTMax).toBits();
+}
+
+// Shortest distance from a point to a box, 0 inside of it
+static float getBoxDistance(const glm::vec3 point, const glm::vec3 boxMin, const float size)
+{
+    return glm::length(glm::max(glm::max(boxMin - point, point - (boxMin + size)), glm::vec3(0.0f)));
+}
+
+// Conservative test of a cone against the bounding sphere of a box. The cone starts at origin and spans coneAngle radians around axis
+static bool coneIntersectsBox(const glm::vec3 origin, const glm::vec3 axis, const float coneAngle, const glm::vec3 boxMin, const float size)
+{
+    const glm::vec3 toCenter = boxMin + size / 2.0f - origin;
+    const float distance = glm::length(toCenter);
+    const float radius = 0.8660254f * size;
+    if (distance <= radius)
+        return true;
+    const float angle = std::acos(std::clamp(glm::dot(toCenter, axis) / distance, -1.0f, 1.0f));
+    return angle <= coneAngle + std::asin(radius / distance);
+}
+
+double CpuTracer::Stats::getRaysPerSecond() const
+{
+    return seconds > 0.0 ? static_cast<double>(rays) / seconds : 0.0;
+}
+
+double CpuTracer::Stats::getRaysPerSecondPerCore() const
+{
+    return threads > 0 ? getRaysPerSecond() / threads : 0.0;
+}
+
+CpuTracer::CpuTracer(const Octree& octree)
+    : m_materials(octree.getMaterials()), m_leafFlags(octree.getLeafFlags())
+{
+    if (octree.getDepth() > MAX_TRACER_DEPTH)
+        throw std::runtime_error("octree depth " + std::to_string(octree.getDepth()) + " is over the maximum of " + std::to_string(MAX_TRACER_DEPTH));
+    m_nodes.resize(octree.getSize());
+    for (uint32_t i = 0; i < octree.getSize(); i++)
+        m_nodes[i] = octree.getNode(i);
+}
+
+// Receives the images as they finish decoding and keeps them, the descriptions are left as they are
+class CpuTextureSink : public TextureUploadSink
+{
+public:
+    explicit CpuTextureSink(std::vector<DecodedTexture>& images) : m_images(images) {}
+
+    void prepare(const std::span<TextureDesc> images) override
+    {
+        m_images.resize(images.size());
+    }
+
+    void upload(const uint32_t image, DecodedTexture texture) override
+    {
+        m_images[image] = std::move(texture);
+    }
+
+private:
+    std::vector<DecodedTexture>& m_images;
+};
+
+void CpuTracer::loadTextures(const std::vector<std::string>& paths, const std::filesystem::path& cacheDir)
+{
+    m_images.clear();
+    m_imageMips.clear();
+    m_textureImages.clear();
+    // Baked octrees carry the colors in the leaves and no material points to a texture
+    if ((m_leafFlags & Octree::LEAF_BAKED_COLOR) != 0 || paths.empty())
+        return;
+
+    CpuTextureSink sink{ m_images };
+    TextureLoader loader{ cacheDir, TRACER_DECODE_BUDGET, TextureCompression::NONE };
+    m_textureImages = loader.load(paths, sink);
+    for (const DecodedTexture& image : m_images)
+        m_imageMips.push_back(getMipLayout(image.format, image.width, image.height, image.mipCount));
+}
+
+CpuTracer::Stats CpuTracer::render(const Camera::Data& camera, const uint32_t width, const uint32_t height, const Settings& settings, std::vector<uint8_t>& pixels) const
+{
+    pixels.resize(static_cast<size_t>(width) * height * 4);
+    if (width == 0 || height == 0)
+        return {};
+
+    TileContext base{};
+    base.settings = &settings;
+    base.camPos = glm::vec3(camera.position);
+    base.invPVMatrix = camera.invPVMatrix;
+    base.width = width;
+    base.height = height;
+    const bool wavefront = settings.wavefront && settings.shadows && !settings.intersectionTest;
+    // The heatmap of the intersection test is not a color that can be reprojected
+    FrameHistory* history = settings.intersectionTest || wavefront ? nullptr : settings.history;
+    base.tileSize = !wavefront && (settings.computeTiles || settings.shortStack || history != nullptr) ? COMPUTE_TILE_SIZE : TILE_SIZE;
+    base.tilesX = (width + base.tileSize - 1) / base.tileSize;
+    base.pixels = pixels.data();
+    base.beams = nullptr;
+    base.beamsX = (width + BEAM_BLOCK_SIZE - 1) / BEAM_BLOCK_SIZE;
+    base.history = history;
+    base.temporalPass = 0;
+    base.hits = nullptr;
+    base.shadowCandidates = nullptr;
+    // The shader takes length(fwidth(direction)) per pixel, packets take the same difference once at the center of the screen
+    base.pixelAngle = getPixelAngle(base.invPVMatrix, base.camPos, static_cast<float>(width) / 2.0f, static_cast<float>(height) / 2.0f, width, height);
+
+    const uint32_t tileCount = base.tilesX * ((height + base.tileSize - 1) / base.tileSize);
+    const uint32_t threadCount = std::max(1u, std::min(settings.threadCount == 0 ? std::thread::hardware_concurrency() : settings.threadCount, tileCount));
+
+    // Tiles left to each thread, with the first tile in the upper half and the end in the lower half
+    // The owner takes tiles from the front and thieves take the back half, both with a single compare and swap of the whole range
+    struct alignas(64) TileRange
+    {
+        std::atomic<uint64_t> range;
+    };
+    std::vector<TileRange> ranges(threadCount);
+
+    const auto popTile = [](TileRange& range, uint32_t& tile)
+    {
+        uint64_t current = range.range.load();
+        while (true)
+        {
+            const uint32_t begin = static_cast<uint32_t>(current >> 32);
+            const uint32_t end = static_cast<uint32_t>(current);
+            if (begin >= end)
+                return false;
+            if (range.range.compare_exchange_weak(current, static_cast<uint64_t>(begin + 1) << 32 | end))
+            {
+                tile = begin;
+                return true;
+            }
+        }
+    };
+    const auto stealTiles = [](TileRange& victim, TileRange& thief)
+    {
+        uint64_t current = victim.range.load();
+        while (true)
+        {
+            const uint32_t begin = static_cast<uint32_t>(current >> 32);
+            const uint32_t end = static_cast<uint32_t>(current);
+            if (begin >= end)
+                return false;
+            const uint32_t middle = begin + (end - begin) / 2;
+            if (victim.range.compare_exchange_weak(current, static_cast<uint64_t>(begin) << 32 | middle))
+            {
+                thief.range.store(static_cast<uint64_t>(middle) << 32 | end);
+                return true;
+            }
+        }
+    };
+
+    std::vector<uint64_t> threadRays(threadCount, 0);
+    const auto renderTiles = [&](const uint32_t temporalPass)
+    {
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            const uint64_t begin = static_cast<uint64_t>(tileCount) * i / threadCount;
+            const uint64_t end = static_cast<uint64_t>(tileCount) * (i + 1) / threadCount;
+            ranges[i].range.store(begin << 32 | end);
+        }
+
+        #pragma omp parallel num_threads(static_cast<int>(threadCount))
+        {
+            // OpenMP may start fewer threads than requested, the ranges of the missing ones are stolen by the rest
+            const uint32_t thread = static_cast<uint32_t>(omp_get_thread_num());
+            TileContext context = base;
+            context.temporalPass = temporalPass;
+            while (true)
+            {
+                uint32_t tile;
+                while (popTile(ranges[thread], tile))
+                {
+                    if (base.tileSize == COMPUTE_TILE_SIZE)
+                        renderComputeTile(tile, context);
+                    else
+                        renderTile(tile, context);
+                }
+
+                bool stolen = false;
+                for (uint32_t i = 1; i < threadCount && !stolen; i++)
+                    stolen = stealTiles(ranges[(thread + i) % threadCount], ranges[thread]);
+                if (!stolen)
+                    break;
+            }
+            threadRays[thread] += context.rays;
+        }
+    };
+
+    const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+    // Beam pre-pass, the cone of each block goes through the corners of its pixels so it holds every ray of the block
+    std::vector<float> beams;
+    if (settings.beamPrepass)
+    {
+        const uint32_t beamsY = (height + BEAM_BLOCK_SIZE - 1) / BEAM_BLOCK_SIZE;
+        beams.resize(static_cast<size_t>(base.beamsX) * beamsY);
+        #pragma omp parallel for num_threads(static_cast<int>(threadCount)) schedule(dynamic, 16)
+        for (int32_t block = 0; block < static_cast<int32_t>(beams.size()); block++)
+        {
+            const float x = static_cast<float>(block % base.beamsX * BEAM_BLOCK_SIZE);
+            const float y = static_cast<float>(block / base.beamsX * BEAM_BLOCK_SIZE);
+            const float blockSize = static_cast<float>(BEAM_BLOCK_SIZE);
+            const glm::vec3 axis = getPixelDirection(base.invPVMatrix, base.camPos, x + blockSize / 2.0f, y + blockSize / 2.0f, width, height);
+            float coneAngle = 0.0f;
+            for (uint32_t corner = 0; corner < 4; corner++)
+            {
+                const glm::vec3 cornerDirection = getPixelDirection(base.invPVMatrix, base.camPos, x + blockSize * static_cast<float>(corner & 1), y + blockSize * static_cast<float>(corner >> 1), width, height);
+                coneAngle = std::max(coneAngle, std::acos(std::clamp(glm::dot(axis, cornerDirection), -1.0f, 1.0f)));
+            }
+            // Rays start a little before the distance, so rounding in their slab tests never skips the leaf the beam stopped at
+            beams[block] = BEAM_START_FACTOR * traceBeam(base.camPos, axis, coneAngle, settings.scale);
+        }
+        base.beams = beams.data();
+    }
+
+    if (wavefront)
+    {
+        const size_t pixelCount = static_cast<size_t>(width) * height;
+        Stats stats{};
+        std::chrono::high_resolution_clock::time_point passStart = std::chrono::high_resolution_clock::now();
+        const auto endPass = [&](double& seconds)
+        {
+            const std::chrono::high_resolution_clock::time_point passEnd = std::chrono::high_resolution_clock::now();
+            seconds = std::chrono::duration<double>(passEnd - passStart).count();
+            passStart = passEnd;
+        };
+
+        // Traversal, the tiles store their hits and candidates instead of shading
+        std::vector<Hit> hits(pixelCount);
+        std::vector<ShadowRay> candidates(pixelCount);
+        base.hits = hits.data();
+        base.shadowCandidates = candidates.data();
+        renderTiles(0);
+        endPass(stats.traversalSeconds);
+
+        std::vector<ShadowRay> queue;
+        compactShadowRays(candidates, queue, threadCount);
+        endPass(stats.compactionSeconds);
+
+        if (settings.sortShadowRays)
+            sortShadowRays(queue, settings.scale, threadCount);
+        endPass(stats.sortSeconds);
+
+        // Shadow rays, packets of consecutive rays of the queue. They all go towards the sun and share an octant
+        const glm::vec3 sunDirection = glm::normalize(settings.sunDirection);
+        const int32_t packetCount = static_cast<int32_t>((queue.size() + SIMD_WIDTH - 1) / SIMD_WIDTH);
+        std::vector<uint8_t> shadowed(pixelCount, 0);
+        #pragma omp parallel for num_threads(static_cast<int>(threadCount)) schedule(dynamic, 16)
+        for (int32_t packetIndex = 0; packetIndex < packetCount; packetIndex++)
+        {
+            const size_t first = static_cast<size_t>(packetIndex) * SIMD_WIDTH;
+            const uint32_t laneCount = static_cast<uint32_t>(std::min<size_t>(SIMD_WIDTH, queue.size() - first));
+            Packet packet;
+            // Lanes past the end of the queue repeat the first ray, they are not traced
+            for (uint32_t lane = 0; lane < SIMD_WIDTH; lane++)
+                packet.setRay(lane, queue[first + (lane < laneCount ? lane : 0)].origin, sunDirection);
+            tracePacket(packet, (1u << laneCount) - 1, settings.scale);
+            for (uint32_t lane = 0; lane < laneCount; lane++)
+                shadowed[queue[first + lane].pixel] = packet.hits[lane].hit ? 1 : 0;
+        }
+        stats.shadowRays = queue.size();
+        endPass(stats.shadowSeconds);
+
+        #pragma omp parallel for num_threads(static_cast<int>(threadCount)) schedule(static)
+        for (int64_t i = 0; i < static_cast<int64_t>(pixelCount); i++)
+        {
+            const glm::vec3 color = getColor(hits[i], shadowed[i] != 0, base.pixelAngle, base);
+            uint8_t* pixel = base.pixels + i * 4;
+            pixel[0] = linearToSrgb(color.x);
+            pixel[1] = linearToSrgb(color.y);
+            pixel[2] = linearToSrgb(color.z);
+            pixel[3] = 255;
+        }
+        endPass(stats.shadingSeconds);
+
+        for (const uint64_t rays : threadRays)
+            stats.rays += rays;
+        stats.rays += stats.shadowRays;
+        stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        stats.threads = threadCount;
+        return stats;
+    }
+
+    if (history != nullptr)
+        history->beginFrame(width, height);
+    // The second pass needs the samples the first one traced around each of its pixels
+    if (history != nullptr && history->hasPrevious())
+    {
+        renderTiles(1);
+        renderTiles(2);
+    }
+    else
+        renderTiles(0);
+    const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+
+    if (history != nullptr)
+        history->endFrame(glm::inverse(camera.invPVMatrix));
+
+    Stats stats{};
+    for (const uint64_t rays : threadRays)
+        stats.rays += rays;
+    stats.seconds = std::chrono::duration<double>(end - start).count();
+    stats.threads = threadCount;
+    return stats;
+}
+
+CpuTracer::Hit CpuTracer::trace(const glm::vec3 origin, const glm::vec3 direction, const float scale) const
+{
+    Packet packet;
+    for (uint32_t lane = 0; lane < SIMD_WIDTH; lane++)
+        packet.setRay(lane, origin, direction);
+    tracePacket(packet, 1, scale);
+    return packet.hits[0];
+}
+
+// traceRay of the shader for the lanes in the bit mask, which must all have the same octant
+// The stack is shared, each element keeps the lanes that go through every child. A child is visited while any of its lanes hasn't hit yet,
+// and only those lanes count the step, so each lane sees the same children in the same order as a ray traced alone
+void CpuTracer::tracePacket(Packet& packet, const uint32_t lanes, const float scale) const
+{
+    struct StackElem
+    {
+        uint32_t index;
+        glm::vec3 pos;
+        uint32_t childCount;
+        uint32_t childLanes[8];
+    };
+
+    SimdFloat origin[3], direction[3], invDirection[3];
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+        origin[axis] = SimdFloat::load(packet.origin[axis]);
+        direction[axis] = SimdFloat::load(packet.direction[axis]);
+        invDirection[axis] = SimdFloat::load(packet.invDirection[axis]);
+    }
+    const SimdFloat tStart = SimdFloat::load(packet.tStart);
+
+    const auto pushElem = [&](StackElem& elem, const uint32_t index, const glm::vec3 pos, const float size, const uint32_t elemLanes)
+    {
+        elem.index = index;
+        elem.pos = pos;
+        elem.childCount = 0;
+        alignas(32) int32_t masks[SIMD_WIDTH];
+        createIntersectionMask(origin, direction, invDirection, tStart, pos, size).store(masks);
+        std::fill(std::begin(elem.childLanes), std::end(elem.childLanes), 0u);
+        for (uint32_t remaining = elemLanes; remaining != 0; remaining &= remaining - 1)
+        {
+            const uint32_t lane = std::countr_zero(remaining);
+            for (uint32_t children = static_cast<uint32_t>(masks[lane]); children != 0; children &= children - 1)
+                elem.childLanes[std::countr_zero(children)] |= 1u << lane;
+        }
+    };
+
+    const uint32_t octant = getOctant({ packet.direction[0][std::countr_zero(lanes)], packet.direction[1][std::countr_zero(lanes)], packet.direction[2][std::countr_zero(lanes)] });
+    const float halfScale = scale / 2.0f;
+    // Rays that don't go through the octree hit nothing, the intersection mask would still give them a first child
+    const uint32_t tracedLanes = lanes & ~getMissedLanes(origin, invDirection, tStart, glm::vec3(-halfScale), scale);
+    if (tracedLanes == 0)
+        return;
+    std::array<StackElem, MAX_TRACER_DEPTH> stack;
+    pushElem(stack[0], 0, glm::vec3(-halfScale), scale, tracedLanes);
+    int32_t stackPtr = 0;
+    uint32_t done = 0;
+
+    while (true)
+    {
+        StackElem& elem = stack[stackPtr];
+        const BranchNode parent{ m_nodes[elem.index] };
+        const uint32_t childMask = parent.childMask.toRaw();
+        const uint32_t leafMask = parent.leafMask.toRaw();
+
+        uint32_t current = 8;
+        uint32_t childLanes = 0;
+        while (childMask != 0 && elem.childCount < 8)
+        {
+            const uint32_t next = elem.childCount ^ octant;
+            childLanes = elem.childLanes[next] & ~done;
+            if ((childMask & (1 << next)) != 0 && childLanes != 0)
+            {
+                current = next;
+                break;
+            }
+            elem.childCount++;
+        }
+        if (current > 7)
+        {
+            // POP
+            stackPtr--;
+            if (stackPtr < 0)
+                break;
+            stack[stackPtr].childCount++;
+            continue;
+        }
+        for (uint32_t remaining = childLanes; remaining != 0; remaining &= remaining - 1)
+            packet.hits[std::countr_zero(remaining)].steps++;
+
+        const float size = std::ldexp(scale, -(stackPtr + 1));
+        const glm::vec3 pos = elem.pos + size * glm::vec3((current & 4) >> 2, (current & 2) >> 1, current & 1);
+        const uint32_t bitMask = (1 << current) - 1;
+        const uint32_t childOffset = std::popcount(childMask & bitMask) + std::popcount(leafMask & bitMask & childMask);
+        const uint32_t address = elem.index + parent.ptr.getPtr();
+        const uint32_t nextChild = (parent.ptr.isFar() ? address + m_nodes[address] : address) + childOffset;
+
+        if ((leafMask & (1 << current)) != 0)
+        {
+            if (isOpaque(nextChild))
+            {
+                for (uint32_t remaining = childLanes; remaining != 0; remaining &= remaining - 1)
+                {
+                    Hit& hit = packet.hits[std::countr_zero(remaining)];
+                    hit.hit = true;
+                    hit.voxelIndex = nextChild;
+                    hit.voxelPos = pos + glm::vec3(size) / 2.0f;
+                    hit.voxelSize = size;
+                }
+                done |= childLanes;
+                if (done == tracedLanes)
+                    break;
+            }
+            elem.childCount++;
+        }
+        else
+        {
+            // PUSH
+            stackPtr++;
+            pushElem(stack[stackPtr], nextChild, pos, size, childLanes);
+        }
+    }
+}
+
+void CpuTracer::renderTile(const uint32_t tile, TileContext& context) const
+{
+    const Settings& settings = *context.settings;
+    const uint32_t tileX = tile % context.tilesX * context.tileSize;
+    const uint32_t tileY = tile / context.tilesX * context.tileSize;
+    const uint32_t endX = std::min(tileX + context.tileSize, context.width);
+    const uint32_t endY = std::min(tileY + context.tileSize, context.height);
+    const bool shadows = settings.shadows && !settings.intersectionTest;
+    const glm::vec3 sunDirection = glm::normalize(settings.sunDirection);
+
+    Packet packet;
+    Packet shadowPacket;
+    for (uint32_t y = tileY; y < endY; y++)
+    {
+        for (uint32_t x = tileX; x < endX; x += SIMD_WIDTH)
+        {
+            const uint32_t laneCount = std::min(SIMD_WIDTH, endX - x);
+            // Lanes past the edge of the image repeat the first pixel, so they hold valid values but are never traced
+            for (uint32_t lane = 0; lane < SIMD_WIDTH; lane++)
+            {
+                const uint32_t laneX = x + (lane < laneCount ? lane : 0);
+                const float px = static_cast<float>(laneX) + 0.5f;
+                const float tStart = context.beams != nullptr ? context.beams[y / BEAM_BLOCK_SIZE * context.beamsX + laneX / BEAM_BLOCK_SIZE] : 0.0f;
+                packet.setRay(lane, context.camPos, getPixelDirection(context.invPVMatrix, context.camPos, px, static_cast<float>(y) + 0.5f, context.width, context.height), tStart);
+            }
+
+            // Lanes are traced in groups with the same octant, the order of the children depends on it
+            const uint32_t validLanes = (1u << laneCount) - 1;
+            for (uint32_t remaining = validLanes; remaining != 0;)
+            {
+                const uint32_t first = std::countr_zero(remaining);
+                const uint32_t octant = getOctant({ packet.direction[0][first], packet.direction[1][first], packet.direction[2][first] });
+                uint32_t group = 0;
+                for (uint32_t lane = first; lane < laneCount; lane++)
+                {
+                    if ((remaining & (1u << lane)) != 0 && getOctant({ packet.direction[0][lane], packet.direction[1][lane], packet.direction[2][lane] }) == octant)
+                        group |= 1u << lane;
+                }
+                tracePacket(packet, group, settings.scale);
+                remaining &= ~group;
+            }
+            context.rays += laneCount;
+
+            // The wavefront passes trace the shadow rays and shade later, from the queue
+            if (context.hits != nullptr)
+            {
+                for (uint32_t lane = 0; lane < laneCount; lane++)
+                {
+                    const size_t pixel = static_cast<size_t>(y) * context.width + x + lane;
+                    const Hit& hit = packet.hits[lane];
+                    context.hits[pixel] = hit;
+                    context.shadowCandidates[pixel] = hit.hit
+                        ? ShadowRay{ hit.voxelPos + SHADOW_ORIGIN_OFFSET * hit.voxelSize * parseLeaf(hit.voxelIndex).normal, static_cast<uint32_t>(pixel) }
+                        : ShadowRay{ glm::vec3(0.0f), NO_SHADOW_RAY };
+                }
+                continue;
+            }
+
+            // Every shadow ray goes towards the sun, so they all share an octant
+            uint32_t shadowLanes = 0;
+            if (shadows)
+            {
+                for (uint32_t lane = 0; lane < SIMD_WIDTH; lane++)
+                {
+                    // Lanes that missed get any valid origin, they are not traced
+                    const bool traced = lane < laneCount && packet.hits[lane].hit;
+                    const Hit& hit = packet.hits[traced ? lane : 0];
+                    // The offset scales with the leaf that was hit, coarse leaves need a bigger one to get out of themselves
+                    const glm::vec3 origin = hit.voxelPos + SHADOW_ORIGIN_OFFSET * hit.voxelSize * parseLeaf(hit.voxelIndex).normal;
+                    shadowPacket.setRay(lane, origin, sunDirection);
+                    if (traced)
+                        shadowLanes |= 1u << lane;
+                }
+                // On the CPU packets stay cheaper than the any hit traversal one ray at a time
+                if (shadowLanes != 0)
+                    tracePacket(shadowPacket, shadowLanes, settings.scale);
+                context.rays += std::popcount(shadowLanes);
+            }
+
+            for (uint32_t lane = 0; lane < laneCount; lane++)
+            {
+                const bool shadowed = (shadowLanes & (1u << lane)) != 0 && shadowPacket.hits[lane].hit;
+                const glm::vec3 color = getColor(packet.hits[lane], shadowed, context.pixelAngle, context);
+
+                // The swapchain is sRGB, so the shader output is encoded when it is stored
+                uint8_t* pixel = context.pixels + (static_cast<size_t>(y) * context.width + x + lane) * 4;
+                pixel[0] = linearToSrgb(color.x);
+                pixel[1] = linearToSrgb(color.y);
+                pixel[2] = linearToSrgb(color.z);
+                pixel[3] = 255;
+            }
+        }
+    }
+}
+
+// traceRayTiled of the compute shader for a single ray. The stack is the slice of the tile memory that belongs to the invocation:
+// the node index and childCount | intersectionMask << 8 of every level, positions are rebuilt from the root when a level is popped
+CpuTracer::Hit CpuTracer::traceShared(const glm::vec3 origin, const glm::vec3 direction, const float tStart, const float scale, uint32_t* stackIndex, uint32_t* stackState) const
+{
+    const SimdFloat rayTStart = SimdFloat::set(tStart);
+    SimdFloat rayOrigin[3], rayDirection[3], rayInvDirection[3];
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+        rayOrigin[axis] = SimdFloat::set(origin[axis]);
+        rayDirection[axis] = SimdFloat::set(direction[axis]);
+        rayInvDirection[axis] = SimdFloat::set(1.0f / direction[axis]);
+    }
+    const auto getIntersectionMask = [&](const glm::vec3 pos, const float size)
+    {
+        alignas(32) int32_t masks[SIMD_WIDTH];
+        createIntersectionMask(rayOrigin, rayDirection, rayInvDirection, rayTStart, pos, size).store(masks);
+        return static_cast<uint32_t>(masks[0]);
+    };
+
+    const uint32_t octant = getOctant(direction);
+    const float halfScale = scale / 2.0f;
+    Hit hit{};
+    glm::vec3 stackPos{ -halfScale };
+    if ((getMissedLanes(rayOrigin, rayInvDirection, rayTStart, stackPos, scale) & 1) != 0)
+        return hit;
+    stackIndex[0] = 0;
+    stackState[0] = getIntersectionMask(stackPos, scale) << 8;
+    int32_t stackPtr = 0;
+
+    while (true)
+    {
+        const BranchNode parent{ m_nodes[stackIndex[stackPtr]] };
+        const uint32_t childMask = parent.childMask.toRaw();
+        const uint32_t leafMask = parent.leafMask.toRaw();
+        const uint32_t intersectionMask = stackState[stackPtr] >> 8;
+        uint32_t childCount = stackState[stackPtr] & 0xFF;
+
+        uint32_t current = 8;
+        while (childMask != 0 && childCount < 8)
+        {
+            const uint32_t next = childCount ^ octant;
+            if ((childMask & intersectionMask & (1 << next)) != 0)
+            {
+                current = next;
+                break;
+            }
+            childCount++;
+        }
+        stackState[stackPtr] = intersectionMask << 8 | childCount;
+        if (current > 7)
+        {
+            // POP
+            stackPtr--;
+            if (stackPtr < 0)
+                break;
+            stackState[stackPtr]++;
+            stackPos = getStackPos(stackState, stackPtr, octant, scale);
+            continue;
+        }
+        hit.steps++;
+
+        const float size = std::ldexp(scale, -(stackPtr + 1));
+        const glm::vec3 pos = stackPos + size * glm::vec3((current & 4) >> 2, (current & 2) >> 1, current & 1);
+        const uint32_t bitMask = (1 << current) - 1;
+        const uint32_t childOffset = std::popcount(childMask & bitMask) + std::popcount(leafMask & bitMask & childMask);
+        const uint32_t address = stackIndex[stackPtr] + parent.ptr.getPtr();
+        const uint32_t nextChild = (parent.ptr.isFar() ? address + m_nodes[address] : address) + childOffset;
+
+        if ((leafMask & (1 << current)) != 0)
+        {
+            if (isOpaque(nextChild))
+            {
+                hit.hit = true;
+                hit.voxelIndex = nextChild;
+                hit.voxelPos = pos + glm::vec3(size) / 2.0f;
+                hit.voxelSize = size;
+                break;
+            }
+            stackState[stackPtr]++;
+        }
+        else
+        {
+            // PUSH
+            stackPtr++;
+            stackIndex[stackPtr] = nextChild;
+            stackState[stackPtr] = getIntersectionMask(pos, size) << 8;
+            stackPos = pos;
+        }
+    }
+    return hit;
+}
+
+// traceRay of the fragment shader, with a short stack instead of one element per level. The current level is kept apart with the
+// descriptor of its node, and only the SHORT_STACK_SIZE levels above it are stored, in the slot of their level
+// Positions are integers in cells of the deepest level: the children add the bit of their level, the parent clears it, and the index
+// of the child a level was at is that bit, so the stack needs no position nor child count. When a pop goes past the stored levels
+// the traversal restarts from the root and follows those bits back down. The intersection mask of the level is created again from
+// the same box, so the children visited are the same as with a full stack
+CpuTracer::Hit CpuTracer::traceShortStack(const glm::vec3 origin, const glm::vec3 direction, const float tStart, const float scale) const
+{
+    struct StackElem
+    {
+        uint32_t index;
+        uint32_t node;
+        uint32_t intersectionMask;
+    };
+
+    const SimdFloat rayTStart = SimdFloat::set(tStart);
+    SimdFloat rayOrigin[3], rayDirection[3], rayInvDirection[3];
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+        rayOrigin[axis] = SimdFloat::set(origin[axis]);
+        rayDirection[axis] = SimdFloat::set(direction[axis]);
+        rayInvDirection[axis] = SimdFloat::set(1.0f / direction[axis]);
+    }
+    const auto getIntersectionMask = [&](const glm::vec3 pos, const float size)
+    {
+        alignas(32) int32_t masks[SIMD_WIDTH];
+        createIntersectionMask(rayOrigin, rayDirection, rayInvDirection, rayTStart, pos, size).store(masks);
+        return static_cast<uint32_t>(masks[0]);
+    };
+    const auto getChildIndex = [this](const uint32_t index, const BranchNode parent, const uint32_t child)
+    {
+        const uint32_t bitMask = (1 << child) - 1;
+        const uint32_t childMask = parent.childMask.toRaw();
+        const uint32_t childOffset = std::popcount(childMask & bitMask) + std::popcount(parent.leafMask.toRaw() & bitMask & childMask);
+        const uint32_t address = index + parent.ptr.getPtr();
+        return (parent.ptr.isFar() ? address + m_nodes[address] : address) + childOffset;
+    };
+
+    const uint32_t octant = getOctant(direction);
+    const float halfScale = scale / 2.0f;
+    // Cell positions give the same floats the full stack adds up as long as they are exact, as they are for scales like 100
+    const float cellSize = std::ldexp(scale, -static_cast<int32_t>(MAX_TRACER_DEPTH));
+    const auto getChildOfCell = [](const glm::uvec3 cell, const uint32_t shift)
+    {
+        return ((cell.x >> shift) & 1) << 2 | ((cell.y >> shift) & 1) << 1 | ((cell.z >> shift) & 1);
+    };
+
+    Hit hit{};
+    if ((getMissedLanes(rayOrigin, rayInvDirection, rayTStart, glm::vec3(-halfScale), scale) & 1) != 0)
+        return hit;
+
+    StackElem stack[SHORT_STACK_SIZE];
+    // Lowest level in the stack, the levels from it to the one above the current one are stored
+    int32_t stackBottom = 0;
+    int32_t level = 0;
+    glm::uvec3 cell{ 0 };
+    uint32_t index = 0;
+    uint32_t node = m_nodes[0];
+    uint32_t intersectionMask = getIntersectionMask(glm::vec3(-halfScale), scale);
+    uint32_t childCount = 0;
+
+    while (true)
+    {
+        const BranchNode parent{ node };
+        const uint32_t childMask = parent.childMask.toRaw();
+        const uint32_t leafMask = parent.leafMask.toRaw();
+
+        uint32_t current = 8;
+        while (childMask != 0 && childCount < 8)
+        {
+            const uint32_t next = childCount ^ octant;
+            if ((childMask & intersectionMask & (1 << next)) != 0)
+            {
+                current = next;
+                break;
+            }
+            childCount++;
+        }
+        if (current > 7)
+        {
+            // POP
+            if (level == 0)
+                break;
+            const uint32_t child = getChildOfCell(cell, MAX_TRACER_DEPTH - level);
+            level--;
+            const uint32_t parentMask = ~((1u << (MAX_TRACER_DEPTH - level)) - 1);
+            cell = glm::uvec3(cell.x & parentMask, cell.y & parentMask, cell.z & parentMask);
+            if (level >= stackBottom)
+            {
+                const StackElem& elem = stack[level % SHORT_STACK_SIZE];
+                index = elem.index;
+                node = elem.node;
+                intersectionMask = elem.intersectionMask;
+            }
+            else
+            {
+                // RESTART
+                index = 0;
+                node = m_nodes[0];
+                for (int32_t i = 0; i < level; i++)
+                {
+                    index = getChildIndex(index, BranchNode{ node }, getChildOfCell(cell, MAX_TRACER_DEPTH - i - 1));
+                    node = m_nodes[index];
+                }
+                intersectionMask = getIntersectionMask(glm::vec3(cell) * cellSize - halfScale, std::ldexp(scale, -level));
+                stackBottom = level;
+            }
+            childCount = (child ^ octant) + 1;
+            continue;
+        }
+        hit.steps++;
+
+        const uint32_t shift = MAX_TRACER_DEPTH - level - 1;
+        const glm::uvec3 childCell = cell + glm::uvec3((current & 4) >> 2, (current & 2) >> 1, current & 1) * (1u << shift);
+        const float size = std::ldexp(scale, -(level + 1));
+        const glm::vec3 pos = glm::vec3(childCell) * cellSize - halfScale;
+        const uint32_t nextChild = getChildIndex(index, parent, current);
+
+        if ((leafMask & (1 << current)) != 0)
+        {
+            if (isOpaque(nextChild))
+            {
+                hit.hit = true;
+                hit.voxelIndex = nextChild;
+                hit.voxelPos = pos + glm::vec3(size) / 2.0f;
+                hit.voxelSize = size;
+                break;
+            }
+            childCount++;
+        }
+        else
+        {
+            // PUSH
+            stack[level % SHORT_STACK_SIZE] = { index, node, intersectionMask };
+            stackBottom = std::max(stackBottom, level - static_cast<int32_t>(SHORT_STACK_SIZE) + 1);
+            level++;
+            cell = childCell;
+            index = nextChild;
+            node = m_nodes[nextChild];
+            intersectionMask = getIntersectionMask(pos, size);
+            childCount = 0;
+        }
+    }
+    return hit;
+}
+
+// Child mask with the bit of child i moved to i ^ octant, toVisitOrder of the shader
+static uint32_t toVisitOrder(uint32_t mask, const uint32_t octant)
+{
+    if ((octant & 4) != 0) mask = (mask & 0x0F) << 4 | (mask & 0xF0) >> 4;
+    if ((octant & 2) != 0) mask = (mask & 0x33) << 2 | (mask & 0xCC) >> 2;
+    if ((octant & 1) != 0) mask = (mask & 0x55) << 1 | (mask & 0xAA) >> 1;
+    return mask;
+}
+
+// Any hit traversal of traceShadowRay, with the same short stack as traceShortStack. Each level keeps the branches it has left
+// in visit order instead of its intersection mask, and the leaves of a node are tested as soon as it is entered
+bool CpuTracer::traceShadow(const glm::vec3 origin, const glm::vec3 direction, const float scale) const
+{
+    struct StackElem
+    {
+        uint32_t index;
+        // Kept parsed, so every node is parsed once
+        BranchNode node{ 0 };
+        uint32_t remaining;
+    };
+
+    const SimdFloat rayTStart = SimdFloat::set(0.0f);
+    SimdFloat rayOrigin[3], rayDirection[3], rayInvDirection[3];
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+        rayOrigin[axis] = SimdFloat::set(origin[axis]);
+        rayDirection[axis] = SimdFloat::set(direction[axis]);
+        rayInvDirection[axis] = SimdFloat::set(1.0f / direction[axis]);
+    }
+    const auto getIntersectionMask = [&](const glm::vec3 pos, const float size)
+    {
+        alignas(32) int32_t masks[SIMD_WIDTH];
+        createIntersectionMask(rayOrigin, rayDirection, rayInvDirection, rayTStart, pos, size).store(masks);
+        return static_cast<uint32_t>(masks[0]);
+    };
+    const auto getChildIndex = [this](const uint32_t index, const BranchNode parent, const uint32_t child)
+    {
+        const uint32_t bitMask = (1 << child) - 1;
+        const uint32_t childMask = parent.childMask.toRaw();
+        const uint32_t childOffset = std::popcount(childMask & bitMask) + std::popcount(parent.leafMask.toRaw() & bitMask & childMask);
+        const uint32_t address = index + parent.ptr.getPtr();
+        return (parent.ptr.isFar() ? address + m_nodes[address] : address) + childOffset;
+    };
+    const auto getChildOfCell = [](const glm::uvec3 cell, const uint32_t shift)
+    {
+        return ((cell.x >> shift) & 1) << 2 | ((cell.y >> shift) & 1) << 1 | ((cell.z >> shift) & 1);
+    };
+
+    const uint32_t octant = getOctant(direction);
+    const float halfScale = scale / 2.0f;
+    const float cellSize = std::ldexp(scale, -static_cast<int32_t>(MAX_TRACER_DEPTH));
+    // Branch children of a node the ray goes through, in visit order
+    const auto getRemainingBranches = [octant](const BranchNode node, const uint32_t intersectionMask)
+    {
+        return toVisitOrder(node.childMask.toRaw() & ~node.leafMask.toRaw() & intersectionMask, octant);
+    };
+
+    if ((getMissedLanes(rayOrigin, rayInvDirection, rayTStart, glm::vec3(-halfScale), scale) & 1) != 0)
+        return false;
+
+    StackElem stack[SHORT_STACK_SIZE];
+    int32_t stackBottom = 0;
+    int32_t level = 0;
+    glm::uvec3 cell{ 0 };
+    uint32_t index = 0;
+    BranchNode node{ m_nodes[0] };
+    uint32_t intersectionMask = getIntersectionMask(glm::vec3(-halfScale), scale);
+    if (hitsLeafChild(index, node, intersectionMask))
+        return true;
+    uint32_t remaining = getRemainingBranches(node, intersectionMask);
+
+    while (true)
+    {
+        if (remaining == 0)
+        {
+            // POP
+            if (level == 0)
+                return false;
+            const uint32_t child = getChildOfCell(cell, MAX_TRACER_DEPTH - level);
+            level--;
+            const uint32_t parentMask = ~((1u << (MAX_TRACER_DEPTH - level)) - 1);
+            cell = glm::uvec3(cell.x & parentMask, cell.y & parentMask, cell.z & parentMask);
+            if (level >= stackBottom)
+            {
+                const StackElem& elem = stack[level % SHORT_STACK_SIZE];
+                index = elem.index;
+                node = elem.node;
+                remaining = elem.remaining;
+            }
+            else
+            {
+                // RESTART, the branches up to the one the ray comes from were already visited
+                index = 0;
+                node = BranchNode{ m_nodes[0] };
+                for (int32_t i = 0; i < level; i++)
+                {
+                    index = getChildIndex(index, node, getChildOfCell(cell, MAX_TRACER_DEPTH - i - 1));
+                    node = BranchNode{ m_nodes[index] };
+                }
+                intersectionMask = getIntersectionMask(glm::vec3(cell) * cellSize - halfScale, std::ldexp(scale, -level));
+                remaining = getRemainingBranches(node, intersectionMask) & ~((2u << (child ^ octant)) - 1);
+                stackBottom = level;
+            }
+            continue;
+        }
+
+        const uint32_t current = static_cast<uint32_t>(std::countr_zero(remaining)) ^ octant;
+        remaining &= remaining - 1;
+        const uint32_t shift = MAX_TRACER_DEPTH - level - 1;
+        const glm::uvec3 childCell = cell + glm::uvec3((current & 4) >> 2, (current & 2) >> 1, current & 1) * (1u << shift);
+        const float size = std::ldexp(scale, -(level + 1));
+        const glm::vec3 pos = glm::vec3(childCell) * cellSize - halfScale;
+        const uint32_t nextChild = getChildIndex(index, node, current);
+
+        // PUSH
+        stack[level % SHORT_STACK_SIZE] = { index, node, remaining };
+        stackBottom = std::max(stackBottom, level - static_cast<int32_t>(SHORT_STACK_SIZE) + 1);
+        level++;
+        cell = childCell;
+        index = nextChild;
+        node = BranchNode{ m_nodes[nextChild] };
+        intersectionMask = getIntersectionMask(pos, size);
+        if (hitsLeafChild(index, node, intersectionMask))
+            return true;
+        remaining = getRemainingBranches(node, intersectionMask);
+    }
+}
+
+// One workgroup of the compute traversal. Invocations run one after the other, each with its row of the tile stack
+// The short stack traces the same pixels one at a time, with its own stack instead of the one of the tile
+// The temporal mode uses the same tiles, the pass of the context tells which half of the checkerboard they fill
+void CpuTracer::renderComputeTile(const uint32_t tile, TileContext& context) const
+{
+    static constexpr uint32_t INVOCATION_COUNT = COMPUTE_TILE_SIZE * COMPUTE_TILE_SIZE;
+    uint32_t stackIndex[INVOCATION_COUNT][MAX_TRACER_DEPTH];
+    uint32_t stackState[INVOCATION_COUNT][MAX_TRACER_DEPTH];
+
+    const Settings& settings = *context.settings;
+    const uint32_t tileX = tile % context.tilesX * COMPUTE_TILE_SIZE;
+    const uint32_t tileY = tile / context.tilesX * COMPUTE_TILE_SIZE;
+    const bool shadows = settings.shadows && !settings.intersectionTest;
+    const glm::vec3 sunDirection = glm::normalize(settings.sunDirection);
+
+    for (uint32_t invocation = 0; invocation < INVOCATION_COUNT; invocation++)
+    {
+        const auto traceRay = [&](const glm::vec3 origin, const glm::vec3 direction, const float tStart)
+        {
+            if (settings.shortStack)
+                return traceShortStack(origin, direction, tStart, settings.scale);
+            return traceShared(origin, direction, tStart, settings.scale, stackIndex[invocation], stackState[invocation]);
+        };
+        const uint32_t x = tileX + invocation % COMPUTE_TILE_SIZE;
+        const uint32_t y = tileY + invocation / COMPUTE_TILE_SIZE;
+        if (x >= context.width || y >= context.height)
+            continue;
+        // Each temporal pass takes its half of the checkerboard
+        if (context.temporalPass != 0 && isTracedPixel(x, y, context.history->getFrameIndex()) != (context.temporalPass == 1))
+            continue;
+
+        const float px = static_cast<float>(x) + 0.5f;
+        const float py = static_cast<float>(y) + 0.5f;
+        const glm::vec3 direction = getPixelDirection(context.invPVMatrix, context.camPos, px, py, context.width, context.height);
+        // Compute shaders have no derivatives, the angle is taken per pixel from the directions of the neighbours
+        const float pixelAngle = getPixelAngle(context.invPVMatrix, context.camPos, px, py, context.width, context.height);
+
+        glm::vec3 color;
+        HistorySample sample{};
+        if (context.temporalPass == 2 && reprojectPixel(*context.history, x, y, context.camPos, direction, pixelAngle, sample))
+            color = sample.color;
+        else
+        {
+            const float tStart = context.beams != nullptr ? context.beams[y / BEAM_BLOCK_SIZE * context.beamsX + x / BEAM_BLOCK_SIZE] : 0.0f;
+            const Hit hit = traceRay(context.camPos, direction, tStart);
+            context.rays++;
+
+            const glm::vec3 normal = hit.hit ? parseLeaf(hit.voxelIndex).normal : glm::vec3(0.0f);
+            bool shadowed = false;
+            if (shadows && hit.hit)
+            {
+                const glm::vec3 origin = hit.voxelPos + SHADOW_ORIGIN_OFFSET * hit.voxelSize * normal;
+                shadowed = traceShadow(origin, sunDirection, settings.scale);
+                context.rays++;
+            }
+            color = getColor(hit, shadowed, pixelAngle, context);
+
+            sample.hit = hit.hit;
+            if (hit.hit)
+                sample.position = context.camPos + getHitDistance(context.camPos, direction, hit.voxelPos, hit.voxelSize) * direction;
+            sample.normal = normal;
+            sample.color = color;
+        }
+        if (context.history != nullptr)
+            context.history->getCurrent(x, y) = sample;
+
+        uint8_t* pixel = context.pixels + (static_cast<size_t>(y) * context.width + x) * 4;
+        pixel[0] = linearToSrgb(color.x);
+        pixel[1] = linearToSrgb(color.y);
+        pixel[2] = linearToSrgb(color.z);
+        pixel[3] = 255;
+    }
+}
+
+// Cone of the beam pre-pass: the shortest distance from the origin to a leaf in it, BEAM_MISS when it doesn't reach any
+// Nodes no bigger than the cone is wide at their distance are not opened, their own distance stands in for the leaves inside
+// Every leaf any ray of the block can reach is in the cone, so none of them is closer than the result
+float CpuTracer::traceBeam(const glm::vec3 origin, const glm::vec3 axis, const float coneAngle, const float scale) const
+{
+    struct BeamElem
+    {
+        uint32_t index;
+        glm::vec3 pos;
+        uint32_t childCount;
+    };
+
+    const glm::vec3 rootPos{ -scale / 2.0f };
+    if (!coneIntersectsBox(origin, axis, coneAngle, rootPos, scale))
+        return BEAM_MISS;
+    const float coneWidth = 2.0f * std::tan(coneAngle);
+    const uint32_t octant = getOctant(axis);
+    std::array<BeamElem, MAX_TRACER_DEPTH> stack;
+    stack[0] = { 0, rootPos, 0 };
+    int32_t stackPtr = 0;
+    float nearest = BEAM_MISS;
+
+    while (stackPtr >= 0)
+    {
+        BeamElem& elem = stack[stackPtr];
+        if (elem.childCount > 7)
+        {
+            // POP
+            stackPtr--;
+            continue;
+        }
+        const uint32_t current = elem.childCount++ ^ octant;
+        const BranchNode parent{ m_nodes[elem.index] };
+        const uint32_t childMask = parent.childMask.toRaw();
+        const uint32_t leafMask = parent.leafMask.toRaw();
+        if ((childMask & (1 << current)) == 0)
+            continue;
+
+        const float size = std::ldexp(scale, -(stackPtr + 1));
+        const glm::vec3 pos = elem.pos + size * glm::vec3((current & 4) >> 2, (current & 2) >> 1, current & 1);
+        const float distance = getBoxDistance(origin, pos, size);
+        if (distance >= nearest || !coneIntersectsBox(origin, axis, coneAngle, pos, size))
+            continue;
+        // Leaves count whether they are opaque or not, the alpha test is left to the rays
+        if ((leafMask & (1 << current)) != 0 || size <= distance * coneWidth)
+        {
+            nearest = distance;
+            continue;
+        }
+
+        // PUSH
+        const uint32_t bitMask = (1 << current) - 1;
+        const uint32_t childOffset = std::popcount(childMask & bitMask) + std::popcount(leafMask & bitMask & childMask);
+        const uint32_t address = elem.index + parent.ptr.getPtr();
+        const uint32_t nextChild = (parent.ptr.isFar() ? address + m_nodes[address] : address) + childOffset;
+        stackPtr++;
+        stack[stackPtr] = { nextChild, pos, 0 };
+    }
+    return nearest;
+}
+
+// Final color of a pixel before the sRGB encoding: the heatmap of the intersection test, the shaded leaf or the sky
+glm::vec3 CpuTracer::getColor(const Hit& hit, const bool shadowed, const float pixelAngle, const TileContext& context) const
+{
+    const Settings& settings = *context.settings;
+    if (settings.intersectionTest)
+    {
+        const float testTint = 0.0025f * static_cast<float>(hit.steps);
+        if (settings.intersectionColor)
+            return hit.hit ? glm::vec3(testTint, 1.0f - testTint, 0.0f) : glm::vec3(testTint, 0.0f, 0.0f);
+        return glm::vec3(testTint);
+    }
+    if (hit.hit)
+        return shade(hit, context.camPos, pixelAngle, shadowed, settings);
+    return settings.skyColor;
+}
+
+// Mirrors parseLeaf of the shader. The index is the first of the two words of the leaf
+CpuTracer::Leaf CpuTracer::parseLeaf(const uint32_t index) const
+{
+    const uint32_t node1 = m_nodes[index];
+    const uint32_t node2 = m_nodes[index + 1];
+    Leaf leaf{};
+    leaf.uv.x = static_cast<float>((node1 & 0xFFF00000) >> 20);
+    leaf.uv.y = static_cast<float>((node1 & 0x000FFF00) >> 8);
+    leaf.material = (node1 & 0x000000FF) << 2;
+    leaf.material |= (node2 & 0xC0000000) >> 30;
+    leaf.normal.x = static_cast<float>((node2 & 0x3FF00000) >> 20);
+    leaf.normal.y = static_cast<float>((node2 & 0x000FFC00) >> 10);
+    leaf.normal.z = static_cast<float>(node2 & 0x000003FF);
+
+    leaf.uv = leaf.uv / static_cast<float>(0xFFF);
+    leaf.normal = leaf.normal / static_cast<float>(0x1FF) - 1.0f;
+    if (leaf.normal != glm::vec3(0.0f))
+        leaf.normal = glm::normalize(leaf.normal);
+
+    leaf.color = glm::vec3(1.0f);
+    leaf.specular = 1.0f;
+    if ((m_leafFlags & Octree::LEAF_BAKED_COLOR) != 0)
+    {
+        // The UV bits hold the sRGB color baked by the voxelizer
+        const uint32_t packedColor = node1 >> 8;
+        if ((m_leafFlags & Octree::LEAF_BAKED_SPECULAR) != 0)
+        {
+            leaf.color = glm::vec3((packedColor >> 19) & 0x1F, (packedColor >> 13) & 0x3F, (packedColor >> 8) & 0x1F) / glm::vec3(31.0f, 63.0f, 31.0f);
+            leaf.specular = static_cast<float>(packedColor & 0xFF) / 255.0f;
+        }
+        else
+            leaf.color = glm::vec3((packedColor >> 16) & 0xFF, (packedColor >> 8) & 0xFF, packedColor & 0xFF) / 255.0f;
+        for (uint32_t i = 0; i < 3; i++)
+            leaf.color[i] = leaf.color[i] <= 0.04045f ? leaf.color[i] / 12.92f : std::pow((leaf.color[i] + 0.055f) / 1.055f, 2.4f);
+    }
+    return leaf;
+}
+
+// Bilinear filtering with repeat in linear space, from the mip closest to the level of detail
+// The GPU also blends two mips, which is not worth it here
+glm::vec4 CpuTracer::sampleMap(const uint32_t map, const glm::vec2 uv, const float lod) const
+{
+    const uint32_t image = m_textureImages[map];
+    const DecodedTexture& texture = m_images[image];
+    const std::vector<TextureMip>& mips = m_imageMips[image];
+    const TextureMip& mip = mips[std::clamp(static_cast<int32_t>(lod + 0.5f), 0, static_cast<int32_t>(mips.size()) - 1)];
+    const uint8_t* texels = texture.pixels.data() + mip.offset;
+
+    const float x = uv.x * static_cast<float>(mip.width) - 0.5f;
+    const float y = uv.y * static_cast<float>(mip.height) - 0.5f;
+    const float fx = std::floor(x);
+    const float fy = std::floor(y);
+    const glm::vec2 weight{ x - fx, y - fy };
+    const auto fetch = [&](const int32_t tx, const int32_t ty)
+    {
+        const uint32_t wx = static_cast<uint32_t>(tx) & (mip.width - 1);
+        const uint32_t wy = static_cast<uint32_t>(ty) & (mip.height - 1);
+        const uint8_t* texel = texels + (static_cast<size_t>(wy) * mip.width + wx) * 4;
+        return glm::vec4{ srgbToLinear(texel[0]), srgbToLinear(texel[1]), srgbToLinear(texel[2]), static_cast<float>(texel[3]) / 255.0f };
+    };
+    const int32_t ix = static_cast<int32_t>(fx);
+    const int32_t iy = static_cast<int32_t>(fy);
+    const glm::vec4 top = glm::mix(fetch(ix, iy), fetch(ix + 1, iy), weight.x);
+    const glm::vec4 bottom = glm::mix(fetch(ix, iy + 1), fetch(ix + 1, iy + 1), weight.x);
+    return glm::mix(top, bottom, weight.y);
+}
+
+// A leaf is drawn if its diffuse map lets it through the alpha test. Without a map (or without loaded textures) it is always drawn
+bool CpuTracer::isOpaque(const uint32_t index) const
+{
+    // Transparent leaves were already removed when the octree was voxelized
+    if ((m_leafFlags & (Octree::LEAF_BAKED_COLOR | Octree::LEAF_OPAQUE)) != 0)
+        return true;
+    const Leaf leaf = parseLeaf(index);
+    const uint32_t diffuseMap = m_materials[leaf.material].diffuseMap;
+    return diffuseMap >= m_textureImages.size() || sampleMap(diffuseMap, leaf.uv, 0.0f).w >= 0.1f;
+}
+
+// Whether one of the leaf children of a node the ray goes through stops it, hitsLeafChild of the shader
+bool CpuTracer::hitsLeafChild(const uint32_t index, const BranchNode node, const uint32_t intersectionMask) const
+{
+    const uint32_t childMask = node.childMask.toRaw();
+    uint32_t leaves = childMask & node.leafMask.toRaw() & intersectionMask;
+    if (leaves == 0)
+        return false;
+    if ((m_leafFlags & (Octree::LEAF_BAKED_COLOR | Octree::LEAF_OPAQUE)) != 0)
+        return true;
+    const uint32_t address = index + node.ptr.getPtr();
+    const uint32_t base = node.ptr.isFar() ? address + m_nodes[address] : address;
+    while (leaves != 0)
+    {
+        const uint32_t current = std::countr_zero(leaves);
+        leaves &= leaves - 1;
+        const uint32_t bitMask = (1u << current) - 1;
+        if (isOpaque(base + std::popcount(childMask & bitMask) + std::popcount(node.leafMask.toRaw() & bitMask & childMask)))
+            return true;
+    }
+    return false;
+}
+
+// Mirrors calculateLighting and colorCorrection of the shader, the shadow ray is traced by the caller
+glm::vec3 CpuTracer::shade(const Hit& hit, const glm::vec3 camPos, const float pixelAngle, const bool shadowed, const Settings& settings) const
+{
+    const Leaf voxel = parseLeaf(hit.voxelIndex);
+    const Octree::Material& mat = m_materials[voxel.material];
+    // The base level is taken as one texel per leaf, each mip after it covers twice the leaves the pixel spans
+    const float lod = std::log2(std::max(glm::distance(camPos, hit.voxelPos) * pixelAngle / hit.voxelSize, 1.0f));
+
+    glm::vec3 diffAmbTexel = voxel.color;
+    if (mat.diffuseMap < m_textureImages.size())
+        diffAmbTexel = glm::vec3(sampleMap(mat.diffuseMap, voxel.uv, lod));
+    const glm::vec3 ambientColor = mat.ambient * diffAmbTexel;
+    glm::vec3 color = settings.sunColor * 0.1f * ambientColor;
+
+    if (!shadowed)
+    {
+        const glm::vec3 sunDirection = glm::normalize(settings.sunDirection);
+        const glm::vec3 camDirection = glm::normalize(camPos - hit.voxelPos);
+        const glm::vec3 halfV = glm::normalize(sunDirection + camDirection);
+        float specularTexel = voxel.specular;
+        if (mat.specularMap < m_textureImages.size())
+            specularTexel = sampleMap(mat.specularMap, voxel.uv, lod).x;
+
+        const float diff = std::clamp(glm::dot(voxel.normal, sunDirection), 0.0f, 1.0f);
+        const float tmp = std::max(glm::dot(voxel.normal, halfV), 0.0f);
+        const float spec = tmp == 0.0f || mat.specularComp == 0.0f ? 0.0f : std::pow(tmp, mat.specularComp * 3.0f);
+        color += settings.sunColor * diff * mat.diffuse * diffAmbTexel;
+        color += settings.sunColor * spec * mat.specular * specularTexel;
+    }
+
+    color = settings.contrast * (color - 0.5f) + 0.5f + settings.brightness;
+    color = glm::clamp(color, glm::vec3(0.0f), glm::vec3(1.0f));
+    const glm::vec3 desat{ glm::dot(color, glm::vec3(0.299f, 0.587f, 0.114f)) };
+    color = glm::clamp(glm::mix(desat, color, settings.saturation), glm::vec3(0.0f), glm::vec3(1.0f));
+    color = glm::clamp(glm::pow(color, glm::vec3(settings.gamma)), glm::vec3(0.0f), glm::vec3(1.0f));
+    return color;
+}
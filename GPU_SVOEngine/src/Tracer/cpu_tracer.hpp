@@ -0,0 +1,134 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "camera.hpp"
+#include "Octree/octree.hpp"
+#include "Texture/texture_processing.hpp"
+#include "Tracer/reprojection.hpp"
+#include "Tracer/wavefront.hpp"
+
+// CPU TRACER
+
+// Port of the traversal and shading of raytracing.frag that runs on the nodes of an Octree, without a GPU
+// Rays are traced in packets as wide as the SIMD registers (see simd.hpp). Every lane keeps its own intersection masks and visits
+// the nodes in the same order it would alone, so each pixel matches what a single ray of the shader finds
+// The screen is split into tiles, each thread starts with a range of them and steals half of another range when it runs out
+class CpuTracer
+{
+public:
+    // Same values the engine sends as push constants and pipeline macros
+    struct Settings
+    {
+        glm::vec3 sunDirection{ 0.0f, 1.0f, 0.0f };
+        glm::vec3 skyColor{ 0.0f, 1.0f, 1.0f };
+        glm::vec3 sunColor{ 1.0f, 1.0f, 1.0f };
+        float scale = 100.0f;
+        float brightness = 0.0f;
+        float saturation = 1.0f;
+        float contrast = 1.0f;
+        float gamma = 1.0f;
+        bool shadows = false;
+        bool intersectionTest = false;
+        bool intersectionColor = false;
+        // Traces like the compute traversal of the engine: 8x8 tiles with one ray per pixel and the stack in the memory of the tile,
+        // and shadow rays with the any hit traversal, instead of packets. The image is the same, it is there to measure and debug
+        // the layout the GPU uses
+        bool computeTiles = false;
+        // Traces one ray at a time with the short stack of the fragment shader instead of packets, the image is the same
+        bool shortStack = false;
+        // Keeps what every pixel saw here and traces half of the pixels of the next frames, the other half is reprojected
+        // from the frame before (see reprojection.hpp). Null traces every pixel, the intersection test always does
+        FrameHistory* history = nullptr;
+        // Traces a cone per 8x8 block first, the rays of the block start at the nearest distance it found instead of at the camera
+        bool beamPrepass = false;
+        // Traces the frame in passes like the WAVEFRONT pipeline of the engine (see wavefront.hpp): primary packets to a hit buffer,
+        // compaction of the shadow rays, sorting, shadow packets from the queue and shading. Needs shadows, without them or with
+        // the intersection test it is ignored. The image is the same, computeTiles, shortStack and history are not used
+        bool wavefront = false;
+        // Sorts the shadow queue by the Morton code of the origins, off traces the rays in the order of their pixels
+        bool sortShadowRays = true;
+        // 0 uses all hardware threads
+        uint32_t threadCount = 0;
+    };
+
+    struct Stats
+    {
+        // Primary and shadow rays
+        uint64_t rays = 0;
+        double seconds = 0.0;
+        uint32_t threads = 0;
+        // Time of every pass of the wavefront mode, zero in the others
+        double traversalSeconds = 0.0;
+        double compactionSeconds = 0.0;
+        double sortSeconds = 0.0;
+        double shadowSeconds = 0.0;
+        double shadingSeconds = 0.0;
+        // Rays of the shadow queue of the wavefront mode
+        uint64_t shadowRays = 0;
+
+        [[nodiscard]] double getRaysPerSecond() const;
+        [[nodiscard]] double getRaysPerSecondPerCore() const;
+    };
+
+    struct Hit
+    {
+        bool hit = false;
+        uint32_t voxelIndex = 0;
+        glm::vec3 voxelPos{ 0.0f };
+        float voxelSize = 0.0f;
+        // Children visited on the way, what the intersection test shows
+        uint32_t steps = 0;
+    };
+
+    // The nodes are copied in forward order, the octree can be freed afterwards
+    explicit CpuTracer(const Octree& octree);
+
+    // Decodes the textures of the octree as RGBA8 with mips. Without them every material is drawn with its colors only
+    // and no leaf is discarded by the alpha test
+    void loadTextures(const std::vector<std::string>& paths, const std::filesystem::path& cacheDir);
+
+    // Renders an RGBA8 image with the sRGB encoding the swapchain applies
+    Stats render(const Camera::Data& camera, uint32_t width, uint32_t height, const Settings& settings, std::vector<uint8_t>& pixels) const;
+    // Single ray, the first leaf it hits with the same rules as the shader
+    [[nodiscard]] Hit trace(glm::vec3 origin, glm::vec3 direction, float scale) const;
+    // traceShadowRay of the shader, whether a ray hits any leaf. Always the same answer as trace(...).hit
+    [[nodiscard]] bool traceShadow(glm::vec3 origin, glm::vec3 direction, float scale) const;
+
+private:
+    struct Leaf
+    {
+        uint32_t material;
+        glm::vec3 normal;
+        glm::vec2 uv;
+        glm::vec3 color;
+        float specular;
+    };
+
+    struct Packet;
+    struct TileContext;
+
+    void tracePacket(Packet& packet, uint32_t lanes, float scale) const;
+    void renderTile(uint32_t tile, TileContext& context) const;
+    [[nodiscard]] Hit traceShared(glm::vec3 origin, glm::vec3 direction, float tStart, float scale, uint32_t* stackIndex, uint32_t* stackState) const;
+    [[nodiscard]] Hit traceShortStack(glm::vec3 origin, glm::vec3 direction, float tStart, float scale) const;
+    void renderComputeTile(uint32_t tile, TileContext& context) const;
+    [[nodiscard]] float traceBeam(glm::vec3 origin, glm::vec3 axis, float coneAngle, float scale) const;
+    [[nodiscard]] glm::vec3 getColor(const Hit& hit, bool shadowed, float pixelAngle, const TileContext& context) const;
+    [[nodiscard]] Leaf parseLeaf(uint32_t index) const;
+    [[nodiscard]] glm::vec4 sampleMap(uint32_t map, glm::vec2 uv, float lod) const;
+    [[nodiscard]] bool isOpaque(uint32_t index) const;
+    [[nodiscard]] bool hitsLeafChild(uint32_t index, BranchNode node, uint32_t intersectionMask) const;
+    [[nodiscard]] glm::vec3 shade(const Hit& hit, glm::vec3 camPos, float pixelAngle, bool shadowed, const Settings& settings) const;
+
+    std::vector<uint32_t> m_nodes;
+    std::vector<Octree::Material> m_materials;
+    uint32_t m_leafFlags = 0;
+    // Images and the image of every texture of the octree
+    std::vector<DecodedTexture> m_images;
+    std::vector<std::vector<TextureMip>> m_imageMips;
+    std::vector<uint32_t> m_textureImages;
+};
@@ -0,0 +1,118 @@
+#include "reprojection.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void FrameHistory::beginFrame(const uint32_t width, const uint32_t height)
+{
+    if (width != m_width || height != m_height)
+    {
+        m_width = width;
+        m_height = height;
+        m_current.assign(static_cast<size_t>(width) * height, HistorySample{});
+        m_previous.assign(static_cast<size_t>(width) * height, HistorySample{});
+        m_hasPrevious = false;
+    }
+}
+
+void FrameHistory::endFrame(const glm::mat4& pvMatrix)
+{
+    std::swap(m_current, m_previous);
+    m_previousPVMatrix = pvMatrix;
+    m_hasPrevious = true;
+    m_frameIndex++;
+}
+
+void FrameHistory::clear()
+{
+    m_hasPrevious = false;
+}
+
+bool isTracedPixel(const uint32_t x, const uint32_t y, const uint32_t frameIndex)
+{
+    return ((x + y + frameIndex) & 1) == 0;
+}
+
+bool projectToPixel(const glm::mat4& pvMatrix, const glm::vec4 point, const uint32_t width, const uint32_t height, glm::uvec2& pixel)
+{
+    const glm::vec4 clip = pvMatrix * point;
+    if (clip.w <= 0.0f)
+        return false;
+    // Inverse of the screen coordinates the directions are created with, x to the right and y down
+    const float x = (clip.x / clip.w + 1.0f) / 2.0f * static_cast<float>(width);
+    const float y = (1.0f - clip.y / clip.w) / 2.0f * static_cast<float>(height);
+    if (!(x >= 0.0f && y >= 0.0f && x < static_cast<float>(width) && y < static_cast<float>(height)))
+        return false;
+    pixel = glm::uvec2(static_cast<uint32_t>(x), static_cast<uint32_t>(y));
+    return true;
+}
+
+float getHitDistance(const glm::vec3 origin, const glm::vec3 direction, const glm::vec3 voxelPos, const float voxelSize)
+{
+    const glm::vec3 invDirection = 1.0f / direction;
+    const glm::vec3 tMid = (voxelPos - origin) * invDirection;
+    const glm::vec3 slabRadius = voxelSize / 2.0f * glm::abs(invDirection);
+    const glm::vec3 tMin = tMid - slabRadius;
+    return std::max(std::max(std::max(tMin.x, tMin.y), tMin.z), 0.0f);
+}
+
+float getPlaneDistance(const glm::vec3 origin, const glm::vec3 direction, const HistorySample& neighbour)
+{
+    const float facing = glm::dot(direction, neighbour.normal);
+    // Grazing planes would put the point anywhere along the ray, the distance of the neighbour itself is closer to the truth
+    if (std::abs(facing) < 0.1f)
+        return glm::dot(neighbour.position - origin, direction);
+    return glm::dot(neighbour.position - origin, neighbour.normal) / facing;
+}
+
+bool acceptHistory(const HistorySample& history, const glm::vec3 origin, const glm::vec3 direction, const float distance, const glm::vec3 normal, const float pixelAngle)
+{
+    const glm::vec3 toHistory = history.position - origin;
+    const float along = glm::dot(toHistory, direction);
+    if (std::abs(along - distance) > REPROJECTION_DEPTH_TOLERANCE * distance)
+        return false;
+    if (glm::length(toHistory - along * direction) > REPROJECTION_PIXEL_TOLERANCE * pixelAngle * along)
+        return false;
+    return glm::dot(history.normal, normal) >= REPROJECTION_NORMAL_TOLERANCE;
+}
+
+bool reprojectPixel(const FrameHistory& history, const uint32_t x, const uint32_t y, const glm::vec3 origin, const glm::vec3 direction, const float pixelAngle, HistorySample& sample)
+{
+    static constexpr int32_t NEIGHBOURS[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+
+    const uint32_t width = history.getWidth();
+    const uint32_t height = history.getHeight();
+    for (const auto& offset : NEIGHBOURS)
+    {
+        const int32_t nx = static_cast<int32_t>(x) + offset[0];
+        const int32_t ny = static_cast<int32_t>(y) + offset[1];
+        if (nx < 0 || ny < 0 || nx >= static_cast<int32_t>(width) || ny >= static_cast<int32_t>(height))
+            continue;
+        const HistorySample& neighbour = history.getCurrent(static_cast<uint32_t>(nx), static_cast<uint32_t>(ny));
+
+        glm::uvec2 previous;
+        if (!neighbour.hit)
+        {
+            // The sky only depends on the direction, it is kept if the previous frame saw the sky that way too
+            if (projectToPixel(history.getPreviousPVMatrix(), glm::vec4(direction, 0.0f), width, height, previous) && !history.getPrevious(previous.x, previous.y).hit)
+            {
+                sample = history.getPrevious(previous.x, previous.y);
+                return true;
+            }
+            continue;
+        }
+
+        const float distance = getPlaneDistance(origin, direction, neighbour);
+        if (distance <= 0.0f || !projectToPixel(history.getPreviousPVMatrix(), glm::vec4(origin + distance * direction, 1.0f), width, height, previous))
+            continue;
+        const HistorySample& candidate = history.getPrevious(previous.x, previous.y);
+        if (candidate.hit && acceptHistory(candidate, origin, direction, distance, neighbour.normal, pixelAngle))
+        {
+            // Moved onto the ray of the pixel, the shader only stores the distance along it
+            sample = candidate;
+            sample.position = origin + glm::dot(candidate.position - origin, direction) * direction;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// TEMPORAL REPROJECTION
+
+// The temporal mode traces half of the pixels of every frame, in a checkerboard that flips every frame. The other half looks for
+// what the previous frame saw there: the surfaces its traced neighbours hit tell where the ray should end, that point is projected
+// into the previous frame, and the sample found there is kept if it is that surface. Pixels without one are traced as well
+// raytracing.frag does the same with functions of the same names, this is the version the CPU tracer uses and tests against
+
+// Distance along the ray the history can be from the surface of the neighbour, relative to that distance
+constexpr float REPROJECTION_DEPTH_TOLERANCE = 0.02f;
+// Smallest cosine between the normal of the history and the normal of the neighbour
+constexpr float REPROJECTION_NORMAL_TOLERANCE = 0.9f;
+// Distance the history can be from the ray, in pixels at the distance of the history
+constexpr float REPROJECTION_PIXEL_TOLERANCE = 1.0f;
+
+// What a frame keeps of each of its pixels
+struct HistorySample
+{
+    // Point where the ray entered the leaf it hit
+    glm::vec3 position{ 0.0f };
+    glm::vec3 normal{ 0.0f };
+    // Linear color, before the sRGB encoding
+    glm::vec3 color{ 0.0f };
+    bool hit = false;
+};
+
+// Samples of the frame being rendered and of the one before it
+class FrameHistory
+{
+public:
+    // Starts a frame, the previous one is dropped if it had another size
+    void beginFrame(uint32_t width, uint32_t height);
+    // The samples of the frame become the previous ones, pvMatrix is the projection the frame was rendered with
+    void endFrame(const glm::mat4& pvMatrix);
+    void clear();
+
+    [[nodiscard]] bool hasPrevious() const { return m_hasPrevious; }
+    [[nodiscard]] uint32_t getFrameIndex() const { return m_frameIndex; }
+    [[nodiscard]] uint32_t getWidth() const { return m_width; }
+    [[nodiscard]] uint32_t getHeight() const { return m_height; }
+    [[nodiscard]] const glm::mat4& getPreviousPVMatrix() const { return m_previousPVMatrix; }
+
+    [[nodiscard]] HistorySample& getCurrent(const uint32_t x, const uint32_t y) { return m_current[static_cast<size_t>(y) * m_width + x]; }
+    [[nodiscard]] const HistorySample& getCurrent(const uint32_t x, const uint32_t y) const { return m_current[static_cast<size_t>(y) * m_width + x]; }
+    [[nodiscard]] const HistorySample& getPrevious(const uint32_t x, const uint32_t y) const { return m_previous[static_cast<size_t>(y) * m_width + x]; }
+
+private:
+    std::vector<HistorySample> m_current;
+    std::vector<HistorySample> m_previous;
+    glm::mat4 m_previousPVMatrix{ 1.0f };
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_frameIndex = 0;
+    bool m_hasPrevious = false;
+};
+
+// Pixels traced in every frame, the other half of the checkerboard is reprojected
+[[nodiscard]] bool isTracedPixel(uint32_t x, uint32_t y, uint32_t frameIndex);
+// Pixel a point ends up in, with the screen coordinates of the tracers. Points with w = 0 are directions, as far as the sky
+// False when the point is behind the camera or outside of the image
+[[nodiscard]] bool projectToPixel(const glm::mat4& pvMatrix, glm::vec4 point, uint32_t width, uint32_t height, glm::uvec2& pixel);
+// Distance along a ray to the entry point of the leaf the ray hit
+[[nodiscard]] float getHitDistance(glm::vec3 origin, glm::vec3 direction, glm::vec3 voxelPos, float voxelSize);
+// Distance along a ray to the plane of the surface a neighbour hit, or to the point itself if the ray is parallel to the plane
+[[nodiscard]] float getPlaneDistance(glm::vec3 origin, glm::vec3 direction, const HistorySample& neighbour);
+// Whether a sample of the previous frame is the surface at the distance a neighbour predicts: close enough to the ray and to that
+// distance, and facing the same way
+[[nodiscard]] bool acceptHistory(const HistorySample& history, glm::vec3 origin, glm::vec3 direction, float distance, glm::vec3 normal, float pixelAngle);
+// Sample of the previous frame for a pixel the frame doesn't trace, tried with each of the four neighbours of the pixel, which are traced
+// False when none of them finds one and the pixel has to be traced
+[[nodiscard]] bool reprojectPixel(const FrameHistory& history, uint32_t x, uint32_t y, glm::vec3 origin, glm::vec3 direction, float pixelAngle, HistorySample& sample);
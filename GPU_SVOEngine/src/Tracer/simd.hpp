@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <immintrin.h>
+
+// Thin wrappers over the SIMD registers the CPU tracer uses. Packets are as wide as the widest instruction set the
+// program is compiled for: 8 lanes with AVX2 (/arch:AVX2 or -mavx2) and 4 lanes with SSE2, which every x64 CPU has
+// Only the operations the intersection mask needs are here, everything else in the tracer works one lane at a time
+
+#if defined(__AVX2__)
+
+static constexpr uint32_t SIMD_WIDTH = 8;
+
+struct SimdMask
+{
+    __m256 v;
+    // One bit per lane, lane 0 in the lowest bit
+    [[nodiscard]] uint32_t toBits() const { return static_cast<uint32_t>(_mm256_movemask_ps(v)); }
+    SimdMask operator|(const SimdMask o) const { return { _mm256_or_ps(v, o.v) }; }
+    SimdMask operator&(const SimdMask o) const { return { _mm256_and_ps(v, o.v) }; }
+};
+
+struct SimdFloat
+{
+    __m256 v;
+    static SimdFloat load(const float* p) { return { _mm256_load_ps(p) }; }
+    static SimdFloat set(const float f) { return { _mm256_set1_ps(f) }; }
+    SimdFloat operator+(const SimdFloat o) const { return { _mm256_add_ps(v, o.v) }; }
+    SimdFloat operator-(const SimdFloat o) const { return { _mm256_sub_ps(v, o.v) }; }
+    SimdFloat operator*(const SimdFloat o) const { return { _mm256_mul_ps(v, o.v) }; }
+    SimdMask operator<(const SimdFloat o) const { return { _mm256_cmp_ps(v, o.v, _CMP_LT_OQ) }; }
+    SimdMask operator>(const SimdFloat o) const { return { _mm256_cmp_ps(v, o.v, _CMP_GT_OQ) }; }
+    SimdMask operator>=(const SimdFloat o) const { return { _mm256_cmp_ps(v, o.v, _CMP_GE_OQ) }; }
+};
+
+struct SimdInt
+{
+    __m256i v;
+    static SimdInt set(const int32_t i) { return { _mm256_set1_epi32(i) }; }
+    void store(int32_t* p) const { _mm256_store_si256(reinterpret_cast<__m256i*>(p), v); }
+    SimdInt operator+(const SimdInt o) const { return { _mm256_add_epi32(v, o.v) }; }
+    SimdInt operator&(const SimdInt o) const { return { _mm256_and_si256(v, o.v) }; }
+    SimdInt operator|(const SimdInt o) const { return { _mm256_or_si256(v, o.v) }; }
+};
+
+inline SimdFloat simdMin(const SimdFloat a, const SimdFloat b) { return { _mm256_min_ps(a.v, b.v) }; }
+inline SimdFloat simdMax(const SimdFloat a, const SimdFloat b) { return { _mm256_max_ps(a.v, b.v) }; }
+inline SimdFloat simdAbs(const SimdFloat a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+inline SimdInt simdSelect(const SimdMask m, const SimdInt a, const SimdInt b) { return { _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b.v), _mm256_castsi256_ps(a.v), m.v)) }; }
+// 1 << shift in every lane
+inline SimdInt simdShiftOne(const SimdInt shift) { return { _mm256_sllv_epi32(_mm256_set1_epi32(1), shift.v) }; }
+
+#else
+
+static constexpr uint32_t SIMD_WIDTH = 4;
+
+struct SimdMask
+{
+    __m128 v;
+    // One bit per lane, lane 0 in the lowest bit
+    [[nodiscard]] uint32_t toBits() const { return static_cast<uint32_t>(_mm_movemask_ps(v)); }
+    SimdMask operator|(const SimdMask o) const { return { _mm_or_ps(v, o.v) }; }
+    SimdMask operator&(const SimdMask o) const { return { _mm_and_ps(v, o.v) }; }
+};
+
+struct SimdFloat
+{
+    __m128 v;
+    static SimdFloat load(const float* p) { return { _mm_load_ps(p) }; }
+    static SimdFloat set(const float f) { return { _mm_set1_ps(f) }; }
+    SimdFloat operator+(const SimdFloat o) const { return { _mm_add_ps(v, o.v) }; }
+    SimdFloat operator-(const SimdFloat o) const { return { _mm_sub_ps(v, o.v) }; }
+    SimdFloat operator*(const SimdFloat o) const { return { _mm_mul_ps(v, o.v) }; }
+    SimdMask operator<(const SimdFloat o) const { return { _mm_cmplt_ps(v, o.v) }; }
+    SimdMask operator>(const SimdFloat o) const { return { _mm_cmpgt_ps(v, o.v) }; }
+    SimdMask operator>=(const SimdFloat o) const { return { _mm_cmpge_ps(v, o.v) }; }
+};
+
+struct SimdInt
+{
+    __m128i v;
+    static SimdInt set(const int32_t i) { return { _mm_set1_epi32(i) }; }
+    void store(int32_t* p) const { _mm_store_si128(reinterpret_cast<__m128i*>(p), v); }
+    SimdInt operator+(const SimdInt o) const { return { _mm_add_epi32(v, o.v) }; }
+    SimdInt operator&(const SimdInt o) const { return { _mm_and_si128(v, o.v) }; }
+    SimdInt operator|(const SimdInt o) const { return { _mm_or_si128(v, o.v) }; }
+};
+
+inline SimdFloat simdMin(const SimdFloat a, const SimdFloat b) { return { _mm_min_ps(a.v, b.v) }; }
+inline SimdFloat simdMax(const SimdFloat a, const SimdFloat b) { return { _mm_max_ps(a.v, b.v) }; }
+inline SimdFloat simdAbs(const SimdFloat a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+inline SimdInt simdSelect(const SimdMask m, const SimdInt a, const SimdInt b)
+{
+    const __m128i mask = _mm_castps_si128(m.v);
+    return { _mm_or_si128(_mm_and_si128(mask, a.v), _mm_andnot_si128(mask, b.v)) };
+}
+// 1 << shift in every lane. SSE2 has no per lane shift, so the shift goes into the exponent of a float and back
+inline SimdInt simdShiftOne(const SimdInt shift) { return { _mm_cvttps_epi32(_mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(shift.v, _mm_set1_epi32(127)), 23))) }; }
+
+#endif
@@ -0,0 +1,108 @@
+#include "wavefront.hpp"
+
+#include <algorithm>
+
+#include <omp.h>
+
+// Puts two zero bits after each of the 10 lowest bits
+static uint32_t expandBits(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+uint32_t getMortonCode(const glm::vec3 position, const float scale)
+{
+    constexpr float cells = static_cast<float>(1u << MORTON_AXIS_BITS);
+    const glm::uvec3 cell{ glm::clamp((position / scale + 0.5f) * cells, glm::vec3(0.0f), glm::vec3(cells - 1.0f)) };
+    return expandBits(cell.x) << 2 | expandBits(cell.y) << 1 | expandBits(cell.z);
+}
+
+void compactShadowRays(const std::span<const ShadowRay> candidates, std::vector<ShadowRay>& queue, const uint32_t threadCount)
+{
+    const size_t blockCount = std::clamp<size_t>(threadCount, 1, std::max<size_t>(candidates.size(), 1));
+    const auto getBlockStart = [&](const size_t block) { return candidates.size() * block / blockCount; };
+
+    // Rays of every block, shifted by one so the scan leaves where each block starts
+    std::vector<size_t> offsets(blockCount + 1, 0);
+    #pragma omp parallel for num_threads(static_cast<int>(blockCount))
+    for (int32_t block = 0; block < static_cast<int32_t>(blockCount); block++)
+    {
+        size_t count = 0;
+        for (size_t i = getBlockStart(block); i < getBlockStart(block + 1); i++)
+            count += candidates[i].pixel != NO_SHADOW_RAY ? 1 : 0;
+        offsets[block + 1] = count;
+    }
+    for (size_t block = 0; block < blockCount; block++)
+        offsets[block + 1] += offsets[block];
+
+    queue.resize(offsets.back());
+    #pragma omp parallel for num_threads(static_cast<int>(blockCount))
+    for (int32_t block = 0; block < static_cast<int32_t>(blockCount); block++)
+    {
+        size_t next = offsets[block];
+        for (size_t i = getBlockStart(block); i < getBlockStart(block + 1); i++)
+        {
+            if (candidates[i].pixel != NO_SHADOW_RAY)
+                queue[next++] = candidates[i];
+        }
+    }
+}
+
+void sortShadowRays(std::vector<ShadowRay>& queue, const float scale, const uint32_t threadCount)
+{
+    constexpr uint32_t digitCount = 1u << SORT_DIGIT_BITS;
+    constexpr uint32_t keyBits = 3 * MORTON_AXIS_BITS;
+    const size_t count = queue.size();
+    if (count < 2)
+        return;
+    const size_t blockCount = std::clamp<size_t>(threadCount, 1, count);
+    const auto getBlockStart = [&](const size_t block) { return count * block / blockCount; };
+
+    std::vector<uint32_t> keys(count);
+    #pragma omp parallel for num_threads(static_cast<int>(blockCount))
+    for (int64_t i = 0; i < static_cast<int64_t>(count); i++)
+        keys[i] = getMortonCode(queue[i].origin, scale);
+
+    std::vector<ShadowRay> sortedRays(count);
+    std::vector<uint32_t> sortedKeys(count);
+    // Digit major, so the scan puts the rays of a digit of every block after the rays of the same digit of the blocks before it
+    std::vector<size_t> counts(digitCount * blockCount);
+    for (uint32_t shift = 0; shift < keyBits; shift += SORT_DIGIT_BITS)
+    {
+        // Count
+        std::fill(counts.begin(), counts.end(), 0);
+        #pragma omp parallel for num_threads(static_cast<int>(blockCount))
+        for (int32_t block = 0; block < static_cast<int32_t>(blockCount); block++)
+        {
+            for (size_t i = getBlockStart(block); i < getBlockStart(block + 1); i++)
+                counts[((keys[i] >> shift) & (digitCount - 1)) * blockCount + block]++;
+        }
+
+        // Scan
+        size_t offset = 0;
+        for (size_t& blockStart : counts)
+        {
+            const size_t blockDigits = blockStart;
+            blockStart = offset;
+            offset += blockDigits;
+        }
+
+        // Scatter
+        #pragma omp parallel for num_threads(static_cast<int>(blockCount))
+        for (int32_t block = 0; block < static_cast<int32_t>(blockCount); block++)
+        {
+            for (size_t i = getBlockStart(block); i < getBlockStart(block + 1); i++)
+            {
+                const size_t next = counts[((keys[i] >> shift) & (digitCount - 1)) * blockCount + block]++;
+                sortedRays[next] = queue[i];
+                sortedKeys[next] = keys[i];
+            }
+        }
+        queue.swap(sortedRays);
+        keys.swap(sortedKeys);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// WAVEFRONT QUEUES
+
+// The wavefront mode splits a frame in passes: the primary rays write their hits to a buffer, the pixels that hit something get a
+// shadow ray in a queue, the queue is sorted so rays that start close to each other are traced together, the shadow rays are traced
+// and the hits are shaded last. raytracing.frag does the same with the WAVEFRONT passes, these are the queue stages the CPU tracer
+// uses, written the way the GPU runs them so their cost and the coherence they buy can be measured without a GPU
+
+// Bits of the Morton code per axis, the octree cube is split in a grid of 1024^3 cells
+constexpr uint32_t MORTON_AXIS_BITS = 10;
+// Digit of each pass of the radix sort, 4 passes cover the 30 bits of a Morton code
+constexpr uint32_t SORT_DIGIT_BITS = 8;
+
+// A shadow ray of the queue. Every one goes towards the sun, so the start point and the pixel it shadows are all it needs
+struct ShadowRay
+{
+    glm::vec3 origin;
+    // Pixel the ray belongs to, NO_SHADOW_RAY for pixels that didn't hit anything
+    uint32_t pixel;
+};
+
+constexpr uint32_t NO_SHADOW_RAY = UINT32_MAX;
+
+// Interleaved bits of the cell of a point in the octree, x in the highest bit of every group. Points outside are clamped to the border cells
+[[nodiscard]] uint32_t getMortonCode(glm::vec3 position, float scale);
+
+// Stream compaction: the rays of the candidates that have a pixel, in the same order. Each thread counts the rays of its block of
+// candidates, an exclusive scan of the counts gives where every block starts, and each block writes its rays from there
+void compactShadowRays(std::span<const ShadowRay> candidates, std::vector<ShadowRay>& queue, uint32_t threadCount);
+
+// Least significant digit radix sort by the Morton code of the origins, stable so rays in the same cell keep the order of their pixels
+// Every pass counts the digits of each block, scans the counts and scatters the blocks, like the count, scan and scatter passes on the GPU
+void sortShadowRays(std::vector<ShadowRay>& queue, float scale, uint32_t threadCount);
@@ -3,7 +3,9 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/transform.hpp>
 
+#ifndef HEADLESS_ONLY
 #include <SDL2/SDL_keycode.h>
+#endif
 
 Camera::Camera(const glm::vec3 pos, const glm::vec3 dir, const float fov, const float near, const float far)
 	: m_position(pos), m_front(dir), m_fov(fov), m_near(near), m_far(far), m_viewDirty(true), m_projDirty(true)
@@ -68,6 +70,11 @@ glm::vec3 Camera::getDir() const
 	return m_front;
 }
 
+float Camera::getFov() const
+{
+	return m_fov;
+}
+
 glm::mat4& Camera::getViewMatrix()
 {
 	if (m_viewDirty)
@@ -127,6 +134,8 @@ void Camera::mouseMoved(const int32_t relX, const int32_t relY)
     setDir(newFront);
 }
 
+// The keys are SDL keycodes, builds without a window have no keys to read
+#ifndef HEADLESS_ONLY
 void Camera::keyPressed(const uint32_t key)
 {
     if (!m_isMouseCaptured)
@@ -190,6 +199,7 @@ void Camera::keyReleased(const uint32_t key)
 		break;
 	}
 }
+#endif
 
 void Camera::updateEvents(const float delta)
 {
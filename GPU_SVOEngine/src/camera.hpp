@@ -24,6 +24,7 @@ public:
 	[[nodiscard]] glm::vec3 getPosition() const;
 		[[nodiscard]] glm::vec4 getPositionV4() const;
 	[[nodiscard]] glm::vec3 getDir() const;
+	[[nodiscard]] float getFov() const;
 
 	glm::mat4& getViewMatrix();
 	glm::mat4& getProjMatrix();
@@ -0,0 +1,48 @@
+#include "camera_path.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+std::vector<CameraPose> loadCameraPath(const std::string_view filename)
+{
+    std::ifstream file(filename.data());
+    if (!file)
+        throw std::runtime_error("could not open camera path " + std::string(filename));
+
+    std::vector<CameraPose> poses;
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        const size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        std::istringstream stream(line);
+        CameraPose pose{};
+        if (!(stream >> pose.position.x >> pose.position.y >> pose.position.z >> pose.direction.x >> pose.direction.y >> pose.direction.z))
+            throw std::runtime_error("invalid pose in line " + std::to_string(lineNumber) + " of camera path " + std::string(filename));
+        if (glm::length(pose.direction) == 0.0f)
+            throw std::runtime_error("null direction in line " + std::to_string(lineNumber) + " of camera path " + std::string(filename));
+        pose.direction = glm::normalize(pose.direction);
+        poses.push_back(pose);
+    }
+    return poses;
+}
+
+// Written with all the digits of a float, so playing the file back gives the exact same frames
+void saveCameraPath(const std::string_view filename, const std::vector<CameraPose>& poses)
+{
+    std::ofstream file(filename.data());
+    if (!file)
+        throw std::runtime_error("could not create camera path " + std::string(filename));
+    file.precision(9);
+    file << "# position x y z, direction x y z\n";
+    for (const CameraPose& pose : poses)
+    {
+        file << pose.position.x << ' ' << pose.position.y << ' ' << pose.position.z << ' '
+             << pose.direction.x << ' ' << pose.direction.y << ' ' << pose.direction.z << '\n';
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <string_view>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Position and direction of the camera in one frame, what Camera keeps between frames
+struct CameraPose
+{
+    glm::vec3 position;
+    glm::vec3 direction;
+};
+
+// CAMERA PATHS
+
+// Paths are text files with one pose per line, "px py pz dx dy dz". Empty lines and lines starting with # are skipped
+// The engine records them while flying around and the headless mode plays them back, one frame per pose
+[[nodiscard]] std::vector<CameraPose> loadCameraPath(std::string_view filename);
+void saveCameraPath(std::string_view filename, const std::vector<CameraPose>& poses);
@@ -1,11 +1,12 @@
 #include "engine.hpp"
 
+#include <algorithm>
 #include <array>
+#include <cstdio>
 #include <stdexcept>
 
 #include <imgui.h>
 #include <ranges>
-#include <numbers>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
@@ -17,31 +18,265 @@
 
 #include "utils/logger.hpp"
 
+#include "raw_image.hpp"
 #include "vulkan_context.hpp"
 #include "Octree/octree.hpp"
-
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
+#include "Octree/octree_pager.hpp"
+#include "Texture/texture_loader.hpp"
+#include "Texture/texture_packer.hpp"
+#include "Tracer/wavefront.hpp"
 
 #include "ext/vulkan_extension_management.hpp"
 #include "ext/vulkan_swapchain.hpp"
 
-// Push constant data for the shaders
-// The alignment rules for the GPU are specified here (https://registry.khronos.org/OpenGL/extensions/ARB/ARB_uniform_buffer_object.txt)
-// Search for the word "alignment" and it will jump to the correct section
-// As a general tip: Floats and uints are aligned to 4 bytes. Vec3, vec4 and mat4 are aligned to 16 bytes
-struct PushConstantData
-{
-    alignas(16) glm::vec3 camPos;
-    alignas(16) glm::mat4 viewProj;
-    alignas(16) glm::vec3 sunDirection;
-    alignas(16) glm::vec3 skyColor;
-    alignas(16) glm::vec3 sunColor;
-    alignas(4) float scale;
-    alignas(4) float brightness;
-    alignas(4) float saturation;
-    alignas(4) float contrast;
-    alignas(4) float gamma;
+// Size of the texture array sampler array in the shader. It doesn't depend on the scene, so the pipelines are only built once
+static constexpr uint32_t MAX_TEXTURE_ARRAYS = 16;
+// Material maps sent to the GPU are packed as (array << 16 | layer), this marks a missing one
+static constexpr uint32_t NO_TEXTURE = UINT32_MAX;
+// Size of the traversal stack in the shader. Octrees of any depth up to this one use the same pipelines
+static constexpr uint32_t MAX_OCTREE_DEPTH = 16;
+// A scene that is switched to at runtime is copied to the GPU in parts of this size, one per frame
+static constexpr VkDeviceSize SCENE_UPLOAD_BUDGET = 32ULL * 1024 * 1024;
+// Bytes taken by a page slot in the octree buffer
+static constexpr VkDeviceSize PAGE_BYTE_SIZE = OCTREE_PAGE_SIZE * sizeof(uint32_t);
+// Pages linked above this depth never leave the GPU, they hold the coarse levels the traversal falls back to when a page is missing
+static constexpr uint8_t PINNED_PAGE_DEPTH = 4;
+// Pages streamed in per frame when the octree doesn't fit in its memory limit
+static constexpr uint32_t PAGE_LOADS_PER_FRAME = 64;
+// Recorded camera paths are saved here, in the working directory
+static constexpr const char* CAMERA_PATH_FILE = "camera_path.txt";
+// Workgroup size of the compute traversal, the shader declares the same local size
+static constexpr uint32_t COMPUTE_TILE_SIZE = 8;
+// Side of the blocks of the beam pre-pass, in pixels. The beam image has one texel per block
+static constexpr uint32_t BEAM_BLOCK_SIZE = 8;
+// Passes of the WAVEFRONT variant of raytracing.frag, the WAVEFRONT_ constants of the shader
+static constexpr uint32_t WAVEFRONT_TRAVERSAL = 1;
+static constexpr uint32_t WAVEFRONT_SORT_COUNT = 2;
+static constexpr uint32_t WAVEFRONT_SORT_SCAN = 3;
+static constexpr uint32_t WAVEFRONT_SORT_SCATTER = 4;
+static constexpr uint32_t WAVEFRONT_SHADOW = 5;
+static constexpr uint32_t WAVEFRONT_SHADING = 6;
+// Rays each workgroup of the sort passes goes through, SORT_BLOCK_SIZE of the shader
+static constexpr uint32_t SORT_BLOCK_SIZE = 4096;
+// Size of the hit of a pixel in the hit buffer, the WavefrontHit of the shader with the std430 alignment
+static constexpr VkDeviceSize WAVEFRONT_HIT_SIZE = 32;
+// Workgroups of the queue passes are numbered row by row, with rows this long
+static constexpr uint32_t WAVEFRONT_DISPATCH_WIDTH = 1024;
+// The octree set and the push constants are used by the fragment and the compute traversal alike
+static constexpr VkShaderStageFlags TRACING_STAGES = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+// Makes what shaders wrote to an image in the general layout visible to the shaders of the next stages
+static void cmdShaderWriteBarrier(const VkCommandBuffer commandBuffer, const VkImage image, const VkPipelineStageFlags dstStages)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, VK_REMAINING_ARRAY_LAYERS };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStages, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+// The screen images and buffers are shared by every frame in flight. The compute passes of a frame and the reset of the shadow queue
+// wait for the shaders of the frames submitted before it
+static void cmdPreviousFrameBarrier(const VkCommandBuffer commandBuffer)
+{
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+// Makes what a stage wrote to the buffers visible to the compute shaders that come after it, between the wavefront passes
+static void cmdBufferWriteBarrier(const VkCommandBuffer commandBuffer, const VkPipelineStageFlags srcStage, const VkAccessFlags srcAccess)
+{
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, srcStage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+// One dimensional dispatch in rows of WAVEFRONT_DISPATCH_WIDTH workgroups, longer than the limit of a single dimension
+static void cmdDispatchRows(const VkCommandBuffer commandBuffer, const uint32_t groupCount)
+{
+    const uint32_t groupsX = std::clamp(groupCount, 1u, WAVEFRONT_DISPATCH_WIDTH);
+    vkCmdDispatch(commandBuffer, groupsX, (groupCount + groupsX - 1) / groupsX, 1);
+}
+
+// The swapchain acquires every image with the same semaphore, which can't be signaled again while a frame in flight still waits on it
+// Each frame slot acquires and presents with semaphores of its own instead. Returns UINT32_MAX when the swapchain is out of date
+static uint32_t acquireSwapchainImage(VulkanDevice& device, const VulkanSwapchain& swapchain, const uint32_t semaphoreID)
+{
+    uint32_t imageIndex = UINT32_MAX;
+    const VkResult result = vkAcquireNextImageKHR(*device, *swapchain, UINT64_MAX, *device.getSemaphore(semaphoreID), VK_NULL_HANDLE, &imageIndex);
+    return result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR ? imageIndex : UINT32_MAX;
+}
+
+// An out of date swapchain is rebuilt by the resize event of the window, so the result is not checked
+static void presentSwapchainImage(VulkanDevice& device, const QueueSelection queue, const VulkanSwapchain& swapchain, const uint32_t imageIndex, const uint32_t semaphoreID)
+{
+    const VkSwapchainKHR swapchainHandle = *swapchain;
+    const VkSemaphore semaphore = *device.getSemaphore(semaphoreID);
+    VkPresentInfoKHR presentInfo{};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &semaphore;
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = &swapchainHandle;
+    presentInfo.pImageIndices = &imageIndex;
+    vkQueuePresentKHR(*device.getQueue(queue), &presentInfo);
+}
+
+// These macros allow easy customization of the tracing shader.
+// For example, the size of the sampler array and the traversal stack, which are needed at compilation time
+// Anything that depends on the octree (like the leaf flags) is a push constant instead, so the pipelines survive a scene change
+static void addTracingMacros(std::vector<VulkanShader::MacroDef>& macros)
+{
+    macros.push_back({"TEXTURE_ARRAY_COUNT", std::to_string(MAX_TEXTURE_ARRAYS)});
+    macros.push_back({"MAX_OCTREE_DEPTH", std::to_string(MAX_OCTREE_DEPTH)});
+    macros.push_back({"OCTREE_PAGE_SIZE", std::to_string(OCTREE_PAGE_SIZE) + "u"});
+}
+
+static VkFormat getVulkanFormat(const TextureFormat format)
+{
+    switch (format)
+    {
+    case TextureFormat::BC1: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+    case TextureFormat::BC3: return VK_FORMAT_BC3_SRGB_BLOCK;
+    case TextureFormat::BC7: return VK_FORMAT_BC7_SRGB_BLOCK;
+    default: return VK_FORMAT_R8G8B8A8_SRGB;
+    }
+}
+
+// Linear between texels and between mips, the shader picks the mip with textureLod
+static VkSampler createTextureSampler(VulkanDevice& device)
+{
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    VkSampler sampler;
+    if (vkCreateSampler(*device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+        throw std::runtime_error("failed to create texture sampler");
+    return sampler;
+}
+
+// Packs the images into texture arrays by size class and copies each one to its layer, all of its mips in one go
+// The arrays are created in prepare(), once the sizes are known and before anything is decoded
+// They have mips and layers, so they are raw images with commands and a staging buffer of their own on the transfer queue
+// The staging buffer grows to the biggest image and is freed with the sink. The sink doesn't free the arrays, whoever takes them does
+class TextureArraySink final : public TextureUploadSink
+{
+public:
+    TextureArraySink(VulkanDevice& device, const QueueSelection transferQueue, const uint32_t graphicsQueueFamily)
+        : m_device(device), m_commands(device, transferQueue), m_queueFamilies{ transferQueue.familyIndex, graphicsQueueFamily } {}
+
+    void prepare(const std::span<TextureDesc> images) override
+    {
+        const uint32_t maxLayers = m_device.getGPU().getProperties().limits.maxImageArrayLayers;
+        m_packing = packTextures(images, MAX_TEXTURE_ARRAYS, maxLayers);
+        const VkCommandBuffer commandBuffer = m_commands.begin();
+        for (const TextureArrayDesc& array : m_packing.arrays)
+        {
+            const TextureDesc& layer = array.layer;
+            m_images.push_back(createRawImage(m_device, getVulkanFormat(layer.format), { layer.width, layer.height }, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, layer.mipCount, array.layers, m_queueFamilies));
+            cmdRawImageLayout(commandBuffer, m_images.back(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                              VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        }
+        m_commands.submit();
+    }
+
+    // The mips are stored one after the other, so the whole image is staged at once and each mip is a region of the copy
+    void upload(const uint32_t image, const DecodedTexture texture) override
+    {
+        const TexturePlacement& placement = m_packing.placements[image];
+        const std::vector<TextureMip> mips = getMipLayout(texture.format, texture.width, texture.height, texture.mipCount);
+        void* stagePtr = m_commands.mapStaging(texture.pixels.size());
+        memcpy(stagePtr, texture.pixels.data(), texture.pixels.size());
+
+        std::vector<VkBufferImageCopy> regions(texture.mipCount);
+        for (uint32_t level = 0; level < texture.mipCount; level++)
+        {
+            regions[level].bufferOffset = mips[level].offset;
+            regions[level].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, placement.layer, 1 };
+            regions[level].imageExtent = { mips[level].width, mips[level].height, 1 };
+        }
+        const VkCommandBuffer commandBuffer = m_commands.begin();
+        vkCmdCopyBufferToImage(commandBuffer, m_commands.getStagingBuffer(), m_images[placement.array].image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+        m_commands.submit();
+        m_sourceSize += texture.sourceSize;
+    }
+
+    // The layers can only be sampled once all of them are uploaded
+    void finish()
+    {
+        const VkCommandBuffer commandBuffer = m_commands.begin();
+        for (const RawImage& image : m_images)
+        {
+            cmdRawImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+        }
+        m_commands.submit();
+    }
+
+    [[nodiscard]] const TexturePacking& getPacking() const { return m_packing; }
+    [[nodiscard]] const std::vector<RawImage>& getImages() const { return m_images; }
+    [[nodiscard]] uint64_t getSourceSize() const { return m_sourceSize; }
+
+private:
+    VulkanDevice& m_device;
+    ImmediateCommands m_commands;
+    std::array<uint32_t, 2> m_queueFamilies;
+    TexturePacking m_packing;
+    std::vector<RawImage> m_images;
+    uint64_t m_sourceSize = 0;
+};
+
+// The frame ring creates its command buffers for the graphics queue
+class VulkanFrameSyncDevice final : public FrameSyncDevice
+{
+public:
+    VulkanFrameSyncDevice(VulkanDevice& device, const QueueFamily& graphicsQueueFamily)
+        : m_device(device), m_graphicsQueueFamily(graphicsQueueFamily) {}
+
+    uint32_t createCommandBuffer() override { return m_device.createCommandBuffer(m_graphicsQueueFamily, 0, false); }
+    uint32_t createFence(const bool signaled) override { return m_device.createFence(signaled); }
+    uint32_t createSemaphore() override { return m_device.createSemaphore(); }
+    void waitFence(const uint32_t fence) override { m_device.getFence(fence).wait(); }
+    void resetFence(const uint32_t fence) override { m_device.getFence(fence).reset(); }
+
+private:
+    VulkanDevice& m_device;
+    QueueFamily m_graphicsQueueFamily;
+};
+
+// A scene the loader finished that is being copied to the GPU a part every frame
+struct SceneUpload
+{
+    SceneUpload(VulkanDevice& device, const QueueSelection transferQueue, const uint32_t graphicsQueueFamily, const bool transientConfig)
+        : sink(device, transferQueue, graphicsQueueFamily), transientConfig(transientConfig) {}
+
+    std::unique_ptr<Scene> scene;
+    OctreeResources resources;
+    TextureArraySink sink;
+    uint32_t nextImage = 0;
+    // Pages picked for the camera once the buffer exists, they are copied before the scene is shown
+    std::vector<OctreePager::Load> loads;
+    size_t nextLoad = 0;
+    // The staging buffer was configured for the upload and is freed after it
+    bool transientConfig;
 };
 
 // Simple helper function to choose the correct GPU. Right now it just tries to look for a discrete GPU
@@ -61,7 +296,7 @@ static VulkanGPU chooseCorrectGPU()
 }
 
 // The constructor will all Vulkan resources and initialize ImGui. Not much to see here
-Engine::Engine(const uint32_t samplerImageCount, const uint8_t depth) : cam({ 0, 0, 0 }, { 0, 0, 0 }), m_window("Vulkan", 1920, 1080)
+Engine::Engine() : cam({ 0, 0, 0 }, { 0, 0, 0 }), m_window("Vulkan", 1920, 1080)
 {
     // Vulkan Instance
     Logger::setRootContext("Engine init");
@@ -105,24 +340,46 @@ Engine::Engine(const uint32_t samplerImageCount, const uint8_t depth) : cam({ 0,
 
     // Command Buffers
     device.configureOneTimeQueue(m_transferQueuePos);
-    m_graphicsCmdBufferID = device.createCommandBuffer(graphicsQueueFamily, 0, false);
-
-    m_depth = depth;
-    m_voxelSize = std::numbers::sqrt2_v<float> * (1.0f / static_cast<float>(1 << m_depth)) / 2.0f;
-    m_samplerImageCount = std::max(samplerImageCount, 1U);
+    m_frameSyncDevice = std::make_unique<VulkanFrameSyncDevice>(device, graphicsQueueFamily);
 
     // Renderpass and pipelines
+    // Nothing in them depends on the octree, so they are built once and kept when the scene changes
     createRenderPass();
     Engine::updatePipelines();
 
+    // Descriptor sets
+    // One is bound while the other one gets the next octree, so switching scenes never waits on the GPU
+    m_octreeDescrPool = device.createDescriptorPool({ 
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 12},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * MAX_TEXTURE_ARRAYS},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 8}
+    }, 2, 0);
+    for (uint32_t& descrSet : m_octreeDescrSets)
+        descrSet = device.createDescriptorSet(m_octreeDescrPool, m_octreeDescrSetLayout);
+    m_blitDescrPool = device.createDescriptorPool({ {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1} }, 1, 0);
+    m_blitDescrSet = device.createDescriptorSet(m_blitDescrPool, m_blitDescrSetLayout);
+
     // Framebuffers
     m_framebuffers.resize(swapchain.getImageCount());
     for (uint32_t i = 0; i < swapchain.getImageCount(); i++)
         m_framebuffers[i] = createFramebuffer(swapchain.getImageView(i), swapchain.getExtent());
+    createScreenImages(swapchain.getExtent());
 
-    // Create sync objects
-    m_renderFinishedSemaphoreID = device.createSemaphore();
-    m_inFlightFenceID = device.createFence(true);
+    // Create sync objects, with a command buffer for every frame in flight
+    m_frameRing = std::make_unique<FrameRing>(*m_frameSyncDevice);
+
+    // Two timestamps around the commands of every frame in flight, the resolution controller gets the time between them
+    if (device.getGPU().getProperties().limits.timestampComputeAndGraphics)
+    {
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = 2 * MAX_FRAMES_IN_FLIGHT;
+        if (vkCreateQueryPool(*device, &queryPoolInfo, nullptr, &m_frameQueryPool) != VK_SUCCESS)
+            m_frameQueryPool = VK_NULL_HANDLE;
+    }
+    if (m_frameQueryPool == VK_NULL_HANDLE)
+        LOG_WARN("The GPU can't time frames, dynamic resolution will use the CPU frame time");
 
     {
         cam.setScreenSize(m_window.getSize().width, m_window.getSize().height);
@@ -141,128 +398,84 @@ Engine::~Engine()
 
     Logger::setRootContext("Resource cleanup");
 
+    // A scene that is still being built is waited for when the loader is destroyed, one that is being uploaded is dropped here
+    if (m_sceneUpload)
+        dropSceneUpload();
+    // The device frees what was made through it, the raw images and samplers have to go first
+    freeOctreeResources(m_octree);
+    for (HistoryImage* history : { &m_historyColor, &m_historyNormal })
+        freeRawImage(VulkanContext::getDevice(m_deviceID), history->image);
+    for (const VkPipeline pipeline : { m_computePipeline, m_noShadowComputePipeline, m_intersectComputePipeline, m_intersectColorComputePipeline, m_beamPipeline, m_wavefrontPipeline })
+        if (pipeline != VK_NULL_HANDLE)
+            vkDestroyPipeline(*VulkanContext::getDevice(m_deviceID), pipeline, nullptr);
+
     ImGui_ImplVulkan_Shutdown();
     m_window.shutdownImgui();
     ImGui::DestroyContext();
 
+    if (m_frameQueryPool != VK_NULL_HANDLE)
+        vkDestroyQueryPool(*VulkanContext::getDevice(m_deviceID), m_frameQueryPool, nullptr);
+
     VulkanContext::freeDevice(m_deviceID);
     m_window.free();
     VulkanContext::free();
 }
 
 // This function will configure the octree in the GPU. It will create the necessary buffers and images and update the descriptor set
-void Engine::configureOctreeBuffer(Octree& octree, const float scale)
+void Engine::configureOctreeBuffer(std::unique_ptr<Octree> octree, const SceneSettings& settings, const float scale)
 {
-    m_octree = &octree;
     VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
-    if (octree.isFinished()) 
-        octree.packAndFinish();
+    if (octree->isFinished())
+        octree->packAndFinish();
+    if (octree->getDepth() > MAX_OCTREE_DEPTH)
+        throw std::runtime_error("octree depth " + std::to_string(octree->getDepth()) + " is over the maximum of " + std::to_string(MAX_OCTREE_DEPTH));
 
-    // Data transfer
+    // A scene that was being uploaded is dropped, this one replaces it
+    if (m_sceneUpload)
     {
-        if (m_octreeBuffer != UINT32_MAX)
-        {
-            device.freeBuffer(m_octreeBuffer);
-            for (const uint32_t& key : m_octreeImages | std::views::keys)
-                device.freeImage(key);
-            m_octreeImages.clear();
-        }
+        dropSceneUpload();
+    }
+    device.waitIdle();
+    freeOctreeResources(m_octree);
+    m_octree.octree = std::move(octree);
+    m_sceneSettings = settings;
+    m_octreeScale = scale;
+    snprintf(m_scenePathInput.data(), m_scenePathInput.size(), "%s", settings.loadPath.empty() ? settings.modelPath.c_str() : settings.loadPath.c_str());
+    m_sceneDepthInput = settings.depth;
 
+    // Data transfer
+    {
         bool transientConfig = false;
         if (!device.isStagingBufferConfigured())
         {
             transientConfig = true;
             device.configureStagingBuffer(100LL * 1024 * 1024, m_transferQueuePos);
         }
-        const VkDeviceSize stagingBufferSize = device.getStagingBufferSize();
-        
-        bool resized = false;
-        VkDeviceSize currentBufferSize = stagingBufferSize;
+
         // Image upload
+        // Decoding happens in other threads, this one only copies each image to the GPU as soon as it is ready
+        // Mips are built and the textures compressed there too, the results are cached next to the octree file if it has one
+        // Octrees with baked colors carry the color in the leaves, so their textures are skipped
         {
-            for (const std::string& imagePath : octree.getMaterialTextures())
+            TextureArraySink sink{ device, m_transferQueuePos, m_graphicsQueuePos.familyIndex };
+            std::vector<uint32_t> textureImages;
+            if ((m_octree.octree->getLeafFlags() & Octree::LEAF_BAKED_COLOR) == 0)
             {
-                int texWidth, texHeight, texChannels;
-                stbi_uc* pixels = stbi_load(imagePath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-                const VkDeviceSize imageSize = static_cast<VkDeviceSize>(texWidth) * texHeight * 4;
-                const VkExtent3D extent = { static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 1 };
-
-                if (!pixels) {
-                    throw std::runtime_error("failed to load texture image " + imagePath); 
-                }
-
-                // The staging buffer is used to transfer the image data to the GPU
-                // We want to send it in one go, so we need to check if the image is too big for the current staging buffer
-                {
-                    if (imageSize > currentBufferSize)
-                    {
-                        device.freeStagingBuffer();
-                        device.configureStagingBuffer(imageSize, m_transferQueuePos);
-                        currentBufferSize = imageSize;
-                        resized = true;
-                    }
-                    void* stagePtr = device.mapStagingBuffer(imageSize, 0);
-                    memcpy(stagePtr, pixels, imageSize);
-                    device.unmapStagingBuffer();
-                    stbi_image_free(pixels);
-                }
-
-                const uint32_t imageID = device.createImage(VK_IMAGE_TYPE_2D, VK_FORMAT_R8G8B8A8_SRGB, extent, VK_IMAGE_USAGE_TRANSFER_DST_BIT |VK_IMAGE_USAGE_SAMPLED_BIT, 0);
-
-                VulkanImage& image = device.getImage(imageID);
-                image.allocateFromFlags({VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, false});
-                image.transitionLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0);
-                device.dumpStagingBufferToImage(imageID, extent, {0, 0, 0}, 0);
-                image.transitionLayout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0);
-
-                VkSampler sampler = image.createSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
-                m_octreeImages.emplace_back(imageID, sampler);
-                // We keep track of the memory usage of the images for stats
-                m_octreeImagesMemUsage += image.getMemoryRequirements().size;
+                TextureLoader loader{ settings.getTextureCacheDir(), TEXTURE_DECODE_BUDGET, settings.textureCompression };
+                textureImages = loader.load(m_octree.octree->getMaterialTextures(), sink);
+                LOG_INFO("Loaded ", textureImages.size(), " textures into ", sink.getPacking().arrays.size(), " texture arrays (", loader.getDuplicates(), " duplicates, ", loader.getCacheHits(), " from the cache)");
             }
-        }
-
-        if (resized)
-        {
-            device.freeStagingBuffer();
-            device.configureStagingBuffer(stagingBufferSize, m_transferQueuePos);
+            createOctreeImages(m_octree, sink, textureImages);
         }
 
         // Octree data upload
-        // We first calculate the total size of the buffer, then we allocate it and copy the data
-        // To calculate the size we need to make sure the material buffer is aligned to the GPU requirements, otherwise data will not be read correctly
-        const VkDeviceSize alignment = device.getGPU().getProperties().limits.minStorageBufferOffsetAlignment;
-        m_octreeMatPadding = alignment - octree.getByteSize() % alignment;
-        const VkDeviceSize bufferSize = octree.getByteSize() + m_octreeMatPadding + octree.getMaterialByteSize();
-        m_octreeBuffer = device.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
-        device.getBuffer(m_octreeBuffer).allocateFromFlags({ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, false });
-        m_octreeBufferSize = device.getBuffer(m_octreeBuffer).getSize();
-
-        // We copy the data in chunks to the staging buffer. If we wanted to send it all at once, we would need to allocate a buffer that is at least as big as the octree data
-        // That can be a lot, we can't afford to duplicate the memory usage like that. So we copy it little by little, offseting the pointer each time
-        VkDeviceSize offset = 0;
-        while (offset < octree.getByteSize())
-        {
-            const VkDeviceSize nextSize = std::min(stagingBufferSize, octree.getByteSize() - offset);
-            void* stagePtr = device.mapStagingBuffer(nextSize, 0);
-            if (!octree.isReversed())
-                memcpy(stagePtr, static_cast<char*>(octree.getData()) + offset, nextSize);
-            else
-            {
-                const uint32_t offsetUint = static_cast<uint32_t>(offset / sizeof(uint32_t));
-                const uint32_t nextSizeUint = static_cast<uint32_t>(nextSize / sizeof(uint32_t));
-                for (uint32_t i = offsetUint; i < offsetUint + nextSizeUint; i++)
-                    static_cast<uint32_t*>(stagePtr)[i - offsetUint] = octree.getRaw(octree.getSize() - 1 - i);
-            }
-            device.dumpStagingBuffer(m_octreeBuffer, nextSize, offset, 0);
-            offset += nextSize;
-        }
+        // The octree is split into pages, if they don't all fit in the memory limit the ones the camera needs most are uploaded first
+        createOctreePager(m_octree, paginateOctree(*m_octree.octree), settings.octreeMemoryLimit);
+        createOctreeBuffer(m_octree);
+        uploadOctreePages(m_octree, updateOctreePager(m_octree, UINT32_MAX));
+        uploadPageTable(m_octree);
+        uploadMaterials(m_octree);
 
-        // Material data is copied in one go since it's small
-        void* stagePtr = device.mapStagingBuffer(octree.getMaterialByteSize(), 0);
-        memcpy(stagePtr, octree.getMaterialData(), octree.getMaterialByteSize());
-        device.dumpStagingBuffer(m_octreeBuffer, octree.getMaterialByteSize(), octree.getByteSize() + m_octreeMatPadding, 0);
-        
         if (transientConfig)
         {
             device.freeStagingBuffer();
@@ -270,60 +483,401 @@ void Engine::configureOctreeBuffer(Octree& octree, const float scale)
     }
 
     // Descriptor sets
-    if (m_octreeDescrPool != UINT32_MAX)
+    writeOctreeDescriptorSet(m_octree, m_octreeDescrSets[m_activeDescrSet]);
+}
+
+bool Engine::requestScene(const SceneSettings& settings)
+{
+    const uint32_t maxTextureLayers = VulkanContext::getDevice(m_deviceID).getGPU().getProperties().limits.maxImageArrayLayers;
+    if (m_sceneUpload || !m_sceneLoader.request(settings, MAX_TEXTURE_ARRAYS, maxTextureLayers))
+        return false;
+    m_sceneSettings = settings;
+    m_sceneStatus = "Building scene...";
+    return true;
+}
+
+// Turns the images of the sink into texture arrays the shader can sample. The sink must have all of its images uploaded
+// The shader always needs an array to bind, a single white texel stands in when there are no textures
+void Engine::createOctreeImages(OctreeResources& resources, TextureArraySink& sink, const std::vector<uint32_t>& textureImages) const
+{
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+    for (const uint32_t image : textureImages)
+        resources.texturePlacements.push_back(sink.getPacking().placements[image]);
+    if (sink.getImages().empty())
+    {
+        TextureDesc white{ TextureFormat::RGBA8, 1, 1, 1 };
+        sink.prepare({ &white, 1 });
+        DecodedTexture texture;
+        texture.width = 1;
+        texture.height = 1;
+        texture.pixels = { 255, 255, 255, 255 };
+        sink.upload(0, std::move(texture));
+    }
+    sink.finish();
+    for (const RawImage& image : sink.getImages())
     {
-        device.freeDescriptorPool(m_octreeDescrPool);
+        resources.images.push_back({ image, createTextureSampler(device) });
+        // We keep track of the memory usage of the images for stats
+        resources.imagesMemUsage += image.size;
     }
+    // And of what they would take uncompressed and without mips
+    resources.imagesSourceSize = sink.getSourceSize();
+}
 
-    m_octreeDescrPool = device.createDescriptorPool({ 
-        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2},
-        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<uint32_t>(octree.getMaterialTextures().size())}
-    }, 2, 0);
-    m_octreeDescrSet = device.createDescriptorSet(m_octreeDescrPool, m_octreeDescrSetLayout);
+// The pool gets as many page slots as fit in the memory limit, or one per page if there is no limit
+void Engine::createOctreePager(OctreeResources& resources, std::vector<OctreePage> pages, const size_t memoryLimit) const
+{
+    const uint32_t pageCount = static_cast<uint32_t>(pages.size());
+    uint32_t slotCount = pageCount;
+    if (memoryLimit != 0)
+        slotCount = static_cast<uint32_t>(std::clamp<size_t>(memoryLimit / PAGE_BYTE_SIZE, 1, pageCount));
+    resources.pager = std::make_unique<OctreePager>(std::move(pages), slotCount, PINNED_PAGE_DEPTH);
+    LOG_INFO("Octree split into ", pageCount, " pages, ", slotCount, " fit on the GPU (", resources.pager->getPinnedCount(), " pinned)");
+}
+
+// We first calculate the total size of the buffer, then we allocate it
+// To calculate the size we need to make sure the material buffer is aligned to the GPU requirements, otherwise data will not be read correctly
+// The nodes take a pool of page slots instead of the whole octree, the page table goes in a buffer of its own since it changes every frame
+void Engine::createOctreeBuffer(OctreeResources& resources) const
+{
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+    const Octree& octree = *resources.octree;
+    const VkDeviceSize alignment = device.getGPU().getProperties().limits.minStorageBufferOffsetAlignment;
+    resources.poolSize = resources.pager->getSlotCount() * PAGE_BYTE_SIZE;
+    resources.matPadding = alignment - resources.poolSize % alignment;
+    const VkDeviceSize bufferSize = resources.poolSize + resources.matPadding + octree.getMaterialByteSize();
+    resources.buffer = device.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    device.getBuffer(resources.buffer).allocateFromFlags({ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, false });
+    resources.pageTableBuffer = device.createBuffer(resources.pager->getPageCount() * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    device.getBuffer(resources.pageTableBuffer).allocateFromFlags({ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, false });
+    resources.bufferSize = device.getBuffer(resources.buffer).getSize() + device.getBuffer(resources.pageTableBuffer).getSize();
+}
+
+// Copies each page to its slot, the staging buffer must be configured and hold at least one page
+// Only the nodes of the page are copied, the rest of the slot is never reached by the traversal
+void Engine::uploadOctreePages(const OctreeResources& resources, const std::vector<OctreePager::Load>& loads) const
+{
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+    for (const OctreePager::Load& load : loads)
+    {
+        const std::vector<uint32_t>& nodes = resources.pager->getPage(load.page).nodes;
+        const VkDeviceSize size = nodes.size() * sizeof(uint32_t);
+        void* stagePtr = device.mapStagingBuffer(size, 0);
+        memcpy(stagePtr, nodes.data(), size);
+        device.unmapStagingBuffer();
+        device.dumpStagingBuffer(resources.buffer, size, load.slot * PAGE_BYTE_SIZE, 0);
+    }
+}
+
+// The page table is small (one uint per page), so it is copied whole every time it changes
+// It is still copied in chunks, the staging buffer may have been configured for a smaller octree
+void Engine::uploadPageTable(const OctreeResources& resources) const
+{
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+    const std::vector<uint32_t>& pageTable = resources.pager->getPageTable();
+    const VkDeviceSize size = pageTable.size() * sizeof(uint32_t);
+    for (VkDeviceSize offset = 0; offset < size;)
+    {
+        const VkDeviceSize nextSize = std::min(device.getStagingBufferSize(), size - offset);
+        void* stagePtr = device.mapStagingBuffer(nextSize, 0);
+        memcpy(stagePtr, reinterpret_cast<const char*>(pageTable.data()) + offset, nextSize);
+        device.unmapStagingBuffer();
+        device.dumpStagingBuffer(resources.pageTableBuffer, nextSize, offset, 0);
+        offset += nextSize;
+    }
+}
+
+// Material data is copied in one go since it's small
+// The maps point to textures of the octree, the GPU copy points to the array and layer each one ended up in instead
+// Every texture fills its whole layer, so the UVs don't need any other transform
+void Engine::uploadMaterials(const OctreeResources& resources) const
+{
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+    Octree& octree = *resources.octree;
+    const Octree::Material* octreeMaterials = static_cast<const Octree::Material*>(octree.getMaterialData());
+    std::vector<Octree::Material> materials{ octreeMaterials, octreeMaterials + octree.getMaterialSize() };
+    for (Octree::Material& material : materials)
+    {
+        for (uint32_t* map : { &material.diffuseMap, &material.normalMap, &material.specularMap })
+        {
+            if (*map >= resources.texturePlacements.size())
+                *map = NO_TEXTURE;
+            else
+                *map = resources.texturePlacements[*map].array << 16 | resources.texturePlacements[*map].layer;
+        }
+    }
+    void* stagePtr = device.mapStagingBuffer(octree.getMaterialByteSize(), 0);
+    memcpy(stagePtr, materials.data(), octree.getMaterialByteSize());
+    device.dumpStagingBuffer(resources.buffer, octree.getMaterialByteSize(), resources.poolSize + resources.matPadding, 0);
+}
+
+// The octree goes from -scale / 2 to scale / 2 in world space, the pager works with [0, 1] on every axis
+// A pixel covers the vertical field of view over the height of the screen
+std::vector<OctreePager::Load> Engine::updateOctreePager(OctreeResources& resources, const uint32_t maxLoads) const
+{
+    const VkExtent2D& extent = VulkanSwapchainExtension::get(m_deviceID)->getSwapchain(m_swapchainID).getExtent();
+    const glm::vec3 cameraPos = cam.getPosition() / m_octreeScale + 0.5f;
+    const float pixelAngle = glm::radians(cam.getFov()) / static_cast<float>(std::max(extent.height, 1U));
+    return resources.pager->update(cameraPos, pixelAngle, maxLoads);
+}
+
+// Called at the start of every frame with the slots of the frames the ring waited for since the last one
+// Octrees that fit whole in their memory limit were uploaded completely, the rest get the pages the camera needs now
+// The frames in flight may still read the slots of the pages this frame evicts, so the pager only gets them back once this frame
+// is done and loads never wait for the GPU. Those frames may also see the new page table: its old entries point to pages that
+// are still in their slots, and its new ones to slots no frame reads
+void Engine::streamOctreePages(const std::span<const uint32_t> completedSlots)
+{
+    if (!m_octree.pager || m_octree.pager->getSlotCount() >= m_octree.pager->getPageCount())
+        return;
+    for (const uint32_t slot : completedSlots)
+    {
+        EvictedPageSlots& evicted = m_octree.evictedSlots[slot];
+        if (evicted.slots.empty() || m_frameRing->getSlot(slot).frame < evicted.frame)
+            continue;
+        m_octree.pager->releaseSlots(evicted.slots);
+        evicted.slots.clear();
+    }
+
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+    const std::vector<OctreePager::Load> loads = updateOctreePager(m_octree, PAGE_LOADS_PER_FRAME);
+    // A frame that is dropped before its submission comes back with the same number, its list keeps growing until it is done
+    EvictedPageSlots& evicted = m_octree.evictedSlots[m_frameRing->getCurrentSlot()];
+    evicted.frame = m_frameRing->getFrame();
+    const std::vector<uint32_t> evictedNow = m_octree.pager->takeEvictedSlots();
+    evicted.slots.insert(evicted.slots.end(), evictedNow.begin(), evictedNow.end());
+    if (loads.empty())
+        return;
+    // The staging buffer stays configured while pages are streamed
+    if (!device.isStagingBufferConfigured())
+        device.configureStagingBuffer(PAGE_BYTE_SIZE, m_transferQueuePos);
+    uploadOctreePages(m_octree, loads);
+    uploadPageTable(m_octree);
+}
+
+// The set must not be in use by a frame the GPU hasn't finished
+void Engine::writeOctreeDescriptorSet(const OctreeResources& resources, const uint32_t descrSet) const
+{
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
 
     VkDescriptorBufferInfo bufferInfo[2];
-    // The buffer is split in two parts: the octree data and the material data. It is all kept in one buffer for performance
+    // The buffer is split in two parts: the page pool and the material data. It is all kept in one buffer for performance
     // but we send it to the GPU as two separate buffers
-    bufferInfo[0].buffer = *device.getBuffer(m_octreeBuffer);
+    bufferInfo[0].buffer = *device.getBuffer(resources.buffer);
     bufferInfo[0].offset = 0;
-    bufferInfo[0].range = octree.getByteSize();
-    bufferInfo[1].buffer = *device.getBuffer(m_octreeBuffer);
-    bufferInfo[1].offset = octree.getByteSize() + m_octreeMatPadding;
+    bufferInfo[0].range = resources.poolSize;
+    bufferInfo[1].buffer = *device.getBuffer(resources.buffer);
+    bufferInfo[1].offset = resources.poolSize + resources.matPadding;
     bufferInfo[1].range = VK_WHOLE_SIZE;
 
-    std::vector<VkWriteDescriptorSet> writeDescriptorSets{2};
+    std::vector<VkWriteDescriptorSet> writeDescriptorSets{1};
     writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writeDescriptorSets[0].dstSet = *device.getDescriptorSet(m_octreeDescrSet);
+    writeDescriptorSets[0].dstSet = *device.getDescriptorSet(descrSet);
     writeDescriptorSets[0].dstBinding = 0;
     writeDescriptorSets[0].dstArrayElement = 0;
     writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     writeDescriptorSets[0].descriptorCount = 2;
     writeDescriptorSets[0].pBufferInfo = bufferInfo;
 
-    // The images are sent as an image sampler array
+    // The texture arrays are sent as a sampler array of a fixed size, the slots without an array repeat the first one
     std::vector<VkDescriptorImageInfo> imageInfos;
-    for (const auto& imageData : m_octreeImages)
+    for (const TextureArrayImage& image : resources.images)
     {
-        const VkImageView view = device.getImage(imageData.first).createImageView(VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
-
-        VkDescriptorImageInfo imageInfo{};
+        VkDescriptorImageInfo& imageInfo = imageInfos.emplace_back();
         imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = view;
-        imageInfo.sampler = imageData.second;
-        imageInfos.push_back(imageInfo);
+        imageInfo.imageView = image.image.view;
+        imageInfo.sampler = image.sampler;
     }
-
-    writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writeDescriptorSets[1].dstSet = *device.getDescriptorSet(m_octreeDescrSet);
-    writeDescriptorSets[1].dstBinding = 2;
-    writeDescriptorSets[1].dstArrayElement = 0;
-    writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    writeDescriptorSets[1].descriptorCount = static_cast<uint32_t>(imageInfos.size());
-    writeDescriptorSets[1].pImageInfo = imageInfos.data();
+    imageInfos.resize(MAX_TEXTURE_ARRAYS, imageInfos.front());
+
+    VkWriteDescriptorSet& imageWrite = writeDescriptorSets.emplace_back();
+    imageWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    imageWrite.dstSet = *device.getDescriptorSet(descrSet);
+    imageWrite.dstBinding = 2;
+    imageWrite.dstArrayElement = 0;
+    imageWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    imageWrite.descriptorCount = MAX_TEXTURE_ARRAYS;
+    imageWrite.pImageInfo = imageInfos.data();
+
+    VkDescriptorBufferInfo pageTableInfo;
+    pageTableInfo.buffer = *device.getBuffer(resources.pageTableBuffer);
+    pageTableInfo.offset = 0;
+    pageTableInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet& pageTableWrite = writeDescriptorSets.emplace_back();
+    pageTableWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    pageTableWrite.dstSet = *device.getDescriptorSet(descrSet);
+    pageTableWrite.dstBinding = 3;
+    pageTableWrite.dstArrayElement = 0;
+    pageTableWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pageTableWrite.descriptorCount = 1;
+    pageTableWrite.pBufferInfo = &pageTableInfo;
 
     device.updateDescriptorSets(writeDescriptorSets);
-    
-    m_octreeScale = scale;
+}
+
+// The GPU must be done with the resources. The octree itself is kept, only the GPU side is freed
+void Engine::freeOctreeResources(OctreeResources& resources) const
+{
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+    if (resources.buffer != UINT32_MAX)
+        device.freeBuffer(resources.buffer);
+    if (resources.pageTableBuffer != UINT32_MAX)
+        device.freeBuffer(resources.pageTableBuffer);
+    for (TextureArrayImage& image : resources.images)
+    {
+        vkDestroySampler(*device, image.sampler, nullptr);
+        freeRawImage(device, image.image);
+    }
+    resources.pager.reset();
+    resources.buffer = UINT32_MAX;
+    resources.pageTableBuffer = UINT32_MAX;
+    resources.bufferSize = 0;
+    resources.poolSize = 0;
+    resources.matPadding = 0;
+    resources.images.clear();
+    resources.texturePlacements.clear();
+    resources.imagesMemUsage = 0;
+    resources.imagesSourceSize = 0;
+}
+
+// SCENE SWITCHING
+
+// Called at the start of every frame
+// Picks up the scene the loader finished, or copies the next part of the one being uploaded
+void Engine::updateSceneUpload()
+{
+    if (m_sceneUpload)
+    {
+        try
+        {
+            stepSceneUpload();
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERR("Failed to upload scene: ", e.what());
+            m_sceneStatus = std::string("Failed to upload scene: ") + e.what();
+            dropSceneUpload();
+        }
+        return;
+    }
+
+    std::unique_ptr<Scene> scene;
+    try
+    {
+        scene = m_sceneLoader.takeScene();
+    }
+    catch (const std::exception& e)
+    {
+        LOG_ERR("Failed to build scene: ", e.what());
+        m_sceneStatus = std::string("Failed to build scene: ") + e.what();
+        return;
+    }
+    if (!scene)
+        return;
+
+    try
+    {
+        startSceneUpload(std::move(scene));
+    }
+    catch (const std::exception& e)
+    {
+        LOG_ERR("Failed to upload scene: ", e.what());
+        m_sceneStatus = std::string("Failed to upload scene: ") + e.what();
+        if (m_sceneUpload)
+            dropSceneUpload();
+    }
+}
+
+// The texture arrays are created here. The loader packed the images with the same limits, so packing them again gives the same arrays
+void Engine::startSceneUpload(std::unique_ptr<Scene> scene)
+{
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+    if (scene->octree->getDepth() > MAX_OCTREE_DEPTH)
+        throw std::runtime_error("octree depth " + std::to_string(scene->octree->getDepth()) + " is over the maximum of " + std::to_string(MAX_OCTREE_DEPTH));
+
+    bool transientConfig = false;
+    if (!device.isStagingBufferConfigured())
+    {
+        transientConfig = true;
+        device.configureStagingBuffer(SCENE_UPLOAD_BUDGET, m_transferQueuePos);
+    }
+    m_sceneUpload = std::make_unique<SceneUpload>(device, m_transferQueuePos, m_graphicsQueuePos.familyIndex, transientConfig);
+    m_sceneUpload->resources.octree = std::move(scene->octree);
+    m_sceneUpload->scene = std::move(scene);
+    m_sceneUpload->sink.prepare(m_sceneUpload->scene->imageDescs);
+    m_sceneStatus = "Uploading scene...";
+}
+
+// Each frame copies up to SCENE_UPLOAD_BUDGET bytes: the images first, then the pages the camera needs
+// Once everything is there the descriptor set that is not bound gets the new octree and it is bound from this frame on
+void Engine::stepSceneUpload()
+{
+    SceneUpload& upload = *m_sceneUpload;
+    Scene& scene = *upload.scene;
+    OctreeResources& resources = upload.resources;
+
+    VkDeviceSize budget = SCENE_UPLOAD_BUDGET;
+    while (upload.nextImage < scene.images.size() && budget > 0)
+    {
+        DecodedTexture& texture = scene.images[upload.nextImage];
+        budget -= std::min<VkDeviceSize>(budget, texture.pixels.size());
+        // Moved out of the scene, so its pixels are freed once they are staged
+        upload.sink.upload(upload.nextImage, std::move(texture));
+        upload.nextImage++;
+    }
+    if (upload.nextImage < scene.images.size())
+        return;
+
+    if (resources.buffer == UINT32_MAX)
+    {
+        createOctreeImages(resources, upload.sink, scene.textureImages);
+        createOctreePager(resources, std::move(scene.pages), m_sceneSettings.octreeMemoryLimit);
+        createOctreeBuffer(resources);
+        upload.loads = updateOctreePager(resources, UINT32_MAX);
+    }
+    const size_t pageCount = std::min<size_t>(std::max<VkDeviceSize>(budget / PAGE_BYTE_SIZE, 1), upload.loads.size() - upload.nextLoad);
+    uploadOctreePages(resources, { upload.loads.begin() + upload.nextLoad, upload.loads.begin() + upload.nextLoad + pageCount });
+    upload.nextLoad += pageCount;
+    if (upload.nextLoad < upload.loads.size())
+        return;
+    uploadPageTable(resources);
+    uploadMaterials(resources);
+
+    // A frame in flight may still use the set that is not bound, or the current resources
+    m_frameRing->waitIdle();
+    const uint32_t nextDescrSet = m_activeDescrSet ^ 1;
+    writeOctreeDescriptorSet(resources, m_octreeDescrSets[nextDescrSet]);
+    m_activeDescrSet = nextDescrSet;
+    // The history belongs to the old scene
+    m_temporalFrame = 0;
+    freeOctreeResources(m_octree);
+    m_octree = std::move(resources);
+    endSceneUpload();
+    m_sceneStatus.clear();
+    LOG_INFO("Switched to the new scene (", m_octree.octree->getSize(), " nodes, ", m_octree.images.size(), " texture arrays)");
+}
+
+// Frees what was uploaded so far, the texture arrays may not be in the resources yet
+void Engine::dropSceneUpload()
+{
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+    if (m_sceneUpload->resources.images.empty())
+    {
+        for (RawImage image : m_sceneUpload->sink.getImages())
+            freeRawImage(device, image);
+    }
+    freeOctreeResources(m_sceneUpload->resources);
+    endSceneUpload();
+}
+
+// The resources of the upload must have been moved or freed already
+void Engine::endSceneUpload()
+{
+    const bool transientConfig = m_sceneUpload->transientConfig;
+    m_sceneUpload.reset();
+    if (transientConfig)
+        VulkanContext::getDevice(m_deviceID).freeStagingBuffer();
 }
 
 void Engine::run()
@@ -331,10 +885,7 @@ void Engine::run()
     VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
     VulkanSwapchainExtension* swapchainExt = VulkanSwapchainExtension::get(device);
 
-    VulkanFence& inFlightFence = device.getFence(m_inFlightFenceID);
-
     const VulkanQueue graphicsQueue = device.getQueue(m_graphicsQueuePos);
-    VulkanCommandBuffer& graphicsBuffer = device.getCommandBuffer(m_graphicsCmdBufferID, 0);
         
     uint64_t frameCounter = 0;
 
@@ -342,21 +893,24 @@ void Engine::run()
     {
 
         Logger::setRootContext("Frame " + std::to_string(frameCounter));
-        m_window.pollEvents();
 
         // Sync
-        inFlightFence.wait();
-        inFlightFence.reset();
+        // Waits for the frames further behind than the frame pacing allows, the input is read after so it is as recent as it can be
+        const uint32_t frameSlot = m_frameRing->beginFrame();
+        const FrameRing::Slot& frame = m_frameRing->getSlot(frameSlot);
+        // Frames the ring waited for since the last one, oldest first
+        const std::vector<uint32_t> completedSlots = m_frameRing->takeCompleted();
 
-        // Acquire
-        VulkanSwapchain& swapchain = swapchainExt->getSwapchain(m_swapchainID);
-        const uint32_t nextImage = swapchain.acquireNextImage();
+        m_window.pollEvents();
+        if (m_recordingCameraPath)
+            m_cameraPath.push_back({ cam.getPosition(), cam.getDir() });
 
-        if (nextImage == UINT32_MAX)
-        {
-            frameCounter++;
-            continue;
-        }
+        // Scene switching, the frames in flight are waited for before the octree they use is replaced
+        updateSceneUpload();
+        // Octree streaming, the pages the camera needs are copied before this frame is recorded
+        streamOctreePages(completedSlots);
+        // Dynamic resolution, the time of the last finished frame decides how much of the screen this one traces
+        updateRenderExtent(completedSlots);
 
         // ImGui
         ImGui_ImplVulkan_NewFrame();
@@ -375,22 +929,85 @@ void Engine::run()
             continue;
         }
 
+        // Acquire
+        // Nothing skips the frame after this, the semaphore of the slot is signaled and only the submission waits on it
+        VulkanSwapchain& swapchain = swapchainExt->getSwapchain(m_swapchainID);
+        const uint32_t nextImage = acquireSwapchainImage(device, swapchain, frame.imageAvailable);
+
+        if (nextImage == UINT32_MAX)
+        {
+            frameCounter++;
+            continue;
+        }
+
         // Record
-        recordCommandBuffer(m_framebuffers[nextImage], imguiDrawData);
+        recordCommandBuffer(frameSlot, m_framebuffers[nextImage], imguiDrawData);
 
         // Submit
-        graphicsBuffer.submit(graphicsQueue, { {swapchain.getImgSemaphore(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT} }, { m_renderFinishedSemaphoreID }, m_inFlightFenceID);
+        m_frameRing->submitFrame();
+        device.getCommandBuffer(frame.commandBuffer, 0).submit(graphicsQueue, { {frame.imageAvailable, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT} }, { frame.renderFinished }, frame.fence);
 
         ImGui::UpdatePlatformWindows();
         ImGui::RenderPlatformWindowsDefault();
 
         // Present
-        swapchain.present(m_presentQueuePos, {      });
+        presentSwapchainImage(device, m_presentQueuePos, swapchain, nextImage, frame.renderFinished);
 
         frameCounter++;
     }
 }
 
+// Passes of the WAVEFRONT variant, each one waits for what the one before wrote. The passes over the queue are sized for a full queue,
+// the workgroups past the rays the traversal appended leave right away
+void Engine::recordWavefrontPasses(VulkanCommandBuffer& commandBuffer, const PushConstantData& pushConstants) const
+{
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+    vkCmdFillBuffer(*commandBuffer, *device.getBuffer(m_shadowQueueBuffer), 0, sizeof(uint32_t), 0);
+    cmdBufferWriteBarrier(*commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdBindPipeline(*commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_wavefrontPipeline);
+
+    PushConstantData passConstants = pushConstants;
+    const auto pushPass = [&](const uint32_t pass, const uint32_t sortShift)
+    {
+        passConstants.wavefrontPass = pass;
+        passConstants.sortShift = sortShift;
+        commandBuffer.cmdPushConstant(m_pipelineLayoutID, TRACING_STAGES, 0, sizeof(passConstants), &passConstants);
+    };
+    const auto passBarrier = [&] { cmdBufferWriteBarrier(*commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT); };
+    const uint32_t tilesX = (m_renderExtent.width + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE;
+    const uint32_t tilesY = (m_renderExtent.height + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE;
+    const uint32_t sortBlocks = (m_shadowQueueCapacity + SORT_BLOCK_SIZE - 1) / SORT_BLOCK_SIZE;
+    const uint32_t tileInvocations = COMPUTE_TILE_SIZE * COMPUTE_TILE_SIZE;
+
+    pushPass(WAVEFRONT_TRAVERSAL, 0);
+    vkCmdDispatch(*commandBuffer, tilesX, tilesY, 1);
+    passBarrier();
+
+    // Four passes of 8 bits cover the 30 bits of the Morton codes and leave the queue in the half it started in
+    if (m_sortShadowRays)
+    {
+        for (uint32_t shift = 0; shift < 3 * MORTON_AXIS_BITS; shift += SORT_DIGIT_BITS)
+        {
+            pushPass(WAVEFRONT_SORT_COUNT, shift);
+            cmdDispatchRows(*commandBuffer, sortBlocks);
+            passBarrier();
+            pushPass(WAVEFRONT_SORT_SCAN, shift);
+            vkCmdDispatch(*commandBuffer, 1, 1, 1);
+            passBarrier();
+            pushPass(WAVEFRONT_SORT_SCATTER, shift);
+            cmdDispatchRows(*commandBuffer, sortBlocks);
+            passBarrier();
+        }
+    }
+
+    pushPass(WAVEFRONT_SHADOW, 0);
+    cmdDispatchRows(*commandBuffer, (m_shadowQueueCapacity + tileInvocations - 1) / tileInvocations);
+    passBarrier();
+
+    pushPass(WAVEFRONT_SHADING, 0);
+    vkCmdDispatch(*commandBuffer, tilesX, tilesY, 1);
+}
+
 void Engine::createRenderPass()
 {
     Logger::pushContext("Create RenderPass");
@@ -413,14 +1030,12 @@ void Engine::createRenderPass()
     Logger::popContext();
 }
 
-uint32_t Engine::createGraphicsPipeline(const uint32_t samplerImageCount, const std::string& fragmentShader, std::vector<VulkanShader::MacroDef> macros)
+void Engine::createPipelineLayouts()
 {
-    Logger::pushContext("Create Pipeline");
-
     VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
 
-    // This function may be called several times to update shaders, so we will want to reuse the descriptor set layout and pipeline layout
-    // TODO: We probably want to update image sampler array descriptor to support runtime octree updates
+    // Pipelines may be built several times to update shaders, so the descriptor set layouts and pipeline layouts are reused
+    // None of them depend on the octree, the texture arrays always take the same amount of descriptors
     if (m_octreeDescrSetLayout == UINT32_MAX)
     {
         // octree buffer
@@ -428,38 +1043,100 @@ uint32_t Engine::createGraphicsPipeline(const uint32_t samplerImageCount, const
         octreeBinding.binding = 0;
         octreeBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
         octreeBinding.descriptorCount = 1;
-        octreeBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        octreeBinding.stageFlags = TRACING_STAGES;
 
         // material buffer
         VkDescriptorSetLayoutBinding matBinding{};
         matBinding.binding = 1;
         matBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
         matBinding.descriptorCount = 1;
-        matBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        matBinding.stageFlags = TRACING_STAGES;
 
-        // texture sampler array
+        // texture array sampler array
         VkDescriptorSetLayoutBinding texBinding{};
         texBinding.binding = 2;
         texBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        texBinding.descriptorCount = samplerImageCount;
-        texBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        texBinding.descriptorCount = MAX_TEXTURE_ARRAYS;
+        texBinding.stageFlags = TRACING_STAGES;
+
+        // page table buffer
+        VkDescriptorSetLayoutBinding pageTableBinding{};
+        pageTableBinding.binding = 3;
+        pageTableBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        pageTableBinding.descriptorCount = 1;
+        pageTableBinding.stageFlags = TRACING_STAGES;
+
+        // traced image, only written by the compute traversal
+        VkDescriptorSetLayoutBinding tracedImageBinding{};
+        tracedImageBinding.binding = 4;
+        tracedImageBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        tracedImageBinding.descriptorCount = 1;
+        tracedImageBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        // beam image, written by the beam pre-pass and read by both traversals
+        VkDescriptorSetLayoutBinding beamImageBinding{};
+        beamImageBinding.binding = 5;
+        beamImageBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        beamImageBinding.descriptorCount = 1;
+        beamImageBinding.stageFlags = TRACING_STAGES;
+
+        // history images, read and written by the temporal passes of the compute traversal
+        VkDescriptorSetLayoutBinding historyColorBinding{};
+        historyColorBinding.binding = 6;
+        historyColorBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        historyColorBinding.descriptorCount = 1;
+        historyColorBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutBinding historyNormalBinding{};
+        historyNormalBinding.binding = 7;
+        historyNormalBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        historyNormalBinding.descriptorCount = 1;
+        historyNormalBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        // Hit buffer, shadow queue and sort counts of the wavefront passes
+        std::array<VkDescriptorSetLayoutBinding, 3> wavefrontBindings{};
+        for (uint32_t i = 0; i < wavefrontBindings.size(); i++)
+        {
+            wavefrontBindings[i].binding = 8 + i;
+            wavefrontBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            wavefrontBindings[i].descriptorCount = 1;
+            wavefrontBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
 
-        m_octreeDescrSetLayout = device.createDescriptorSetLayout({ octreeBinding, matBinding, texBinding }, 0);
+        m_octreeDescrSetLayout = device.createDescriptorSetLayout({ octreeBinding, matBinding, texBinding, pageTableBinding, tracedImageBinding, beamImageBinding, historyColorBinding, historyNormalBinding,
+            wavefrontBindings[0], wavefrontBindings[1], wavefrontBindings[2] }, 0);
     }
     if (m_pipelineLayoutID == UINT32_MAX)
     {
         std::vector<VkPushConstantRange> pushConstants{ 1 };
-        pushConstants[0] = { VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstantData) };
+        pushConstants[0] = { TRACING_STAGES, 0, sizeof(PushConstantData) };
         m_pipelineLayoutID = device.createPipelineLayout({ m_octreeDescrSetLayout }, pushConstants);
     }
+    if (m_blitDescrSetLayout == UINT32_MAX)
+    {
+        VkDescriptorSetLayoutBinding tracedImageBinding{};
+        tracedImageBinding.binding = 0;
+        tracedImageBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        tracedImageBinding.descriptorCount = 1;
+        tracedImageBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        m_blitDescrSetLayout = device.createDescriptorSetLayout({ tracedImageBinding }, 0);
+        // The part of the traced image that holds the frame
+        std::vector<VkPushConstantRange> pushConstants{ 1 };
+        pushConstants[0] = { VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(glm::vec2) };
+        m_blitPipelineLayoutID = device.createPipelineLayout({ m_blitDescrSetLayout }, pushConstants);
+    }
+}
+
+uint32_t Engine::createGraphicsPipeline(const std::string& fragmentShader, std::vector<VulkanShader::MacroDef> macros, const uint32_t pipelineLayoutID)
+{
+    Logger::pushContext("Create Pipeline");
+
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
 
     // Shader creation
     const uint32_t vertexShaderID = device.createShader("shaders/raytracing.vert", VK_SHADER_STAGE_VERTEX_BIT, false, {});
-    // These macros allow easy customization of the shader.
-    // For example, we can change the number of textures in the sampler array, which is needed at compilation time
-    macros.push_back({"SAMPLER_ARRAY_SIZE", std::to_string(samplerImageCount)});
-    macros.push_back({"VOXEL_SIZE", std::to_string(m_voxelSize)});
-    macros.push_back({"OCTREE_DEPTH", std::to_string(m_depth)});
+    addTracingMacros(macros);
     const uint32_t fragmentShaderID = device.createShader(fragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, false, macros);
 
     VkPipelineColorBlendAttachmentState colorBlendAttachment{};
@@ -478,7 +1155,7 @@ uint32_t Engine::createGraphicsPipeline(const uint32_t samplerImageCount, const
     builder.setDynamicState({ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR });
     builder.addShaderStage(vertexShaderID);
     builder.addShaderStage(fragmentShaderID);
-    const uint32_t pipelineID = device.createPipeline(builder, m_pipelineLayoutID, m_renderPassID, 0);
+    const uint32_t pipelineID = device.createPipeline(builder, pipelineLayoutID, m_renderPassID, 0);
 
     device.freeShader(vertexShaderID);
     device.freeShader(fragmentShaderID);
@@ -487,6 +1164,212 @@ uint32_t Engine::createGraphicsPipeline(const uint32_t samplerImageCount, const
     return pipelineID;
 }
 
+// The compute traversal (COMPUTE_TILES) and the beam pre-pass (BEAM_PREPASS) are raytracing.frag compiled as a compute shader,
+// with the same macros as the fragment variants
+VkPipeline Engine::createComputePipeline(std::vector<VulkanShader::MacroDef> macros)
+{
+    Logger::pushContext("Create Compute Pipeline");
+
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+
+    addTracingMacros(macros);
+    const uint32_t computeShaderID = device.createShader("shaders/raytracing.frag", VK_SHADER_STAGE_COMPUTE_BIT, false, macros);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = *device.getShader(computeShaderID);
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = *device.getPipelineLayout(m_pipelineLayoutID);
+    VkPipeline pipeline;
+    const VkResult result = vkCreateComputePipelines(*device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+
+    device.freeShader(computeShaderID);
+    if (result != VK_SUCCESS)
+        throw std::runtime_error("failed to create compute pipeline");
+
+    Logger::popContext();
+    return pipeline;
+}
+
+// Images that follow the size of the swapchain, they are created again when the window is resized
+// Both octree sets point to them, the sets are not rewritten for them when the scene changes
+void Engine::createScreenImages(const VkExtent2D extent)
+{
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+    if (m_tracedImage.image != UINT32_MAX)
+        device.freeImage(m_tracedImage.image);
+    if (m_beamImage.image != UINT32_MAX)
+        device.freeImage(m_beamImage.image);
+    for (HistoryImage* history : { &m_historyColor, &m_historyNormal })
+        freeRawImage(device, history->image);
+    for (const uint32_t buffer : { m_wavefrontHitBuffer, m_shadowQueueBuffer, m_sortCountBuffer })
+        if (buffer != UINT32_MAX)
+            device.freeBuffer(buffer);
+
+    // The compute traversal stores linear colors in the traced image and the blit pass reads them back, so it stays in the general layout
+    m_tracedImage.image = device.createImage(VK_IMAGE_TYPE_2D, m_tracedImage.format, { extent.width, extent.height, 1 }, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 0);
+    VulkanImage& image = device.getImage(m_tracedImage.image);
+    image.allocateFromFlags({ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, false });
+    image.transitionLayout(VK_IMAGE_LAYOUT_GENERAL, 0);
+    // The blit filters when it scales a lower resolution up, at full resolution it reads the centers of the texels
+    m_tracedImage.sampler = image.createSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+    m_tracedImageExtent = extent;
+
+    const VkExtent2D beamExtent{ (extent.width + BEAM_BLOCK_SIZE - 1) / BEAM_BLOCK_SIZE, (extent.height + BEAM_BLOCK_SIZE - 1) / BEAM_BLOCK_SIZE };
+    m_beamImage.image = device.createImage(VK_IMAGE_TYPE_2D, m_beamImage.format, { beamExtent.width, beamExtent.height, 1 }, VK_IMAGE_USAGE_STORAGE_BIT, 0);
+    VulkanImage& beamImage = device.getImage(m_beamImage.image);
+    beamImage.allocateFromFlags({ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, false });
+    beamImage.transitionLayout(VK_IMAGE_LAYOUT_GENERAL, 0);
+
+    // Two layers each, a frame writes the one of its parity and reprojects from the other. The color alpha holds the hit distance
+    // Only the compute passes on the graphics queue use them, they go to the general layout there
+    std::array<VkDescriptorImageInfo, 2> historyInfos{};
+    std::array<HistoryImage*, 2> histories{ &m_historyColor, &m_historyNormal };
+    ImmediateCommands commands{ device, m_graphicsQueuePos };
+    const VkCommandBuffer commandBuffer = commands.begin();
+    for (size_t i = 0; i < histories.size(); i++)
+    {
+        histories[i]->image = createRawImage(device, histories[i]->format, extent, VK_IMAGE_USAGE_STORAGE_BIT, 1, 2, std::span(&m_graphicsQueuePos.familyIndex, 1));
+        cmdRawImageLayout(commandBuffer, histories[i]->image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        historyInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        historyInfos[i].imageView = histories[i]->image.view;
+        historyInfos[i].sampler = VK_NULL_HANDLE;
+    }
+    commands.submit();
+    // The new images hold nothing yet, the next frame is traced in full
+    m_temporalFrame = 0;
+
+    // The queue starts with its count, then the two halves the sort passes go between. The counts fit the blocks of a full queue
+    m_shadowQueueCapacity = extent.width * extent.height;
+    const uint32_t sortBlocks = (m_shadowQueueCapacity + SORT_BLOCK_SIZE - 1) / SORT_BLOCK_SIZE;
+    const std::array<VkDeviceSize, 3> wavefrontSizes{
+        WAVEFRONT_HIT_SIZE * m_shadowQueueCapacity,
+        sizeof(glm::uvec2) + 2 * sizeof(glm::uvec2) * static_cast<VkDeviceSize>(m_shadowQueueCapacity),
+        sizeof(uint32_t) * (1u << SORT_DIGIT_BITS) * static_cast<VkDeviceSize>(sortBlocks)
+    };
+    std::array<uint32_t*, 3> wavefrontBuffers{ &m_wavefrontHitBuffer, &m_shadowQueueBuffer, &m_sortCountBuffer };
+    std::array<VkDescriptorBufferInfo, 3> wavefrontInfos{};
+    for (size_t i = 0; i < wavefrontBuffers.size(); i++)
+    {
+        *wavefrontBuffers[i] = device.createBuffer(wavefrontSizes[i], VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        device.getBuffer(*wavefrontBuffers[i]).allocateFromFlags({ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, false });
+        wavefrontInfos[i].buffer = *device.getBuffer(*wavefrontBuffers[i]);
+        wavefrontInfos[i].offset = 0;
+        // The shader takes the capacity of the queue from the length of its array, so the range is the exact size and not the allocation
+        wavefrontInfos[i].range = wavefrontSizes[i];
+    }
+
+    VkDescriptorImageInfo imageInfo;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    imageInfo.imageView = image.createImageView(m_tracedImage.format, VK_IMAGE_ASPECT_COLOR_BIT);
+    imageInfo.sampler = m_tracedImage.sampler;
+
+    VkDescriptorImageInfo beamImageInfo;
+    beamImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    beamImageInfo.imageView = beamImage.createImageView(m_beamImage.format, VK_IMAGE_ASPECT_COLOR_BIT);
+    beamImageInfo.sampler = VK_NULL_HANDLE;
+
+    std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+    for (const uint32_t descrSet : m_octreeDescrSets)
+    {
+        VkWriteDescriptorSet& storageWrite = writeDescriptorSets.emplace_back();
+        storageWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        storageWrite.dstSet = *device.getDescriptorSet(descrSet);
+        storageWrite.dstBinding = 4;
+        storageWrite.dstArrayElement = 0;
+        storageWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        storageWrite.descriptorCount = 1;
+        storageWrite.pImageInfo = &imageInfo;
+
+        VkWriteDescriptorSet& beamWrite = writeDescriptorSets.emplace_back();
+        beamWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        beamWrite.dstSet = *device.getDescriptorSet(descrSet);
+        beamWrite.dstBinding = 5;
+        beamWrite.dstArrayElement = 0;
+        beamWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        beamWrite.descriptorCount = 1;
+        beamWrite.pImageInfo = &beamImageInfo;
+
+        for (uint32_t i = 0; i < historyInfos.size(); i++)
+        {
+            VkWriteDescriptorSet& historyWrite = writeDescriptorSets.emplace_back();
+            historyWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            historyWrite.dstSet = *device.getDescriptorSet(descrSet);
+            historyWrite.dstBinding = 6 + i;
+            historyWrite.dstArrayElement = 0;
+            historyWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            historyWrite.descriptorCount = 1;
+            historyWrite.pImageInfo = &historyInfos[i];
+        }
+
+        for (uint32_t i = 0; i < wavefrontInfos.size(); i++)
+        {
+            VkWriteDescriptorSet& wavefrontWrite = writeDescriptorSets.emplace_back();
+            wavefrontWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            wavefrontWrite.dstSet = *device.getDescriptorSet(descrSet);
+            wavefrontWrite.dstBinding = 8 + i;
+            wavefrontWrite.dstArrayElement = 0;
+            wavefrontWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            wavefrontWrite.descriptorCount = 1;
+            wavefrontWrite.pBufferInfo = &wavefrontInfos[i];
+        }
+    }
+    VkWriteDescriptorSet& blitWrite = writeDescriptorSets.emplace_back();
+    blitWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    blitWrite.dstSet = *device.getDescriptorSet(m_blitDescrSet);
+    blitWrite.dstBinding = 0;
+    blitWrite.dstArrayElement = 0;
+    blitWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    blitWrite.descriptorCount = 1;
+    blitWrite.pImageInfo = &imageInfo;
+
+    device.updateDescriptorSets(writeDescriptorSets);
+}
+
+// Only the compute traversal scales the resolution, the fragment traversal and the intersection test always trace the whole screen
+void Engine::updateRenderExtent(const std::span<const uint32_t> completedSlots)
+{
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+    const bool dynamic = m_dynamicResolution && m_computeTraversal;
+    const glm::uvec2 screenSize{ m_tracedImageExtent.width, m_tracedImageExtent.height };
+    if (!dynamic)
+        m_resolutionController.reset(m_resolutionController.getSettings().maxScale);
+
+    // The ring waited for the fences of these frames, so their timestamps are written. They are fed oldest first
+    // A frame that was in flight when the scale changed was traced at the old size, its time is moved to the current one with the model of the controller
+    for (const uint32_t slot : completedSlots)
+    {
+        if (!m_frameTimePending[slot])
+            continue;
+        m_frameTimePending[slot] = false;
+        std::array<uint64_t, 2> timestamps{};
+        if (vkGetQueryPoolResults(*device, m_frameQueryPool, 2 * slot, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+            continue;
+        m_gpuFrameMs = static_cast<float>(static_cast<double>(timestamps[1] - timestamps[0]) * device.getGPU().getProperties().limits.timestampPeriod / 1e6);
+        if (dynamic)
+        {
+            const glm::uvec2 frameSize = m_framePushConstants[slot].renderSize;
+            const glm::uvec2 size = ResolutionController::getRenderSize(screenSize, m_resolutionController.getScale());
+            m_resolutionController.update(m_gpuFrameMs * static_cast<float>(size.x * size.y) / static_cast<float>(std::max(frameSize.x * frameSize.y, 1u)));
+        }
+    }
+    if (m_frameQueryPool == VK_NULL_HANDLE)
+    {
+        m_gpuFrameMs = ImGui::GetIO().DeltaTime * 1000.0f;
+        if (dynamic)
+            m_resolutionController.update(m_gpuFrameMs);
+    }
+
+    const glm::uvec2 renderSize = dynamic ? ResolutionController::getRenderSize(screenSize, m_resolutionController.getScale()) : screenSize;
+    // The history was traced with other pixels
+    if (renderSize.x != m_renderExtent.width || renderSize.y != m_renderExtent.height)
+        m_temporalFrame = 0;
+    m_renderExtent = { renderSize.x, renderSize.y };
+}
+
 uint32_t Engine::createFramebuffer(const VkImageView colorAttachment, const VkExtent2D newExtent) const
 {
     const std::vector<VkImageView> attachments{ colorAttachment };
@@ -543,7 +1426,8 @@ void Engine::initImgui() const
     init_info.RenderPass = *device.getRenderPass(m_renderPassID);
     init_info.Subpass = 0;
     init_info.MinImageCount = swapchain.getMinImageCount();
-    init_info.ImageCount = swapchain.getImageCount();
+    // The backend cycles its vertex buffers through this many frames, so every frame in flight needs one
+    init_info.ImageCount = std::max(swapchain.getImageCount(), MAX_FRAMES_IN_FLIGHT);
     init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
     ImGui_ImplVulkan_Init(&init_info);
 }
@@ -574,12 +1458,13 @@ void Engine::setupInputEvents()
                 device.freeFramebuffer(m_framebuffers[i]);
                 m_framebuffers[i] = createFramebuffer(swapchain.getImageView(i), extent);
             }
+            createScreenImages(extent);
             Logger::popContext();
         });
 }
 
-// Record the commands to the command buffer. This function is called every frame
-void Engine::recordCommandBuffer(const uint32_t framebufferID, ImDrawData* main_draw_data)
+// Record the commands to the command buffer of the frame slot. This function is called every frame
+void Engine::recordCommandBuffer(const uint32_t frameSlot, const uint32_t framebufferID, ImDrawData* main_draw_data)
 {
     Logger::pushContext("Command buffer recording");
     VulkanSwapchainExtension* swapchainExt = VulkanSwapchainExtension::get(m_deviceID);
@@ -601,10 +1486,23 @@ void Engine::recordCommandBuffer(const uint32_t framebufferID, ImDrawData* main_
     scissor.offset = { 0, 0 };
     scissor.extent = extent;
 
-    const uint32_t layout = VulkanContext::getDevice(m_deviceID).getPipeline(m_pipelineID).getLayout();
+    const uint32_t layout = m_pipelineLayoutID;
+
+    // The wavefront passes split the shadow rays from the primary ones, without shadows there is nothing to split
+    const bool wavefront = m_wavefront && m_computeTraversal && !m_intersectionTest && !m_noShadows;
+    // The temporal passes need the history the compute traversal writes, the intersection test doesn't shade anything worth keeping
+    const bool temporal = m_temporal && m_computeTraversal && !m_intersectionTest && !wavefront;
+    if (!temporal)
+        m_temporalFrame = 0;
+
+    // The temporal passes reproject the frame recorded before this one, its push constants are still in its slot
+    const uint32_t previousSlot = m_frameRing->getPreviousSlot();
+    const glm::mat4 prevPVMatrix = previousSlot != UINT32_MAX ? glm::inverse(m_framePushConstants[previousSlot].viewProj) : glm::mat4{ 1.0f };
+    const glm::vec3 prevCamPos = previousSlot != UINT32_MAX ? m_framePushConstants[previousSlot].camPos : glm::vec3{ 0.0f };
 
     const Camera::Data camData = cam.getData();
-    const PushConstantData pushConstants{
+    PushConstantData& pushConstants = m_framePushConstants[frameSlot];
+    pushConstants = {
         camData.position,
         camData.invPVMatrix,
         m_sunlightDir,
@@ -614,36 +1512,96 @@ void Engine::recordCommandBuffer(const uint32_t framebufferID, ImDrawData* main_
         m_brightness,
         m_saturation,
         m_contrast,
-        m_gamma
+        m_gamma,
+        m_octree.octree->getLeafFlags(),
+        m_beamPrepass ? 1u : 0u,
+        temporal ? 1u : 0u,
+        m_temporalFrame,
+        prevPVMatrix,
+        prevCamPos,
+        { m_renderExtent.width, m_renderExtent.height },
+        0u,
+        0u
     };
 
-    VulkanCommandBuffer& graphicsBuffer = VulkanContext::getDevice(m_deviceID).getCommandBuffer(m_graphicsCmdBufferID, 0);
+    VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+    VulkanCommandBuffer& graphicsBuffer = device.getCommandBuffer(m_frameRing->getSlot(frameSlot).commandBuffer, 0);
     graphicsBuffer.reset();
     graphicsBuffer.beginRecording();
+    if (m_frameQueryPool != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(*graphicsBuffer, m_frameQueryPool, 2 * frameSlot, 2);
+        vkCmdWriteTimestamp(*graphicsBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_frameQueryPool, 2 * frameSlot);
+    }
 
-    graphicsBuffer.cmdBeginRenderPass(m_renderPassID, framebufferID, extent, clearValues);
-
-    graphicsBuffer.cmdBindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, layout, m_octreeDescrSet);
+    // The compute passes go before the render pass, the barrier keeps them from writing images the frame before may still read
+    // Both use the layout of the traversal, so the set and the push constants stay bound for the compute traversal
+    if (m_beamPrepass || m_computeTraversal)
+    {
+        cmdPreviousFrameBarrier(*graphicsBuffer);
+        graphicsBuffer.cmdBindDescriptorSet(VK_PIPELINE_BIND_POINT_COMPUTE, layout, m_octreeDescrSets[m_activeDescrSet]);
+        graphicsBuffer.cmdPushConstant(layout, TRACING_STAGES, 0, sizeof(pushConstants), &pushConstants);
+    }
+    if (m_beamPrepass)
+    {
+        vkCmdBindPipeline(*graphicsBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_beamPipeline);
+        const uint32_t blocksX = (m_renderExtent.width + BEAM_BLOCK_SIZE - 1) / BEAM_BLOCK_SIZE;
+        const uint32_t blocksY = (m_renderExtent.height + BEAM_BLOCK_SIZE - 1) / BEAM_BLOCK_SIZE;
+        vkCmdDispatch(*graphicsBuffer, (blocksX + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE, (blocksY + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE, 1);
+        cmdShaderWriteBarrier(*graphicsBuffer, *device.getImage(m_beamImage.image), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    }
+    if (wavefront)
+    {
+        recordWavefrontPasses(graphicsBuffer, pushConstants);
+        cmdShaderWriteBarrier(*graphicsBuffer, *device.getImage(m_tracedImage.image), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    }
+    else if (m_computeTraversal)
+    {
+        vkCmdBindPipeline(*graphicsBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, getComputeTracingPipeline());
+        vkCmdDispatch(*graphicsBuffer, (m_renderExtent.width + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE, (m_renderExtent.height + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE, 1);
+        // The reprojected half looks at the history its traced neighbours just wrote
+        if (temporal && m_temporalFrame != 0)
+        {
+            cmdShaderWriteBarrier(*graphicsBuffer, m_historyColor.image.image, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            cmdShaderWriteBarrier(*graphicsBuffer, m_historyNormal.image.image, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            PushConstantData reprojectConstants = pushConstants;
+            reprojectConstants.temporalPass = 2;
+            graphicsBuffer.cmdPushConstant(layout, TRACING_STAGES, 0, sizeof(reprojectConstants), &reprojectConstants);
+            vkCmdDispatch(*graphicsBuffer, (m_renderExtent.width + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE, (m_renderExtent.height + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE, 1);
+        }
+        cmdShaderWriteBarrier(*graphicsBuffer, *device.getImage(m_tracedImage.image), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    }
+    if (temporal)
+        m_temporalFrame++;
 
-    if (m_intersectionTest)
-        if (m_intersectionTestColor)
-            graphicsBuffer.cmdBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, m_intersectColorPipelineID);
-        else
-            graphicsBuffer.cmdBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, m_intersectPipelineID);
-    else if (m_noShadows)
-        graphicsBuffer.cmdBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, m_noShadowPipelineID);
-    else
-        graphicsBuffer.cmdBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineID);
+    graphicsBuffer.cmdBeginRenderPass(m_renderPassID, framebufferID, extent, clearValues);
 
     graphicsBuffer.cmdSetViewport(viewport);
     graphicsBuffer.cmdSetScissor(scissor);
 
-    graphicsBuffer.cmdPushConstant(layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushConstants), &pushConstants);
+    if (m_computeTraversal)
+    {
+        graphicsBuffer.cmdBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, m_blitPipelineID);
+        graphicsBuffer.cmdBindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, m_blitPipelineLayoutID, m_blitDescrSet);
+        const glm::vec2 renderSize{ static_cast<float>(m_renderExtent.width), static_cast<float>(m_renderExtent.height) };
+        graphicsBuffer.cmdPushConstant(m_blitPipelineLayoutID, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(renderSize), &renderSize);
+    }
+    else
+    {
+        graphicsBuffer.cmdBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, getTracingPipeline());
+        graphicsBuffer.cmdBindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, layout, m_octreeDescrSets[m_activeDescrSet]);
+        graphicsBuffer.cmdPushConstant(layout, TRACING_STAGES, 0, sizeof(pushConstants), &pushConstants);
+    }
     graphicsBuffer.cmdDraw(6, 0);
 
     ImGui_ImplVulkan_RenderDrawData(main_draw_data, *graphicsBuffer);
 
     graphicsBuffer.cmdEndRenderPass();
+    if (m_frameQueryPool != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(*graphicsBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_frameQueryPool, 2 * frameSlot + 1);
+        m_frameTimePending[frameSlot] = true;
+    }
     graphicsBuffer.endRecording();
 
     Logger::popContext();
@@ -655,36 +1613,95 @@ void Engine::drawImgui()
 
     ImGui::Begin("Metrics");
     ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
+    ImGui::Text("GPU: %.3f ms", m_gpuFrameMs);
+    ImGui::Text("Render resolution: %ux%u (%.0f%%)", m_renderExtent.width, m_renderExtent.height, 100.0f * static_cast<float>(m_renderExtent.width) / static_cast<float>(std::max(m_tracedImageExtent.width, 1u)));
     ImGui::Separator();
     ImGui::Text("Camera position: (%.3f, %.3f, %.3f)", cam.getPosition().x, cam.getPosition().y, cam.getPosition().z);
     ImGui::Text("Camera direction: (%.3f, %.3f, %.3f)", cam.getDir().x, cam.getDir().y, cam.getDir().z);
+    // The path gets the pose of every frame, so it plays back at the frame rate it was recorded at
+    if (!m_recordingCameraPath && ImGui::Button("Record camera path"))
+    {
+        m_cameraPath.clear();
+        m_recordingCameraPath = true;
+    }
+    else if (m_recordingCameraPath && ImGui::Button("Stop recording"))
+    {
+        m_recordingCameraPath = false;
+        try
+        {
+            saveCameraPath(CAMERA_PATH_FILE, m_cameraPath);
+            LOG_INFO("Saved ", m_cameraPath.size(), " camera poses to ", CAMERA_PATH_FILE);
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERR("Failed to save camera path: ", e.what());
+        }
+    }
+    if (m_recordingCameraPath)
+    {
+        ImGui::SameLine();
+        ImGui::Text("%u poses", static_cast<uint32_t>(m_cameraPath.size()));
+    }
 
     ImGui::End();
     ImGui::Begin("Octree stats");
-    if (m_octree->isOctreeLoadedFromFile())
+    if (m_octree.octree->isOctreeLoadedFromFile())
     {
-        ImGui::Text("Load time: %.4fs", m_octree->getStats().saveTime);
+        ImGui::Text("Load time: %.4fs", m_octree.octree->getStats().saveTime);
     }
     else
     {
-        ImGui::Text("Construction time: %.4fs", m_octree->getStats().constructionTime);
-        ImGui::Text("Save time: %.4fs", m_octree->getStats().saveTime);
+        ImGui::Text("Construction time: %.4fs", m_octree.octree->getStats().constructionTime);
+        ImGui::Text("Save time: %.4fs", m_octree.octree->getStats().saveTime);
     }
     ImGui::Separator();
-    ImGui::Text("Total nodes: %u nodes", m_octree->getSize());
-    ImGui::Text(" - Voxel nodes: %llu nodes (%.4f%%)", m_octree->getStats().voxels, static_cast<float>(m_octree->getStats().voxels) / static_cast<float>(m_octree->getSize()) * 100.0f);
-    ImGui::Text(" - Branch nodes: %llu nodes (%.4f%%)", m_octree->getSize() - m_octree->getStats().voxels, static_cast<float>(m_octree->getSize() - m_octree->getStats().voxels) / static_cast<float>(m_octree->getSize()) * 100.0f);
-    ImGui::Text(" - Far nodes: %llu nodes (%.4f%%)", m_octree->getStats().farPtrs, static_cast<float>(m_octree->getStats().farPtrs) / static_cast<float>(m_octree->getSize()) * 100.0f);
-    ImGui::Text("Materials: %u", m_octree->getStats().materials);
-    ImGui::Text("Textures: %u", static_cast<uint32_t>(m_octree->getMaterialTextures().size()));
+    ImGui::Text("Total nodes: %u nodes", m_octree.octree->getSize());
+    ImGui::Text(" - Voxel nodes: %llu nodes (%.4f%%)", m_octree.octree->getStats().voxels, static_cast<float>(m_octree.octree->getStats().voxels) / static_cast<float>(m_octree.octree->getSize()) * 100.0f);
+    ImGui::Text(" - Branch nodes: %llu nodes (%.4f%%)", m_octree.octree->getSize() - m_octree.octree->getStats().voxels, static_cast<float>(m_octree.octree->getSize() - m_octree.octree->getStats().voxels) / static_cast<float>(m_octree.octree->getSize()) * 100.0f);
+    ImGui::Text(" - Far nodes: %llu nodes (%.4f%%)", m_octree.octree->getStats().farPtrs, static_cast<float>(m_octree.octree->getStats().farPtrs) / static_cast<float>(m_octree.octree->getSize()) * 100.0f);
+    ImGui::Text("Materials: %u", m_octree.octree->getStats().materials);
+    ImGui::Text("Textures: %u (%u texture arrays)", static_cast<uint32_t>(m_octree.octree->getMaterialTextures().size()), static_cast<uint32_t>(m_octree.images.size()));
     ImGui::Separator();
-    ImGui::Text("Depth: %d", m_octree->getDepth());
-    ImGui::Text("Density: %.4f%%", static_cast<float>(m_octree->getStats().voxels) / static_cast<float>(std::pow(8, m_octree->getDepth())) * 100.0f);
+    ImGui::Text("Depth: %d", m_octree.octree->getDepth());
+    ImGui::Text("Density: %.4f%%", static_cast<float>(m_octree.octree->getStats().voxels) / static_cast<float>(std::pow(8, m_octree.octree->getDepth())) * 100.0f);
     ImGui::Separator();
-    ImGui::Text("GPU Memory usage: %s", VulkanMemoryAllocator::compactBytes(m_octreeImagesMemUsage + m_octreeBufferSize).c_str());
-    ImGui::Text(" - GPU Memory usage (octree): %s", VulkanMemoryAllocator::compactBytes(m_octreeBufferSize).c_str());
-    ImGui::Text(" - GPU Memory usage (images): %s", VulkanMemoryAllocator::compactBytes(m_octreeImagesMemUsage).c_str());
-    ImGui::Text("CPU Memory usage: %s", VulkanMemoryAllocator::compactBytes(m_octree->getByteSize()).c_str());
+    const OctreePager::Stats pagerStats = m_octree.pager->getStats();
+    ImGui::Text("Pages: %u resident of %u (%u slots, %u pinned)", m_octree.pager->getResidentCount(), m_octree.pager->getPageCount(), m_octree.pager->getSlotCount(), m_octree.pager->getPinnedCount());
+    ImGui::Text(" - Streamed: %llu loads, %llu evictions", pagerStats.loads, pagerStats.evictions);
+    ImGui::Separator();
+    ImGui::Text("GPU Memory usage: %s", VulkanMemoryAllocator::compactBytes(m_octree.imagesMemUsage + m_octree.bufferSize).c_str());
+    ImGui::Text(" - GPU Memory usage (octree): %s", VulkanMemoryAllocator::compactBytes(m_octree.bufferSize).c_str());
+    ImGui::Text(" - GPU Memory usage (images): %s", VulkanMemoryAllocator::compactBytes(m_octree.imagesMemUsage).c_str());
+    ImGui::Text("   (%s as decoded RGBA8 without mips)", VulkanMemoryAllocator::compactBytes(m_octree.imagesSourceSize).c_str());
+    ImGui::Text("CPU Memory usage: %s", VulkanMemoryAllocator::compactBytes(m_octree.octree->getByteSize()).c_str());
+    ImGui::End();
+
+    // Octree files are loaded as they are, models are voxelized with the settings the program was started with and the depth set here
+    ImGui::Begin("Scene");
+    ImGui::InputText("Path", m_scenePathInput.data(), m_scenePathInput.size());
+    ImGui::InputInt("Depth", &m_sceneDepthInput);
+    m_sceneDepthInput = std::clamp(m_sceneDepthInput, 1, static_cast<int>(MAX_OCTREE_DEPTH));
+    ImGui::BeginDisabled(m_sceneLoader.isBusy() || m_sceneUpload != nullptr);
+    if (ImGui::Button("Load octree"))
+    {
+        SceneSettings settings = m_sceneSettings;
+        settings.loadPath = m_scenePathInput.data();
+        requestScene(settings);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Voxelize model"))
+    {
+        SceneSettings settings = m_sceneSettings;
+        settings.loadPath.clear();
+        settings.savePath.clear();
+        settings.procedural = false;
+        settings.modelPath = m_scenePathInput.data();
+        settings.depth = static_cast<uint8_t>(m_sceneDepthInput);
+        requestScene(settings);
+    }
+    ImGui::EndDisabled();
+    if (!m_sceneStatus.empty())
+        ImGui::TextWrapped("%s", m_sceneStatus.c_str());
     ImGui::End();
 
     ImGui::Begin("Settings");
@@ -705,42 +1722,99 @@ void Engine::drawImgui()
 	ImGui::DragFloat("Contrast", &m_contrast, 0.001f, 0, 1);
 	ImGui::DragFloat("Gamma", &m_gamma, 0.001f, 0, 4);
     ImGui::Separator();
+    // More frames ahead let the CPU record a frame while the GPU traces the last ones, each one adds a frame of input latency
+    int framePacing = static_cast<int>(m_frameRing->getFramesAhead()) - 1;
+    if (ImGui::Combo("Frame pacing", &framePacing, "Low latency (1 frame)\0Balanced (2 frames)\0Throughput (3 frames)\0"))
+        m_frameRing->setFramesAhead(static_cast<uint32_t>(framePacing) + 1);
+    // The old pipelines are freed, the frames in flight may still use them
     if (ImGui::Button("Reload shaders"))
+    {
+        m_frameRing->waitIdle();
         updatePipelines();
+    }
     if (!m_intersectionTest)
         ImGui::Checkbox("No shadows", &m_noShadows);
     ImGui::Checkbox("Intersection test", &m_intersectionTest);
     if (m_intersectionTest)
         ImGui::Checkbox("Enable color intersection", &m_intersectionTestColor);
+    ImGui::Checkbox("Compute traversal", &m_computeTraversal);
+    // Wavefront passes only change how the shadow rays are traced
+    const bool wavefrontAvailable = m_computeTraversal && !m_intersectionTest && !m_noShadows;
+    if (wavefrontAvailable)
+    {
+        ImGui::Checkbox("Wavefront passes", &m_wavefront);
+        if (m_wavefront)
+            ImGui::Checkbox("Sort shadow rays", &m_sortShadowRays);
+    }
+    if (m_computeTraversal && !m_intersectionTest && !(wavefrontAvailable && m_wavefront))
+        ImGui::Checkbox("Temporal reprojection", &m_temporal);
+    if (m_computeTraversal)
+    {
+        ImGui::Checkbox("Dynamic resolution", &m_dynamicResolution);
+        if (m_dynamicResolution)
+        {
+            ResolutionSettings resolution = m_resolutionController.getSettings();
+            const bool targetChanged = ImGui::DragFloat("Frame budget (ms)", &resolution.targetMs, 0.1f, 1.0f, 100.0f);
+            const bool minChanged = ImGui::DragFloat("Min resolution scale", &resolution.minScale, 0.01f, 0.1f, 1.0f);
+            if (targetChanged || minChanged)
+                m_resolutionController.setSettings(resolution);
+        }
+    }
+    ImGui::Checkbox("Beam pre-pass", &m_beamPrepass);
     ImGui::End();
 }
 
 void Engine::updatePipelines()
 {
     VulkanDevice& device = VulkanContext::getDevice(m_deviceID);
+    createPipelineLayouts();
+
+    // The old pipeline is only freed once the new one is built, a shader that doesn't compile leaves the last working one
+    const auto rebuild = [&](uint32_t& pipelineID, const uint32_t newPipelineID)
+    {
+        if (pipelineID != UINT32_MAX)
+            device.freePipeline(pipelineID);
+        pipelineID = newPipelineID;
+    };
+    const auto rebuildCompute = [&](VkPipeline& pipeline, const VkPipeline newPipeline)
+    {
+        if (pipeline != VK_NULL_HANDLE)
+            vkDestroyPipeline(*device, pipeline, nullptr);
+        pipeline = newPipeline;
+    };
 
     try
     {
-        uint32_t oldPipeline = m_pipelineID;
-        m_pipelineID = createGraphicsPipeline(m_samplerImageCount, "shaders/raytracing.frag", {});
-        if (oldPipeline != UINT32_MAX)
-            device.freePipeline(oldPipeline);
-        oldPipeline = m_noShadowPipelineID;
-        m_noShadowPipelineID = createGraphicsPipeline(m_samplerImageCount, "shaders/raytracing.frag", {{"NO_SHADOW", "true"}});
-        if (oldPipeline != UINT32_MAX)
-            device.freePipeline(oldPipeline);
-        oldPipeline = m_intersectPipelineID;
-        m_intersectPipelineID = createGraphicsPipeline(m_samplerImageCount, "shaders/raytracing.frag", {{"INTERSECTION_TEST", "true"}});
-        if (oldPipeline != UINT32_MAX)
-            device.freePipeline(oldPipeline);
-        oldPipeline = m_intersectColorPipelineID;
-        m_intersectColorPipelineID = createGraphicsPipeline(m_samplerImageCount, "shaders/raytracing.frag", {{"INTERSECTION_TEST", "true"}, {"INTERSECTION_COLOR", "true"}});
-        if (oldPipeline != UINT32_MAX)
-            device.freePipeline(oldPipeline);
+        rebuild(m_pipelineID, createGraphicsPipeline("shaders/raytracing.frag", {}, m_pipelineLayoutID));
+        rebuild(m_noShadowPipelineID, createGraphicsPipeline("shaders/raytracing.frag", {{"NO_SHADOW", "true"}}, m_pipelineLayoutID));
+        rebuild(m_intersectPipelineID, createGraphicsPipeline("shaders/raytracing.frag", {{"INTERSECTION_TEST", "true"}}, m_pipelineLayoutID));
+        rebuild(m_intersectColorPipelineID, createGraphicsPipeline("shaders/raytracing.frag", {{"INTERSECTION_TEST", "true"}, {"INTERSECTION_COLOR", "true"}}, m_pipelineLayoutID));
+        rebuildCompute(m_computePipeline, createComputePipeline({{"COMPUTE_TILES", "true"}}));
+        rebuildCompute(m_noShadowComputePipeline, createComputePipeline({{"COMPUTE_TILES", "true"}, {"NO_SHADOW", "true"}}));
+        rebuildCompute(m_intersectComputePipeline, createComputePipeline({{"COMPUTE_TILES", "true"}, {"INTERSECTION_TEST", "true"}}));
+        rebuildCompute(m_intersectColorComputePipeline, createComputePipeline({{"COMPUTE_TILES", "true"}, {"INTERSECTION_TEST", "true"}, {"INTERSECTION_COLOR", "true"}}));
+        rebuildCompute(m_beamPipeline, createComputePipeline({{"BEAM_PREPASS", "true"}}));
+        rebuildCompute(m_wavefrontPipeline, createComputePipeline({{"COMPUTE_TILES", "true"}, {"WAVEFRONT", "true"}}));
+        rebuild(m_blitPipelineID, createGraphicsPipeline("shaders/blit.frag", {}, m_blitPipelineLayoutID));
     }
     catch (const std::exception& e)
     {
         LOG_ERR("Failed to reload shaders: ", e.what());
     }
-    
+}
+
+// Variant of the fragment traversal for the current settings
+uint32_t Engine::getTracingPipeline() const
+{
+    if (m_intersectionTest)
+        return m_intersectionTestColor ? m_intersectColorPipelineID : m_intersectPipelineID;
+    return m_noShadows ? m_noShadowPipelineID : m_pipelineID;
+}
+
+// Same for the compute traversal
+VkPipeline Engine::getComputeTracingPipeline() const
+{
+    if (m_intersectionTest)
+        return m_intersectionTestColor ? m_intersectColorComputePipeline : m_intersectComputePipeline;
+    return m_noShadows ? m_noShadowComputePipeline : m_computePipeline;
 }
@@ -1,35 +1,150 @@
 #pragma once
+#include <array>
+#include <memory>
+#include <span>
+
 #include "camera.hpp"
+#include "camera_path.hpp"
+#include "frame_ring.hpp"
 #include "imgui.h"
+#include "raw_image.hpp"
+#include "resolution_controller.hpp"
+#include "scene_loader.hpp"
 #include "sdl_window.hpp"
 #include "vulkan_queues.hpp"
 #include "vulkan_shader.hpp"
+#include "Texture/texture_packer.hpp"
+
+class TextureArraySink;
+class VulkanCommandBuffer;
+struct SceneUpload;
+
+struct OctreeImage
+{
+    uint32_t image;
+    VkSampler sampler;
+    VkFormat format;
+};
+// A texture array, it has mips and layers so it is a raw image
+struct TextureArrayImage
+{
+    RawImage image;
+    VkSampler sampler = VK_NULL_HANDLE;
+};
+// Color or normal of the last two frames, a layer per frame parity, so they are raw images too
+struct HistoryImage
+{
+    RawImage image;
+    VkFormat format;
+};
+// Everything one octree takes on the GPU. The next octree fills its own while the current one keeps rendering
+// Slots of the page pool evicted while recording a frame, the frames before it may still read them
+struct EvictedPageSlots
+{
+    uint64_t frame = UINT64_MAX;
+    std::vector<uint32_t> slots;
+};
+
+struct OctreeResources
+{
+    std::unique_ptr<Octree> octree;
+    // Decides which pages of the octree are in the pool at the start of the buffer, the page table says where each one is
+    std::unique_ptr<OctreePager> pager;
+    // One list per slot of the frame ring, given back to the pager once the ring reports the frame that evicted them as done
+    std::array<EvictedPageSlots, MAX_FRAMES_IN_FLIGHT> evictedSlots{};
+    uint32_t buffer = UINT32_MAX;
+    uint32_t pageTableBuffer = UINT32_MAX;
+    VkDeviceSize bufferSize = 0;
+    VkDeviceSize poolSize = 0;
+    VkDeviceSize matPadding = 0;
+    // One per texture array
+    std::vector<TextureArrayImage> images{};
+    // Array and layer of each texture of the octree, textures with the same content share the layer
+    std::vector<TexturePlacement> texturePlacements{};
+    VkDeviceSize imagesMemUsage = 0;
+    VkDeviceSize imagesSourceSize = 0;
+};
+
+// Push constant data for the shaders
+// The alignment rules for the GPU are specified here (https://registry.khronos.org/OpenGL/extensions/ARB/ARB_uniform_buffer_object.txt)
+// Search for the word "alignment" and it will jump to the correct section
+// As a general tip: Floats and uints are aligned to 4 bytes. Vec3, vec4 and mat4 are aligned to 16 bytes
+struct PushConstantData
+{
+    alignas(16) glm::vec3 camPos;
+    alignas(16) glm::mat4 viewProj;
+    alignas(16) glm::vec3 sunDirection;
+    alignas(16) glm::vec3 skyColor;
+    alignas(16) glm::vec3 sunColor;
+    alignas(4) float scale;
+    alignas(4) float brightness;
+    alignas(4) float saturation;
+    alignas(4) float contrast;
+    alignas(4) float gamma;
+    alignas(4) uint32_t leafFlags;
+    alignas(4) uint32_t beamPrepass;
+    alignas(4) uint32_t temporalPass;
+    alignas(4) uint32_t frameIndex;
+    alignas(16) glm::mat4 prevPVMatrix;
+    alignas(16) glm::vec3 prevCamPos;
+    alignas(8) glm::uvec2 renderSize;
+    alignas(4) uint32_t wavefrontPass;
+    alignas(4) uint32_t sortShift;
+};
 
-class Octree;
 
 class Engine
 {
 public:
-    explicit Engine(uint32_t samplerImageCount, uint8_t depth);
+    Engine();
 	~Engine();
 
-	void configureOctreeBuffer(Octree& octree, float scale);
+    // Uploads the octree before returning. The settings say where its textures are and how they are compressed
+	void configureOctreeBuffer(std::unique_ptr<Octree> octree, const SceneSettings& settings, float scale);
+    // Builds the scene on a background thread and swaps to it once it is on the GPU, the current octree keeps rendering meanwhile
+    // Returns false if another scene is still loading
+    bool requestScene(const SceneSettings& settings);
 
 	void run();
 
 private:
 	void createRenderPass();
-    uint32_t createGraphicsPipeline(const uint32_t samplerImageCount, const std::string& fragmentShader, std::vector<VulkanShader::MacroDef> macros);
+    void createPipelineLayouts();
+    uint32_t createGraphicsPipeline(const std::string& fragmentShader, std::vector<VulkanShader::MacroDef> macros, uint32_t pipelineLayoutID);
+    VkPipeline createComputePipeline(std::vector<VulkanShader::MacroDef> macros);
+    void createScreenImages(VkExtent2D extent);
 	uint32_t createFramebuffer(VkImageView colorAttachment, VkExtent2D newExtent) const;
 	void initImgui() const;
 
 	void setupInputEvents();
 
-	void recordCommandBuffer(uint32_t framebufferID, ImDrawData* main_draw_data);
+	void recordCommandBuffer(uint32_t frameSlot, uint32_t framebufferID, ImDrawData* main_draw_data);
+    void recordWavefrontPasses(VulkanCommandBuffer& commandBuffer, const PushConstantData& pushConstants) const;
+    // Reads the times of the frames the ring waited for and picks the render extent of the next one
+    void updateRenderExtent(std::span<const uint32_t> completedSlots);
 
 	void drawImgui();
 
     void updatePipelines();
+    [[nodiscard]] uint32_t getTracingPipeline() const;
+    [[nodiscard]] VkPipeline getComputeTracingPipeline() const;
+
+    void createOctreeImages(OctreeResources& resources, TextureArraySink& sink, const std::vector<uint32_t>& textureImages) const;
+    void createOctreePager(OctreeResources& resources, std::vector<OctreePage> pages, size_t memoryLimit) const;
+    void createOctreeBuffer(OctreeResources& resources) const;
+    void uploadOctreePages(const OctreeResources& resources, const std::vector<OctreePager::Load>& loads) const;
+    void uploadPageTable(const OctreeResources& resources) const;
+    void uploadMaterials(const OctreeResources& resources) const;
+    [[nodiscard]] std::vector<OctreePager::Load> updateOctreePager(OctreeResources& resources, uint32_t maxLoads) const;
+    void streamOctreePages(std::span<const uint32_t> completedSlots);
+    void writeOctreeDescriptorSet(const OctreeResources& resources, uint32_t descrSet) const;
+    void freeOctreeResources(OctreeResources& resources) const;
+
+    void updateSceneUpload();
+    void startSceneUpload(std::unique_ptr<Scene> scene);
+    void stepSceneUpload();
+    void dropSceneUpload();
+    void endSceneUpload();
 
 	Camera cam;
 
@@ -42,41 +157,94 @@ private:
 	QueueSelection m_presentQueuePos{};
 	QueueSelection m_transferQueuePos{};
 
-	uint32_t m_graphicsCmdBufferID = UINT32_MAX;
 	uint32_t m_renderPassID = UINT32_MAX;
 	uint32_t m_pipelineID = UINT32_MAX;
 	uint32_t m_noShadowPipelineID = UINT32_MAX;
 	uint32_t m_intersectPipelineID = UINT32_MAX;
 	uint32_t m_intersectColorPipelineID = UINT32_MAX;
     uint32_t m_pipelineLayoutID = UINT32_MAX;
+    // Compute traversal. Tiles of 8x8 pixels are traced to an image, then a fullscreen pass copies it to the swapchain
+	// VkPlayground only builds graphics pipelines, the compute ones are made and freed directly
+	VkPipeline m_computePipeline = VK_NULL_HANDLE;
+	VkPipeline m_noShadowComputePipeline = VK_NULL_HANDLE;
+	VkPipeline m_intersectComputePipeline = VK_NULL_HANDLE;
+	VkPipeline m_intersectColorComputePipeline = VK_NULL_HANDLE;
+	VkPipeline m_beamPipeline = VK_NULL_HANDLE;
+	// Compute traversal split in the traversal, sort, shadow and shading passes of the WAVEFRONT variant
+	VkPipeline m_wavefrontPipeline = VK_NULL_HANDLE;
+	uint32_t m_blitPipelineID = UINT32_MAX;
+	uint32_t m_blitPipelineLayoutID = UINT32_MAX;
+	uint32_t m_blitDescrSetLayout = UINT32_MAX;
+	uint32_t m_blitDescrPool = UINT32_MAX;
+	uint32_t m_blitDescrSet = UINT32_MAX;
+	// Same size as the swapchain, it is created again when the window is resized
+	OctreeImage m_tracedImage{ UINT32_MAX, VK_NULL_HANDLE, VK_FORMAT_R16G16B16A16_SFLOAT };
+	VkExtent2D m_tracedImageExtent{ 0, 0 };
+	// Start distance of the primary rays of every 8x8 block, written by the beam pre-pass
+	OctreeImage m_beamImage{ UINT32_MAX, VK_NULL_HANDLE, VK_FORMAT_R32_SFLOAT };
+	// Part of the screen images the compute passes trace, the blit scales it up to the swapchain
+	VkExtent2D m_renderExtent{ 0, 0 };
+	// Color with the hit distance in alpha and normal of the last two frames, for the temporal passes of the compute traversal
+	HistoryImage m_historyColor{ {}, VK_FORMAT_R16G16B16A16_SFLOAT };
+	HistoryImage m_historyNormal{ {}, VK_FORMAT_R8G8B8A8_SNORM };
+	// Primary hit of every pixel, shadow ray queue with room for two copies of it and digit counts of the sort of the wavefront passes
+	// Sized for the swapchain like the images, so the queue always holds a ray per pixel
+	uint32_t m_wavefrontHitBuffer = UINT32_MAX;
+	uint32_t m_shadowQueueBuffer = UINT32_MAX;
+	uint32_t m_sortCountBuffer = UINT32_MAX;
+	uint32_t m_shadowQueueCapacity = 0;
 	std::vector<uint32_t> m_framebuffers{};
-	uint32_t m_renderFinishedSemaphoreID = UINT32_MAX;
-	uint32_t m_inFlightFenceID = UINT32_MAX;
+	// Command buffer, fence and semaphores of every frame in flight
+	std::unique_ptr<FrameSyncDevice> m_frameSyncDevice;
+	std::unique_ptr<FrameRing> m_frameRing;
+	// What each frame in flight was recorded with, the temporal passes reproject from the last one
+	std::array<PushConstantData, MAX_FRAMES_IN_FLIGHT> m_framePushConstants{};
+	// Null when the GPU has no timestamps for graphics and compute queues. Each frame slot has two queries
+	VkQueryPool m_frameQueryPool = VK_NULL_HANDLE;
+	std::array<bool, MAX_FRAMES_IN_FLIGHT> m_frameTimePending{};
 
-	uint32_t m_octreeBuffer = UINT32_MAX;
 	uint32_t m_octreeDescrPool = UINT32_MAX;
 	uint32_t m_octreeDescrSetLayout = UINT32_MAX;
-	uint32_t m_octreeDescrSet = UINT32_MAX;
-    VkDeviceSize m_octreeBufferSize = 0;
-    VkDeviceSize m_octreeMatPadding = 0;
+	// Two sets, the next octree is written to the one that is not bound
+	std::array<uint32_t, 2> m_octreeDescrSets{ UINT32_MAX, UINT32_MAX };
+	uint32_t m_activeDescrSet = 0;
+    OctreeResources m_octree{};
     float m_octreeScale = 1.0f;
     float m_sunRotationLat = 0.0f;
     float m_sunRotationAlt = 0.0f;
     glm::vec3 m_sunlightDir{1.0f, 1.0f, 0.0f};
     glm::vec3 m_skyColor{0.0, 1.0, 1.0};
     glm::vec3 m_sunColor{1.0, 1.0, 1.0};
-    std::vector<std::pair<uint32_t, VkSampler>> m_octreeImages{};
 
-    uint32_t m_samplerImageCount = 0;
-    VkDeviceSize m_octreeImagesMemUsage = 0;
-    float m_voxelSize = 1.0f;
-    uint8_t m_depth = 0;
+    // Scene switching. The loader builds the next scene in the background, then it is uploaded a part every frame
+    SceneLoader m_sceneLoader;
+    std::unique_ptr<SceneUpload> m_sceneUpload;
+    SceneSettings m_sceneSettings{};
+    std::array<char, 512> m_scenePathInput{};
+    int m_sceneDepthInput = 11;
+    std::string m_sceneStatus;
 
-    Octree* m_octree = nullptr;
+    // Poses of every frame while recording, saved for the headless mode to play back
+    std::vector<CameraPose> m_cameraPath;
+    bool m_recordingCameraPath = false;
 
     bool m_noShadows = true;
     bool m_intersectionTest = false;
     bool m_intersectionTestColor = false;
+    bool m_computeTraversal = false;
+    bool m_beamPrepass = false;
+    // Traces half of the pixels every frame and reprojects the rest, only with the compute traversal
+    bool m_temporal = false;
+    // Frames since the history was reset, the first one is traced in full
+    uint32_t m_temporalFrame = 0;
+    // Traces the frame in wavefront passes, only with the compute traversal and shadows. Temporal reprojection is off meanwhile
+    bool m_wavefront = false;
+    // Sorts the shadow rays by the Morton code of their origin before tracing them
+    bool m_sortShadowRays = true;
+    // Scales the resolution of the compute traversal to keep the GPU time of a frame under a budget
+    bool m_dynamicResolution = false;
+    ResolutionController m_resolutionController;
+    float m_gpuFrameMs = 0.0f;
 
     float m_brightness = 0.0f;
     float m_saturation = 1.0f;
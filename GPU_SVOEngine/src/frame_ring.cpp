@@ -0,0 +1,68 @@
+#include "frame_ring.hpp"
+
+#include <algorithm>
+
+FrameRing::FrameRing(FrameSyncDevice& device, const uint32_t framesAhead)
+    : m_device(device), m_framesAhead(std::clamp(framesAhead, 1u, MAX_FRAMES_IN_FLIGHT))
+{
+    for (Slot& slot : m_slots)
+    {
+        slot.commandBuffer = m_device.createCommandBuffer();
+        slot.fence = m_device.createFence(true);
+        slot.imageAvailable = m_device.createSemaphore();
+        slot.renderFinished = m_device.createSemaphore();
+    }
+}
+
+// Frames are checked oldest first, the GPU finishes them in that order. The slot of this frame held the frame MAX_FRAMES_IN_FLIGHT
+// before it, which is always old enough to be waited for
+uint32_t FrameRing::beginFrame()
+{
+    const uint64_t first = m_frame < MAX_FRAMES_IN_FLIGHT ? 0 : m_frame - MAX_FRAMES_IN_FLIGHT;
+    for (uint64_t frame = first; frame + m_framesAhead <= m_frame; frame++)
+    {
+        const uint32_t slot = static_cast<uint32_t>(frame % MAX_FRAMES_IN_FLIGHT);
+        if (m_slots[slot].inFlight && m_slots[slot].frame == frame)
+            complete(slot);
+    }
+    return getCurrentSlot();
+}
+
+void FrameRing::submitFrame()
+{
+    Slot& slot = m_slots[getCurrentSlot()];
+    m_device.resetFence(slot.fence);
+    slot.frame = m_frame;
+    slot.inFlight = true;
+    m_frame++;
+}
+
+void FrameRing::waitIdle()
+{
+    const uint64_t first = m_frame < MAX_FRAMES_IN_FLIGHT ? 0 : m_frame - MAX_FRAMES_IN_FLIGHT;
+    for (uint64_t frame = first; frame < m_frame; frame++)
+    {
+        const uint32_t slot = static_cast<uint32_t>(frame % MAX_FRAMES_IN_FLIGHT);
+        if (m_slots[slot].inFlight && m_slots[slot].frame == frame)
+            complete(slot);
+    }
+}
+
+std::vector<uint32_t> FrameRing::takeCompleted()
+{
+    std::vector<uint32_t> completed;
+    completed.swap(m_completed);
+    return completed;
+}
+
+void FrameRing::setFramesAhead(const uint32_t framesAhead)
+{
+    m_framesAhead = std::clamp(framesAhead, 1u, MAX_FRAMES_IN_FLIGHT);
+}
+
+void FrameRing::complete(const uint32_t slot)
+{
+    m_device.waitFence(m_slots[slot].fence);
+    m_slots[slot].inFlight = false;
+    m_completed.push_back(slot);
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Frames the CPU can record while the GPU still works on earlier ones, and the slots the frame ring keeps
+static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+
+// The part of the device the frame ring needs. The engine implements it with Vulkan objects, anything else can count the calls
+class FrameSyncDevice
+{
+public:
+    virtual ~FrameSyncDevice() = default;
+
+    virtual uint32_t createCommandBuffer() = 0;
+    virtual uint32_t createFence(bool signaled) = 0;
+    virtual uint32_t createSemaphore() = 0;
+    virtual void waitFence(uint32_t fence) = 0;
+    virtual void resetFence(uint32_t fence) = 0;
+};
+
+// FRAMES IN FLIGHT
+
+// Each frame is recorded to the slot of its number modulo MAX_FRAMES_IN_FLIGHT, with its own command buffer, fence and semaphores
+// The CPU runs up to framesAhead frames ahead of the GPU: before recording a frame the fences of the older frames are waited
+// One frame ahead is the old behaviour, the CPU waits for the last frame and input is never more than a frame old
+// A frame only counts once it is submitted, one that is dropped before (a swapchain that is out of date) leaves its slot as it was
+class FrameRing
+{
+public:
+    struct Slot
+    {
+        uint32_t commandBuffer = UINT32_MAX;
+        // Signaled when the GPU is done with the last frame submitted with the slot
+        uint32_t fence = UINT32_MAX;
+        // Waited by the submission before writing to the swapchain image, signaled by the acquire
+        uint32_t imageAvailable = UINT32_MAX;
+        // Waited by the presentation, signaled by the submission
+        uint32_t renderFinished = UINT32_MAX;
+        uint64_t frame = UINT64_MAX;
+        // Submitted and its fence not waited yet
+        bool inFlight = false;
+    };
+
+    explicit FrameRing(FrameSyncDevice& device, uint32_t framesAhead = 2);
+
+    // Waits until the next frame can be recorded and returns its slot. Slots whose frames finished meanwhile are kept for takeCompleted()
+    uint32_t beginFrame();
+    // Resets the fence of the slot beginFrame() returned, right before the submission that signals it, and moves to the next frame
+    void submitFrame();
+    // Waits for every frame in flight, for changes to resources the frames share
+    void waitIdle();
+    // Slots whose frames were waited since the last call, oldest frame first. Their fences are signaled, so their queries are written
+    [[nodiscard]] std::vector<uint32_t> takeCompleted();
+
+    // Clamped to [1, MAX_FRAMES_IN_FLIGHT], takes effect on the next beginFrame()
+    void setFramesAhead(uint32_t framesAhead);
+    [[nodiscard]] uint32_t getFramesAhead() const { return m_framesAhead; }
+
+    [[nodiscard]] const Slot& getSlot(const uint32_t slot) const { return m_slots[slot]; }
+    // Number of the frame being recorded, frames that were dropped don't count
+    [[nodiscard]] uint64_t getFrame() const { return m_frame; }
+    [[nodiscard]] uint32_t getCurrentSlot() const { return static_cast<uint32_t>(m_frame % MAX_FRAMES_IN_FLIGHT); }
+    // Slot of the last frame that was submitted, UINT32_MAX before the first one
+    [[nodiscard]] uint32_t getPreviousSlot() const { return m_frame == 0 ? UINT32_MAX : static_cast<uint32_t>((m_frame - 1) % MAX_FRAMES_IN_FLIGHT); }
+
+private:
+    void complete(uint32_t slot);
+
+    FrameSyncDevice& m_device;
+    std::array<Slot, MAX_FRAMES_IN_FLIGHT> m_slots{};
+    uint32_t m_framesAhead;
+    uint64_t m_frame = 0;
+    std::vector<uint32_t> m_completed;
+};
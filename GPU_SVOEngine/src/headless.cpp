@@ -0,0 +1,122 @@
+#include "headless.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include "camera.hpp"
+#include "camera_path.hpp"
+#include "Tracer/simd.hpp"
+#include "utils/logger.hpp"
+
+// Nearest rank percentile of values sorted from lowest to highest
+static double getPercentile(const std::vector<double>& sorted, const double percentile)
+{
+    const size_t rank = static_cast<size_t>(std::ceil(percentile / 100.0 * static_cast<double>(sorted.size())));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+void runHeadless(const Octree& octree, const SceneSettings& scene, const HeadlessSettings& settings)
+{
+    Logger::pushContext("Headless render");
+    const std::vector<CameraPose> poses = loadCameraPath(settings.cameraPath);
+    if (poses.empty())
+        throw std::runtime_error("camera path " + settings.cameraPath + " has no poses");
+    std::filesystem::create_directories(settings.outputDir);
+
+    CpuTracer tracer{ octree };
+    CpuTracer::Settings tracerSettings = settings.tracer;
+    FrameHistory history;
+    if (settings.temporal)
+        tracerSettings.history = &history;
+    // Same textures the engine would upload, decoded without compression and cached with the rest
+    if ((octree.getLeafFlags() & Octree::LEAF_BAKED_COLOR) == 0)
+        tracer.loadTextures(octree.getMaterialTextures(), scene.getTextureCacheDir());
+
+    const uint32_t width = std::max(settings.width, 1u);
+    const uint32_t height = std::max(width * 9 / 16, 1u);
+    Camera cam{ poses[0].position, poses[0].direction };
+    cam.setScreenSize(width, height);
+    if (settings.temporal)
+        LOG_INFO("Rendering ", poses.size(), " frames at ", width, "x", height, " with temporal reprojection");
+    else if (tracerSettings.wavefront)
+        LOG_INFO("Rendering ", poses.size(), " frames at ", width, "x", height, " in wavefront passes", tracerSettings.sortShadowRays ? " with sorted shadow rays" : "");
+    else
+        LOG_INFO("Rendering ", poses.size(), " frames at ", width, "x", height, " with packets of ", SIMD_WIDTH, " rays");
+
+    std::ofstream timings(settings.outputDir / "timings.csv");
+    timings << "frame,milliseconds,rays,rays_per_second_per_core\n";
+    std::vector<double> frameTimes;
+    uint64_t totalRays = 0;
+    double totalSeconds = 0.0;
+    uint32_t threads = 0;
+    // Sum of the passes of the wavefront mode
+    CpuTracer::Stats passes{};
+    std::vector<uint8_t> pixels;
+    for (uint32_t i = 0; i < poses.size(); i++)
+    {
+        cam.setPosition(poses[i].position);
+        cam.setDir(poses[i].direction);
+        const CpuTracer::Stats stats = tracer.render(cam.getData(), width, height, tracerSettings, pixels);
+        frameTimes.push_back(stats.seconds * 1000.0);
+        totalRays += stats.rays;
+        totalSeconds += stats.seconds;
+        threads = stats.threads;
+        passes.traversalSeconds += stats.traversalSeconds;
+        passes.compactionSeconds += stats.compactionSeconds;
+        passes.sortSeconds += stats.sortSeconds;
+        passes.shadowSeconds += stats.shadowSeconds;
+        passes.shadingSeconds += stats.shadingSeconds;
+        passes.shadowRays += stats.shadowRays;
+        timings << i << ',' << stats.seconds * 1000.0 << ',' << stats.rays << ',' << stats.getRaysPerSecondPerCore() << '\n';
+
+        char frameName[32];
+        snprintf(frameName, sizeof(frameName), "frame_%05u.png", i);
+        const std::string framePath = (settings.outputDir / frameName).string();
+        if (stbi_write_png(framePath.c_str(), static_cast<int>(width), static_cast<int>(height), 4, pixels.data(), static_cast<int>(width * 4)) == 0)
+            throw std::runtime_error("could not write frame " + framePath);
+    }
+
+    std::sort(frameTimes.begin(), frameTimes.end());
+    const CpuTracer::Stats total{ totalRays, totalSeconds, threads };
+    std::ostringstream summary;
+    summary << "frames: " << poses.size() << "\n"
+        << "resolution: " << width << "x" << height << "\n"
+        << "threads: " << threads << "\n"
+        << "simd width: " << SIMD_WIDTH << "\n"
+        << "temporal: " << (settings.temporal ? "yes" : "no") << "\n"
+        << "p50 ms: " << getPercentile(frameTimes, 50.0) << "\n"
+        << "p95 ms: " << getPercentile(frameTimes, 95.0) << "\n"
+        << "p99 ms: " << getPercentile(frameTimes, 99.0) << "\n"
+        << "mean ms: " << totalSeconds * 1000.0 / static_cast<double>(poses.size()) << "\n"
+        << "rays per frame: " << static_cast<double>(totalRays) / static_cast<double>(poses.size()) << "\n"
+        << "rays per second: " << total.getRaysPerSecond() << "\n"
+        << "rays per second per core: " << total.getRaysPerSecondPerCore() << "\n";
+    const double frameCount = static_cast<double>(poses.size());
+    if (tracerSettings.wavefront)
+    {
+        summary << "wavefront: " << (tracerSettings.sortShadowRays ? "sorted" : "unsorted") << "\n"
+            << "traversal ms: " << passes.traversalSeconds * 1000.0 / frameCount << "\n"
+            << "compaction ms: " << passes.compactionSeconds * 1000.0 / frameCount << "\n"
+            << "sort ms: " << passes.sortSeconds * 1000.0 / frameCount << "\n"
+            << "shadow ms: " << passes.shadowSeconds * 1000.0 / frameCount << "\n"
+            << "shading ms: " << passes.shadingSeconds * 1000.0 / frameCount << "\n"
+            << "shadow rays per frame: " << static_cast<double>(passes.shadowRays) / frameCount << "\n";
+    }
+    std::ofstream(settings.outputDir / "summary.txt") << summary.str();
+
+    LOG_INFO("Frame times: p50 ", getPercentile(frameTimes, 50.0), "ms, p95 ", getPercentile(frameTimes, 95.0), "ms, p99 ", getPercentile(frameTimes, 99.0), "ms");
+    LOG_INFO("Rays per second per core: ", total.getRaysPerSecondPerCore(), " (", threads, " threads)");
+    if (tracerSettings.wavefront)
+        LOG_INFO("Mean passes: traversal ", passes.traversalSeconds * 1000.0 / frameCount, "ms, compaction ", passes.compactionSeconds * 1000.0 / frameCount,
+            "ms, sort ", passes.sortSeconds * 1000.0 / frameCount, "ms, shadow ", passes.shadowSeconds * 1000.0 / frameCount,
+            "ms, shading ", passes.shadingSeconds * 1000.0 / frameCount, "ms");
+    LOG_INFO("Frames and timings written to ", settings.outputDir.string());
+    Logger::popContext();
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "scene_loader.hpp"
+#include "Tracer/cpu_tracer.hpp"
+
+struct HeadlessSettings
+{
+    std::string cameraPath;
+    // Frames and reports are written here, the directory is created if it doesn't exist
+    std::filesystem::path outputDir = "frames";
+    // The camera projection is always 16:9, the height follows from the width
+    uint32_t width = 1280;
+    // Traces half of the pixels of each frame and reprojects the rest from the frame before, the first frame is traced in full
+    bool temporal = false;
+    CpuTracer::Settings tracer{};
+};
+
+// HEADLESS RENDERING
+
+// Plays back a camera path with the CPU tracer, without a window or a GPU. Every pose is rendered to frame_<n>.png and
+// timed, the times go to timings.csv and the 50th, 95th and 99th percentiles to the log and summary.txt
+// Only the tracing is timed, so builds of the same octree can be compared on the same machine
+void runHeadless(const Octree& octree, const SceneSettings& scene, const HeadlessSettings& settings);
@@ -1,15 +1,16 @@
+#include <cstring>
 #include <iostream>
 
+#ifndef HEADLESS_ONLY
 #include "engine.hpp"
+#endif
 #include "utils/logger.hpp"
 
-#include "Octree/octree.hpp"
-#include "Octree/voxelizer.hpp"
+#include "headless.hpp"
+#include "scene_loader.hpp"
 
 //#define EXIT_ON_NO_ARGS
 
-#define PARALLEL_VOXELIZATION
-
 #ifdef EXIT_ON_NO_ARGS
 // Default values for release
 std::string loadPath = "assets/octree.bin";
@@ -19,6 +20,24 @@ uint8_t depth = 11;
 bool loadFlag = false;
 bool voxelizeFlag = false;
 bool saveFlag = false;
+bool rasterFlag = false;
+Voxelizer::Separability separability = Voxelizer::Separability::SEPARATING_6;
+bool solidFlag = false;
+bool areaFilterFlag = false;
+float adaptiveTolerance = 0.0f;
+Voxelizer::ColorBaking colorBaking = Voxelizer::ColorBaking::NONE;
+bool proceduralFlag = false;
+std::string proceduralScene = "sphere";
+size_t outOfCoreLimit = 0;
+TextureCompression textureCompression = TextureCompression::BC;
+size_t octreeMemoryLimit = 0;
+bool headlessFlag = false;
+std::string cameraPathFile = "camera_path.txt";
+std::string outputDir = "frames";
+uint32_t frameWidth = 1280;
+bool temporalFlag = false;
+bool wavefrontFlag = false;
+bool sortShadowRaysFlag = true;
 #else
 // Values to use when executing from IDE
 std::string loadPath = "assets/octree.bin";
@@ -28,6 +47,24 @@ uint8_t depth = 12;
 bool loadFlag = false;
 bool voxelizeFlag = !loadFlag;
 bool saveFlag = true;
+bool rasterFlag = false;
+Voxelizer::Separability separability = Voxelizer::Separability::SEPARATING_6;
+bool solidFlag = false;
+bool areaFilterFlag = false;
+float adaptiveTolerance = 0.0f;
+Voxelizer::ColorBaking colorBaking = Voxelizer::ColorBaking::NONE;
+bool proceduralFlag = false;
+std::string proceduralScene = "sphere";
+size_t outOfCoreLimit = 0;
+TextureCompression textureCompression = TextureCompression::BC;
+size_t octreeMemoryLimit = 0;
+bool headlessFlag = false;
+std::string cameraPathFile = "camera_path.txt";
+std::string outputDir = "frames";
+uint32_t frameWidth = 1280;
+bool temporalFlag = false;
+bool wavefrontFlag = false;
+bool sortShadowRaysFlag = true;
 #endif
 
 void printHelpAndExit()
@@ -37,7 +74,21 @@ void printHelpAndExit()
         << "  -d <depth>          Set the depth of the octree, ignored if -l is added\n"
         << "  -m <path>           Load model from file, ignored if -l is added\n"
         << "  -s <path>           Save octree to file, ignored if -m is not added or if -l is added\n"
-        << "  -l <path>           Load octree from file\n";
+        << "  -l <path>           Load octree from file\n"
+        << "  -r <6|26>           Voxelize by rasterizing triangles with 6 or 26 separability, ignored if -l is added\n"
+        << "  -v <surface|solid>  Voxelize only the surface or also fill the interior of watertight models, ignored if -l or -r are added\n"
+        << "  -f <closest|area>   Take the leaf attributes from the closest triangle or average all triangles by covered area, ignored if -l or -r are added\n"
+        << "  -a <tolerance>      Stop subdividing flat surfaces once the error is below the tolerance (in voxels of the max depth), ignored if -l, -r or -p are added\n"
+        << "  -c <none|diffuse|specular>  Bake the texture colors into the voxels so textures are not needed at runtime, ignored if -l is added\n"
+        << "  -p <scene>          Generate a procedural scene (sphere, csg, terrain, noise or a heightmap image) instead of a model, ignored if -l is added\n"
+        << "  -o <megabytes>      Voxelize out of core, streaming the model through buckets on disk to stay below the memory limit, ignored if -l, -r or -p are added\n"
+        << "  -t <none|bc|bc7>    Block compress the textures with BC1/BC3 or BC7, they are cached next to the octree file\n"
+        << "  -g <megabytes>      Keep at most this much of the octree on the GPU, the rest is streamed in as the camera moves\n"
+        << "  -b <path>           Play back a recorded camera path with the CPU tracer instead of opening a window\n"
+        << "  -w <directory>      Write the frames and timings of -b to this directory (frames by default)\n"
+        << "  -x <width>          Width of the frames of -b, the height keeps the 16:9 aspect of the camera\n"
+        << "  -e <full|temporal|wavefront|wavefront-unsorted>  Trace every pixel of the frames of -b, half of them and reproject the rest from the\n"
+        << "                      previous frame, or every pixel with shadows in wavefront passes with the shadow rays sorted or in pixel order\n";
     exit(EXIT_SUCCESS);
 }
 
@@ -82,6 +133,119 @@ void parseCommands(const int argc, char* argv[])
             loadPath = argv[i + 1];
             loadFlag = true;
         }
+        else if (strcmp(argv[i], "-r") == 0)
+        {
+            rasterFlag = true;
+            if (strcmp(argv[i + 1], "26") == 0)
+                separability = Voxelizer::Separability::SEPARATING_26;
+            else if (strcmp(argv[i + 1], "6") != 0)
+                LOG_WARN("Invalid separability value, using default value of 6");
+        }
+        else if (strcmp(argv[i], "-v") == 0)
+        {
+            if (strcmp(argv[i + 1], "solid") == 0)
+                solidFlag = true;
+            else if (strcmp(argv[i + 1], "surface") != 0)
+                LOG_WARN("Invalid voxelization mode, using default value of surface");
+        }
+        else if (strcmp(argv[i], "-f") == 0)
+        {
+            if (strcmp(argv[i + 1], "area") == 0)
+                areaFilterFlag = true;
+            else if (strcmp(argv[i + 1], "closest") != 0)
+                LOG_WARN("Invalid leaf filtering mode, using default value of closest");
+        }
+        else if (strcmp(argv[i], "-a") == 0)
+        {
+            try
+            {
+                adaptiveTolerance = std::stof(argv[i + 1]);
+            }
+            catch (const std::exception&)
+            {
+                LOG_WARN("Invalid adaptive depth tolerance, subdividing every surface to the maximum depth");
+            }
+        }
+        else if (strcmp(argv[i], "-p") == 0)
+        {
+            proceduralScene = argv[i + 1];
+            proceduralFlag = true;
+            voxelizeFlag = true;
+        }
+        else if (strcmp(argv[i], "-o") == 0)
+        {
+            try
+            {
+                outOfCoreLimit = static_cast<size_t>(std::stoull(argv[i + 1])) << 20;
+            }
+            catch (const std::exception&)
+            {
+                LOG_WARN("Invalid memory limit, voxelizing in memory");
+            }
+        }
+        else if (strcmp(argv[i], "-t") == 0)
+        {
+            if (strcmp(argv[i + 1], "none") == 0)
+                textureCompression = TextureCompression::NONE;
+            else if (strcmp(argv[i + 1], "bc7") == 0)
+                textureCompression = TextureCompression::BC7;
+            else if (strcmp(argv[i + 1], "bc") != 0)
+                LOG_WARN("Invalid texture compression, using default value of bc");
+        }
+        else if (strcmp(argv[i], "-g") == 0)
+        {
+            try
+            {
+                octreeMemoryLimit = static_cast<size_t>(std::stoull(argv[i + 1])) << 20;
+            }
+            catch (const std::exception&)
+            {
+                LOG_WARN("Invalid GPU memory limit, keeping the whole octree on the GPU");
+            }
+        }
+        else if (strcmp(argv[i], "-b") == 0)
+        {
+            cameraPathFile = argv[i + 1];
+            headlessFlag = true;
+        }
+        else if (strcmp(argv[i], "-w") == 0)
+        {
+            outputDir = argv[i + 1];
+        }
+        else if (strcmp(argv[i], "-x") == 0)
+        {
+            try
+            {
+                frameWidth = static_cast<uint32_t>(std::stoul(argv[i + 1]));
+            }
+            catch (const std::exception&)
+            {
+                LOG_WARN("Invalid frame width, using default value of ", frameWidth);
+            }
+        }
+        else if (strcmp(argv[i], "-e") == 0)
+        {
+            if (strcmp(argv[i + 1], "temporal") == 0)
+                temporalFlag = true;
+            else if (strcmp(argv[i + 1], "wavefront") == 0)
+                wavefrontFlag = true;
+            else if (strcmp(argv[i + 1], "wavefront-unsorted") == 0)
+            {
+                wavefrontFlag = true;
+                sortShadowRaysFlag = false;
+            }
+            else if (strcmp(argv[i + 1], "full") != 0)
+                LOG_WARN("Invalid tracing mode, using default value of full");
+        }
+        else if (strcmp(argv[i], "-c") == 0)
+        {
+            if (strcmp(argv[i + 1], "diffuse") == 0)
+                colorBaking = Voxelizer::ColorBaking::DIFFUSE;
+            else if (strcmp(argv[i + 1], "specular") == 0)
+                colorBaking = Voxelizer::ColorBaking::DIFFUSE_SPECULAR;
+            else if (strcmp(argv[i + 1], "none") != 0)
+                LOG_WARN("Invalid color baking mode, using default value of none");
+        }
     }
     if (loadFlag && (saveFlag || voxelizeFlag))
     {
@@ -107,6 +271,41 @@ void parseCommands(const int argc, char* argv[])
     {
         LOG_WARN("No depth provided, using default value of ", depth);
     }
+    if (proceduralFlag && rasterFlag)
+    {
+        LOG_WARN("Procedural scenes are not rasterized, ignoring raster flag");
+        rasterFlag = false;
+    }
+    if (solidFlag && rasterFlag)
+    {
+        LOG_WARN("Solid voxelization is not supported by the rasterizer, ignoring solid flag");
+        solidFlag = false;
+    }
+    if (adaptiveTolerance > 0.0f && (rasterFlag || proceduralFlag))
+    {
+        LOG_WARN("Adaptive depth only works with the traversal over a model, ignoring tolerance");
+        adaptiveTolerance = 0.0f;
+    }
+    if (outOfCoreLimit != 0 && (rasterFlag || proceduralFlag))
+    {
+        LOG_WARN("Out of core voxelization only works with the traversal over a model, ignoring memory limit");
+        outOfCoreLimit = 0;
+    }
+    if (outOfCoreLimit != 0 && solidFlag)
+    {
+        LOG_WARN("Solid voxelization needs the whole model for the parity test, ignoring solid flag");
+        solidFlag = false;
+    }
+    if (outOfCoreLimit != 0 && colorBaking != Voxelizer::ColorBaking::NONE)
+    {
+        LOG_WARN("Color baking is not supported out of core, ignoring color baking");
+        colorBaking = Voxelizer::ColorBaking::NONE;
+    }
+    if (headlessFlag && octreeMemoryLimit != 0)
+    {
+        LOG_WARN("The CPU tracer keeps the whole octree in memory, ignoring GPU memory limit");
+        octreeMemoryLimit = 0;
+    }
     if (voxelizeFlag && !saveFlag)
     {
         LOG_WARN("No save path provided, octree will be lost on exit");
@@ -126,48 +325,59 @@ int main(const int argc, char* argv[])
 #endif
 
         Logger::setRootContext("Octree init");
-        Octree octree{ depth };
-        
+        // The octree is built by the scene loader, the same one the engine uses to switch scenes at runtime
+        SceneSettings settings;
         if (loadFlag)
+            settings.loadPath = loadPath;
+        if (saveFlag)
+            settings.savePath = savePath;
+        settings.modelPath = modelPath;
+        settings.depth = depth;
+        settings.procedural = proceduralFlag;
+        settings.proceduralScene = proceduralScene;
+        settings.raster = rasterFlag;
+        settings.separability = separability;
+        settings.solid = solidFlag;
+        settings.areaFilter = areaFilterFlag;
+        settings.adaptiveTolerance = adaptiveTolerance;
+        settings.colorBaking = colorBaking;
+        settings.outOfCoreLimit = outOfCoreLimit;
+        // Textures are downscaled, get their mips and are compressed once, the results are cached next to the octree file
+        // Without an octree file they go to the system temporary directory instead
+        settings.textureCompression = textureCompression;
+        // The octree is split into pages, only as many as fit in the limit are on the GPU at once
+        settings.octreeMemoryLimit = octreeMemoryLimit;
+        std::unique_ptr<Octree> octree = SceneLoader::buildOctree(settings);
+
+        // Without a window the camera path is rendered on the CPU, the engine and Vulkan are never initialized
+        if (headlessFlag)
         {
-            octree.load(loadPath);
-            depth = octree.getDepth();
-        }
-        else if (voxelizeFlag)
-        {
-            // The octree is kept independent from the voxelizer, because maybe you want to generate an octree
-            // that is not voxelizing a model, like a procedural octree or one that voxelizes a mathematical function
-            // The octree requests a function (ProcessFunc or ParallelProcessFunc) that will be called for each node.
-            // This function is supposed to say if a node exists or not given an AABB shape and other metadata.
-            // It is also responsible for setting the leaf data, if the node is a leaf.
-            // It also accepts a void pointer that can be used to pass data to the function.
-            Voxelizer voxelizer{ modelPath, depth };
-#ifdef PARALLEL_VOXELIZATION
-            octree.generateParallel(voxelizer.getModelAABB(), Voxelizer::parallelVoxelize, &voxelizer);
-#else
-            octree.generate(voxelizer.getModelAABB(), Voxelizer::voxelize, &voxelizer);
-#endif
-            // Material data is stored separately in the octree, since voxels contain material IDs that point to the specific material
-            // Materials will also point to different images, the octree stores the paths and resolves the map IDs in the material
-            octree.setMaterialPath(voxelizer.getMaterialFilePath());
-            for (const Material& mat : voxelizer.getMaterials())
-                octree.addMaterial(mat.toOctreeMaterial(), mat.diffuseMap, mat.normalMap, mat.specularMap);
-            // Optionally, all octree data can be dumped. This is a very simple binary dump but it stores all necessary data and some statistics of the octree
-            if (saveFlag)
-                octree.dump(savePath);
+            HeadlessSettings headless;
+            headless.cameraPath = cameraPathFile;
+            headless.outputDir = outputDir;
+            headless.width = frameWidth;
+            headless.temporal = temporalFlag;
+            // The wavefront passes are there to trace the shadow rays apart, so they turn shadows on
+            headless.tracer.wavefront = wavefrontFlag;
+            headless.tracer.shadows = wavefrontFlag;
+            headless.tracer.sortShadowRays = sortShadowRaysFlag;
+            runHeadless(*octree, settings, headless);
+            return EXIT_SUCCESS;
         }
 
-        // Called to generate a possible sample material if none are provided (as safeguard) and to finalize some statistics
-        // This is not necessary, but it is recommended to call it before packing the octree
-        octree.packAndFinish();
-
+#ifdef HEADLESS_ONLY
+        // Built without SDL and Vulkan (CMakeLists.txt), there is no window to open
+        LOG_ERR("This build has no window, a camera path has to be played back with -b");
+        return EXIT_FAILURE;
+#else
         // The engine initializes all Vulkan resources using VkPlayground (https://github.com/AsperTheDog/VkPlayground)
-        Engine engine{ static_cast<uint32_t>(octree.getMaterialTextures().size()), depth };
+        Engine engine{};
 
         Logger::setRootContext("Engine context init");
         // Send the octree and textures to the GPU
-        engine.configureOctreeBuffer(octree, 100.0f);
+        engine.configureOctreeBuffer(std::move(octree), settings, 100.0f);
         engine.run();
+#endif
 
 #ifndef _DEBUG
     }
@@ -0,0 +1,207 @@
+#include "raw_image.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static uint32_t findMemoryType(VulkanDevice& device, const uint32_t typeBits, const VkMemoryPropertyFlags properties, const VkMemoryPropertyFlags fallback)
+{
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(*device.getGPU(), &memoryProperties);
+    for (const VkMemoryPropertyFlags flags : { properties, fallback })
+    {
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+        {
+            if ((typeBits & (1u << i)) != 0 && (memoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+                return i;
+        }
+    }
+    throw std::runtime_error("no memory type fits the raw image or buffer");
+}
+
+static void checkResult(const VkResult result, const char* what)
+{
+    if (result != VK_SUCCESS)
+        throw std::runtime_error(std::string("failed to ") + what + " (VkResult " + std::to_string(result) + ")");
+}
+
+RawImage createRawImage(VulkanDevice& device, const VkFormat format, const VkExtent2D extent, const VkImageUsageFlags usage, const uint32_t mipCount, const uint32_t layers, const std::span<const uint32_t> queueFamilies)
+{
+    std::vector<uint32_t> families{ queueFamilies.begin(), queueFamilies.end() };
+    std::ranges::sort(families);
+    families.erase(std::ranges::unique(families).begin(), families.end());
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = { extent.width, extent.height, 1 };
+    imageInfo.mipLevels = mipCount;
+    imageInfo.arrayLayers = layers;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = usage;
+    imageInfo.sharingMode = families.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.queueFamilyIndexCount = families.size() > 1 ? static_cast<uint32_t>(families.size()) : 0;
+    imageInfo.pQueueFamilyIndices = families.size() > 1 ? families.data() : nullptr;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    RawImage image;
+    image.mipCount = mipCount;
+    image.layers = layers;
+    checkResult(vkCreateImage(*device, &imageInfo, nullptr, &image.image), "create raw image");
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(*device, image.image, &requirements);
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = requirements.size;
+    allocInfo.memoryTypeIndex = findMemoryType(device, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+    const VkResult allocResult = vkAllocateMemory(*device, &allocInfo, nullptr, &image.memory);
+    if (allocResult != VK_SUCCESS)
+    {
+        freeRawImage(device, image);
+        checkResult(allocResult, "allocate raw image memory");
+    }
+    vkBindImageMemory(*device, image.image, image.memory, 0);
+    image.size = requirements.size;
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    viewInfo.format = format;
+    viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipCount, 0, layers };
+    const VkResult viewResult = vkCreateImageView(*device, &viewInfo, nullptr, &image.view);
+    if (viewResult != VK_SUCCESS)
+    {
+        freeRawImage(device, image);
+        checkResult(viewResult, "create raw image view");
+    }
+    return image;
+}
+
+void freeRawImage(VulkanDevice& device, RawImage& image)
+{
+    if (image.view != VK_NULL_HANDLE)
+        vkDestroyImageView(*device, image.view, nullptr);
+    if (image.image != VK_NULL_HANDLE)
+        vkDestroyImage(*device, image.image, nullptr);
+    if (image.memory != VK_NULL_HANDLE)
+        vkFreeMemory(*device, image.memory, nullptr);
+    image = RawImage{};
+}
+
+void cmdRawImageLayout(const VkCommandBuffer commandBuffer, const RawImage& image, const VkImageLayout oldLayout, const VkImageLayout newLayout,
+                       const VkPipelineStageFlags srcStages, const VkAccessFlags srcAccess, const VkPipelineStageFlags dstStages, const VkAccessFlags dstAccess)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image.image;
+    barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, image.mipCount, 0, image.layers };
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+ImmediateCommands::ImmediateCommands(VulkanDevice& device, const QueueSelection queue)
+    : m_device(device), m_queue(*device.getQueue(queue))
+{
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queue.familyIndex;
+    checkResult(vkCreateCommandPool(*m_device, &poolInfo, nullptr, &m_commandPool), "create command pool");
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = m_commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    const VkResult result = vkAllocateCommandBuffers(*m_device, &allocInfo, &m_commandBuffer);
+    if (result != VK_SUCCESS)
+    {
+        vkDestroyCommandPool(*m_device, m_commandPool, nullptr);
+        checkResult(result, "allocate command buffer");
+    }
+}
+
+ImmediateCommands::~ImmediateCommands()
+{
+    freeStaging();
+    vkDestroyCommandPool(*m_device, m_commandPool, nullptr);
+}
+
+VkCommandBuffer ImmediateCommands::begin()
+{
+    vkResetCommandBuffer(m_commandBuffer, 0);
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    checkResult(vkBeginCommandBuffer(m_commandBuffer, &beginInfo), "begin command buffer");
+    return m_commandBuffer;
+}
+
+void ImmediateCommands::submit()
+{
+    checkResult(vkEndCommandBuffer(m_commandBuffer), "end command buffer");
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &m_commandBuffer;
+    checkResult(vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE), "submit immediate commands");
+    checkResult(vkQueueWaitIdle(m_queue), "wait for immediate commands");
+}
+
+void* ImmediateCommands::mapStaging(const VkDeviceSize size)
+{
+    if (size <= m_stagingSize)
+        return m_stagingPtr;
+    freeStaging();
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    checkResult(vkCreateBuffer(*m_device, &bufferInfo, nullptr, &m_stagingBuffer), "create staging buffer");
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(*m_device, m_stagingBuffer, &requirements);
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = requirements.size;
+    const VkMemoryPropertyFlags hostFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    allocInfo.memoryTypeIndex = findMemoryType(m_device, requirements.memoryTypeBits, hostFlags, hostFlags);
+    const VkResult result = vkAllocateMemory(*m_device, &allocInfo, nullptr, &m_stagingMemory);
+    if (result != VK_SUCCESS)
+    {
+        freeStaging();
+        checkResult(result, "allocate staging memory");
+    }
+    vkBindBufferMemory(*m_device, m_stagingBuffer, m_stagingMemory, 0);
+    checkResult(vkMapMemory(*m_device, m_stagingMemory, 0, VK_WHOLE_SIZE, 0, &m_stagingPtr), "map staging memory");
+    m_stagingSize = size;
+    return m_stagingPtr;
+}
+
+void ImmediateCommands::freeStaging()
+{
+    if (m_stagingMemory != VK_NULL_HANDLE)
+    {
+        if (m_stagingPtr != nullptr)
+            vkUnmapMemory(*m_device, m_stagingMemory);
+        vkFreeMemory(*m_device, m_stagingMemory, nullptr);
+    }
+    if (m_stagingBuffer != VK_NULL_HANDLE)
+        vkDestroyBuffer(*m_device, m_stagingBuffer, nullptr);
+    m_stagingBuffer = VK_NULL_HANDLE;
+    m_stagingMemory = VK_NULL_HANDLE;
+    m_stagingSize = 0;
+    m_stagingPtr = nullptr;
+}
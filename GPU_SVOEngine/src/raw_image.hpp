@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <span>
+
+#include "vulkan_device.hpp"
+#include "vulkan_queues.hpp"
+
+// RAW IMAGES
+
+// Images with several mips or layers. VulkanImage always has one of each, so these are made directly with Vulkan
+// The view covers every mip and layer as a 2D array, the shaders index the layer
+struct RawImage
+{
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    uint32_t mipCount = 1;
+    uint32_t layers = 1;
+};
+
+// Device local memory if there is any that fits. The image is shared by the given queue families, it can be written on one and read on another
+[[nodiscard]] RawImage createRawImage(VulkanDevice& device, VkFormat format, VkExtent2D extent, VkImageUsageFlags usage, uint32_t mipCount, uint32_t layers, std::span<const uint32_t> queueFamilies);
+// Does nothing for an image that was never created. The GPU must be done with it
+void freeRawImage(VulkanDevice& device, RawImage& image);
+// Layout change of every mip and layer of the image
+void cmdRawImageLayout(VkCommandBuffer commandBuffer, const RawImage& image, VkImageLayout oldLayout, VkImageLayout newLayout,
+                       VkPipelineStageFlags srcStages, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess);
+
+// IMMEDIATE COMMANDS
+
+// A command buffer of its own on one queue and a host visible buffer to copy from, for the raw images
+// Each submit waits for the queue, like the one time queue of the device does
+class ImmediateCommands
+{
+public:
+    ImmediateCommands(VulkanDevice& device, QueueSelection queue);
+    ~ImmediateCommands();
+    ImmediateCommands(const ImmediateCommands&) = delete;
+    ImmediateCommands& operator=(const ImmediateCommands&) = delete;
+
+    [[nodiscard]] VkCommandBuffer begin();
+    void submit();
+
+    // The buffer grows to the size if it is smaller. The pointer is valid until the next call, the data must not be in use by a submit
+    [[nodiscard]] void* mapStaging(VkDeviceSize size);
+    [[nodiscard]] VkBuffer getStagingBuffer() const { return m_stagingBuffer; }
+
+private:
+    void freeStaging();
+
+    VulkanDevice& m_device;
+    VkQueue m_queue;
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+    VkBuffer m_stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_stagingMemory = VK_NULL_HANDLE;
+    VkDeviceSize m_stagingSize = 0;
+    void* m_stagingPtr = nullptr;
+};
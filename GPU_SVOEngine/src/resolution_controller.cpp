@@ -0,0 +1,69 @@
+#include "resolution_controller.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+ResolutionController::ResolutionController(const ResolutionSettings& settings)
+    : m_scale(1.0f)
+{
+    setSettings(settings);
+    m_scale = m_settings.maxScale;
+}
+
+float ResolutionController::update(float frameMs)
+{
+    if (!(frameMs > 0.0f))
+        return m_scale;
+    if (!m_hasAverage)
+    {
+        m_averageMs = frameMs;
+        m_hasAverage = true;
+    }
+    const bool hitch = frameMs > m_averageMs * m_settings.spikeLimit;
+    m_hitchFrames = hitch ? m_hitchFrames + 1 : 0;
+    if (hitch && m_hitchFrames <= m_settings.maxHitches)
+        return m_scale;
+    frameMs = std::min(frameMs, m_averageMs * m_settings.spikeLimit);
+    m_averageMs += (frameMs - m_averageMs) * m_settings.smoothing;
+    m_framesSinceChange++;
+
+    const float target = m_settings.targetMs;
+    if (m_framesSinceChange <= m_settings.settleFrames || std::abs(m_averageMs - target) <= target * m_settings.hysteresis)
+        return m_scale;
+
+    // The scale the model expects to take the target time, limited to a step
+    const float ideal = m_scale * std::sqrt(target / std::max(m_averageMs, 0.001f));
+    const float step = ideal > m_scale ? m_settings.maxStep / 2.0f : m_settings.maxStep;
+    const float scale = std::clamp(std::clamp(ideal, m_scale - step, m_scale + step), m_settings.minScale, m_settings.maxScale);
+    if (scale == m_scale)
+        return m_scale;
+
+    // The average is moved to the new scale with the same model, so the next frames don't have to wash out the old ones
+    m_averageMs *= (scale * scale) / (m_scale * m_scale);
+    m_scale = scale;
+    m_framesSinceChange = 0;
+    return m_scale;
+}
+
+void ResolutionController::reset(const float scale)
+{
+    m_scale = std::clamp(scale, m_settings.minScale, m_settings.maxScale);
+    m_averageMs = 0.0f;
+    m_framesSinceChange = 0;
+    m_hitchFrames = 0;
+    m_hasAverage = false;
+}
+
+void ResolutionController::setSettings(const ResolutionSettings& settings)
+{
+    m_settings = settings;
+    m_settings.minScale = std::clamp(m_settings.minScale, 0.01f, 1.0f);
+    m_settings.maxScale = std::clamp(m_settings.maxScale, m_settings.minScale, 1.0f);
+    m_scale = std::clamp(m_scale, m_settings.minScale, m_settings.maxScale);
+}
+
+glm::uvec2 ResolutionController::getRenderSize(const glm::uvec2 screenSize, const float scale)
+{
+    const glm::vec2 size = glm::round(glm::vec2(screenSize) * scale);
+    return glm::clamp(glm::uvec2(size), glm::uvec2(1), glm::max(screenSize, glm::uvec2(1)));
+}
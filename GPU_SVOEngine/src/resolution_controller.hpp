@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// DYNAMIC RESOLUTION
+
+// Picks the fraction of the screen that is traced so the frame time stays at a target. It only sees frame times, so the
+// same controller drives the engine with GPU timestamps and can be tested with a made up feed
+// Tracing time is close to proportional to the pixel count, so a frame that took t ms at a scale s is expected to take
+// t * (s' / s)^2 at a scale s'. The scale is corrected with that model, the filtering and hysteresis deal with where it is wrong
+struct ResolutionSettings
+{
+    // A little under the 16.7 ms of a 60 Hz display, the CPU and the presentation need some room too
+    float targetMs = 15.0f;
+    // Bounds of the scale, the fraction of the width and of the height of the screen that is traced
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    // Weight of the newest frame in the running average of the frame times
+    float smoothing = 0.2f;
+    // Fraction of the target the average can be away from it before the scale changes
+    float hysteresis = 0.1f;
+    // Largest change of the scale in one step. Going up takes half steps, a frame over the target is a dropped frame
+    float maxStep = 0.1f;
+    // Frames after a change before the next one, the frames in flight were recorded at the old scale
+    uint32_t settleFrames = 3;
+    // Frames longer than this many times the average are hitches and are skipped, so a single one doesn't drop the resolution
+    float spikeLimit = 2.0f;
+    // A run of more hitches than this is the scene getting heavier. From then on they count, clipped to the spike limit
+    uint32_t maxHitches = 2;
+};
+
+class ResolutionController
+{
+public:
+    explicit ResolutionController(const ResolutionSettings& settings = {});
+
+    // Feeds the time of the last frame, rendered at the current scale, and returns the scale of the next one
+    float update(float frameMs);
+    // Drops the frame times seen so far, the next frame starts from this scale
+    void reset(float scale);
+
+    void setSettings(const ResolutionSettings& settings);
+    [[nodiscard]] const ResolutionSettings& getSettings() const { return m_settings; }
+    [[nodiscard]] float getScale() const { return m_scale; }
+    // Running average of the frame times, as if they were all rendered at the current scale
+    [[nodiscard]] float getAverageMs() const { return m_averageMs; }
+
+    // Pixels traced of a screen of the given size at a scale, never less than one
+    [[nodiscard]] static glm::uvec2 getRenderSize(glm::uvec2 screenSize, float scale);
+
+private:
+    ResolutionSettings m_settings;
+    float m_scale;
+    float m_averageMs = 0.0f;
+    uint32_t m_framesSinceChange = 0;
+    uint32_t m_hitchFrames = 0;
+    bool m_hasAverage = false;
+};
@@ -0,0 +1,211 @@
+#include "scene_loader.hpp"
+
+#include <stdexcept>
+
+#include "utils/logger.hpp"
+
+#include "Octree/out_of_core_voxelizer.hpp"
+#include "Octree/procedural.hpp"
+#include "Texture/texture_loader.hpp"
+
+// Processed textures are cached in this folder of the system temporary directory between runs if no other folder is set
+static constexpr const char* TEXTURE_CACHE_DIR = "GPU_SVOEngine_textures";
+
+// Keeps the processed images in memory instead of uploading them, the engine copies them to the GPU later
+// They are packed here already, so each image is processed to the size of the texture array it will end up in
+class SceneTextureSink final : public TextureUploadSink
+{
+public:
+    SceneTextureSink(Scene& scene, const uint32_t maxArrays, const uint32_t maxLayers) : m_scene(scene), m_maxArrays(maxArrays), m_maxLayers(maxLayers) {}
+
+    void prepare(const std::span<TextureDesc> images) override
+    {
+        m_scene.packing = packTextures(images, m_maxArrays, m_maxLayers);
+        m_scene.imageDescs.assign(images.begin(), images.end());
+        m_scene.images.resize(images.size());
+    }
+
+    void upload(const uint32_t image, DecodedTexture texture) override
+    {
+        m_scene.images[image] = std::move(texture);
+    }
+
+private:
+    Scene& m_scene;
+    uint32_t m_maxArrays;
+    uint32_t m_maxLayers;
+};
+
+std::filesystem::path SceneSettings::getTextureCacheDir() const
+{
+    if (!loadPath.empty())
+        return loadPath + ".textures";
+    if (!savePath.empty())
+        return savePath + ".textures";
+    return std::filesystem::temp_directory_path() / TEXTURE_CACHE_DIR;
+}
+
+SceneLoader::~SceneLoader()
+{
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+std::unique_ptr<Octree> SceneLoader::buildOctree(const SceneSettings& settings)
+{
+    std::unique_ptr<Octree> octree = std::make_unique<Octree>(settings.depth);
+
+    if (!settings.loadPath.empty())
+    {
+        octree->load(settings.loadPath);
+    }
+    else if (settings.procedural)
+    {
+        // Procedural scenes don't need a model, the source classifies whole nodes by itself and plugs directly into the octree
+        ProceduralScene scene = createProceduralScene(settings.proceduralScene);
+        scene.source->setSolid(settings.solid);
+#ifdef PARALLEL_VOXELIZATION
+        octree->generateParallel(scene.source->getBounds(), ProceduralSource::parallelProcess, scene.source.get());
+#else
+        octree->generate(scene.source->getBounds(), ProceduralSource::process, scene.source.get());
+#endif
+        for (const Octree::Material& mat : scene.materials)
+            octree->addMaterial(mat, "", "", "");
+        // Without textures nothing can cut a leaf out
+        octree->setLeafFlags(Octree::LEAF_OPAQUE);
+    }
+    else if (settings.outOfCoreLimit != 0)
+    {
+        // The model is never fully in memory, it is streamed into buckets on disk that are voxelized one at a time (one per thread)
+        OutOfCoreVoxelizer voxelizer{ settings.modelPath, settings.depth, settings.outOfCoreLimit };
+        voxelizer.setAreaFiltering(settings.areaFilter);
+        voxelizer.setAdaptiveDepth(settings.adaptiveTolerance);
+#ifdef PARALLEL_VOXELIZATION
+        octree->generateParallel(voxelizer.getModelAABB(), OutOfCoreVoxelizer::parallelVoxelize, &voxelizer);
+#else
+        octree->generate(voxelizer.getModelAABB(), OutOfCoreVoxelizer::voxelize, &voxelizer);
+#endif
+        octree->setMaterialPath(voxelizer.getMaterialFilePath());
+        for (const Material& mat : voxelizer.getMaterials())
+            octree->addMaterial(mat.toOctreeMaterial(), mat.diffuseMap, mat.normalMap, mat.specularMap);
+    }
+    else
+    {
+        // The octree is kept independent from the voxelizer, because maybe you want to generate an octree
+        // that is not voxelizing a model, like a procedural octree or one that voxelizes a mathematical function
+        // The octree requests a function (ProcessFunc or ParallelProcessFunc) that will be called for each node.
+        // This function is supposed to say if a node exists or not given an AABB shape and other metadata.
+        // It is also responsible for setting the leaf data, if the node is a leaf.
+        // It also accepts a void pointer that can be used to pass data to the function.
+        Voxelizer voxelizer{ settings.modelPath, settings.depth };
+        // Baking samples the textures on the CPU once per leaf, the leaves then store a color instead of a UV
+        voxelizer.setColorBaking(settings.colorBaking);
+        // The rasterizer skips the traversal entirely, it generates the leaves directly and the octree is built from them
+        if (settings.raster)
+            octree->generateFromLeaves(voxelizer.rasterize(settings.depth, settings.separability));
+        else
+        {
+            // Solid voxelization fills the inside of the model, nodes that are completely inside collapse into a single leaf
+            voxelizer.setSolid(settings.solid);
+            // Area filtering averages the normal of every triangle in the leaf, which gives smoother shading at lower depths
+            voxelizer.setAreaFiltering(settings.areaFilter);
+            // Adaptive depth turns flat regions into bigger leaves instead of subdividing them down to the maximum depth
+            voxelizer.setAdaptiveDepth(settings.adaptiveTolerance);
+#ifdef PARALLEL_VOXELIZATION
+            octree->generateParallel(voxelizer.getModelAABB(), Voxelizer::parallelVoxelize, &voxelizer);
+#else
+            octree->generate(voxelizer.getModelAABB(), Voxelizer::voxelize, &voxelizer);
+#endif
+        }
+        // Material data is stored separately in the octree, since voxels contain material IDs that point to the specific material
+        // Materials will also point to different images, the octree stores the paths and resolves the map IDs in the material
+        octree->setMaterialPath(voxelizer.getMaterialFilePath());
+        for (const Material& mat : voxelizer.getMaterials())
+            octree->addMaterial(mat.toOctreeMaterial(), mat.diffuseMap, mat.normalMap, mat.specularMap);
+        // The flags tell the engine how to read the leaves, they are stored in the octree file too
+        octree->setLeafFlags(voxelizer.getLeafFlags());
+    }
+
+    // Called to drop the materials and textures no voxel uses, generate a possible sample material if none are provided (as safeguard)
+    // and to finalize some statistics. This is not necessary, but it is recommended to call it before packing the octree
+    octree->packAndFinish();
+    // Optionally, all octree data can be dumped. This is a very simple binary dump but it stores all necessary data and some statistics of the octree
+    // It is dumped after pruning, so the file only keeps the materials and textures that are used
+    if (settings.loadPath.empty() && !settings.savePath.empty())
+        octree->dump(settings.savePath);
+    return octree;
+}
+
+std::unique_ptr<Scene> SceneLoader::buildScene(const SceneSettings& settings, const uint32_t maxTextureArrays, const uint32_t maxTextureLayers)
+{
+    std::unique_ptr<Scene> scene = std::make_unique<Scene>();
+    scene->octree = buildOctree(settings);
+    scene->pages = paginateOctree(*scene->octree);
+    // Octrees with baked colors carry the color in the leaves, so their textures are skipped
+    if ((scene->octree->getLeafFlags() & Octree::LEAF_BAKED_COLOR) == 0)
+    {
+        SceneTextureSink sink{ *scene, maxTextureArrays, maxTextureLayers };
+        TextureLoader loader{ settings.getTextureCacheDir(), TEXTURE_DECODE_BUDGET, settings.textureCompression };
+        scene->textureImages = loader.load(scene->octree->getMaterialTextures(), sink);
+    }
+    return scene;
+}
+
+bool SceneLoader::request(const SceneSettings& settings, const uint32_t maxTextureArrays, const uint32_t maxTextureLayers)
+{
+    if (m_busy)
+        return false;
+    // The previous thread is done but may not have been joined if its scene was never taken
+    if (m_thread.joinable())
+        m_thread.join();
+    {
+        std::lock_guard lock{ m_mutex };
+        m_scene.reset();
+        m_error.clear();
+    }
+    m_busy = true;
+    m_thread = std::thread(&SceneLoader::buildWorker, this, settings, maxTextureArrays, maxTextureLayers);
+    return true;
+}
+
+bool SceneLoader::isBusy() const
+{
+    return m_busy;
+}
+
+std::unique_ptr<Scene> SceneLoader::takeScene()
+{
+    if (m_busy || !m_thread.joinable())
+        return nullptr;
+    m_thread.join();
+
+    std::lock_guard lock{ m_mutex };
+    if (!m_error.empty())
+    {
+        const std::string error = std::move(m_error);
+        m_error.clear();
+        throw std::runtime_error(error);
+    }
+    return std::move(m_scene);
+}
+
+// Errors can't leave the thread, they are kept and thrown again by takeScene
+void SceneLoader::buildWorker(const SceneSettings settings, const uint32_t maxTextureArrays, const uint32_t maxTextureLayers)
+{
+    std::unique_ptr<Scene> scene;
+    std::string error;
+    try
+    {
+        scene = buildScene(settings, maxTextureArrays, maxTextureLayers);
+    }
+    catch (const std::exception& e)
+    {
+        error = e.what();
+    }
+    {
+        std::lock_guard lock{ m_mutex };
+        m_scene = std::move(scene);
+        m_error = std::move(error);
+    }
+    m_busy = false;
+}
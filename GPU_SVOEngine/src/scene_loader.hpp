@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Octree/octree.hpp"
+#include "Octree/octree_pager.hpp"
+#include "Octree/voxelizer.hpp"
+#include "Texture/texture_packer.hpp"
+
+// Voxelizes the model on every core instead of one
+#define PARALLEL_VOXELIZATION
+
+// Decoded images waiting to be collected can't take more than this, unless a single image is bigger
+// Shared by the textures of the scenes built here and the ones the engine loads and uploads itself
+inline constexpr size_t TEXTURE_DECODE_BUDGET = 512ULL * 1024 * 1024;
+
+// Where an octree comes from. An octree file is loaded if loadPath is set, otherwise the model (or procedural scene) is voxelized
+struct SceneSettings
+{
+    std::string loadPath;
+    std::string modelPath;
+    // Voxelized octrees are saved here if it is set
+    std::string savePath;
+    uint8_t depth = 11;
+    bool procedural = false;
+    std::string proceduralScene = "sphere";
+    bool raster = false;
+    Voxelizer::Separability separability = Voxelizer::Separability::SEPARATING_6;
+    bool solid = false;
+    bool areaFilter = false;
+    float adaptiveTolerance = 0.0f;
+    Voxelizer::ColorBaking colorBaking = Voxelizer::ColorBaking::NONE;
+    size_t outOfCoreLimit = 0;
+    TextureCompression textureCompression = TextureCompression::BC;
+    // GPU memory for the octree nodes, the pages that don't fit are streamed in and out as the camera moves. 0 keeps all of them resident
+    size_t octreeMemoryLimit = 0;
+
+    // Processed textures are cached next to the octree file, or in the system temporary directory if there is none
+    [[nodiscard]] std::filesystem::path getTextureCacheDir() const;
+};
+
+// An octree that is ready to be sent to the GPU, split into pages and with its textures already decoded, resized, with mips and compressed
+struct Scene
+{
+    std::unique_ptr<Octree> octree;
+    std::vector<OctreePage> pages;
+    // Descriptions after packing, packing them again with the same limits gives the same texture arrays
+    std::vector<TextureDesc> imageDescs;
+    TexturePacking packing;
+    std::vector<DecodedTexture> images;
+    // Image of each texture of the octree, textures with the same content share the image
+    std::vector<uint32_t> textureImages;
+};
+
+// SCENE LOADER
+
+// Builds scenes without touching the GPU. The engine uses it to prepare the next scene on a background thread
+// while the current one keeps rendering, then it only has to copy the result
+class SceneLoader
+{
+public:
+    ~SceneLoader();
+
+    // Loads or voxelizes the octree on the calling thread, then drops the unused materials and saves it if there is a save path
+    [[nodiscard]] static std::unique_ptr<Octree> buildOctree(const SceneSettings& settings);
+    // Builds and paginates the octree and decodes all of its textures on the calling thread, packed into texture arrays within the limits
+    [[nodiscard]] static std::unique_ptr<Scene> buildScene(const SceneSettings& settings, uint32_t maxTextureArrays, uint32_t maxTextureLayers);
+
+    // Starts building the scene on a background thread. Returns false if the previous one is not finished yet
+    bool request(const SceneSettings& settings, uint32_t maxTextureArrays, uint32_t maxTextureLayers);
+    [[nodiscard]] bool isBusy() const;
+    // Returns the scene once it is built and nullptr before that. Throws if it couldn't be built
+    [[nodiscard]] std::unique_ptr<Scene> takeScene();
+
+private:
+    void buildWorker(SceneSettings settings, uint32_t maxTextureArrays, uint32_t maxTextureLayers);
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::unique_ptr<Scene> m_scene;
+    std::string m_error;
+    std::atomic<bool> m_busy = false;
+};
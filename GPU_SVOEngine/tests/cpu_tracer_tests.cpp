@@ -0,0 +1,302 @@
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "glsl_shim.hpp"
+#include "scene_loader.hpp"
+#include "test_checks.hpp"
+#include "Octree/octree_pager.hpp"
+#include "Tracer/cpu_tracer.hpp"
+
+// SHADER TRAVERSAL
+
+// The OCTREE TRAVERSAL section of raytracing.frag, copied out of the shader by extract_traversal.cmake
+// Included once as the fragment shader, with the short stack, and once as the compute tiles, with the full stack
+#define MAX_OCTREE_DEPTH 16
+#define shared static
+#define gl_LocalInvocationIndex 0u
+namespace glsl::fragment
+{
+#include "raytracing_traversal.inl"
+}
+#define COMPUTE_TILES
+namespace glsl::compute
+{
+#include "raytracing_traversal.inl"
+}
+#undef COMPUTE_TILES
+#undef gl_LocalInvocationIndex
+#undef shared
+
+static const char* const SCENES[] = { "sphere", "csg", "terrain", "noise" };
+static constexpr uint8_t SCENE_DEPTH = 8;
+static constexpr float SCALE = 100.0f;
+
+static std::unique_ptr<Octree> buildScene(const char* name)
+{
+    SceneSettings settings;
+    settings.procedural = true;
+    settings.proceduralScene = name;
+    settings.depth = SCENE_DEPTH;
+    return SceneLoader::buildOctree(settings);
+}
+
+// Copies the pages to a pool laid out like the one of the engine, every page in the slot of its number
+// Pages smaller than OCTREE_PAGE_SIZE give far links at every few levels, the slots keep the stride of the shader
+static size_t loadPool(const Octree& octree)
+{
+    const std::vector<OctreePage> pages = paginateOctree(octree, 2048);
+    glsl::octree.assign(pages.size() * OCTREE_PAGE_SIZE, 0);
+    glsl::pageTable.resize(pages.size());
+    for (uint32_t page = 0; page < pages.size(); page++)
+    {
+        std::ranges::copy(pages[page].nodes, glsl::octree.begin() + page * OCTREE_PAGE_SIZE);
+        glsl::pageTable[page] = page;
+    }
+    // Without textures nothing is cut out, like a CpuTracer that loaded none
+    glsl::materials.assign(1024, glsl::Material{});
+    for (glsl::Material& material : glsl::materials)
+        material.diffuseMap = glsl::NO_TEXTURE;
+    glsl::leafFlags = octree.getLeafFlags();
+    glsl::octreeScale = SCALE;
+    return pages.size();
+}
+
+template<class Ray>
+static Ray makeRay(const glm::vec3 origin, const glm::vec3 direction, const float tStart)
+{
+    Ray ray{};
+    ray.origin = glsl::vec3(origin.x, origin.y, origin.z);
+    ray.direction = glsl::vec3(direction.x, direction.y, direction.z);
+    ray.invDirection = 1.0 / ray.direction;
+    ray.tStart = tStart;
+    return ray;
+}
+
+template<class A, class B>
+static bool sameCollision(const A& a, const B& b)
+{
+    if (a.hit != b.hit)
+        return false;
+    return !a.hit || (a.voxelIndex == b.voxelIndex && a.voxelSize == b.voxelSize && a.voxelPos.x == b.voxelPos.x && a.voxelPos.y == b.voxelPos.y &&
+                      a.voxelPos.z == b.voxelPos.z);
+}
+
+// The indices of CpuTracer are in its own copy of the nodes, the leaf is told apart by its box
+static bool sameHit(const glsl::fragment::Collision& a, const CpuTracer::Hit& b)
+{
+    if (a.hit != b.hit)
+        return false;
+    return !a.hit || (a.voxelSize == b.voxelSize && a.voxelPos.x == b.voxelPos.x && a.voxelPos.y == b.voxelPos.y && a.voxelPos.z == b.voxelPos.z);
+}
+
+struct TestRay
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float tStart;
+};
+
+// Rays from inside and around the octree, a quarter of them aimed at its center so most of the others don't just miss
+static std::vector<TestRay> makeRays(const uint32_t count, const uint32_t seed)
+{
+    std::mt19937 random{ seed };
+    std::uniform_real_distribution<float> unit{ -1.0f, 1.0f };
+    std::vector<TestRay> rays;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const glm::vec3 origin = glm::vec3(unit(random), unit(random), unit(random)) * (i % 2 == 0 ? 0.45f : 1.2f) * SCALE;
+        glm::vec3 direction{ unit(random), unit(random), unit(random) };
+        if (i % 4 == 0)
+            direction = -origin + direction * 0.2f * SCALE;
+        rays.push_back({ origin, glm::normalize(direction), i % 3 == 0 ? (unit(random) + 1.0f) * 0.2f * SCALE : 0.0f });
+    }
+    return rays;
+}
+
+// The short stack of the fragment shader, the full stack of the compute tiles and CpuTracer find the same leaf for every ray,
+// and the shadow traversal of the shader says a ray hits whenever they do
+static void testShaderTraversal(const char* name, const Octree& octree, const CpuTracer& tracer)
+{
+    const size_t pageCount = loadPool(octree);
+    CHECK(pageCount > 1);
+
+    uint32_t hits = 0;
+    uint32_t mismatches = 0;
+    for (const TestRay& test : makeRays(20000, 7))
+    {
+        auto fragmentRay = makeRay<glsl::fragment::Ray>(test.origin, test.direction, test.tStart);
+        auto computeRay = makeRay<glsl::compute::Ray>(test.origin, test.direction, test.tStart);
+        const uint32_t octant = glsl::fragment::getOctant(fragmentRay.direction);
+        const glsl::fragment::Collision collision = glsl::fragment::traceRay(fragmentRay, octant);
+        bool same = sameCollision(collision, glsl::compute::traceRay(computeRay, octant));
+        same = same && glsl::fragment::traceShadowRay(fragmentRay, octant) == collision.hit;
+        // CpuTracer::trace always starts at the origin
+        if (test.tStart == 0.0f)
+        {
+            same = same && sameHit(collision, tracer.trace(test.origin, test.direction, SCALE));
+            same = same && tracer.traceShadow(test.origin, test.direction, SCALE) == collision.hit;
+        }
+        hits += collision.hit ? 1 : 0;
+        mismatches += same ? 0 : 1;
+    }
+    if (mismatches != 0)
+        std::printf("%s: %u of the rays differ between the shader traversals and CpuTracer\n", name, mismatches);
+    CHECK(mismatches == 0);
+    CHECK(hits > 1000);
+
+    // With pages missing the traversals stop at the same link leaves
+    std::mt19937 random{ 11 };
+    for (uint32_t page = 1; page < pageCount; page++)
+        glsl::pageTable[page] = random() % 3 == 0 ? PAGE_NOT_RESIDENT : page;
+    mismatches = 0;
+    for (const TestRay& test : makeRays(20000, 13))
+    {
+        auto fragmentRay = makeRay<glsl::fragment::Ray>(test.origin, test.direction, test.tStart);
+        auto computeRay = makeRay<glsl::compute::Ray>(test.origin, test.direction, test.tStart);
+        const uint32_t octant = glsl::fragment::getOctant(fragmentRay.direction);
+        const glsl::fragment::Collision collision = glsl::fragment::traceRay(fragmentRay, octant);
+        const bool same = sameCollision(collision, glsl::compute::traceRay(computeRay, octant)) &&
+                          glsl::fragment::traceShadowRay(fragmentRay, octant) == collision.hit;
+        mismatches += same ? 0 : 1;
+    }
+    if (mismatches != 0)
+        std::printf("%s: %u of the rays differ between the shader traversals with missing pages\n", name, mismatches);
+    CHECK(mismatches == 0);
+}
+
+// IMAGES
+
+static constexpr uint32_t WIDTH = 160;
+static constexpr uint32_t HEIGHT = 90;
+
+struct Pose
+{
+    glm::vec3 position;
+    glm::vec3 direction;
+};
+
+// Outside the octree like the orbit of the headless test, and in a corner of its box
+static const Pose POSES[] = {
+    { { 80.0f, 40.0f, 0.0f }, { -0.894427f, -0.447214f, 0.0f } },
+    { { 45.0f, 45.0f, -45.0f }, { -1.0f, -1.0f, 1.0f } },
+};
+
+static std::vector<uint8_t> renderImage(const CpuTracer& tracer, const Pose& pose, const CpuTracer::Settings& settings)
+{
+    Camera camera{ pose.position, glm::normalize(pose.direction) };
+    camera.setScreenSize(WIDTH, HEIGHT);
+    std::vector<uint8_t> pixels;
+    (void)tracer.render(camera.getData(), WIDTH, HEIGHT, settings, pixels);
+    return pixels;
+}
+
+static void checkSameImage(const std::vector<uint8_t>& expected, const std::vector<uint8_t>& image, const std::string& what)
+{
+    CHECK(image.size() == expected.size());
+    uint32_t differing = 0;
+    for (size_t pixel = 0; pixel + 3 < std::min(image.size(), expected.size()); pixel += 4)
+        differing += std::equal(image.begin() + pixel, image.begin() + pixel + 4, expected.begin() + pixel) ? 0 : 1;
+    if (differing != 0)
+        std::printf("%s: %u pixels differ\n", what.c_str(), differing);
+    CHECK(differing == 0);
+}
+
+// Renders the view with the packets, then with every mode that claims to give the same image
+static std::vector<uint8_t> checkModes(const CpuTracer& tracer, const Pose& pose, const CpuTracer::Settings& settings, const std::string& what)
+{
+    const std::vector<uint8_t> expected = renderImage(tracer, pose, settings);
+
+    CpuTracer::Settings shortStack = settings;
+    shortStack.shortStack = true;
+    checkSameImage(expected, renderImage(tracer, pose, shortStack), what + " short stack");
+
+    CpuTracer::Settings computeTiles = settings;
+    computeTiles.computeTiles = true;
+    checkSameImage(expected, renderImage(tracer, pose, computeTiles), what + " compute tiles");
+
+    CpuTracer::Settings beam = settings;
+    beam.beamPrepass = true;
+    checkSameImage(expected, renderImage(tracer, pose, beam), what + " beam pre-pass");
+    return expected;
+}
+
+static CpuTracer::Settings getSettings(const bool shadows)
+{
+    CpuTracer::Settings settings;
+    settings.shadows = shadows;
+    settings.sunDirection = glm::normalize(glm::vec3(0.4f, 1.0f, 0.3f));
+    return settings;
+}
+
+static void testImages(const char* name, const CpuTracer& tracer)
+{
+    for (const bool shadows : { false, true })
+    {
+        for (uint32_t pose = 0; pose < std::size(POSES); pose++)
+        {
+            const std::string what = std::string(name) + " pose " + std::to_string(pose) + (shadows ? " with shadows" : "");
+            const std::vector<uint8_t> expected = checkModes(tracer, POSES[pose], getSettings(shadows), what);
+
+            // The scene is in view, not only the sky
+            std::set<uint32_t> colors;
+            for (size_t pixel = 0; pixel + 3 < expected.size(); pixel += 4)
+                colors.insert(expected[pixel] | expected[pixel + 1] << 8 | expected[pixel + 2] << 16);
+            CHECK(colors.size() > 16);
+        }
+    }
+}
+
+// RAYS THAT MISS THE OCTREE
+
+// Rays that pass the root box without entering it, just outside a face, an edge or a corner, or that start outside and point away
+// The intersection mask of the root would still give them a first child, every traversal has to stop before it
+static const TestRay MISSES[] = {
+    { { -100.0f, 51.0f, 0.0f }, { 1.0f, 0.0005f, 0.0003f }, 0.0f },
+    { { 0.0f, 102.0f, 0.0f }, { 1.0f, -1.0f, 0.001f }, 0.0f },
+    { { 0.0f, 103.0f, 1.0f }, { 1.0f, -1.0f, -1.0f }, 0.0f },
+    { { -60.0f, 0.0f, 0.0f }, { -1.0f, 0.1f, 0.2f }, 0.0f },
+    { { 60.0f, 60.0f, 60.0f }, { 0.3f, 0.2f, 0.9f }, 0.0f },
+    // Through the box, but everything in it is before the start
+    { { -60.0f, 0.1f, 0.2f }, { 1.0f, 0.001f, 0.002f }, 200.0f },
+};
+
+// Expects the pool of the octree to be loaded by testShaderTraversal
+static void testMisses(const char* name, const CpuTracer& tracer)
+{
+    for (const TestRay& miss : MISSES)
+    {
+        const glm::vec3 direction = glm::normalize(miss.direction);
+        auto fragmentRay = makeRay<glsl::fragment::Ray>(miss.origin, direction, miss.tStart);
+        auto computeRay = makeRay<glsl::compute::Ray>(miss.origin, direction, miss.tStart);
+        const uint32_t octant = glsl::fragment::getOctant(fragmentRay.direction);
+        CHECK(!glsl::fragment::traceRay(fragmentRay, octant).hit);
+        CHECK(!glsl::compute::traceRay(computeRay, octant).hit);
+        CHECK(!glsl::fragment::traceShadowRay(fragmentRay, octant));
+        if (miss.tStart == 0.0f)
+        {
+            CHECK(!tracer.trace(miss.origin, direction, SCALE).hit);
+            CHECK(!tracer.traceShadow(miss.origin, direction, SCALE));
+        }
+    }
+
+    // A camera outside the octree that looks away from it, the beam of every block misses the root
+    const Pose away{ { 80.0f, 40.0f, 0.0f }, { 0.894427f, 0.447214f, 0.0f } };
+    for (const bool shadows : { false, true })
+        (void)checkModes(tracer, away, getSettings(shadows), std::string(name) + " looking away" + (shadows ? " with shadows" : ""));
+}
+
+int main()
+{
+    for (const char* name : SCENES)
+    {
+        const std::unique_ptr<Octree> octree = buildScene(name);
+        const CpuTracer tracer{ *octree };
+        testShaderTraversal(name, *octree, tracer);
+        testMisses(name, tracer);
+        testImages(name, tracer);
+    }
+    return finishTests("cpu_tracer_tests");
+}
@@ -0,0 +1,24 @@
+# Copies the OCTREE TRAVERSAL section of raytracing.frag to a file C++ can include with glsl_shim.hpp
+# cmake -DSHADER=<raytracing.frag> -DOUTPUT=<file> -P extract_traversal.cmake
+
+file(READ "${SHADER}" source)
+string(FIND "${source}" "//  OCTREE TRAVERSAL" begin)
+string(FIND "${source}" "//     LIGHTING" end)
+if (begin EQUAL -1 OR end EQUAL -1 OR end LESS begin)
+    message(FATAL_ERROR "${SHADER} has no OCTREE TRAVERSAL section followed by LIGHTING")
+endif()
+math(EXPR length "${end} - ${begin}")
+string(SUBSTRING "${source}" ${begin} ${length} section)
+
+# inout and out parameters become references
+string(REGEX REPLACE "([(,] *)(inout|out) ([A-Za-z0-9_]+) " "\\1\\3& " section "${section}")
+
+set(section "// Generated from raytracing.frag by extract_traversal.cmake\n${section}")
+# Only written when the section changed, so editing the rest of the shader doesn't rebuild the test
+set(previous "")
+if (EXISTS "${OUTPUT}")
+    file(READ "${OUTPUT}" previous)
+endif()
+if (NOT previous STREQUAL section)
+    file(WRITE "${OUTPUT}" "${section}")
+endif()
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "frame_ring.hpp"
+#include "test_checks.hpp"
+
+// A device without a GPU. Fences follow the Vulkan rules: a submission signals its fence once the simulated GPU gets to it,
+// in submission order, and a fence is only reset while signaled. Waiting a fence nothing will signal would hang, so it is a failure
+class MockFrameSyncDevice : public FrameSyncDevice
+{
+public:
+    enum class Kind { COMMAND_BUFFER, FENCE, SEMAPHORE };
+
+    uint32_t createCommandBuffer() override { return create(Kind::COMMAND_BUFFER, false); }
+    uint32_t createFence(const bool signaled) override { return create(Kind::FENCE, signaled); }
+    uint32_t createSemaphore() override { return create(Kind::SEMAPHORE, false); }
+
+    void waitFence(const uint32_t fence) override
+    {
+        CHECK(isFence(fence));
+        waits++;
+        if (m_signaled[fence])
+            return;
+        // The GPU runs until the fence is signaled, every earlier submission finishes first
+        CHECK(m_pending.end() != std::ranges::find(m_pending, fence));
+        while (!m_pending.empty() && !m_signaled[fence])
+            finishOldest();
+        blockingWaits++;
+    }
+
+    void resetFence(const uint32_t fence) override
+    {
+        CHECK(isFence(fence));
+        CHECK(m_signaled[fence]);
+        m_signaled[fence] = false;
+        resets++;
+    }
+
+    // The submission that follows a resetFence(), it signals the fence when the GPU is done with it
+    void submit(const uint32_t fence)
+    {
+        CHECK(!m_signaled[fence]);
+        m_pending.push_back(fence);
+    }
+
+    // The GPU finishes the oldest submission on its own
+    void finishOldest()
+    {
+        if (m_pending.empty())
+            return;
+        m_signaled[m_pending.front()] = true;
+        m_pending.pop_front();
+    }
+
+    [[nodiscard]] bool isSignaled(const uint32_t fence) const { return m_signaled[fence]; }
+    [[nodiscard]] uint32_t getPendingCount() const { return static_cast<uint32_t>(m_pending.size()); }
+    [[nodiscard]] bool isFence(const uint32_t object) const { return object < m_kinds.size() && m_kinds[object] == Kind::FENCE; }
+    [[nodiscard]] bool isKind(const uint32_t object, const Kind kind) const { return object < m_kinds.size() && m_kinds[object] == kind; }
+
+    uint32_t waits = 0;
+    uint32_t blockingWaits = 0;
+    uint32_t resets = 0;
+
+private:
+    uint32_t create(const Kind kind, const bool signaled)
+    {
+        m_kinds.push_back(kind);
+        m_signaled.push_back(signaled);
+        return static_cast<uint32_t>(m_kinds.size() - 1);
+    }
+
+    std::vector<Kind> m_kinds;
+    std::vector<bool> m_signaled;
+    std::deque<uint32_t> m_pending;
+};
+
+// Every slot has objects of its own, of the right kind
+static void testCreation()
+{
+    MockFrameSyncDevice device;
+    const FrameRing ring{ device, 2 };
+    std::vector<uint32_t> objects;
+    for (uint32_t slot = 0; slot < MAX_FRAMES_IN_FLIGHT; slot++)
+    {
+        const FrameRing::Slot& data = ring.getSlot(slot);
+        CHECK(device.isKind(data.commandBuffer, MockFrameSyncDevice::Kind::COMMAND_BUFFER));
+        CHECK(device.isFence(data.fence) && device.isSignaled(data.fence));
+        CHECK(device.isKind(data.imageAvailable, MockFrameSyncDevice::Kind::SEMAPHORE));
+        CHECK(device.isKind(data.renderFinished, MockFrameSyncDevice::Kind::SEMAPHORE));
+        CHECK(!data.inFlight);
+        objects.insert(objects.end(), { data.commandBuffer, data.fence, data.imageAvailable, data.renderFinished });
+    }
+    std::ranges::sort(objects);
+    CHECK(std::ranges::adjacent_find(objects) == objects.end());
+    CHECK(ring.getPreviousSlot() == UINT32_MAX);
+
+    CHECK(FrameRing(device, 0).getFramesAhead() == 1);
+    CHECK(FrameRing(device, 10).getFramesAhead() == MAX_FRAMES_IN_FLIGHT);
+}
+
+// PACING
+
+// 1000 frames with a GPU that finishes a frame at random times, dropped frames and waits for idle in between
+static void testPacing(const uint32_t framesAhead, const bool fastGPU)
+{
+    MockFrameSyncDevice device;
+    FrameRing ring{ device, framesAhead };
+    std::mt19937 random{ framesAhead * 2 + (fastGPU ? 1 : 0) };
+
+    uint64_t completedFrames = 0;
+    uint64_t lastCompleted = 0;
+    uint32_t submittedSinceIdle = 0;
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        // A fast GPU is done with most frames before the CPU comes back, a slow one with none of them
+        if (fastGPU && random() % 4 != 0)
+            device.finishOldest();
+
+        const uint32_t slot = ring.beginFrame();
+        CHECK(slot == ring.getCurrentSlot());
+        CHECK(slot == ring.getFrame() % MAX_FRAMES_IN_FLIGHT);
+        // The slot is free: the GPU is done with its command buffer and the fence can be reset
+        CHECK(!ring.getSlot(slot).inFlight);
+        CHECK(device.isSignaled(ring.getSlot(slot).fence));
+        // Never more than framesAhead - 1 frames on the GPU while recording, and with a slow GPU exactly that many
+        uint32_t inFlight = 0;
+        for (uint32_t k = 0; k < MAX_FRAMES_IN_FLIGHT; k++)
+            inFlight += ring.getSlot(k).inFlight ? 1 : 0;
+        CHECK(inFlight <= framesAhead - 1);
+        CHECK(device.getPendingCount() <= framesAhead - 1);
+        if (!fastGPU)
+            CHECK(device.getPendingCount() == std::min(framesAhead - 1, submittedSinceIdle));
+
+        // Oldest first and every frame once
+        for (const uint32_t completed : ring.takeCompleted())
+        {
+            CHECK(ring.getSlot(completed).frame == lastCompleted);
+            CHECK(!ring.getSlot(completed).inFlight);
+            lastCompleted++;
+            completedFrames++;
+        }
+
+        // The swapchain was out of date, the frame is dropped before the submission
+        if (random() % 10 == 0)
+            continue;
+        if (random() % 50 == 0)
+        {
+            ring.waitIdle();
+            CHECK(device.getPendingCount() == 0);
+            submittedSinceIdle = 0;
+        }
+        const uint64_t frame = ring.getFrame();
+        ring.submitFrame();
+        device.submit(ring.getSlot(slot).fence);
+        submittedSinceIdle++;
+        CHECK(ring.getSlot(slot).frame == frame && ring.getSlot(slot).inFlight);
+        CHECK(ring.getPreviousSlot() == slot);
+    }
+    ring.waitIdle();
+    completedFrames += ring.takeCompleted().size();
+
+    // Every submitted frame was waited exactly once and had its fence reset exactly once
+    CHECK(ring.getFrame() > 800);
+    CHECK(completedFrames == ring.getFrame());
+    CHECK(device.waits == ring.getFrame());
+    CHECK(device.resets == ring.getFrame());
+    CHECK(device.getPendingCount() == 0);
+    // Only a slow GPU makes the CPU block
+    if (fastGPU)
+        CHECK(device.blockingWaits < device.waits);
+    else
+        CHECK(device.blockingWaits == device.waits);
+}
+
+// Fewer frames ahead takes effect on the next frame, waiting for the frames over the new limit
+static void testFramesAheadChange()
+{
+    MockFrameSyncDevice device;
+    FrameRing ring{ device, 3 };
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        const uint32_t slot = ring.beginFrame();
+        ring.submitFrame();
+        device.submit(ring.getSlot(slot).fence);
+    }
+    CHECK(device.getPendingCount() == 3);
+
+    ring.setFramesAhead(1);
+    ring.beginFrame();
+    CHECK(device.getPendingCount() == 0);
+    for (uint32_t slot = 0; slot < MAX_FRAMES_IN_FLIGHT; slot++)
+        CHECK(!ring.getSlot(slot).inFlight);
+    CHECK(ring.getPreviousSlot() == 2);
+    CHECK(ring.takeCompleted().size() == 3);
+
+    ring.setFramesAhead(0);
+    CHECK(ring.getFramesAhead() == 1);
+}
+
+int main()
+{
+    testCreation();
+    for (uint32_t framesAhead = 1; framesAhead <= MAX_FRAMES_IN_FLIGHT; framesAhead++)
+    {
+        testPacing(framesAhead, false);
+        testPacing(framesAhead, true);
+    }
+    testFramesAheadChange();
+    return finishTests("frame_ring_tests");
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "Octree/octree_pager.hpp"
+
+// The GLSL the OCTREE TRAVERSAL section of raytracing.frag uses, so extract_traversal.cmake can turn it into C++
+// Arithmetic is done in float like on the GPU, double constants are converted before they touch a vector
+// Sections of the shader are included inside a namespace of their own nested in glsl, whose functions then hide the ones of the C library
+
+namespace glsl
+{
+using uint = uint32_t;
+
+template<class T>
+concept Scalar = std::is_arithmetic_v<T>;
+
+struct vec2
+{
+    float x = 0.0f;
+    float y = 0.0f;
+
+    vec2() = default;
+    template<Scalar S>
+    explicit vec2(const S s) : x(float(s)), y(float(s)) {}
+    template<Scalar A, Scalar B>
+    vec2(const A a, const B b) : x(float(a)), y(float(b)) {}
+};
+
+struct uvec3;
+
+struct vec3
+{
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+
+    vec3() = default;
+    template<Scalar S>
+    explicit vec3(const S s) : x(float(s)), y(float(s)), z(float(s)) {}
+    template<Scalar A, Scalar B, Scalar C>
+    vec3(const A a, const B b, const C c) : x(float(a)), y(float(b)), z(float(c)) {}
+    explicit vec3(const uvec3& v);
+};
+
+struct vec4
+{
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+    union
+    {
+        float w = 0.0f;
+        float a;
+    };
+};
+
+struct uvec3
+{
+    uint x = 0;
+    uint y = 0;
+    uint z = 0;
+
+    uvec3() = default;
+    template<Scalar S>
+    explicit uvec3(const S s) : x(uint(s)), y(uint(s)), z(uint(s)) {}
+    template<Scalar A, Scalar B, Scalar C>
+    uvec3(const A a, const B b, const C c) : x(uint(a)), y(uint(b)), z(uint(c)) {}
+};
+
+struct bvec3
+{
+    bool x = false;
+    bool y = false;
+    bool z = false;
+};
+
+inline vec3::vec3(const uvec3& v) : x(float(v.x)), y(float(v.y)), z(float(v.z)) {}
+
+#define GLSL_FLOAT_OPERATOR(op) \
+    inline vec2 operator op(const vec2 a, const vec2 b) { return { a.x op b.x, a.y op b.y }; } \
+    template<Scalar S> vec2 operator op(const vec2 a, const S s) { return a op vec2(s); } \
+    inline vec3 operator op(const vec3 a, const vec3 b) { return { a.x op b.x, a.y op b.y, a.z op b.z }; } \
+    template<Scalar S> vec3 operator op(const vec3 a, const S s) { return a op vec3(s); } \
+    template<Scalar S> vec3 operator op(const S s, const vec3 a) { return vec3(s) op a; }
+
+#define GLSL_UINT_OPERATOR(op) \
+    inline uvec3 operator op(const uvec3 a, const uvec3 b) { return { a.x op b.x, a.y op b.y, a.z op b.z }; } \
+    template<Scalar S> uvec3 operator op(const uvec3 a, const S s) { return a op uvec3(s); } \
+    template<Scalar S> uvec3& operator op##=(uvec3& a, const S s) { return a = a op uvec3(s); } \
+    inline uvec3& operator op##=(uvec3& a, const uvec3 b) { return a = a op b; }
+
+GLSL_FLOAT_OPERATOR(+)
+GLSL_FLOAT_OPERATOR(-)
+GLSL_FLOAT_OPERATOR(*)
+GLSL_FLOAT_OPERATOR(/)
+GLSL_UINT_OPERATOR(+)
+GLSL_UINT_OPERATOR(-)
+GLSL_UINT_OPERATOR(&)
+GLSL_UINT_OPERATOR(|)
+GLSL_UINT_OPERATOR(<<)
+GLSL_UINT_OPERATOR(>>)
+
+#undef GLSL_FLOAT_OPERATOR
+#undef GLSL_UINT_OPERATOR
+
+inline vec3 operator-(const vec3 a) { return { -a.x, -a.y, -a.z }; }
+
+// BUILT-IN FUNCTIONS
+
+inline float abs(const float a) { return std::fabs(a); }
+inline vec3 abs(const vec3 a) { return { std::fabs(a.x), std::fabs(a.y), std::fabs(a.z) }; }
+inline float min(const float a, const float b) { return std::min(a, b); }
+inline float max(const float a, const float b) { return std::max(a, b); }
+inline int min(const int a, const int b) { return std::min(a, b); }
+inline int max(const int a, const int b) { return std::max(a, b); }
+inline uint min(const uint a, const uint b) { return std::min(a, b); }
+inline uint max(const uint a, const uint b) { return std::max(a, b); }
+// The shader only raises 2.0 to integer powers, which are exact in float
+inline float pow(const double a, const int b) { return float(std::pow(a, b)); }
+inline float pow(const float a, const float b) { return std::pow(a, b); }
+inline vec3 pow(const vec3 a, const vec3 b) { return { std::pow(a.x, b.x), std::pow(a.y, b.y), std::pow(a.z, b.z) }; }
+inline float dot(const vec3 a, const vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float length(const vec3 a) { return std::sqrt(dot(a, a)); }
+inline vec3 normalize(const vec3 a) { return a / length(a); }
+inline bvec3 greaterThan(const vec3 a, const vec3 b) { return { a.x > b.x, a.y > b.y, a.z > b.z }; }
+inline vec3 mix(const vec3 a, const vec3 b, const bvec3 select) { return { select.x ? b.x : a.x, select.y ? b.y : a.y, select.z ? b.z : a.z }; }
+inline int bitCount(const uint v) { return std::popcount(v); }
+inline int findLSB(const uint v) { return v == 0 ? -1 : std::countr_zero(v); }
+
+// DECLARATIONS OF THE SHADER
+
+// Same values as the ones raytracing.frag declares above the section
+const uint LEAF_BAKED_COLOR = 1u << 0;
+const uint LEAF_BAKED_SPECULAR = 1u << 1;
+const uint LEAF_OPAQUE = 1u << 2;
+const uint NO_TEXTURE = 0xFFFFFFFFu;
+
+struct Material
+{
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float specularComp;
+    uint diffuseMap;
+    uint normalMap;
+    uint specularMap;
+};
+
+// The buffers and push constants the section reads, shared by every namespace it is included in
+// OCTREE_PAGE_SIZE and PAGE_NOT_RESIDENT come from octree_pager.hpp like the engine passes them
+inline std::vector<uint> octree;
+inline std::vector<uint> pageTable;
+inline std::vector<Material> materials;
+inline float octreeScale = 1.0f;
+inline uint leafFlags = 0;
+
+// Every texel is opaque, like the textures of a CpuTracer that loaded none
+inline vec4 sampleMap(uint, vec2, float)
+{
+    vec4 texel;
+    texel.x = texel.y = texel.z = texel.a = 1.0f;
+    return texel;
+}
+}
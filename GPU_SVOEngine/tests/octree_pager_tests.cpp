@@ -0,0 +1,412 @@
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "scene_loader.hpp"
+#include "test_checks.hpp"
+#include "Octree/octree_pager.hpp"
+
+// Leaves by their cube, the size is negative for the leaf of a link whose page is not resident
+using LeafKey = std::tuple<float, float, float, float>;
+using LeafMap = std::map<LeafKey, std::pair<uint32_t, uint32_t>>;
+
+static glm::vec3 getChildMin(const glm::vec3& min, const float childSize, const uint8_t child)
+{
+    return min + childSize * glm::vec3((child & 4) >> 2, (child & 2) >> 1, child & 1);
+}
+
+static void collectLeaves(const Octree& octree, const uint32_t index, const glm::vec3& min, const float size, LeafMap& leaves)
+{
+    const BranchNode node{ octree.getNode(index) };
+    const uint32_t childAddress = octree.getChildAddress(index, node);
+    uint32_t offset = 0;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        if (!node.childMask.getBit(i))
+            continue;
+        const glm::vec3 childMin = getChildMin(min, size / 2, i);
+        if (node.leafMask.getBit(i))
+        {
+            leaves[{ childMin.x, childMin.y, childMin.z, size / 2 }] = { octree.getNode(childAddress + offset), octree.getNode(childAddress + offset + 1) };
+            offset += 2;
+        }
+        else
+            collectLeaves(octree, childAddress + offset++, childMin, size / 2, leaves);
+    }
+}
+
+// Same walk the shader does, over a pool of pages of pageSize nodes and the page table
+struct PagedWalk
+{
+    const std::vector<uint32_t>& pool;
+    const std::vector<uint32_t>& pageTable;
+    uint32_t pageSize;
+    // Set when every page is in the slot of its own number, the links are checked against the pages then
+    const std::vector<OctreePage>* pages = nullptr;
+    LeafMap leaves{};
+    uint32_t fallbacks = 0;
+
+    void walk(const uint32_t index, const glm::vec3& min, const float size)
+    {
+        const BranchNode node{ pool[index] };
+        if (node.childMask.toRaw() == 0)
+            return;
+        uint32_t childAddress = index + node.ptr.getPtr();
+        if (node.ptr.isFar())
+        {
+            const uint32_t target = pool[childAddress];
+            if (pages != nullptr)
+            {
+                // A link points to a child page of the one it is in, and inside of it
+                const std::vector<uint32_t>& children = (*pages)[index / pageSize].children;
+                CHECK(std::ranges::find(children, target) != children.end());
+                CHECK(pool[childAddress + 1] < (*pages)[target].nodes.size());
+            }
+            const uint32_t slot = pageTable[target];
+            if (slot == PAGE_NOT_RESIDENT)
+            {
+                leaves[{ min.x, min.y, min.z, -size }] = { pool[childAddress + 2], pool[childAddress + 3] };
+                fallbacks++;
+                return;
+            }
+            childAddress = slot * pageSize + pool[childAddress + 1];
+        }
+        uint32_t offset = 0;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            if (!node.childMask.getBit(i))
+                continue;
+            const glm::vec3 childMin = getChildMin(min, size / 2, i);
+            if (node.leafMask.getBit(i))
+            {
+                leaves[{ childMin.x, childMin.y, childMin.z, size / 2 }] = { pool[childAddress + offset], pool[childAddress + offset + 1] };
+                offset += 2;
+            }
+            else
+                walk(childAddress + offset++, childMin, size / 2);
+        }
+    }
+};
+
+// A leaf of the reference inside the cube of the link has the same content as the leaf of the link
+static bool isLeafOfSubtree(const LeafMap& reference, const LeafKey& link, const std::pair<uint32_t, uint32_t>& leaf)
+{
+    const auto [x, y, z, negativeSize] = link;
+    const float size = -negativeSize;
+    for (const auto& [key, value] : reference)
+    {
+        const auto [lx, ly, lz, leafSize] = key;
+        if (value == leaf && lx >= x && ly >= y && lz >= z && lx + leafSize <= x + size && ly + leafSize <= y + size && lz + leafSize <= z + size)
+            return true;
+    }
+    return false;
+}
+
+// PAGE TABLE ENCODING
+
+static void testPagination(const Octree& octree, const LeafMap& reference)
+{
+    constexpr uint32_t pageSize = 1024;
+    const std::vector<OctreePage> pages = paginateOctree(octree, pageSize);
+    CHECK(pages.size() > 8);
+    CHECK(pages[0].parent == PAGE_NOT_RESIDENT);
+
+    for (uint32_t page = 0; page < pages.size(); page++)
+    {
+        CHECK(!pages[page].nodes.empty() && pages[page].nodes.size() <= pageSize);
+        for (const uint32_t child : pages[page].children)
+        {
+            CHECK(child > page);
+            CHECK(pages[child].parent == page);
+            CHECK(pages[child].depth > pages[page].depth);
+        }
+    }
+
+    // With every page resident the paged walk finds exactly the leaves of the octree
+    std::vector<uint32_t> pool(pages.size() * pageSize, 0);
+    std::vector<uint32_t> pageTable(pages.size());
+    for (uint32_t page = 0; page < pages.size(); page++)
+    {
+        std::ranges::copy(pages[page].nodes, pool.begin() + page * pageSize);
+        pageTable[page] = page;
+    }
+    PagedWalk full{ pool, pageTable, pageSize, &pages };
+    full.walk(0, glm::vec3(0.0f), 1.0f);
+    CHECK(full.fallbacks == 0);
+    CHECK(full.leaves == reference);
+
+    // With only the root resident every link is drawn with a leaf of its own subtree
+    std::ranges::fill(pageTable, PAGE_NOT_RESIDENT);
+    pageTable[0] = 0;
+    PagedWalk rootOnly{ pool, pageTable, pageSize };
+    rootOnly.walk(0, glm::vec3(0.0f), 1.0f);
+    CHECK(rootOnly.fallbacks > 0);
+    for (const auto& [key, leaf] : rootOnly.leaves)
+    {
+        if (std::get<3>(key) > 0.0f)
+            CHECK(reference.at(key) == leaf);
+        else
+            CHECK(isLeafOfSubtree(reference, key, leaf));
+    }
+}
+
+// PAGING POLICY
+
+// A root with four children, slabs of a quarter of the octree along x. Only the bounds matter to the policy
+static std::vector<OctreePage> createSlabPages()
+{
+    std::vector<OctreePage> pages(5);
+    pages[0].nodes.push_back(0);
+    for (uint32_t page = 1; page < 5; page++)
+    {
+        pages[page].nodes.push_back(0);
+        pages[page].parent = 0;
+        pages[page].depth = 1;
+        pages[page].boundsMin = glm::vec3(0.25f * (page - 1), 0.0f, 0.0f);
+        pages[page].boundsMax = glm::vec3(0.25f * page, 1.0f, 1.0f);
+        pages[0].children.push_back(page);
+    }
+    return pages;
+}
+
+// Slabs are 1 unit tall, so with this angle they cover the minimum of 4 pixels up to 0.15 units away
+static constexpr float SLAB_PIXEL_ANGLE = 1.0f / (4.0f * 0.15f);
+
+static glm::vec3 slabCamera(const float x)
+{
+    return { x, 0.5f, 0.5f };
+}
+
+static void testPriority()
+{
+    // Room for every slab but one, so pages below the minimum size are left out
+    OctreePager pager{ createSlabPages(), 4 };
+
+    // The root comes first, then the slab the camera is in
+    std::vector<OctreePager::Load> loads = pager.update(slabCamera(0.55f), SLAB_PIXEL_ANGLE, 1);
+    CHECK(loads.size() == 2);
+    CHECK(loads.size() == 2 && loads[0].page == 0 && loads[0].slot == 0 && loads[1].page == 3);
+    // Then the neighbour 0.05 away. The one 0.2 away is too small to be wanted
+    loads = pager.update(slabCamera(0.55f), SLAB_PIXEL_ANGLE, 1);
+    CHECK(loads.size() == 1 && loads[0].page == 2);
+    loads = pager.update(slabCamera(0.55f), SLAB_PIXEL_ANGLE, 1);
+    CHECK(loads.empty());
+    CHECK(pager.getPageTable()[4] == PAGE_NOT_RESIDENT);
+
+    // On the border of two slabs both are infinitely big, the lower page goes first
+    OctreePager tied{ createSlabPages(), 4 };
+    loads = tied.update(slabCamera(0.5f), SLAB_PIXEL_ANGLE, 2);
+    CHECK(loads.size() == 3 && loads[1].page == 2 && loads[2].page == 3);
+
+    // When everything fits every page is loaded, no matter how small
+    OctreePager everything{ createSlabPages(), 5 };
+    loads = everything.update(slabCamera(-10.0f), SLAB_PIXEL_ANGLE, UINT32_MAX);
+    CHECK(loads.size() == 5);
+    CHECK(everything.getResidentCount() == 5);
+}
+
+static void testLRUEviction()
+{
+    // The root and two slabs
+    OctreePager pager{ createSlabPages(), 3 };
+
+    std::vector<OctreePager::Load> loads = pager.update(slabCamera(-0.1f), SLAB_PIXEL_ANGLE, UINT32_MAX);
+    CHECK(loads.size() == 2 && loads[1].page == 1);
+    const uint32_t firstSlot = pager.getPageTable()[1];
+
+    loads = pager.update(slabCamera(1.1f), SLAB_PIXEL_ANGLE, UINT32_MAX);
+    CHECK(loads.size() == 1 && loads[0].page == 4);
+    const uint32_t secondSlot = pager.getPageTable()[4];
+    CHECK(pager.getStats().evictions == 0);
+
+    // Neither slab is wanted anymore. The one used longest ago goes first, but frames in flight may still read the slots
+    loads = pager.update(slabCamera(0.45f), SLAB_PIXEL_ANGLE, UINT32_MAX);
+    CHECK(loads.empty());
+    CHECK(pager.getPageTable()[1] == PAGE_NOT_RESIDENT && pager.getPageTable()[4] == PAGE_NOT_RESIDENT);
+    CHECK(pager.getStats().evictions == 2);
+    CHECK(pager.getResidentCount() == 1);
+    const std::vector<uint32_t> evicted = pager.takeEvictedSlots();
+    CHECK(evicted == std::vector<uint32_t>({ firstSlot, secondSlot }));
+    CHECK(pager.takeEvictedSlots().empty());
+    CHECK(pager.getWaitingSlotCount() == 2);
+
+    // Nothing is loaded into them until they are released
+    loads = pager.update(slabCamera(0.45f), SLAB_PIXEL_ANGLE, UINT32_MAX);
+    CHECK(loads.empty());
+    pager.releaseSlots(evicted);
+    CHECK(pager.getWaitingSlotCount() == 0);
+    loads = pager.update(slabCamera(0.45f), SLAB_PIXEL_ANGLE, UINT32_MAX);
+    CHECK(loads.size() == 2 && loads[0].page == 2 && loads[1].page == 3);
+    CHECK(loads.size() == 2 && std::ranges::is_permutation(std::vector<uint32_t>{ loads[0].slot, loads[1].slot }, evicted));
+    CHECK(pager.getResidentCount() == 3);
+
+    // Both slabs around the camera are wanted, the one it approaches is smaller than either of them, so nothing moves
+    loads = pager.update(slabCamera(0.38f), SLAB_PIXEL_ANGLE, UINT32_MAX);
+    CHECK(loads.empty());
+    CHECK(pager.getStats().evictions == 2);
+
+    // Now it is bigger than the resident slab on the other side, which makes room for it even though it is still wanted
+    const uint32_t slabSlot = pager.getPageTable()[3];
+    loads = pager.update(slabCamera(0.36f), SLAB_PIXEL_ANGLE, UINT32_MAX);
+    CHECK(loads.empty());
+    CHECK(pager.getPageTable()[3] == PAGE_NOT_RESIDENT);
+    CHECK(pager.getStats().evictions == 3);
+    pager.releaseSlots(pager.takeEvictedSlots());
+    loads = pager.update(slabCamera(0.36f), SLAB_PIXEL_ANGLE, UINT32_MAX);
+    CHECK(loads.size() == 1 && loads[0].page == 1 && loads[0].slot == slabSlot);
+
+    // A slot can't be released twice, nor one that holds a page
+    bool threw = false;
+    try
+    {
+        pager.releaseSlots(std::vector<uint32_t>{ slabSlot });
+    }
+    catch (const std::runtime_error&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+// No more than maxLoads slots wait to be released, the rest of the pages stay until then
+static void testWaitingSlots()
+{
+    OctreePager pager{ createSlabPages(), 3 };
+    (void)pager.update(slabCamera(-0.1f), SLAB_PIXEL_ANGLE, UINT32_MAX);
+    (void)pager.update(slabCamera(1.1f), SLAB_PIXEL_ANGLE, UINT32_MAX);
+
+    CHECK(pager.update(slabCamera(0.45f), SLAB_PIXEL_ANGLE, 1).empty());
+    CHECK(pager.getStats().evictions == 1);
+    CHECK(pager.getWaitingSlotCount() == 1);
+    const std::vector<uint32_t> evicted = pager.takeEvictedSlots();
+    CHECK(pager.update(slabCamera(0.45f), SLAB_PIXEL_ANGLE, 1).empty());
+    CHECK(pager.getStats().evictions == 1);
+
+    // Once it is back the biggest page takes it and the next slot is evicted
+    pager.releaseSlots(evicted);
+    const std::vector<OctreePager::Load> loads = pager.update(slabCamera(0.45f), SLAB_PIXEL_ANGLE, 1);
+    CHECK(loads.size() == 1 && loads[0].page == 2 && loads[0].slot == evicted[0]);
+    CHECK(pager.getStats().evictions == 1);
+    CHECK(pager.update(slabCamera(0.45f), SLAB_PIXEL_ANGLE, 1).empty());
+    CHECK(pager.getStats().evictions == 2);
+}
+
+// CAMERA PATH
+
+static void testCameraPath(const Octree& octree, const LeafMap& reference)
+{
+    constexpr uint32_t pageSize = 1024;
+    constexpr uint32_t maxLoads = 16;
+    const std::vector<OctreePage> pages = paginateOctree(octree, pageSize);
+    const uint32_t slotCount = static_cast<uint32_t>(pages.size() / 4 + 1);
+    // Pins the pages linked by the root page, the first level below it
+    uint8_t pinnedDepth = UINT8_MAX;
+    for (const uint32_t child : pages[0].children)
+        pinnedDepth = std::min(pinnedDepth, static_cast<uint8_t>(pages[child].depth + 1));
+    OctreePager pager{ pages, slotCount, pinnedDepth };
+    // The root and the pages linked above the pinned depth from other pinned pages
+    std::vector<bool> pinned(pages.size(), false);
+    for (uint32_t page = 0; page < pages.size(); page++)
+        pinned[page] = page == 0 || (pages[page].depth < pinnedDepth && pinned[pages[page].parent]);
+    CHECK(pager.getPinnedCount() == std::ranges::count(pinned, true));
+    CHECK(pager.getPinnedCount() > 1);
+
+    std::vector<uint32_t> pool(static_cast<size_t>(slotCount) * pageSize, 0);
+    std::vector<uint32_t> slotPages(slotCount, PAGE_NOT_RESIDENT);
+    // Like the engine with two frames in flight, the slots evicted by a frame are released when it is done, two frames later
+    constexpr uint32_t framesInFlight = 2;
+    std::deque<std::vector<uint32_t>> evictedSlots;
+    std::vector<uint32_t> evictedFrame(slotCount, UINT32_MAX);
+    const float pixelAngle = glm::radians(70.0f) / 1080.0f;
+    for (uint32_t frame = 0; frame < 400; frame++)
+    {
+        // An orbit around the terrain, then a smaller one closer to the ground, then standing still
+        const float t = static_cast<float>(frame) / 400.0f * 6.2831f;
+        glm::vec3 cameraPos{ 0.5f + 0.6f * std::cos(t), 0.45f, 0.5f + 0.6f * std::sin(t) };
+        if (frame > 200)
+            cameraPos = { 0.5f + 0.3f * std::cos(t), 0.3f, 0.5f };
+        if (frame > 350)
+            cameraPos = { 0.5f + 0.3f * std::cos(6.2831f * 350.0f / 400.0f), 0.3f, 0.5f };
+
+        if (evictedSlots.size() == framesInFlight)
+        {
+            pager.releaseSlots(evictedSlots.front());
+            evictedSlots.pop_front();
+        }
+        const std::vector<OctreePager::Load> loads = pager.update(cameraPos, pixelAngle, frame == 0 ? UINT32_MAX : maxLoads);
+        evictedSlots.push_back(pager.takeEvictedSlots());
+        for (const uint32_t slot : evictedSlots.back())
+        {
+            evictedFrame[slot] = frame;
+            slotPages[slot] = PAGE_NOT_RESIDENT;
+        }
+        CHECK(pager.getWaitingSlotCount() <= framesInFlight * maxLoads);
+        if (frame > 0)
+            CHECK(loads.size() <= maxLoads);
+        // Standing still the pool settles, the loads of the first still frame may still be catching up
+        if (frame > 360)
+            CHECK(loads.empty());
+        for (const OctreePager::Load& load : loads)
+        {
+            // No frame that may have seen the evicted page is still in flight
+            CHECK(slotPages[load.slot] == PAGE_NOT_RESIDENT);
+            CHECK(evictedFrame[load.slot] == UINT32_MAX || frame >= evictedFrame[load.slot] + framesInFlight);
+            const std::vector<uint32_t>& nodes = pager.getPage(load.page).nodes;
+            std::fill_n(pool.begin() + load.slot * pageSize, pageSize, 0);
+            std::ranges::copy(nodes, pool.begin() + load.slot * pageSize);
+            slotPages[load.slot] = load.page;
+        }
+
+        const std::vector<uint32_t>& pageTable = pager.getPageTable();
+        CHECK(pageTable[0] == 0);
+        uint32_t resident = 0;
+        for (uint32_t page = 0; page < pageTable.size(); page++)
+        {
+            if (pageTable[page] == PAGE_NOT_RESIDENT)
+            {
+                CHECK(!pinned[page]);
+                continue;
+            }
+            resident++;
+            CHECK(slotPages[pageTable[page]] == page);
+            CHECK(page == 0 || pageTable[pages[page].parent] != PAGE_NOT_RESIDENT);
+        }
+        CHECK(resident == pager.getResidentCount());
+        CHECK(resident <= slotCount);
+
+        // Whatever is resident, the leaves reached are the ones of the octree
+        PagedWalk walk{ pool, pageTable, pageSize };
+        walk.walk(0, glm::vec3(0.0f), 1.0f);
+        for (const auto& [key, leaf] : walk.leaves)
+        {
+            if (std::get<3>(key) > 0.0f)
+                CHECK(reference.contains(key) && reference.at(key) == leaf);
+        }
+    }
+
+    const OctreePager::Stats stats = pager.getStats();
+    CHECK(stats.evictions > 0);
+    CHECK(stats.loads == stats.evictions + pager.getResidentCount());
+    CHECK(pager.getWaitingSlotCount() + pager.getResidentCount() <= slotCount);
+}
+
+int main()
+{
+    SceneSettings settings;
+    settings.procedural = true;
+    settings.proceduralScene = "terrain";
+    settings.depth = 8;
+    const std::unique_ptr<Octree> octree = SceneLoader::buildOctree(settings);
+    LeafMap reference;
+    collectLeaves(*octree, 0, glm::vec3(0.0f), 1.0f, reference);
+
+    testPagination(*octree, reference);
+    testPriority();
+    testLRUEviction();
+    testWaitingSlots();
+    testCameraPath(*octree, reference);
+    return finishTests("octree_pager_tests");
+}
@@ -0,0 +1,175 @@
+#include <cmath>
+#include <functional>
+
+#include "resolution_controller.hpp"
+#include "test_checks.hpp"
+
+// Frame time of the simulated GPU at a scale
+using FrameCost = std::function<float(float scale)>;
+
+// Tracing cost proportional to the pixel count, the model the controller is built on
+static FrameCost tracingCost(const float fullMs)
+{
+    return [fullMs](const float scale) { return fullMs * scale * scale; };
+}
+
+struct FeedResult
+{
+    float scale;
+    float frameMs;
+    // Times the scale changed, in the whole feed and in its last settled frames
+    uint32_t changes = 0;
+    uint32_t lateChanges = 0;
+    uint32_t lastChange = 0;
+    // First frame from which the frame time stayed within the hysteresis of the target, or the frame count if it never did
+    uint32_t settledFrame = 0;
+};
+
+// Plays frames of the given cost through the controller. The scale picked for a frame is the one it is rendered at
+static FeedResult runFeed(ResolutionController& controller, const FrameCost& cost, const uint32_t frames, const uint32_t settledFrames)
+{
+    const ResolutionSettings& settings = controller.getSettings();
+    FeedResult result{ controller.getScale(), cost(controller.getScale()) };
+    result.settledFrame = frames;
+    bool inBand = false;
+    for (uint32_t frame = 0; frame < frames; frame++)
+    {
+        result.frameMs = cost(result.scale);
+        const float scale = controller.update(result.frameMs);
+        if (scale != result.scale)
+        {
+            result.changes++;
+            result.lastChange = frame;
+            if (frame >= frames - settledFrames)
+                result.lateChanges++;
+        }
+        result.scale = scale;
+
+        const bool nowInBand = std::abs(result.frameMs - settings.targetMs) <= settings.targetMs * settings.hysteresis;
+        if (nowInBand && !inBand)
+            result.settledFrame = frame;
+        inBand = nowInBand;
+    }
+    return result;
+}
+
+// STEPS
+
+// A scene that takes 10 ms, then 24 ms, then 80 ms at full resolution, then 10 ms again
+static void testSteps()
+{
+    ResolutionController controller;
+    const ResolutionSettings& settings = controller.getSettings();
+
+    // Under the target, so full resolution and not a single change
+    FeedResult result = runFeed(controller, tracingCost(10.0f), 200, 200);
+    CHECK(result.scale == settings.maxScale);
+    CHECK(result.changes == 0);
+
+    // The model finds the scale in a few steps and keeps it
+    result = runFeed(controller, tracingCost(24.0f), 300, 200);
+    CHECK(std::abs(result.frameMs - settings.targetMs) <= settings.targetMs * settings.hysteresis);
+    CHECK(result.settledFrame < 20);
+    CHECK(result.lastChange < 20);
+    CHECK(result.lateChanges == 0);
+    CHECK(result.scale < settings.maxScale && result.scale > settings.minScale);
+
+    // Over twice the average, so the first frames look like hitches until they keep coming
+    // Too expensive even at the smallest scale, it stays there instead of bouncing off the bound
+    result = runFeed(controller, tracingCost(80.0f), 300, 200);
+    CHECK(result.scale == settings.minScale);
+    CHECK(result.lastChange < 20);
+    CHECK(result.lateChanges == 0);
+
+    // Going up takes half steps but gets back to full resolution
+    result = runFeed(controller, tracingCost(10.0f), 300, 200);
+    CHECK(result.scale == settings.maxScale);
+    CHECK(result.lastChange < 40);
+    CHECK(result.lateChanges == 0);
+}
+
+// HITCHES
+
+static void testHitches()
+{
+    ResolutionController controller;
+    runFeed(controller, tracingCost(10.0f), 100, 100);
+
+    // A frame of 100 ms every 20 frames, shader compilation or a page upload. Single ones are skipped
+    uint32_t changes = 0;
+    float scale = controller.getScale();
+    for (uint32_t frame = 0; frame < 400; frame++)
+    {
+        const float frameMs = frame % 20 == 0 ? 100.0f : 10.0f * scale * scale;
+        const float next = controller.update(frameMs);
+        changes += next != scale ? 1 : 0;
+        scale = next;
+    }
+    CHECK(changes == 0);
+    CHECK(scale == controller.getSettings().maxScale);
+
+    // Frames without a time are skipped
+    CHECK(controller.update(0.0f) == scale);
+    CHECK(controller.update(-1.0f) == scale);
+    CHECK(controller.update(NAN) == scale);
+
+    // A hitch at the scale found for 24 ms doesn't move it either
+    runFeed(controller, tracingCost(24.0f), 300, 300);
+    const float settled = controller.getScale();
+    scale = settled;
+    for (uint32_t frame = 0; frame < 100; frame++)
+        scale = controller.update(frame == 50 ? 200.0f : 24.0f * scale * scale);
+    CHECK(scale == settled);
+}
+
+// FIXED COST
+
+// Part of the frame doesn't depend on the pixel count, so the model is wrong. The hysteresis has to keep it from oscillating
+static void testFixedCost()
+{
+    ResolutionController controller;
+    const ResolutionSettings& settings = controller.getSettings();
+
+    // 12 ms of the 20 ms of a full frame are fixed, the target is reachable but shrinking does less than the model expects
+    FeedResult result = runFeed(controller, [](const float scale) { return 12.0f + 8.0f * scale * scale; }, 400, 300);
+    CHECK(result.lateChanges == 0);
+    CHECK(result.changes <= 10);
+    CHECK(result.frameMs <= settings.targetMs * (1.0f + settings.hysteresis));
+
+    // More fixed cost than the target, no scale reaches it. It goes to the smallest and stays
+    controller.reset(settings.maxScale);
+    result = runFeed(controller, [](const float scale) { return 20.0f + 4.0f * scale * scale; }, 400, 300);
+    CHECK(result.scale == settings.minScale);
+    CHECK(result.lateChanges == 0);
+    CHECK(result.changes <= 10);
+}
+
+// SETTINGS
+
+static void testSettings()
+{
+    ResolutionController controller;
+    ResolutionSettings swapped;
+    swapped.minScale = 0.9f;
+    swapped.maxScale = 0.5f;
+    controller.setSettings(swapped);
+    CHECK(controller.getSettings().maxScale >= controller.getSettings().minScale);
+    CHECK(controller.getScale() >= controller.getSettings().minScale && controller.getScale() <= controller.getSettings().maxScale);
+
+    controller.setSettings({});
+    controller.reset(0.2f);
+    CHECK(controller.getScale() == controller.getSettings().minScale);
+
+    CHECK(ResolutionController::getRenderSize({ 1920, 1080 }, 0.5f) == glm::uvec2(960, 540));
+    CHECK(ResolutionController::getRenderSize({ 1920, 1080 }, 0.0f) == glm::uvec2(1, 1));
+    CHECK(ResolutionController::getRenderSize({ 1920, 1080 }, 2.0f) == glm::uvec2(1920, 1080));
+}
+
+int main()
+{
+    testSteps();
+    testHitches();
+    testFixedCost();
+    testSettings();
+    return finishTests("resolution_controller_tests");
+}
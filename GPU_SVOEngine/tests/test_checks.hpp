@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+
+// Minimal checks for the self tests, a failed check is printed and the test keeps going so every failure shows up in one run
+
+inline int& testFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            testFailures()++; \
+        } \
+    } while (false)
+
+// Return value of main
+inline int finishTests(const char* name)
+{
+    if (testFailures() == 0)
+    {
+        std::printf("%s: all checks passed\n", name);
+        return EXIT_SUCCESS;
+    }
+    std::printf("%s: %d checks failed\n", name, testFailures());
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,263 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stb_image_write.h>
+
+#include "test_checks.hpp"
+#include "Texture/texture_loader.hpp"
+
+namespace fs = std::filesystem;
+
+// Records everything the loader hands over instead of uploading it, and checks each image arrives once and as described
+class RecordingSink : public TextureUploadSink
+{
+public:
+    struct Upload
+    {
+        uint32_t image;
+        uint64_t hash;
+        uint64_t pixelsHash;
+    };
+
+    void prepare(const std::span<TextureDesc> images) override
+    {
+        prepareCalls++;
+        descs.assign(images.begin(), images.end());
+        uploaded.assign(images.size(), false);
+    }
+
+    void upload(const uint32_t image, const DecodedTexture texture) override
+    {
+        if (throwOnUpload)
+            throw std::runtime_error("sink failed");
+        CHECK(image < descs.size());
+        if (image >= descs.size())
+            return;
+        CHECK(!uploaded[image]);
+        uploaded[image] = true;
+
+        const TextureDesc& desc = descs[image];
+        CHECK(texture.format == desc.format && texture.width == desc.width && texture.height == desc.height && texture.mipCount == desc.mipCount);
+        CHECK(texture.pixels.size() == getTextureSize(desc));
+        uploads.push_back({ image, texture.hash, TextureLoader::hashBytes(texture.pixels) });
+        // A slow upload, so the decoding threads get ahead and the budget has to hold them back
+        if (uploadDelay.count() > 0)
+            std::this_thread::sleep_for(uploadDelay);
+    }
+
+    uint32_t prepareCalls = 0;
+    std::vector<TextureDesc> descs;
+    std::vector<bool> uploaded;
+    std::vector<Upload> uploads;
+    std::chrono::milliseconds uploadDelay{ 0 };
+    bool throwOnUpload = false;
+};
+
+struct TestImage
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+};
+
+// Sizes that are resized to powers of two, with and without alpha
+static const TestImage TEST_IMAGES[] = { { 64, 64, 3 }, { 100, 50, 3 }, { 32, 32, 4 }, { 128, 96, 4 }, { 17, 200, 3 }, { 256, 256, 3 } };
+static constexpr uint32_t IMAGE_COUNT = static_cast<uint32_t>(std::size(TEST_IMAGES));
+
+static std::vector<uint8_t> readBytes(const fs::path& path)
+{
+    std::ifstream file{ path, std::ios::binary };
+    return { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+}
+
+// Writes the images as PNG files, each one with a pattern of its own. The paths list every image, then copies of some of them under other names
+static std::vector<std::string> writeImages(const fs::path& dir)
+{
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::vector<std::string> paths;
+    for (uint32_t i = 0; i < IMAGE_COUNT; i++)
+    {
+        const TestImage& image = TEST_IMAGES[i];
+        std::vector<uint8_t> pixels(static_cast<size_t>(image.width) * image.height * image.channels);
+        for (size_t p = 0; p < pixels.size(); p++)
+            pixels[p] = static_cast<uint8_t>(p * (i + 3) + i * 41);
+        const std::string path = (dir / ("image" + std::to_string(i) + ".png")).string();
+        const int written = stbi_write_png(path.c_str(), static_cast<int>(image.width), static_cast<int>(image.height), static_cast<int>(image.channels),
+                                           pixels.data(), static_cast<int>(image.width * image.channels));
+        CHECK(written != 0);
+        paths.push_back(path);
+    }
+    for (const uint32_t i : { 1u, 3u, 1u })
+    {
+        const fs::path copy = dir / ("copy" + std::to_string(paths.size()) + ".png");
+        fs::copy_file(paths[i], copy);
+        paths.push_back(copy.string());
+    }
+    return paths;
+}
+
+// Path of the original of each copy in the list writeImages() gives
+static uint32_t getOriginal(const uint32_t path)
+{
+    constexpr uint32_t originals[] = { 1, 3, 1 };
+    return path < IMAGE_COUNT ? path : originals[path - IMAGE_COUNT];
+}
+
+// DEDUPLICATION AND CACHE
+
+static void testLoadAndCache(const std::vector<std::string>& paths, const fs::path& cacheDir)
+{
+    fs::remove_all(cacheDir);
+    std::vector<RecordingSink::Upload> firstUploads(IMAGE_COUNT);
+    for (uint32_t run = 0; run < 2; run++)
+    {
+        RecordingSink sink;
+        TextureLoader loader{ cacheDir, 64u << 20, TextureCompression::BC, 4 };
+        const std::vector<uint32_t> images = loader.load(paths, sink);
+
+        // Copies share the image of their original, the rest are numbered in the order of their paths
+        CHECK(images.size() == paths.size());
+        for (uint32_t path = 0; path < paths.size(); path++)
+            CHECK(images[path] == getOriginal(path));
+        CHECK(loader.getDuplicates() == paths.size() - IMAGE_COUNT);
+        CHECK(sink.prepareCalls == 1);
+        CHECK(sink.descs.size() == IMAGE_COUNT);
+        CHECK(sink.uploads.size() == IMAGE_COUNT);
+
+        for (const RecordingSink::Upload& upload : sink.uploads)
+        {
+            // Images are told apart by the hash of their file
+            CHECK(upload.hash == TextureLoader::hashBytes(readBytes(paths[upload.image])));
+            if (run == 0)
+                firstUploads[upload.image] = upload;
+            else
+                CHECK(upload.pixelsHash == firstUploads[upload.image].pixelsHash);
+        }
+
+        // The first run processes everything and fills the cache, the second one reads all of it back
+        CHECK(loader.getCacheHits() == (run == 0 ? 0 : IMAGE_COUNT));
+    }
+
+    // A changed file gets an entry of its own instead of the stale one
+    std::vector<uint8_t> bytes = readBytes(paths[0]);
+    fs::copy_file(paths[2], paths[0], fs::copy_options::overwrite_existing);
+    RecordingSink sink;
+    TextureLoader loader{ cacheDir, 64u << 20, TextureCompression::BC, 4 };
+    const std::vector<uint32_t> images = loader.load(paths, sink);
+    CHECK(images[0] == 0 && images[2] == 0);
+    CHECK(sink.uploads.size() == IMAGE_COUNT - 1);
+    std::ofstream{ paths[0], std::ios::binary }.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+// MEMORY BUDGET
+
+static void testMemoryBudget(const std::vector<std::string>& paths)
+{
+    // The most a single image reserves, its decoded source, the resized level and the processed copy
+    RecordingSink describeSink;
+    TextureLoader describer{ "", SIZE_MAX, TextureCompression::BC, 4 };
+    (void)describer.load(paths, describeSink);
+    size_t largest = 0;
+    for (uint32_t image = 0; image < IMAGE_COUNT; image++)
+    {
+        const TextureDesc& desc = describeSink.descs[image];
+        const size_t sourceSize = static_cast<size_t>(TEST_IMAGES[image].width) * TEST_IMAGES[image].height * 4;
+        largest = std::max(largest, sourceSize + static_cast<size_t>(desc.width) * desc.height * 4 + getTextureSize(desc));
+    }
+
+    // Without a budget the slow sink lets the threads get ahead
+    RecordingSink unboundedSink;
+    unboundedSink.uploadDelay = std::chrono::milliseconds(20);
+    TextureLoader unbounded{ "", SIZE_MAX, TextureCompression::BC, 4 };
+    (void)unbounded.load(paths, unboundedSink);
+    CHECK(unbounded.getPeakMemory() > largest);
+
+    for (const size_t budget : { size_t{ 1 }, largest, largest * 2 })
+    {
+        RecordingSink sink;
+        sink.uploadDelay = std::chrono::milliseconds(20);
+        TextureLoader loader{ "", budget, TextureCompression::BC, 4 };
+        (void)loader.load(paths, sink);
+        CHECK(sink.uploads.size() == IMAGE_COUNT);
+        CHECK(loader.getPeakMemory() <= std::max(budget, largest));
+    }
+}
+
+// ERRORS
+
+static bool loadThrows(TextureLoader& loader, const std::vector<std::string>& paths, RecordingSink& sink, const std::string& expected)
+{
+    try
+    {
+        (void)loader.load(paths, sink);
+    }
+    catch (const std::runtime_error& error)
+    {
+        return std::string(error.what()).find(expected) != std::string::npos;
+    }
+    return false;
+}
+
+static void testErrors(std::vector<std::string> paths, const fs::path& dir)
+{
+    TextureLoader loader{ "", 64u << 20, TextureCompression::BC, 4 };
+
+    // A missing file fails before the sink is told anything
+    std::vector<std::string> missing = paths;
+    missing.insert(missing.begin() + 2, (dir / "missing.png").string());
+    RecordingSink missingSink;
+    CHECK(loadThrows(loader, missing, missingSink, "missing.png"));
+    CHECK(missingSink.prepareCalls == 0);
+
+    // So does a file that is not an image
+    const fs::path notImage = dir / "not_an_image.png";
+    std::ofstream{ notImage } << "not an image";
+    std::vector<std::string> corrupt = paths;
+    corrupt.push_back(notImage.string());
+    RecordingSink corruptSink;
+    CHECK(loadThrows(loader, corrupt, corruptSink, "not_an_image.png"));
+
+    // A file cut after its header is only found out while decoding, once the other images are on their way to the sink
+    const std::vector<uint8_t> bytes = readBytes(paths[0]);
+    const fs::path truncated = dir / "truncated.png";
+    std::ofstream{ truncated, std::ios::binary }.write(reinterpret_cast<const char*>(bytes.data()), 40);
+    std::vector<std::string> cut = paths;
+    cut.push_back(truncated.string());
+    RecordingSink cutSink;
+    CHECK(loadThrows(loader, cut, cutSink, "truncated.png"));
+    CHECK(cutSink.prepareCalls == 1);
+
+    // An exception of the sink leaves the loader, after its threads are stopped
+    RecordingSink throwingSink;
+    throwingSink.throwOnUpload = true;
+    CHECK(loadThrows(loader, paths, throwingSink, "sink failed"));
+
+    // The same loader still works afterwards
+    RecordingSink sink;
+    CHECK(loader.load(paths, sink).size() == paths.size());
+    CHECK(sink.uploads.size() == IMAGE_COUNT);
+
+    // No paths, no images and no calls
+    RecordingSink emptySink;
+    CHECK(loader.load({}, emptySink).empty());
+    CHECK(emptySink.prepareCalls == 0);
+}
+
+int main()
+{
+    const fs::path dir = fs::current_path() / "texture_loader_tests_data";
+    const std::vector<std::string> paths = writeImages(dir / "images");
+
+    testLoadAndCache(paths, dir / "cache");
+    testMemoryBudget(paths);
+    testErrors(paths, dir);
+
+    fs::remove_all(dir);
+    return finishTests("texture_loader_tests");
+}